@@ -11,6 +11,18 @@ fi
 
 wait
 
-cc -g -I. -Iwren/src/include -o run_wren main.c wren.o -lm -ldl &
-cc -g -I. -Iwren/src/include -std=c++17 -fPIC -shared -o file.so file.cpp wren.o -lc++ -lm -ldl &
-cc -g -I. -Iwren/src/include -fPIC -shared -o image.so image.c wren.o -lm -ldl &
+if [ "$1" = "--static" ]; then
+    # Link the standard library into run_wren (no dlopen when scripts import it).
+    cc -g -I. -Iwren/src/include -DWRENCH_PRIVATE_IMPLEMENTATION=1 -std=c++17 -pthread -c -o file.o file.cpp &
+    cc -g -I. -Iwren/src/include -DWRENCH_PRIVATE_IMPLEMENTATION=1 -pthread -c -o image.o image.c &
+
+    wait
+
+    cc -g -I. -Iwren/src/include -DWRENCH_STATIC_STDLIB=1 -pthread -o run_wren main.c file.o image.o wren.o -lc++ -lm -ldl &
+    cc -g -I. -Iwren/src/include -std=c++17 -fPIC -shared -pthread -o vec2.so examples/vec2.cpp wren.o -lc++ -lm -ldl &
+else
+    cc -g -I. -Iwren/src/include -pthread -o run_wren main.c wren.o -lm -ldl &
+    cc -g -I. -Iwren/src/include -std=c++17 -fPIC -shared -pthread -o file.so file.cpp wren.o -lc++ -lm -ldl &
+    cc -g -I. -Iwren/src/include -fPIC -shared -pthread -o image.so image.c wren.o -lm -ldl &
+    cc -g -I. -Iwren/src/include -std=c++17 -fPIC -shared -pthread -o vec2.so examples/vec2.cpp wren.o -lc++ -lm -ldl &
+fi
@@ -5,3 +5,4 @@ rm -rf run_wren
 rm -rf *.o
 rm -rf *.so
 rm -rf *.dSYM
+rm -rf tests/scratch
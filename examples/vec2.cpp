@@ -0,0 +1,50 @@
+/* -----------------------------------------------------------------------------
+--- Copyright (c) 2012-2026 Adam Schackart / "AJ Hackman", all rights reserved.
+--- Distributed under the BSD license v2 (opensource.org/licenses/BSD-3-Clause)
+----------------------------------------------------------------------------- */
+#define WRENCH_IMPLEMENTATION
+#include <wrench.hpp>
+
+#include <cmath>
+
+/* The Wrench++ example from wrench.hpp as a complete library: `import "vec2" for Vec2`.
+ */
+struct Vec2
+{
+    double x;
+    double y;
+
+    Vec2(double x, double y) : x(x), y(y) {}
+
+    double length() const { return std::sqrt(x * x + y * y); }
+    double dot(const Vec2& other) const { return x * other.x + y * other.y; }
+};
+
+static Vec2 vec2Lerp(const Vec2& a, const Vec2& b, double t)
+{
+    return Vec2(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t);
+}
+
+WRENCH_EXPORT bool vec2WrenInit(WrenVM* vm)
+{
+    if (!wrenBeginModule(vm, "vec2")) { return false; }
+
+    if (!wrench::ForeignClass<Vec2>::begin<double, double>(vm, "vec2", "Vec2")
+        .property<&Vec2::x>("x")
+        .property<&Vec2::y>("y")
+        .method<&Vec2::length>("length")
+        .method<&Vec2::dot>("dot")
+        .method<&vec2Lerp>("lerp") // A free function becomes a static method.
+        .code("toString { \"(%(x), %(y))\" }")
+        .end())
+    {
+        return false;
+    }
+
+    return wrenEndModule(vm);
+}
+
+WRENCH_EXPORT void vec2WrenQuit(void)
+{
+    //
+}
@@ -6,388 +6,7542 @@
 #define WRENCH_IMPLEMENTATION
 #include <file.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
 #include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
-/*
-================================================================================
- * ~~ [ path ] ~~ *
---------------------------------------------------------------------------------
-*/
+#include <errno.h>
 
-static void file_Path_list(WrenVM* vm)
-{
-    const char* path = wrenGetSlotString(vm, 1);
-    const bool recursive = wrenGetSlotBool(vm, 2);
-    const bool include_subdirectories = wrenGetSlotBool(vm, 3);
+#if !_WIN32
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <sys/ioctl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#else
+    #include <fcntl.h>
+    #include <io.h>
+    #include <process.h>
+    #include <sys/stat.h>
+#endif
 
-    const std::filesystem::path p{path};
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
 
-    // TODO: Abort if directory doesn't exist, or empty list?
-    wrenSetSlotNewList(vm, 0);
+#if __linux__
+    #include <linux/fs.h>
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <sys/sendfile.h>
+#endif
 
-    #define ENTRY() do                                                      \
-    {                                                                       \
-        if (include_subdirectories == false && dir_entry.is_directory())    \
-        {                                                                   \
-            continue;                                                       \
-        }                                                                   \
-                                                                            \
-        wrenSetSlotString(vm, 1, dir_entry.path().c_str());                 \
-        wrenInsertInList(vm, 0, -1, 1);                                     \
-    }                                                                       \
-    while (0)
+#if __linux__ && defined(STATX_BASIC_STATS) && __has_include(<linux/io_uring.h>)
+    #include <linux/io_uring.h>
+    #include <poll.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
 
-    if (recursive)
-    {
-        for (auto const& dir_entry : std::filesystem::recursive_directory_iterator{p})
-        {
-            ENTRY();
-        }
-    }
-    else
-    {
-        for (auto const& dir_entry : std::filesystem::directory_iterator{p})
-        {
-            ENTRY();
-        }
-    }
+    #ifndef FILE_HAVE_IO_URING
+    #define FILE_HAVE_IO_URING 1
+    #endif
+#else
+    #ifndef FILE_HAVE_IO_URING
+    #define FILE_HAVE_IO_URING 0
+    #endif
+#endif
 
-    #undef ENTRY
-}
+#ifndef DTTOIF
+#define DTTOIF(dirtype) ((dirtype) << 12)
+#endif
+
+#ifndef S_IFLNK
+#define S_IFLNK 0xA000
+#endif
 
 /*
 ================================================================================
- * ~~ [ file ] ~~ *
+ * ~~ [ stat ] ~~ *
 --------------------------------------------------------------------------------
 */
 
-static void file_File_ctor(WrenVM* vm)
+typedef struct file_Stat
 {
-    WRENCH_STUB();
+    double size; // -1 if the path doesn't exist.
+    double mtime; // Seconds since the epoch, with sub-second precision.
+    double mode; // Type and permission bits (st_mode).
+    double inode;
 }
+file_Stat;
 
-static void file_File_dtor(void* data)
+/* Stat `name` relative to an open directory (or the working dir if `dir_fd` is -1),
+ * using one statx() call on Linux. Symlinks are only followed if `follow` is set.
+ */
+static bool fileStatAt(int dir_fd, const char* name, bool follow, file_Stat* st)
 {
-    WRENCH_CHECK_MAGIC_TAG(data, file, File);
-    FILE* file = ((file_File*)data)->file;
+    st->size = -1.0;
+    st->mtime = 0.0;
+    st->mode = 0.0;
+    st->inode = 0.0;
 
-    if (file != NULL) { fclose(file); }
-}
-
-static void file_File_open(WrenVM* vm)
-{
-    const char* path = wrenGetSlotString(vm, 1);
-    const char* mode = wrenGetSlotString(vm, 2);
+    #if defined(__linux__) && defined(STATX_BASIC_STATS)
+    {
+        struct statx stx;
+        const unsigned int mask = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME | STATX_INO;
 
-    FILE* file = fopen(path, mode);
+        if (statx(dir_fd < 0 ? AT_FDCWD : dir_fd, name, follow ? 0 : AT_SYMLINK_NOFOLLOW, mask, &stx) != 0)
+        {
+            return false;
+        }
 
-    if (file != NULL)
+        st->size = (double)stx.stx_size;
+        st->mtime = (double)stx.stx_mtime.tv_sec + (double)stx.stx_mtime.tv_nsec * 1e-9;
+        st->mode = (double)stx.stx_mode;
+        st->inode = (double)stx.stx_ino;
+    }
+    #elif !_WIN32
     {
-        file_File* data = (file_File*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(file_File));
-        WRENCH_SET_MAGIC_TAG(data, file, File);
+        struct stat sb;
 
-        data->file = file;
+        if (fstatat(dir_fd < 0 ? AT_FDCWD : dir_fd, name, &sb, follow ? 0 : AT_SYMLINK_NOFOLLOW) != 0)
+        {
+            return false;
+        }
+
+        st->size = (double)sb.st_size;
+        st->mtime = (double)sb.st_mtime;
+        st->mode = (double)sb.st_mode;
+        st->inode = (double)sb.st_ino;
     }
-    else
+    #else
     {
-        char error[1024];
-        wrench_snprintf(error, sizeof(error), "failed to open file \"%s\" with mode \"%s\"", path, mode);
+        wrench_assert(dir_fd < 0, "%i", dir_fd);
+        struct _stat64 sb;
 
-        wrenSetSlotString(vm, 0, (const char*)error);
-        wrenAbortFiber(vm, 0);
+        if (_stat64(name, &sb) != 0)
+        {
+            return false;
+        }
+
+        st->size = (double)sb.st_size;
+        st->mtime = (double)sb.st_mtime;
+        st->mode = (double)sb.st_mode;
+        st->inode = 0.0;
     }
+    #endif
+
+    return true;
 }
 
-static void file_File_close(WrenVM* vm)
+/* Parallel columns of directory entry metadata, so results can be handed to Wren
+ * as a handful of numeric lists instead of one map per entry.
+ */
+typedef struct file_Entries
 {
-    file_File* self = (file_File*)wrenGetSlotForeign(vm, 0);
-    WRENCH_CHECK_MAGIC_TAG(self, file, File);
+    std::vector<std::string> paths;
+    std::vector<double> sizes;
+    std::vector<double> mtimes;
+    std::vector<double> modes;
+    std::vector<double> inodes;
 
-    if (fclose(self->file) != 0)
+    void push(const std::string& path, const file_Stat& st)
     {
-        /* TODO: Keep/copy the name and mode of the file.
-         */
-        wrenSetSlotString(vm, 0, "failed to close file");
-        wrenAbortFiber(vm, 0);
+        paths.push_back(path);
+        sizes.push_back(st.size);
+        mtimes.push_back(st.mtime);
+        modes.push_back(st.mode);
+        inodes.push_back(st.inode);
     }
 }
+file_Entries;
 
-static void file_File_stdout(WrenVM* vm)
+/* Include/exclude globs for walks. Patterns containing a separator match the path relative to
+ * the root, others just the name; '*' and '?' stay within a path component, "**" doesn't.
+ * Excluded directories aren't descended into.
+ */
+typedef struct file_Filter
 {
-    file_File* data = (file_File*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(file_File));
-    WRENCH_SET_MAGIC_TAG(data, file, File);
-
-    data->file = stdout;
+    std::vector<std::string> include;
+    std::vector<std::string> exclude;
+    size_t root_size; // Of the root path, with its trailing separator.
 }
+file_Filter;
 
-static void file_File_stderr(WrenVM* vm)
+static bool fileGlobMatch(const char* pattern, const char* s)
 {
-    file_File* data = (file_File*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(file_File));
-    WRENCH_SET_MAGIC_TAG(data, file, File);
+    for (; *pattern != '\0'; pattern++, s++)
+    {
+        if (pattern[0] == '*')
+        {
+            const bool any_depth = (pattern[1] == '*');
+            pattern += any_depth ? 2 : 1;
+
+            if (any_depth && *pattern == '/' && fileGlobMatch(pattern + 1, s))
+            {
+                return true; // "a/**/b" matches "a/b".
+            }
+
+            for (;; s++)
+            {
+                if (fileGlobMatch(pattern, s))
+                {
+                    return true;
+                }
+
+                if (*s == '\0' || (*s == '/' && !any_depth))
+                {
+                    return false;
+                }
+            }
+        }
 
-    data->file = stderr;
+        if (*s == '\0' || (*pattern == '?' ? *s == '/' : *pattern != *s))
+        {
+            return false;
+        }
+    }
+
+    return *s == '\0';
 }
 
-static void file_File_stdin(WrenVM* vm)
+static bool fileFilterMatch(const std::vector<std::string>& patterns, const std::string& path, size_t root_size)
 {
-    file_File* data = (file_File*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(file_File));
-    WRENCH_SET_MAGIC_TAG(data, file, File);
+    const char* relative = path.c_str() + std::min(root_size, path.size());
+    const char* name = strrchr(relative, '/');
+
+    name = (name != NULL) ? name + 1 : relative;
 
-    data->file = stdin;
+    for (const std::string& pattern : patterns)
+    {
+        if (fileGlobMatch(pattern.c_str(), (pattern.find('/') != std::string::npos) ? relative : name))
+        {
+            return true;
+        }
+    }
+
+    return false;
 }
 
-static void file_File_getc(WrenVM* vm)
+static bool fileFilterSkip(const file_Filter* filter, const std::string& path, bool is_directory)
 {
-    file_File* self = (file_File*)wrenGetSlotForeign(vm, 0);
-    WRENCH_CHECK_MAGIC_TAG(self, file, File);
+    if (filter == NULL)
+    {
+        return false;
+    }
 
-    wrenSetSlotInt(vm, 0, getc(self->file));
+    if (fileFilterMatch(filter->exclude, path, filter->root_size))
+    {
+        return true;
+    }
+
+    return !is_directory && !filter->include.empty() && !fileFilterMatch(filter->include, path, filter->root_size);
 }
 
-static void file_File_putc(WrenVM* vm)
+/* Enumerate a directory. If `with_stat` is false, the entry type comes from d_type
+ * (and the inode from d_ino) and no per-entry syscall is made unless d_type is unknown.
+ * Returns false if the root directory can't be opened.
+ */
+static bool fileWalk(std::string& path, bool recursive, bool include_subdirectories, bool with_stat, file_Entries* out,
+                     const file_Filter* filter = NULL)
 {
-    file_File* self = (file_File*)wrenGetSlotForeign(vm, 0);
-    WRENCH_CHECK_MAGIC_TAG(self, file, File);
+    if (path.empty() || (path.back() != '/' && path.back() != '\\'))
+    {
+        path += '/';
+    }
 
-    switch (wrenGetSlotType(vm, 1))
+    #if !_WIN32
     {
-        case WREN_TYPE_NUM:
+        DIR* dir = opendir(path.c_str());
+
+        if (dir == NULL)
         {
-            wrenSetSlotInt(vm, 0, putc(wrenGetSlotInt(vm, 1), self->file));
+            return false;
         }
-        break;
 
-        case WREN_TYPE_STRING:
+        const size_t base = path.size();
+        const int fd = dirfd(dir);
+
+        for (struct dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
         {
-            const char* s = wrenGetSlotString(vm, 1);
+            const char* name = entry->d_name;
 
-            if (s[0] != '\0')
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
             {
-                wrench_assert(s[1] == '\0', "multi-char string \"%s\"", s);
-                wrenSetSlotInt(vm, 0, putc(s[0], self->file));
+                continue;
+            }
+
+            file_Stat st;
+
+            if (with_stat || entry->d_type == DT_UNKNOWN)
+            {
+                if (!fileStatAt(fd, name, false, &st))
+                {
+                    continue; // Raced with a delete.
+                }
             }
             else
             {
-                wrenSetSlotInt(vm, 0, 0);
+                st.size = -1.0;
+                st.mtime = 0.0;
+                st.mode = (double)DTTOIF(entry->d_type);
+                st.inode = (double)entry->d_ino;
+            }
+
+            const bool is_directory = S_ISDIR((mode_t)st.mode);
+
+            path.resize(base);
+            path += name;
+
+            if (fileFilterSkip(filter, path, is_directory))
+            {
+                continue;
+            }
+
+            if (include_subdirectories || !is_directory)
+            {
+                out->push(path, st);
+            }
+
+            if (recursive && is_directory)
+            {
+                fileWalk(path, recursive, include_subdirectories, with_stat, out, filter);
             }
         }
-        break;
 
-        default:
+        path.resize(base);
+        closedir(dir);
+    }
+    #else
+    {
+        std::error_code ec;
+        std::filesystem::directory_iterator it{path, ec};
+
+        if (ec)
         {
-            wrenSetSlotString(vm, 0, "Invalid type for arg 1 of File.putc");
-            wrenAbortFiber(vm, 0);
+            return false;
+        }
+
+        for (auto const& dir_entry : it)
+        {
+            std::string entry_path = dir_entry.path().string();
+            file_Stat st;
+
+            if (!fileStatAt(-1, entry_path.c_str(), false, &st))
+            {
+                continue;
+            }
+
+            const bool is_directory = (((int)st.mode) & S_IFMT) == S_IFDIR;
+
+            if (fileFilterSkip(filter, entry_path, is_directory))
+            {
+                continue;
+            }
+
+            if (include_subdirectories || !is_directory)
+            {
+                out->push(entry_path, st);
+            }
+
+            if (recursive && is_directory)
+            {
+                fileWalk(entry_path, recursive, include_subdirectories, with_stat, out, filter);
+            }
         }
-        break;
     }
-}
+    #endif
 
-static void file_File_EOF(WrenVM* vm)
-{
-    wrenSetSlotInt(vm, 0, EOF);
+    return true;
 }
 
-static void file_File_eof(WrenVM* vm)
+/* Store a list of numbers in `slot`, using `scratch` as the element slot.
+ */
+static void fileSetSlotNumList(WrenVM* vm, int slot, int scratch, const std::vector<double>& values)
 {
-    file_File* self = (file_File*)wrenGetSlotForeign(vm, 0);
-    WRENCH_CHECK_MAGIC_TAG(self, file, File);
-
-    wrenSetSlotBool(vm, 0, feof(self->file) != 0);
+    wrenSetSlotListFromDoubles(vm, slot, scratch, values.data(), (int)values.size());
 }
 
-static void file_File_flush(WrenVM* vm)
+static void fileSetSlotStringList(WrenVM* vm, int slot, int scratch, const std::vector<std::string>& values)
 {
-    file_File* self = (file_File*)wrenGetSlotForeign(vm, 0);
-    WRENCH_CHECK_MAGIC_TAG(self, file, File);
+    std::vector<const char*> strings;
+    strings.reserve(values.size());
 
-    if (fflush(self->file) != 0)
+    for (const std::string& value : values)
     {
-        /* TODO: Keep/copy the name and mode of the file.
-         */
-        wrenSetSlotString(vm, 0, "failed to flush file");
-        wrenAbortFiber(vm, 0);
+        strings.push_back(value.c_str());
     }
+
+    wrenSetSlotListFromStrings(vm, slot, scratch, strings.data(), (int)strings.size());
 }
 
 /*
 ================================================================================
- * ~~ [ (un)hook ] ~~ *
+ * ~~ [ threads ] ~~ *
 --------------------------------------------------------------------------------
 */
 
-#if WRENCH_FILE_EXTENDED
-    /*
-     * Enable user extension of stdlib modules.
-     */
-    #include <file_ex.inl>
-#else
-    static bool fileWrenInitEx(WrenVM* vm)
+/* Run `func(i)` for every i in [0, count) across `num_threads` threads (0 = one per core).
+ * Work is handed out one index at a time, so uneven item costs still balance.
+ */
+template <typename F> static void fileParallelFor(size_t count, int num_threads, F func)
+{
+    if (num_threads <= 0)
     {
-        return true;
+        num_threads = (int)std::thread::hardware_concurrency();
     }
 
-    static void fileWrenQuitEx(void)
+    if (num_threads <= 1 || count <= 1)
     {
-        //
+        for (size_t i = 0; i < count; i++) { func(i); }
+        return;
     }
-#endif /* WRENCH_FILE_EXTENDED */
 
-WRENCH_EXPORT bool fileWrenInit(WrenVM* vm)
-{
-    if (!wrenBeginModule(vm, "file")) { return false; } else
+    if ((size_t)num_threads > count)
     {
-        WREN_BEGIN_CLASS_EX(file, Path, NULL, NULL);
-        {
-            // TODO: exists
-            // TODO: current
-            // TODO: base
+        num_threads = (int)count;
+    }
 
-            // TODO: home
-            // TODO: desktop
-            // TODO: documents
-            // TODO: downloads
-            // TODO: music
-            // TODO: pictures
-            // TODO: public_share
-            // TODO: saved_games
-            // TODO: screenshots
-            // TODO: templates
-            // TODO: videos
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
 
-            // TODO: path
-            // TODO: fileName
-            // TODO: extension
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < count; i = next++) { func(i); }
+    };
 
-            // TODO: split
-            // TODO: join
+    for (int i = 1; i < num_threads; i++)
+    {
+        threads.emplace_back(worker);
+    }
 
-            // TODO: isDirectory
-            // TODO: isFile
+    worker();
 
-            // TODO: createDirectory
-            // TODO: createFile
-            // TODO: copyFile
-            // TODO: moveFile
-            // TODO: deleteFile
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
 
-            WREN_METHOD(file, Path, true, list, "(path, recursive, include_subdirectories)", "(_,_,_)");
-            WREN_CODE("static list(path, recursive) { list(path, recursive, true) }");
-            WREN_CODE("static list(path) { list(path, false, true) }");
-            WREN_CODE("static walk(path) { list(path, true, true) }");
-        }
-        WREN_END_CLASS();
+/*
+================================================================================
+ * ~~ [ copy ] ~~ *
+--------------------------------------------------------------------------------
+*/
 
-        WREN_BEGIN_CLASS(file, File);
-        {
-            WREN_METHOD(file, File, true, open, "(path, mode)", "(_,_)");
-            WREN_METHOD(file, File, false, close, "()", "()");
+#ifndef FILE_COPY_BUFFER_SIZE
+#define FILE_COPY_BUFFER_SIZE (1024 * 1024) // Chunk size when data has to pass through user space.
+#endif
 
-            // TODO: name
-            // TODO: mode
+#if !_WIN32
 
-            // TODO: toString
+/* Copy `size` bytes between two open files, preferring methods that never bring
+ * the data into user space: a reflink (shares extents on btrfs/XFS), then
+ * copy_file_range (in-kernel, may offload to the filesystem), then sendfile,
+ * and finally plain read/write with a large buffer.
+ */
+static bool fileCopyFd(int in_fd, int out_fd, off_t size)
+{
+    off_t copied = 0;
 
-            /* XXX: `stdout` et al. are #defined on most platforms, requiring a bit of a workaround here.
-             */
-            WREN_METHOD_EX(file, File, true, stdout, "", "", file_File_stdout);
-            WREN_METHOD_EX(file, File, true, stderr, "", "", file_File_stderr);
-            WREN_METHOD_EX(file, File, true, stdin, "", "", file_File_stdin);
+    #if __linux__
+    {
+        #ifdef FICLONE
+        if (ioctl(out_fd, FICLONE, in_fd) == 0)
+        {
+            return true;
+        }
+        #endif
 
-            /* XXX: getc and putc are also macros (which is all that differentiates them from fgetc/fputc).
-             */
-            WREN_METHOD_EX(file, File, false, getc, "()", "()", file_File_getc);
-            WREN_METHOD_EX(file, File, false, putc, "(c)", "(_)", file_File_putc);
+        while (copied < size)
+        {
+            const ssize_t n = copy_file_range(in_fd, NULL, out_fd, NULL, (size_t)(size - copied), 0);
 
-            WREN_METHOD_EX(file, File, true, EOF, "", "", file_File_EOF);
-            WREN_METHOD(file, File, false, eof, "()", "()");
+            if (n <= 0)
+            {
+                if (n < 0 && errno != EXDEV && errno != ENOSYS && errno != EOPNOTSUPP && errno != EINVAL)
+                {
+                    return false;
+                }
 
-            /* TODO: Native/foreign methods for performance.
-             */
-            if (!wrenCode(vm,
+                break;
+            }
 
-            "read(count) {\n"
-                "var EOF = type.EOF\n"
-                "var s = []\n"
+            copied += n;
+        }
 
-                "for (i in 0...count) {\n"
-                    "var c = getc()\n"
+        while (copied < size)
+        {
+            const ssize_t n = sendfile(out_fd, in_fd, NULL, (size_t)(size - copied));
 
-                    "if (c < 0 || c == EOF) {\n"
-                        "break\n"
-                    "} else {\n"
-                        "s.insert(-1, String.fromByte(c))\n"
-                    "}\n"
-                "}\n"
+            if (n <= 0)
+            {
+                if (n < 0 && errno != ENOSYS && errno != EINVAL)
+                {
+                    return false;
+                }
 
-                "return s.join()\n"
-            "}\n"
+                break;
+            }
 
-            "read() { read(Num.maxSafeInteger) }\n"
+            copied += n;
+        }
+    }
+    #endif
 
-            "static read(path) {\n"
-                "var file = open(path, \"rb\")\n"
-                "var data = file.read()\n"
+    if (copied < size || size == 0) // Also handles files that lie about their size (procfs).
+    {
+        char* buffer = (char*)wrench_malloc(FILE_COPY_BUFFER_SIZE);
 
-                "file.close()\n"
-                "return data\n"
-            "}\n"
+        if (buffer == NULL)
+        {
+            return false;
+        }
 
-            )) { return false; }
+        for (;;)
+        {
+            const ssize_t n = read(in_fd, buffer, FILE_COPY_BUFFER_SIZE);
 
-            // TODO: write
-            // TODO: seek
-            // TODO: tell
-            // TODO: size
+            if (n == 0) { break; }
+            if (n < 0)
+            {
+                if (errno == EINTR) { continue; }
 
-            WREN_METHOD(file, File, false, flush, "()", "()");
+                wrench_free(buffer);
+                return false;
+            }
 
-            /* TODO: Native/foreign methods for performance.
-             */
-            if (!wrenCode(vm,
+            for (ssize_t done = 0; done < n; )
+            {
+                const ssize_t w = write(out_fd, buffer + done, (size_t)(n - done));
 
-            "readLine(strip_newlines) {\n"
-                "var s = []\n"
+                if (w < 0)
+                {
+                    if (errno == EINTR) { continue; }
 
-                "while (!eof()) {\n"
-                    "s.insert(-1, read(1))\n"
+                    wrench_free(buffer);
+                    return false;
+                }
 
-                    "if (s[-1] == \"\n\") {\n"
-                        "if (strip_newlines) {\n"
-                            "s.removeAt(-1)\n"
-                        "}\n"
+                done += w;
+            }
+        }
 
-                        "break\n"
-                    "}\n"
-                "}\n"
+        wrench_free(buffer);
+    }
 
-                "return s.join()\n"
-            "}\n"
+    return true;
+}
 
-            "readLine() { readLine(true) }\n"
+#endif /* !_WIN32 */
 
-            "readLines(strip_newlines) {\n"
-                "var s = []\n"
+/* Copy a single file, overwriting `dst`. Permission bits are preserved, including when `dst`
+ * already exists. Copying a file onto itself (or a hard link to it) fails.
+ */
+static bool fileCopyFile(const char* src, const char* dst, char* error, size_t error_size)
+{
+    #if !_WIN32
+    {
+        const int in_fd = open(src, O_RDONLY | O_CLOEXEC);
 
-                "while (!eof()) {\n"
-                    "s.insert(-1, readLine(strip_newlines))\n"
-                "}\n"
+        if (in_fd < 0)
+        {
+            wrench_snprintf(error, error_size, "failed to open \"%s\" for copying: %s", src, strerror(errno));
+            return false;
+        }
 
-                "return s\n"
-            "}\n"
+        struct stat sb;
 
-            "readLines() { readLines(true) }\n"
+        if (fstat(in_fd, &sb) != 0)
+        {
+            wrench_snprintf(error, error_size, "failed to stat \"%s\": %s", src, strerror(errno));
 
-            "static readLines(path) {\n"
-                "var file = open(path, \"rb\")\n"
-                "var text = file.readLines()\n"
+            close(in_fd);
+            return false;
+        }
+
+        // Not O_TRUNC: if `dst` turns out to be `src`, truncating would destroy it.
+        const int out_fd = open(dst, O_WRONLY | O_CREAT | O_CLOEXEC, sb.st_mode & 07777);
+
+        if (out_fd < 0)
+        {
+            wrench_snprintf(error, error_size, "failed to create \"%s\": %s", dst, strerror(errno));
+
+            close(in_fd);
+            return false;
+        }
+
+        struct stat out_sb;
+
+        if (fstat(out_fd, &out_sb) == 0 && out_sb.st_dev == sb.st_dev && out_sb.st_ino == sb.st_ino)
+        {
+            wrench_snprintf(error, error_size, "failed to copy \"%s\" to \"%s\": they are the same file", src, dst);
+
+            close(in_fd);
+            close(out_fd);
+            return false;
+        }
+
+        if (ftruncate(out_fd, 0) != 0 || fchmod(out_fd, sb.st_mode & 07777) != 0)
+        {
+            wrench_snprintf(error, error_size, "failed to overwrite \"%s\": %s", dst, strerror(errno));
+
+            close(in_fd);
+            close(out_fd);
+            return false;
+        }
+
+        bool ok = fileCopyFd(in_fd, out_fd, sb.st_size);
+
+        if (!ok)
+        {
+            wrench_snprintf(error, error_size, "failed to copy \"%s\" to \"%s\": %s", src, dst, strerror(errno));
+        }
+
+        close(in_fd);
+
+        if (close(out_fd) != 0 && ok)
+        {
+            wrench_snprintf(error, error_size, "failed to close \"%s\": %s", dst, strerror(errno));
+            ok = false;
+        }
+
+        return ok;
+    }
+    #else
+    {
+        std::error_code ec;
+        std::filesystem::copy_file(src, dst, std::filesystem::copy_options::overwrite_existing, ec);
+
+        if (ec)
+        {
+            wrench_snprintf(error, error_size, "failed to copy \"%s\" to \"%s\": %s", src, dst, ec.message().c_str());
+            return false;
+        }
+
+        return true;
+    }
+    #endif
+}
+
+/* Rename if both paths are on the same device, otherwise copy and delete.
+ */
+static bool fileMoveFile(const char* src, const char* dst, char* error, size_t error_size)
+{
+    std::error_code ec;
+    std::filesystem::rename(src, dst, ec);
+
+    if (!ec)
+    {
+        return true;
+    }
+
+    if (ec != std::errc::cross_device_link)
+    {
+        wrench_snprintf(error, error_size, "failed to move \"%s\" to \"%s\": %s", src, dst, ec.message().c_str());
+        return false;
+    }
+
+    if (!fileCopyFile(src, dst, error, error_size))
+    {
+        return false;
+    }
+
+    if (!std::filesystem::remove(src, ec))
+    {
+        wrench_snprintf(error, error_size, "copied \"%s\" to \"%s\" but failed to remove it: %s", src, dst, ec.message().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/* Recreate the directory structure of `src` under `dst` serially, then copy the
+ * files on `num_threads` threads. Symlinks are recreated rather than followed.
+ */
+static bool fileCopyTree(const char* src, const char* dst, int num_threads, char* error, size_t error_size)
+{
+    std::string root = src;
+    file_Entries entries;
+
+    if (!fileWalk(root, true, true, false, &entries))
+    {
+        wrench_snprintf(error, error_size, "failed to open directory \"%s\"", src);
+        return false;
+    }
+
+    const size_t root_length = root.size(); // fileWalk appends a separator.
+    std::vector<std::pair<std::string, std::string>> files;
+
+    std::error_code ec;
+    std::filesystem::create_directories(dst, ec);
+
+    if (ec)
+    {
+        wrench_snprintf(error, error_size, "failed to create directory \"%s\": %s", dst, ec.message().c_str());
+        return false;
+    }
+
+    for (size_t i = 0; i < entries.paths.size(); i++)
+    {
+        const std::string& from = entries.paths[i];
+        std::string to = (std::filesystem::path{dst} / from.substr(root_length)).string();
+
+        const int type = ((int)entries.modes[i]) & S_IFMT;
+
+        if (type == S_IFDIR)
+        {
+            std::filesystem::create_directory(to, ec);
+        }
+        else if (type == S_IFLNK)
+        {
+            std::filesystem::copy_symlink(from, to, ec);
+        }
+        else
+        {
+            files.emplace_back(from, std::move(to));
+        }
+
+        if (ec)
+        {
+            wrench_snprintf(error, error_size, "failed to create \"%s\": %s", to.c_str(), ec.message().c_str());
+            return false;
+        }
+    }
+
+    std::atomic<bool> failed{false};
+    std::mutex error_lock;
+
+    fileParallelFor(files.size(), num_threads, [&](size_t i)
+    {
+        char e[1024];
+
+        if (!failed && !fileCopyFile(files[i].first.c_str(), files[i].second.c_str(), e, sizeof(e)))
+        {
+            std::lock_guard<std::mutex> lock{error_lock};
+
+            if (!failed.exchange(true))
+            {
+                wrench_snprintf(error, error_size, "%s", (const char*)e);
+            }
+        }
+    });
+
+    return !failed;
+}
+
+/*
+================================================================================
+ * ~~ [ hash ] ~~ *
+--------------------------------------------------------------------------------
+*/
+
+enum
+{
+    FILE_HASH_XXH64,
+    FILE_HASH_CRC32C,
+    FILE_HASH_SHA256,
+};
+
+static const char* file_hash_names[] = { "xxh64", "crc32c", "sha256" };
+
+typedef struct file_Hash
+{
+    int algo;
+    uint64_t total;
+
+    uint8_t buffer[64]; // Partial block (32 bytes for XXH64, 64 for SHA-256).
+    size_t buffered;
+
+    union
+    {
+        uint64_t xxh64[4];
+        uint32_t crc32c;
+        uint32_t sha256[8];
+    };
+}
+file_Hash;
+
+static inline uint64_t fileRotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+static inline uint32_t fileRotr32(uint32_t x, int r) { return (x >> r) | (x << (32 - r)); }
+
+static inline uint64_t fileRead64(const uint8_t* p) { uint64_t v; wrench_memcpy(&v, p, 8); return v; } // Little endian.
+static inline uint32_t fileRead32(const uint8_t* p) { uint32_t v; wrench_memcpy(&v, p, 4); return v; }
+
+/* XXH64, seed 0.
+ */
+#define FILE_XXH_P1 0x9E3779B185EBCA87ULL
+#define FILE_XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define FILE_XXH_P3 0x165667B19E3779F9ULL
+#define FILE_XXH_P4 0x85EBCA77C2B2AE63ULL
+#define FILE_XXH_P5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t fileXXH64Round(uint64_t acc, uint64_t input)
+{
+    return fileRotl64(acc + input * FILE_XXH_P2, 31) * FILE_XXH_P1;
+}
+
+static inline uint64_t fileXXH64Merge(uint64_t acc, uint64_t value)
+{
+    return (acc ^ fileXXH64Round(0, value)) * FILE_XXH_P1 + FILE_XXH_P4;
+}
+
+static const uint8_t* fileXXH64Stripes(uint64_t* v, const uint8_t* p, const uint8_t* end)
+{
+    uint64_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+
+    for (; p + 32 <= end; p += 32)
+    {
+        v1 = fileXXH64Round(v1, fileRead64(p + 0));
+        v2 = fileXXH64Round(v2, fileRead64(p + 8));
+        v3 = fileXXH64Round(v3, fileRead64(p + 16));
+        v4 = fileXXH64Round(v4, fileRead64(p + 24));
+    }
+
+    v[0] = v1; v[1] = v2; v[2] = v3; v[3] = v4;
+    return p;
+}
+
+static uint64_t fileXXH64Final(const file_Hash* h)
+{
+    const uint64_t* v = h->xxh64;
+    uint64_t acc;
+
+    if (h->total >= 32)
+    {
+        acc = fileRotl64(v[0], 1) + fileRotl64(v[1], 7) + fileRotl64(v[2], 12) + fileRotl64(v[3], 18);
+
+        acc = fileXXH64Merge(acc, v[0]);
+        acc = fileXXH64Merge(acc, v[1]);
+        acc = fileXXH64Merge(acc, v[2]);
+        acc = fileXXH64Merge(acc, v[3]);
+    }
+    else
+    {
+        acc = FILE_XXH_P5;
+    }
+
+    acc += h->total;
+
+    const uint8_t* p = h->buffer;
+    const uint8_t* end = p + h->buffered;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        acc = fileRotl64(acc ^ fileXXH64Round(0, fileRead64(p)), 27) * FILE_XXH_P1 + FILE_XXH_P4;
+    }
+
+    if (p + 4 <= end)
+    {
+        acc = fileRotl64(acc ^ (fileRead32(p) * FILE_XXH_P1), 23) * FILE_XXH_P2 + FILE_XXH_P3;
+        p += 4;
+    }
+
+    for (; p < end; p++)
+    {
+        acc = fileRotl64(acc ^ (*p * FILE_XXH_P5), 11) * FILE_XXH_P1;
+    }
+
+    acc ^= acc >> 33; acc *= FILE_XXH_P2;
+    acc ^= acc >> 29; acc *= FILE_XXH_P3;
+    acc ^= acc >> 32;
+
+    return acc;
+}
+
+/* CRC32C (Castagnoli). Uses the SSE4.2 / ARMv8 CRC instructions when available, and
+ * slicing-by-8 tables otherwise.
+ */
+static uint32_t file_crc32c_table[8][256];
+
+static void fileCRC32CInitTable(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+
+        for (int j = 0; j < 8; j++)
+        {
+            crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+        }
+
+        file_crc32c_table[0][i] = crc;
+    }
+
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        for (int t = 1; t < 8; t++)
+        {
+            const uint32_t prev = file_crc32c_table[t - 1][i];
+            file_crc32c_table[t][i] = (prev >> 8) ^ file_crc32c_table[0][prev & 0xFF];
+        }
+    }
+}
+
+static uint32_t fileCRC32CSoftware(uint32_t crc, const uint8_t* p, size_t size)
+{
+    static std::once_flag once;
+    std::call_once(once, fileCRC32CInitTable);
+
+    const uint32_t (*t)[256] = file_crc32c_table;
+
+    for (; size >= 8; p += 8, size -= 8)
+    {
+        const uint32_t lo = fileRead32(p) ^ crc;
+        const uint32_t hi = fileRead32(p + 4);
+
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+
+    for (; size > 0; p++, size--)
+    {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #include <nmmintrin.h>
+
+    #define FILE_HAVE_CRC32C_HW 1
+
+    __attribute__((target("sse4.2"))) static uint32_t fileCRC32CHardware(uint32_t crc, const uint8_t* p, size_t size)
+    {
+        uint64_t crc64 = crc;
+
+        for (; size >= 8; p += 8, size -= 8)
+        {
+            crc64 = _mm_crc32_u64(crc64, fileRead64(p));
+        }
+
+        crc = (uint32_t)crc64;
+
+        for (; size > 0; p++, size--)
+        {
+            crc = _mm_crc32_u8(crc, *p);
+        }
+
+        return crc;
+    }
+
+    static bool fileCRC32CHardwareSupported(void)
+    {
+        static const bool supported = __builtin_cpu_supports("sse4.2");
+        return supported;
+    }
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    #include <arm_acle.h>
+
+    #define FILE_HAVE_CRC32C_HW 1
+
+    static uint32_t fileCRC32CHardware(uint32_t crc, const uint8_t* p, size_t size)
+    {
+        for (; size >= 8; p += 8, size -= 8)
+        {
+            crc = __crc32cd(crc, fileRead64(p));
+        }
+
+        for (; size > 0; p++, size--)
+        {
+            crc = __crc32cb(crc, *p);
+        }
+
+        return crc;
+    }
+
+    static bool fileCRC32CHardwareSupported(void)
+    {
+        return true;
+    }
+#else
+    #define FILE_HAVE_CRC32C_HW 0
+#endif
+
+/* SHA-256 (FIPS 180-4).
+ */
+static const uint32_t file_sha256_k[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void fileSHA256Blocks(uint32_t* state, const uint8_t* p, size_t num_blocks)
+{
+    for (; num_blocks > 0; num_blocks--, p += 64)
+    {
+        uint32_t w[64];
+
+        for (int i = 0; i < 16; i++)
+        {
+            w[i] = ((uint32_t)p[i * 4] << 24) | ((uint32_t)p[i * 4 + 1] << 16) | ((uint32_t)p[i * 4 + 2] << 8) | p[i * 4 + 3];
+        }
+
+        for (int i = 16; i < 64; i++)
+        {
+            const uint32_t s0 = fileRotr32(w[i - 15], 7) ^ fileRotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 = fileRotr32(w[i - 2], 17) ^ fileRotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; i++)
+        {
+            const uint32_t t1 = h + (fileRotr32(e, 6) ^ fileRotr32(e, 11) ^ fileRotr32(e, 25)) + ((e & f) ^ (~e & g)) + file_sha256_k[i] + w[i];
+            const uint32_t t2 = (fileRotr32(a, 2) ^ fileRotr32(a, 13) ^ fileRotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+/* Streaming interface, shared by every algorithm.
+ */
+static bool fileHashInit(file_Hash* h, const char* algo)
+{
+    wrench_memset(h, 0, sizeof(*h));
+
+    for (h->algo = 0; h->algo < (int)WRENCH_ARRAY_COUNT(file_hash_names); h->algo++)
+    {
+        if (wrench_strcmp(algo, file_hash_names[h->algo]) == 0)
+        {
+            break;
+        }
+    }
+
+    switch (h->algo)
+    {
+        case FILE_HASH_XXH64:
+        {
+            h->xxh64[0] = FILE_XXH_P1 + FILE_XXH_P2;
+            h->xxh64[1] = FILE_XXH_P2;
+            h->xxh64[2] = 0;
+            h->xxh64[3] = 0 - FILE_XXH_P1;
+        }
+        return true;
+
+        case FILE_HASH_CRC32C:
+        {
+            h->crc32c = 0xFFFFFFFFu;
+        }
+        return true;
+
+        case FILE_HASH_SHA256:
+        {
+            const uint32_t iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+            wrench_memcpy(h->sha256, iv, sizeof(iv));
+        }
+        return true;
+    }
+
+    return false;
+}
+
+static void fileHashUpdate(file_Hash* h, const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + size;
+
+    h->total += size;
+
+    if (h->algo == FILE_HASH_CRC32C)
+    {
+        #if FILE_HAVE_CRC32C_HW
+        if (fileCRC32CHardwareSupported())
+        {
+            h->crc32c = fileCRC32CHardware(h->crc32c, p, size);
+            return;
+        }
+        #endif
+
+        h->crc32c = fileCRC32CSoftware(h->crc32c, p, size);
+        return;
+    }
+
+    const size_t block = (h->algo == FILE_HASH_XXH64) ? 32 : 64;
+
+    // Top off a partial block from the previous update.
+    if (h->buffered > 0)
+    {
+        const size_t n = std::min(block - h->buffered, size);
+
+        wrench_memcpy(h->buffer + h->buffered, p, n);
+        h->buffered += n;
+        p += n;
+
+        if (h->buffered < block)
+        {
+            return;
+        }
+
+        if (h->algo == FILE_HASH_XXH64)
+        {
+            fileXXH64Stripes(h->xxh64, h->buffer, h->buffer + block);
+        }
+        else
+        {
+            fileSHA256Blocks(h->sha256, h->buffer, 1);
+        }
+
+        h->buffered = 0;
+    }
+
+    if (h->algo == FILE_HASH_XXH64)
+    {
+        p = fileXXH64Stripes(h->xxh64, p, end);
+    }
+    else
+    {
+        const size_t num_blocks = (size_t)(end - p) / 64;
+
+        fileSHA256Blocks(h->sha256, p, num_blocks);
+        p += num_blocks * 64;
+    }
+
+    wrench_memcpy(h->buffer, p, (size_t)(end - p));
+    h->buffered = (size_t)(end - p);
+}
+
+/* Finish the hash and write it as lowercase hex (big endian, as printed by the reference tools).
+ */
+static void fileHashFinal(file_Hash* h, char* hex)
+{
+    uint8_t digest[32];
+    size_t digest_size = 0;
+
+    switch (h->algo)
+    {
+        case FILE_HASH_XXH64:
+        {
+            const uint64_t value = fileXXH64Final(h);
+
+            for (int i = 0; i < 8; i++) { digest[i] = (uint8_t)(value >> (56 - i * 8)); }
+            digest_size = 8;
+        }
+        break;
+
+        case FILE_HASH_CRC32C:
+        {
+            const uint32_t value = ~h->crc32c;
+
+            for (int i = 0; i < 4; i++) { digest[i] = (uint8_t)(value >> (24 - i * 8)); }
+            digest_size = 4;
+        }
+        break;
+
+        case FILE_HASH_SHA256:
+        {
+            const uint64_t bits = h->total * 8;
+            uint8_t pad[64 + 8] = { 0x80 };
+
+            const size_t pad_size = ((h->buffered < 56) ? 56 : 120) - h->buffered;
+
+            for (int i = 0; i < 8; i++) { pad[pad_size + i] = (uint8_t)(bits >> (56 - i * 8)); }
+            fileHashUpdate(h, pad, pad_size + 8);
+
+            for (int i = 0; i < 32; i++) { digest[i] = (uint8_t)(h->sha256[i / 4] >> (24 - (i % 4) * 8)); }
+            digest_size = 32;
+        }
+        break;
+    }
+
+    for (size_t i = 0; i < digest_size; i++)
+    {
+        hex[i * 2 + 0] = "0123456789abcdef"[digest[i] >> 4];
+        hex[i * 2 + 1] = "0123456789abcdef"[digest[i] & 15];
+    }
+
+    hex[digest_size * 2] = '\0';
+}
+
+/* Hash a file's contents without loading them all into memory: the file is mapped and
+ * walked sequentially where possible, and read in large chunks otherwise (pipes, procfs).
+ * `hex` must hold 65 characters.
+ */
+static bool fileHashFile(const char* path, const char* algo, char* hex, char* error, size_t error_size)
+{
+    file_Hash h;
+
+    if (!fileHashInit(&h, algo))
+    {
+        wrench_snprintf(error, error_size, "Unknown hash algorithm \"%s\" (expected xxh64, crc32c, or sha256).", algo);
+        return false;
+    }
+
+    #if !_WIN32
+    {
+        const int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+        {
+            wrench_snprintf(error, error_size, "Failed to open \"%s\" for hashing: %s", path, strerror(errno));
+            return false;
+        }
+
+        struct stat st;
+        bool mapped = false;
+
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+                madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+                fileHashUpdate(&h, data, (size_t)st.st_size);
+                munmap(data, (size_t)st.st_size);
+
+                mapped = true;
+            }
+        }
+
+        if (!mapped)
+        {
+            char* buffer = (char*)wrench_malloc(FILE_COPY_BUFFER_SIZE);
+
+            for (ssize_t n; buffer != NULL && (n = read(fd, buffer, FILE_COPY_BUFFER_SIZE)) != 0; )
+            {
+                if (n < 0)
+                {
+                    if (errno == EINTR) { continue; }
+
+                    wrench_snprintf(error, error_size, "Failed to read \"%s\" for hashing: %s", path, strerror(errno));
+
+                    wrench_free(buffer);
+                    close(fd);
+
+                    return false;
+                }
+
+                fileHashUpdate(&h, buffer, (size_t)n);
+            }
+
+            if (buffer == NULL)
+            {
+                wrench_snprintf(error, error_size, "Out of memory hashing \"%s\".", path);
+                close(fd);
+
+                return false;
+            }
+
+            wrench_free(buffer);
+        }
+
+        close(fd);
+    }
+    #else
+    {
+        FILE* file = fopen(path, "rb");
+        char* buffer = (char*)wrench_malloc(FILE_COPY_BUFFER_SIZE);
+
+        if (file == NULL || buffer == NULL)
+        {
+            wrench_snprintf(error, error_size, "Failed to open \"%s\" for hashing: %s", path, strerror(errno));
+
+            if (file != NULL) { fclose(file); }
+            wrench_free(buffer);
+
+            return false;
+        }
+
+        for (size_t n; (n = fread(buffer, 1, FILE_COPY_BUFFER_SIZE, file)) != 0; )
+        {
+            fileHashUpdate(&h, buffer, n);
+        }
+
+        const bool failed = ferror(file) != 0;
+
+        fclose(file);
+        wrench_free(buffer);
+
+        if (failed)
+        {
+            wrench_snprintf(error, error_size, "Failed to read \"%s\" for hashing.", path);
+            return false;
+        }
+    }
+    #endif
+
+    fileHashFinal(&h, hex);
+    return true;
+}
+
+static void file_File_hash(WrenVM* vm)
+{
+    char hex[65], error[1024 * 4];
+
+    if (fileHashFile(wrenGetSlotString(vm, 1), wrenGetSlotString(vm, 2), hex, error, sizeof(error)))
+    {
+        wrenSetSlotString(vm, 0, (const char*)hex);
+    }
+    else
+    {
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+    }
+}
+
+static void file_File_hashBytes(WrenVM* vm)
+{
+    int size = 0;
+    const char* data = wrenGetSlotBytes(vm, 1, &size);
+    const char* algo = wrenGetSlotString(vm, 2);
+
+    file_Hash h;
+    char hex[65], error[1024 * 4];
+
+    if (fileHashInit(&h, algo))
+    {
+        fileHashUpdate(&h, data, (size_t)size);
+        fileHashFinal(&h, hex);
+
+        wrenSetSlotString(vm, 0, (const char*)hex);
+    }
+    else
+    {
+        wrench_snprintf(error, sizeof(error), "Unknown hash algorithm \"%s\" (expected xxh64, crc32c, or sha256).", algo);
+
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+    }
+}
+
+/* Hash a list of paths on `threads` threads (0 = one per core). Files that can't be read
+ * hash to null, so one vanished file doesn't sink a whole dedup pass.
+ */
+static void file_File_hashAll(WrenVM* vm)
+{
+    const char* algo = wrenGetSlotString(vm, 2);
+    const int num_threads = wrenGetSlotInt(vm, 3);
+
+    file_Hash probe;
+    char error[1024 * 4];
+
+    if (!fileHashInit(&probe, algo))
+    {
+        wrench_snprintf(error, sizeof(error), "Unknown hash algorithm \"%s\" (expected xxh64, crc32c, or sha256).", algo);
+
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    if (wrenGetSlotType(vm, 1) != WREN_TYPE_LIST)
+    {
+        wrenSetSlotString(vm, 0, "File.hashAll expects a list of paths");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    const int count = wrenGetListCount(vm, 1);
+    std::vector<std::string> paths((size_t)count);
+
+    wrenEnsureSlots(vm, 5);
+
+    for (int i = 0; i < count; i++)
+    {
+        wrenGetListElement(vm, 1, i, 4);
+
+        if (wrenGetSlotType(vm, 4) != WREN_TYPE_STRING)
+        {
+            wrenSetSlotString(vm, 0, "File.hashAll expects a list of paths");
+            wrenAbortFiber(vm, 0);
+
+            return;
+        }
+
+        paths[(size_t)i] = wrenGetSlotString(vm, 4);
+    }
+
+    std::vector<std::array<char, 65>> hashes((size_t)count);
+    std::vector<unsigned char> ok((size_t)count); // Not vector<bool>: its packed bits would race between threads.
+
+    fileParallelFor((size_t)count, num_threads, [&](size_t i)
+    {
+        char ignored[256];
+        ok[i] = fileHashFile(paths[i].c_str(), algo, hashes[i].data(), ignored, sizeof(ignored));
+    });
+
+    wrenSetSlotNewList(vm, 0);
+
+    for (size_t i = 0; i < (size_t)count; i++)
+    {
+        if (ok[i]) { wrenSetSlotString(vm, 4, hashes[i].data()); } else { wrenSetSlotNull(vm, 4); }
+        wrenInsertInList(vm, 0, -1, 4);
+    }
+}
+
+/*
+================================================================================
+ * ~~ [ line index ] ~~ *
+--------------------------------------------------------------------------------
+*/
+
+/* A `.lidx` sidecar holds the start offset of every line, so line N is one lookup instead of
+ * a scan. Offsets are stored as u32 deltas from a u64 base per block of lines, which keeps
+ * the index at ~4 bytes per line while staying directly indexable once mapped:
+ *
+ *      header | u32 delta[num_lines] | u64 base[num_blocks]
+ *
+ * If a block ever spans more than 4 GiB (absurdly long lines), `wide` is set and the deltas
+ * are replaced by absolute u64 offsets. The source's size and mtime are recorded so a stale
+ * index is detected and rebuilt.
+ */
+typedef struct file_LineIndexHeader
+{
+    char magic[8];
+    double file_size;
+    double mtime;
+    unsigned long long num_lines;
+    unsigned long long num_blocks;
+    unsigned int block_shift;
+    unsigned int wide;
+    unsigned long long reserved[2];
+}
+file_LineIndexHeader;
+
+static const char file_line_index_magic[8] = { 'W', 'R', 'L', 'I', 'D', 'X', '1', '\0' };
+
+#ifndef FILE_LINE_INDEX_BLOCK_SHIFT
+#define FILE_LINE_INDEX_BLOCK_SHIFT 8 // 256 lines per base.
+#endif
+
+#if !_WIN32
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+/* Call `func(offset)` with the start of every line after the first.
+ */
+template <typename F> static void fileScanLines(const char* data, size_t size, F func)
+{
+    size_t i = 0;
+
+    #if defined(__SSE2__)
+    {
+        const __m128i newline = _mm_set1_epi8('\n');
+
+        for (; i + 64 <= size; i += 64)
+        {
+            const char* p = data + i;
+
+            uint64_t mask = (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p +  0)), newline));
+            mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 16)), newline)) << 16;
+            mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 32)), newline)) << 32;
+            mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 48)), newline)) << 48;
+
+            for (; mask != 0; mask &= mask - 1)
+            {
+                const size_t start = i + (size_t)__builtin_ctzll(mask) + 1;
+                if (start < size) { func(start); }
+            }
+        }
+    }
+    #endif
+
+    for (const char* p; i < size && (p = (const char*)wrench_memchr(data + i, '\n', size - i)) != NULL; )
+    {
+        i = (size_t)(p - data) + 1;
+        if (i < size) { func(i); }
+    }
+}
+
+/* Scan `path` and write its index to `index_path` (through a temporary file, so readers never
+ * see a partial index).
+ */
+static bool fileLineIndexBuild(const char* path, const char* index_path, char* error, size_t error_size)
+{
+    file_Stat st;
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0 || !fileStatAt(-1, path, true, &st))
+    {
+        wrench_snprintf(error, error_size, "Failed to open \"%s\" for indexing: %s", path, strerror(errno));
+        if (fd >= 0) { close(fd); }
+
+        return false;
+    }
+
+    const size_t size = (size_t)st.size;
+    const char* data = NULL;
+
+    if (size > 0)
+    {
+        data = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == (const char*)MAP_FAILED)
+        {
+            wrench_snprintf(error, error_size, "Failed to map \"%s\" for indexing: %s", path, strerror(errno));
+            close(fd);
+
+            return false;
+        }
+
+        madvise((void*)data, size, MADV_SEQUENTIAL);
+    }
+
+    close(fd);
+
+    std::string temp_path = std::string(index_path) + ".tmp" + std::to_string((long long)getpid());
+    FILE* out = fopen(temp_path.c_str(), "wb");
+
+    if (out == NULL)
+    {
+        wrench_snprintf(error, error_size, "Failed to create line index \"%s\": %s", index_path, strerror(errno));
+        if (data != NULL) { munmap((void*)data, size); }
+
+        return false;
+    }
+
+    file_LineIndexHeader header;
+    wrench_memset(&header, 0, sizeof(header));
+
+    wrench_memcpy(header.magic, file_line_index_magic, sizeof(header.magic));
+    header.file_size = st.size;
+    header.mtime = st.mtime;
+    header.block_shift = FILE_LINE_INDEX_BLOCK_SHIFT;
+
+    std::vector<unsigned long long> bases;
+    bool ok;
+
+    for (;;)
+    {
+        fseek(out, (long)sizeof(header), SEEK_SET);
+        bases.clear();
+
+        // Deltas (or wide offsets) are batched, since there can be billions of them.
+        std::vector<unsigned int> batch32;
+        std::vector<unsigned long long> batch64;
+
+        unsigned long long num_lines = 0;
+        bool overflow = false;
+
+        ok = true;
+
+        auto flush = [&]()
+        {
+            if (header.wide) { ok = ok && fwrite(batch64.data(), 8, batch64.size(), out) == batch64.size(); batch64.clear(); }
+            else { ok = ok && fwrite(batch32.data(), 4, batch32.size(), out) == batch32.size(); batch32.clear(); }
+        };
+
+        auto add_line = [&](size_t start)
+        {
+            if ((num_lines & ((1ull << FILE_LINE_INDEX_BLOCK_SHIFT) - 1)) == 0)
+            {
+                bases.push_back(start);
+            }
+
+            if (header.wide)
+            {
+                batch64.push_back(start);
+                if (batch64.size() == 1024 * 16) { flush(); }
+            }
+            else
+            {
+                const unsigned long long delta = start - bases.back();
+
+                if (delta > 0xFFFFFFFFull) { overflow = true; }
+
+                batch32.push_back((unsigned int)delta);
+                if (batch32.size() == 1024 * 16) { flush(); }
+            }
+
+            num_lines++;
+        };
+
+        if (size > 0)
+        {
+            add_line(0);
+            fileScanLines(data, size, add_line);
+        }
+
+        flush();
+
+        if (overflow && !header.wide)
+        {
+            header.wide = 1;
+            continue;
+        }
+
+        header.num_lines = num_lines;
+        header.num_blocks = bases.size();
+
+        break;
+    }
+
+    // Bases start 8-byte aligned so the mapping can be used in place.
+    const long deltas_end = (long)(sizeof(header) + header.num_lines * (header.wide ? 8 : 4));
+    const char padding[8] = {};
+
+    ok = ok && fwrite(padding, 1, (size_t)(((deltas_end + 7) & ~7L) - deltas_end), out) == (size_t)(((deltas_end + 7) & ~7L) - deltas_end);
+    ok = ok && fwrite(bases.data(), 8, bases.size(), out) == bases.size();
+
+    ok = ok && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = (fclose(out) == 0) && ok;
+
+    if (data != NULL)
+    {
+        munmap((void*)data, size);
+    }
+
+    if (!ok || rename(temp_path.c_str(), index_path) != 0)
+    {
+        wrench_snprintf(error, error_size, "Failed to write line index \"%s\": %s", index_path, strerror(errno));
+        remove(temp_path.c_str());
+
+        return false;
+    }
+
+    return true;
+}
+
+/* Map `self->index_path`, returning false if it's missing, corrupt, or stale.
+ */
+static bool fileLineIndexMap(file_LineIndex* self, const file_Stat* st)
+{
+    const int fd = open(self->index_path, O_RDONLY | O_CLOEXEC);
+    struct stat sb;
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(file_LineIndexHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+
+    const file_LineIndexHeader* header = (const file_LineIndexHeader*)map;
+
+    const size_t deltas_end = sizeof(*header) + header->num_lines * (header->wide ? 8 : 4);
+    const size_t bases_offset = (deltas_end + 7) & ~(size_t)7;
+
+    const bool valid = wrench_memcmp(header->magic, file_line_index_magic, sizeof(header->magic)) == 0
+                    && header->file_size == st->size && header->mtime == st->mtime
+                    && header->block_shift < 64 && header->num_blocks == ((header->num_lines + (1ull << header->block_shift) - 1) >> header->block_shift)
+                    && bases_offset + header->num_blocks * 8 == (size_t)sb.st_size;
+
+    if (!valid)
+    {
+        munmap(map, (size_t)sb.st_size);
+        return false;
+    }
+
+    self->map = map;
+    self->map_size = (size_t)sb.st_size;
+
+    self->offsets = (const char*)map + sizeof(*header);
+    self->bases = (const unsigned long long*)((const char*)map + bases_offset);
+
+    self->num_lines = (double)header->num_lines;
+    self->file_size = header->file_size;
+    self->mtime = header->mtime;
+    self->block_shift = (int)header->block_shift;
+    self->wide = header->wide != 0;
+
+    return true;
+}
+
+static void fileLineIndexUnmap(file_LineIndex* self)
+{
+    if (self->map != NULL) { munmap(self->map, self->map_size); }
+    if (self->fd >= 0) { close(self->fd); }
+
+    self->map = NULL;
+    self->fd = -1;
+}
+
+/* (Re)load the index, rebuilding the sidecar if it's missing or stale (or `rebuild` is set).
+ */
+static bool fileLineIndexLoad(file_LineIndex* self, bool rebuild, char* error, size_t error_size)
+{
+    fileLineIndexUnmap(self);
+    file_Stat st;
+
+    if (!fileStatAt(-1, self->path, true, &st))
+    {
+        wrench_snprintf(error, error_size, "Failed to index \"%s\": %s", self->path, strerror(errno));
+        return false;
+    }
+
+    if (rebuild || !fileLineIndexMap(self, &st))
+    {
+        if (!fileLineIndexBuild(self->path, self->index_path, error, error_size))
+        {
+            return false;
+        }
+
+        if (!fileStatAt(-1, self->path, true, &st) || !fileLineIndexMap(self, &st))
+        {
+            wrench_snprintf(error, error_size, "\"%s\" changed while it was being indexed.", self->path);
+            return false;
+        }
+    }
+
+    self->fd = open(self->path, O_RDONLY | O_CLOEXEC);
+
+    if (self->fd < 0)
+    {
+        wrench_snprintf(error, error_size, "Failed to open \"%s\": %s", self->path, strerror(errno));
+        fileLineIndexUnmap(self);
+
+        return false;
+    }
+
+    return true;
+}
+
+static inline unsigned long long fileLineIndexOffset(const file_LineIndex* self, unsigned long long n)
+{
+    if (n >= (unsigned long long)self->num_lines)
+    {
+        return (unsigned long long)self->file_size;
+    }
+
+    if (self->wide)
+    {
+        return ((const unsigned long long*)self->offsets)[n];
+    }
+
+    return self->bases[n >> self->block_shift] + ((const unsigned int*)self->offsets)[n];
+}
+
+#endif /* !_WIN32 */
+
+static void file_LineIndex_ctor(WrenVM* vm)
+{
+    file_LineIndex* self = (file_LineIndex*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(file_LineIndex));
+    wrench_memset(self, 0, sizeof(file_LineIndex));
+
+    WRENCH_SET_MAGIC_TAG(self, file, LineIndex);
+    self->fd = -1;
+
+    char error[1024 * 4];
+
+    #if !_WIN32
+    {
+        const char* path = wrenGetSlotString(vm, 1);
+        const bool rebuild = wrenGetSlotBool(vm, 2);
+
+        self->path = wrench_strdup(path);
+
+        if (wrenGetSlotType(vm, 3) == WREN_TYPE_STRING)
+        {
+            self->index_path = wrench_strdup(wrenGetSlotString(vm, 3));
+        }
+        else if (self->path != NULL && (self->index_path = (char*)wrench_malloc(wrench_strlen(path) + 6)) != NULL)
+        {
+            wrench_snprintf(self->index_path, wrench_strlen(path) + 6, "%s.lidx", path);
+        }
+
+        if (self->path == NULL || self->index_path == NULL)
+        {
+            wrench_snprintf(error, sizeof(error), "Out of memory.");
+        }
+        else if (fileLineIndexLoad(self, rebuild, error, sizeof(error)))
+        {
+            return;
+        }
+    }
+    #else
+    {
+        wrench_snprintf(error, sizeof(error), "LineIndex is not supported on this platform.");
+    }
+    #endif
+
+    wrenSetSlotString(vm, 0, (const char*)error);
+    wrenAbortFiber(vm, 0);
+}
+
+static void file_LineIndex_dtor(void* data)
+{
+    WRENCH_CHECK_MAGIC_TAG(data, file, LineIndex);
+    file_LineIndex* self = (file_LineIndex*)data;
+
+    #if !_WIN32
+        fileLineIndexUnmap(self);
+    #endif
+
+    wrench_free(self->path);
+    wrench_free(self->index_path);
+}
+
+/* Returns the index from slot 0, reloading it first if the file has changed since it was built.
+ */
+static file_LineIndex* fileGetLineIndex(WrenVM* vm)
+{
+    file_LineIndex* self = (file_LineIndex*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, LineIndex);
+
+    char error[1024 * 4];
+
+    #if !_WIN32
+    {
+        file_Stat st;
+
+        if (self->map == NULL)
+        {
+            wrench_snprintf(error, sizeof(error), "LineIndex for \"%s\" is closed.", self->path);
+        }
+        else if (fileStatAt(-1, self->path, true, &st) && st.size == self->file_size && st.mtime == self->mtime)
+        {
+            return self;
+        }
+        else if (fileLineIndexLoad(self, false, error, sizeof(error)))
+        {
+            return self;
+        }
+    }
+    #else
+    {
+        wrench_snprintf(error, sizeof(error), "LineIndex is not supported on this platform.");
+    }
+    #endif
+
+    wrenSetSlotString(vm, 0, (const char*)error);
+    wrenAbortFiber(vm, 0);
+
+    return NULL;
+}
+
+static void file_LineIndex_count_get(WrenVM* vm)
+{
+    file_LineIndex* self = fileGetLineIndex(vm);
+
+    if (self != NULL)
+    {
+        wrenSetSlotDouble(vm, 0, self->num_lines);
+    }
+}
+
+static void file_LineIndex_offset(WrenVM* vm)
+{
+    file_LineIndex* self = fileGetLineIndex(vm);
+
+    #if !_WIN32
+    if (self != NULL)
+    {
+        const double n = wrenGetSlotDouble(vm, 1);
+        wrenSetSlotDouble(vm, 0, (n < 0) ? 0.0 : (double)fileLineIndexOffset(self, (unsigned long long)n));
+    }
+    #endif
+}
+
+/* Read lines [a, b) with a single pread. Returns them as a list, or as a single string when
+ * `single` (for `line(n)`). Line terminators ("\n") are stripped.
+ */
+static void fileLineIndexRead(WrenVM* vm, double a, double b, bool single)
+{
+    file_LineIndex* self = fileGetLineIndex(vm);
+
+    #if !_WIN32
+    if (self != NULL)
+    {
+        char error[1024 * 4];
+
+        if (a < 0 || b > self->num_lines || a > b || (single && a >= self->num_lines))
+        {
+            wrench_snprintf(error, sizeof(error), "Line range [%.0f, %.0f) out of bounds for \"%s\" (%.0f lines).",
+                                                                    a, b, self->path, self->num_lines);
+            wrenSetSlotString(vm, 0, (const char*)error);
+            wrenAbortFiber(vm, 0);
+
+            return;
+        }
+
+        const unsigned long long first = (unsigned long long)a;
+        const unsigned long long last = (unsigned long long)b;
+
+        const unsigned long long start = fileLineIndexOffset(self, first);
+        const unsigned long long end = fileLineIndexOffset(self, last);
+
+        char* buffer = (char*)wrench_malloc((size_t)(end - start) + 1);
+        ssize_t got = 0;
+
+        while (buffer != NULL && got < (ssize_t)(end - start))
+        {
+            const ssize_t n = pread(self->fd, buffer + got, (size_t)(end - start) - (size_t)got, (off_t)(start + got));
+
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n <= 0) { break; }
+
+            got += n;
+        }
+
+        if (buffer == NULL || got != (ssize_t)(end - start))
+        {
+            wrench_snprintf(error, sizeof(error), "Failed to read lines from \"%s\": %s", self->path,
+                                                    buffer == NULL ? "out of memory" : "short read");
+            wrench_free(buffer);
+
+            wrenSetSlotString(vm, 0, (const char*)error);
+            wrenAbortFiber(vm, 0);
+
+            return;
+        }
+
+        if (!single)
+        {
+            wrenEnsureSlots(vm, 2);
+            wrenSetSlotNewList(vm, 0);
+        }
+
+        for (unsigned long long n = first; n < last; n++)
+        {
+            const size_t line_start = (size_t)(fileLineIndexOffset(self, n) - start);
+            size_t line_end = (size_t)(fileLineIndexOffset(self, n + 1) - start);
+
+            if (line_end > line_start && buffer[line_end - 1] == '\n') { line_end--; }
+
+            if (single)
+            {
+                wrenSetSlotBytes(vm, 0, buffer + line_start, line_end - line_start);
+            }
+            else
+            {
+                wrenSetSlotBytes(vm, 1, buffer + line_start, line_end - line_start);
+                wrenInsertInList(vm, 0, -1, 1);
+            }
+        }
+
+        wrench_free(buffer);
+    }
+    #endif
+}
+
+static void file_LineIndex_line(WrenVM* vm)
+{
+    const double n = wrenGetSlotDouble(vm, 1);
+    fileLineIndexRead(vm, n, n + 1, true);
+}
+
+static void file_LineIndex_range(WrenVM* vm)
+{
+    fileLineIndexRead(vm, wrenGetSlotDouble(vm, 1), wrenGetSlotDouble(vm, 2), false);
+}
+
+static void file_LineIndex_close(WrenVM* vm)
+{
+    file_LineIndex* self = (file_LineIndex*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, LineIndex);
+
+    #if !_WIN32
+        fileLineIndexUnmap(self);
+    #endif
+}
+
+/*
+================================================================================
+ * ~~ [ follow ] ~~ *
+--------------------------------------------------------------------------------
+*/
+
+/* `tail -f` for growing logs (`File.follow`). New data is split with the line index's newline
+ * scanner and handed over a batch per wakeup. Between reads the follower sleeps on inotify
+ * (the file for writes, its directory for a replacement appearing), falling back to polling
+ * elsewhere. Truncation restarts from the top; rotation (a new inode at the path) finishes the
+ * old file and then follows the new one from its start.
+ */
+#ifndef FILE_FOLLOW_RECHECK_MS
+#define FILE_FOLLOW_RECHECK_MS 1000 // Longest sleep without checking for rotation.
+#endif
+
+#ifndef FILE_FOLLOW_POLL_MS
+#define FILE_FOLLOW_POLL_MS 250 // Without inotify.
+#endif
+
+typedef struct file_Follow
+{
+    std::string path;
+    int fd; // -1 while the file doesn't exist.
+
+    unsigned long long device;
+    unsigned long long inode;
+    unsigned long long position;
+
+    std::string partial; // An unterminated last line.
+
+    int notify_fd;
+    int file_watch;
+    int dir_watch;
+}
+file_Follow;
+
+#if !_WIN32
+
+static void fileFollowWatch(file_Follow* follow)
+{
+    #if __linux__
+        if (follow->notify_fd >= 0)
+        {
+            if (follow->file_watch >= 0)
+            {
+                inotify_rm_watch(follow->notify_fd, follow->file_watch);
+            }
+
+            follow->file_watch = inotify_add_watch(follow->notify_fd, follow->path.c_str(), IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+        }
+    #endif
+}
+
+static bool fileFollowOpen(file_Follow* follow, bool from_start)
+{
+    const int fd = open(follow->path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat sb;
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if (fstat(fd, &sb) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    follow->fd = fd;
+    follow->device = (unsigned long long)sb.st_dev;
+    follow->inode = (unsigned long long)sb.st_ino;
+    follow->position = from_start ? 0 : (unsigned long long)sb.st_size;
+    follow->partial.clear();
+
+    fileFollowWatch(follow);
+    return true;
+}
+
+static void fileFollowClose(file_Follow* follow)
+{
+    if (follow->fd >= 0)
+    {
+        close(follow->fd);
+        follow->fd = -1;
+    }
+
+    if (follow->notify_fd >= 0)
+    {
+        close(follow->notify_fd);
+        follow->notify_fd = -1;
+    }
+}
+
+/* Append the complete lines in `partial + data` to `lines`, keeping the rest as `partial`.
+ */
+static void fileFollowSplit(file_Follow* follow, const char* data, size_t size, std::vector<std::string>* lines)
+{
+    std::string& text = follow->partial;
+    text.append(data, size);
+
+    size_t begin = 0;
+
+    fileScanLines(text.data(), text.size(), [&](size_t start)
+    {
+        lines->emplace_back(text, begin, start - 1 - begin);
+        begin = start;
+    });
+
+    if (begin < text.size() && text.back() == '\n')
+    {
+        lines->emplace_back(text, begin, text.size() - 1 - begin);
+        begin = text.size();
+    }
+
+    text.erase(0, begin);
+}
+
+/* Read whatever has been appended since last time. Returns false on a read error.
+ */
+static bool fileFollowRead(file_Follow* follow, std::vector<std::string>* lines, char* error, size_t error_size)
+{
+    for (int pass = 0; pass < 2; pass++)
+    {
+        if (follow->fd < 0 && !fileFollowOpen(follow, true))
+        {
+            return true; // Not there (yet, or between rotations).
+        }
+
+        struct stat sb;
+
+        if (fstat(follow->fd, &sb) == 0 && (unsigned long long)sb.st_size < follow->position)
+        {
+            follow->position = 0; // Truncated.
+            follow->partial.clear();
+        }
+
+        char buffer[1024 * 64];
+
+        for (;;)
+        {
+            const ssize_t n = pread(follow->fd, buffer, sizeof(buffer), (off_t)follow->position);
+
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (n < 0)
+            {
+                wrench_snprintf(error, error_size, "Failed to read \"%s\": %s", follow->path.c_str(), strerror(errno));
+                return false;
+            }
+
+            if (n == 0)
+            {
+                break;
+            }
+
+            follow->position += (unsigned long long)n;
+            fileFollowSplit(follow, buffer, (size_t)n, lines);
+        }
+
+        // The old file has been drained; if the path now names another file, switch to it.
+        if (stat(follow->path.c_str(), &sb) == 0 && (unsigned long long)sb.st_ino == follow->inode &&
+            (unsigned long long)sb.st_dev == follow->device)
+        {
+            return true;
+        }
+
+        if (!follow->partial.empty())
+        {
+            lines->push_back(follow->partial); // The old file's last line was never terminated.
+        }
+
+        close(follow->fd);
+        follow->fd = -1;
+        follow->partial.clear();
+    }
+
+    return true;
+}
+
+static void fileFollowWait(file_Follow* follow, int timeout_ms)
+{
+    timeout_ms = (timeout_ms < 0) ? FILE_FOLLOW_RECHECK_MS : std::min(timeout_ms, FILE_FOLLOW_RECHECK_MS);
+
+    #if __linux__
+        if (follow->notify_fd >= 0)
+        {
+            struct pollfd pfd = { follow->notify_fd, POLLIN, 0 };
+
+            if (poll(&pfd, 1, timeout_ms) > 0)
+            {
+                char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+                while (read(follow->notify_fd, events, sizeof(events)) > 0) {} // Only the wakeup matters.
+            }
+
+            return;
+        }
+    #endif
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(std::min(timeout_ms, FILE_FOLLOW_POLL_MS)));
+}
+
+#endif /* !_WIN32 */
+
+static void file_Follower_ctor(WrenVM* vm)
+{
+    file_Follower* self = (file_Follower*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(file_Follower));
+    WRENCH_SET_MAGIC_TAG(self, file, Follower);
+
+    self->follow = NULL;
+
+    #if !_WIN32
+    {
+        file_Follow* follow = new file_Follow();
+
+        follow->path = wrenGetSlotString(vm, 1);
+        follow->fd = -1;
+        follow->notify_fd = -1;
+        follow->file_watch = -1;
+        follow->dir_watch = -1;
+
+        #if __linux__
+        {
+            follow->notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+            if (follow->notify_fd >= 0)
+            {
+                const size_t slash = follow->path.find_last_of('/');
+                const std::string dir = (slash == std::string::npos) ? "." : (slash == 0) ? "/" : follow->path.substr(0, slash);
+
+                follow->dir_watch = inotify_add_watch(follow->notify_fd, dir.c_str(), IN_CREATE | IN_MOVED_TO);
+            }
+        }
+        #endif
+
+        fileFollowOpen(follow, wrenGetSlotBool(vm, 2));
+        self->follow = follow;
+    }
+    #else
+    {
+        wrenSetSlotString(vm, 0, "File.follow is not supported on this platform.");
+        wrenAbortFiber(vm, 0);
+    }
+    #endif
+}
+
+static void file_Follower_dtor(void* data)
+{
+    WRENCH_CHECK_MAGIC_TAG(data, file, Follower);
+    file_Follower* self = (file_Follower*)data;
+
+    #if !_WIN32
+        if (self->follow != NULL)
+        {
+            fileFollowClose(self->follow);
+        }
+    #endif
+
+    delete self->follow;
+}
+
+/* Wait up to `timeoutMs` (forever if negative, not at all if 0) for new lines, returning
+ * all of them as a list (empty on timeout), or null once closed.
+ */
+static void file_Follower_next(WrenVM* vm)
+{
+    file_Follower* self = (file_Follower*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, Follower);
+
+    const int timeout_ms = wrenGetSlotInt(vm, 1);
+
+    if (self->follow == NULL)
+    {
+        wrenSetSlotNull(vm, 0);
+        return;
+    }
+
+    #if !_WIN32
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::string> lines;
+        char error[1024 * 4];
+
+        for (;;)
+        {
+            if (!fileFollowRead(self->follow, &lines, error, sizeof(error)))
+            {
+                wrenSetSlotString(vm, 0, (const char*)error);
+                wrenAbortFiber(vm, 0);
+
+                return;
+            }
+
+            const long long elapsed = (long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+            if (!lines.empty() || (timeout_ms >= 0 && elapsed >= timeout_ms))
+            {
+                break;
+            }
+
+            fileFollowWait(self->follow, (timeout_ms < 0) ? -1 : (int)(timeout_ms - elapsed));
+        }
+
+        wrenEnsureSlots(vm, 2);
+        wrenSetSlotNewList(vm, 0);
+
+        for (const std::string& line : lines)
+        {
+            wrenSetSlotBytes(vm, 1, line.data(), line.size());
+            wrenInsertInList(vm, 0, -1, 1);
+        }
+    }
+    #endif
+}
+
+static void file_Follower_close(WrenVM* vm)
+{
+    file_Follower* self = (file_Follower*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, Follower);
+
+    #if !_WIN32
+        if (self->follow != NULL)
+        {
+            fileFollowClose(self->follow);
+        }
+    #endif
+
+    delete self->follow;
+    self->follow = NULL;
+}
+
+/*
+================================================================================
+ * ~~ [ line jobs ] ~~ *
+--------------------------------------------------------------------------------
+*/
+
+/* A VM-independent copy of a Wren value, used to move results between VMs.
+ */
+typedef struct file_Value
+{
+    WrenType type;
+
+    double number;
+    bool boolean;
+    std::string string;
+
+    std::vector<file_Value> elements; // Lists, and maps as flattened key/value pairs.
+}
+file_Value;
+
+/* Copy the value in `slot` out of `vm`, using the slots above it as scratch. Maps arrive
+ * from the worker glue (see below) as lists whose first element is the glue class.
+ */
+static void fileValueRead(WrenVM* vm, int slot, file_Value* value)
+{
+    value->type = wrenGetSlotType(vm, slot);
+
+    switch (value->type)
+    {
+        case WREN_TYPE_BOOL: value->boolean = wrenGetSlotBool(vm, slot); break;
+        case WREN_TYPE_NUM: value->number = wrenGetSlotDouble(vm, slot); break;
+
+        case WREN_TYPE_STRING:
+        {
+            int length = 0;
+            const char* bytes = wrenGetSlotBytes(vm, slot, &length);
+
+            value->string.assign(bytes, (size_t)length);
+        }
+        break;
+
+        case WREN_TYPE_LIST:
+        {
+            const int count = wrenGetListCount(vm, slot);
+            int first = 0;
+
+            wrenEnsureSlots(vm, slot + 2);
+
+            if (count > 0)
+            {
+                wrenGetListElement(vm, slot, 0, slot + 1);
+
+                if (wrenGetSlotType(vm, slot + 1) == WREN_TYPE_UNKNOWN)
+                {
+                    value->type = WREN_TYPE_MAP;
+                    first = 1;
+                }
+            }
+
+            value->elements.resize((size_t)(count - first));
+
+            for (int i = first; i < count; i++)
+            {
+                wrenGetListElement(vm, slot, i, slot + 1);
+                fileValueRead(vm, slot + 1, &value->elements[(size_t)(i - first)]);
+            }
+        }
+        break;
+
+        default: value->type = WREN_TYPE_NULL; break;
+    }
+}
+
+static void fileValueWrite(WrenVM* vm, int slot, const file_Value* value)
+{
+    switch (value->type)
+    {
+        case WREN_TYPE_BOOL: wrenSetSlotBool(vm, slot, value->boolean); break;
+        case WREN_TYPE_NUM: wrenSetSlotDouble(vm, slot, value->number); break;
+        case WREN_TYPE_STRING: wrenSetSlotBytes(vm, slot, value->string.data(), value->string.size()); break;
+
+        case WREN_TYPE_LIST:
+        {
+            wrenEnsureSlots(vm, slot + 2);
+            wrenSetSlotNewList(vm, slot);
+
+            for (const file_Value& element : value->elements)
+            {
+                fileValueWrite(vm, slot + 1, &element);
+                wrenInsertInList(vm, slot, -1, slot + 1);
+            }
+        }
+        break;
+
+        case WREN_TYPE_MAP:
+        {
+            wrenEnsureSlots(vm, slot + 3);
+            wrenSetSlotNewMap(vm, slot);
+
+            for (size_t i = 0; i + 1 < value->elements.size(); i += 2)
+            {
+                fileValueWrite(vm, slot + 1, &value->elements[i + 0]);
+                fileValueWrite(vm, slot + 2, &value->elements[i + 1]);
+
+                wrenSetMapValue(vm, slot, slot + 1, slot + 2);
+            }
+        }
+        break;
+
+        default: wrenSetSlotNull(vm, slot); break;
+    }
+}
+
+/* Loaded into every worker VM. The C API can't enumerate map keys, so maps are flattened
+ * into [LineJobWorker_, k0, v0, k1, v1, ...] before the result is copied out.
+ */
+static const char file_line_job_glue[] =
+
+"import \"%s\" for map\n"
+"var MapFn_ = map\n" // Lowercase names in methods are calls on `this`.
+
+"class LineJobWorker_ {\n"
+    "static run(lines) { pack_(MapFn_.call(lines)) }\n"
+
+    "static pack_(v) {\n"
+        "if (v is Num || v is String || v is Bool || v == null) return v\n"
+
+        "if (v is List) {\n"
+            "for (e in v) {\n"
+                "if (!(e is Num || e is String || e is Bool || e == null)) return v.map {|e| pack_(e) }.toList\n"
+            "}\n"
+
+            "return v\n"
+        "}\n"
+
+        "if (v is Map) {\n"
+            "var pairs = [LineJobWorker_]\n"
+
+            "for (e in v) {\n"
+                "pairs.add(pack_(e.key))\n"
+                "pairs.add(pack_(e.value))\n"
+            "}\n"
+
+            "return pairs\n"
+        "}\n"
+
+        "Fiber.abort(\"LineJob results must be nums, strings, bools, null, lists, or maps (got %%(v.type)).\")\n"
+    "}\n"
+"}\n";
+
+typedef struct file_LineJobWorker
+{
+    WrenVM* vm;
+    WrenHandle* worker_class;
+    WrenHandle* run;
+}
+file_LineJobWorker;
+
+static void fileLineJobFreeWorker(file_LineJobWorker* worker)
+{
+    if (worker->vm != NULL)
+    {
+        if (worker->run != NULL) { wrenReleaseHandle(worker->vm, worker->run); }
+        if (worker->worker_class != NULL) { wrenReleaseHandle(worker->vm, worker->worker_class); }
+
+        wrenFreeExtendedVM(worker->vm, false);
+    }
+}
+
+/* Create a worker VM that shares the main VM's command line, base path and library policy,
+ * and load `module`'s `map` function into it. Wrench contexts aren't thread safe to create,
+ * so this runs on the main thread; each worker VM is then only touched by its own thread.
+ */
+static bool fileLineJobNewWorker(WrenVM* main_vm, const char* module, file_LineJobWorker* worker, char* error, size_t error_size)
+{
+    int argc = 0;
+    char** argv = wrenGetCommandLine(main_vm, &argc);
+
+    wrench_memset(worker, 0, sizeof(*worker));
+    worker->vm = wrenNewExtendedVM(argc, argv, false);
+
+    if (worker->vm == NULL)
+    {
+        wrench_snprintf(error, error_size, "Failed to create LineJob worker VM.");
+        return false;
+    }
+
+    if (wrenGetBasePath(main_vm) != NULL)
+    {
+        wrenSetBasePath(worker->vm, wrenGetBasePath(main_vm));
+    }
+
+    wrenSetForeignLibraryLoadEnabled(worker->vm, wrenGetForeignLibraryLoadEnabled(main_vm));
+
+    std::string glue(sizeof(file_line_job_glue) + wrench_strlen(module), '\0');
+    glue.resize((size_t)wrench_snprintf(&glue[0], glue.size(), file_line_job_glue, module));
+
+    if (wrenInterpret(worker->vm, "wrench_line_job", glue.c_str()) != WREN_RESULT_SUCCESS)
+    {
+        wrench_snprintf(error, error_size, "Failed to load `map` from module \"%s\" for LineJob.", module);
+        return false;
+    }
+
+    wrenEnsureSlots(worker->vm, 1);
+    wrenGetVariable(worker->vm, "wrench_line_job", "LineJobWorker_", 0);
+
+    worker->worker_class = wrenGetSlotHandle(worker->vm, 0);
+    worker->run = wrenMakeCallHandle(worker->vm, "run(_)");
+
+    return true;
+}
+
+/* Run `map(lines)` on one chunk of the file in the worker's VM, and copy out the result.
+ */
+static bool fileLineJobRunChunk(file_LineJobWorker* worker, const char* data, size_t size, file_Value* result)
+{
+    WrenVM* vm = worker->vm;
+
+    wrenEnsureSlots(vm, 3);
+    wrenSetSlotHandle(vm, 0, worker->worker_class);
+    wrenSetSlotNewList(vm, 1);
+
+    // The chunk's own terminator was already trimmed, so N newlines always means N + 1 lines.
+    for (size_t start = 0; ; )
+    {
+        const char* newline = (const char*)wrench_memchr(data + start, '\n', size - start);
+        const size_t end = (newline != NULL) ? (size_t)(newline - data) : size;
+
+        wrenSetSlotBytes(vm, 2, data + start, end - start);
+        wrenInsertInList(vm, 1, -1, 2);
+
+        if (newline == NULL)
+        {
+            break;
+        }
+
+        start = end + 1;
+    }
+
+    if (wrenCall(vm, worker->run) != WREN_RESULT_SUCCESS)
+    {
+        return false;
+    }
+
+    fileValueRead(vm, 0, result);
+    return true;
+}
+
+/* Split `path` into newline-aligned chunks of about `chunk_bytes` and map each chunk on a pool
+ * of worker VMs. Results land in file order.
+ */
+static bool fileLineJobMap(WrenVM* vm, const char* path, const char* module, int num_threads, size_t chunk_bytes,
+                                            std::vector<file_Value>* results, char* error, size_t error_size)
+{
+    #if !_WIN32
+    {
+        const int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat sb;
+
+        if (fd < 0 || fstat(fd, &sb) != 0)
+        {
+            wrench_snprintf(error, error_size, "Failed to open \"%s\" for LineJob: %s", path, strerror(errno));
+            if (fd >= 0) { close(fd); }
+
+            return false;
+        }
+
+        const size_t size = (size_t)sb.st_size;
+        const char* data = NULL;
+
+        if (size > 0)
+        {
+            data = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data == (const char*)MAP_FAILED)
+            {
+                wrench_snprintf(error, error_size, "Failed to map \"%s\" for LineJob: %s", path, strerror(errno));
+                close(fd);
+
+                return false;
+            }
+
+            madvise((void*)data, size, MADV_SEQUENTIAL);
+        }
+
+        close(fd);
+
+        if (num_threads <= 0)
+        {
+            num_threads = (int)std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        /* Default to several chunks per thread so uneven chunks still balance, but keep them
+         * big enough that per-call overhead disappears.
+         */
+        if (chunk_bytes == 0)
+        {
+            chunk_bytes = std::min<size_t>(std::max<size_t>(size / ((size_t)num_threads * 8), 1024 * 1024), 64 * 1024 * 1024);
+        }
+
+        std::vector<std::pair<size_t, size_t>> chunks;
+
+        for (size_t start = 0; start < size; )
+        {
+            size_t end = std::min(start + chunk_bytes, size);
+
+            if (end < size)
+            {
+                const char* newline = (const char*)wrench_memchr(data + end - 1, '\n', size - (end - 1));
+                end = (newline != NULL) ? (size_t)(newline - data) + 1 : size;
+            }
+
+            // The chunk excludes its trailing newline, so a final "\n" doesn't make an empty line.
+            chunks.push_back({ start, (data[end - 1] == '\n') ? end - 1 - start : end - start });
+            start = end;
+        }
+
+        num_threads = std::min(num_threads, std::max(1, (int)chunks.size()));
+
+        std::vector<file_LineJobWorker> workers((size_t)num_threads);
+        bool ok = true;
+
+        for (size_t i = 0; i < workers.size() && ok; i++)
+        {
+            ok = fileLineJobNewWorker(vm, module, &workers[i], error, error_size);
+
+            if (!ok)
+            {
+                workers.resize(i + 1); // Free the partially created worker too.
+            }
+        }
+
+        if (ok)
+        {
+            results->resize(chunks.size());
+
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> failed{SIZE_MAX};
+
+            std::vector<std::thread> threads;
+
+            for (file_LineJobWorker& worker : workers)
+            {
+                threads.emplace_back([&, worker_ptr = &worker]()
+                {
+                    for (size_t i; failed.load() == SIZE_MAX && (i = next++) < chunks.size(); )
+                    {
+                        if (!fileLineJobRunChunk(worker_ptr, data + chunks[i].first, chunks[i].second, &(*results)[i]))
+                        {
+                            size_t expected = SIZE_MAX;
+                            failed.compare_exchange_strong(expected, i);
+                        }
+                    }
+                });
+            }
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            if (failed.load() != SIZE_MAX)
+            {
+                wrench_snprintf(error, error_size, "LineJob map from \"%s\" failed on \"%s\" at byte %zu.",
+                                                    module, path, chunks[failed.load()].first);
+                ok = false;
+            }
+        }
+
+        for (file_LineJobWorker& worker : workers)
+        {
+            fileLineJobFreeWorker(&worker);
+        }
+
+        if (data != NULL)
+        {
+            munmap((void*)data, size);
+        }
+
+        return ok;
+    }
+    #else
+    {
+        wrench_snprintf(error, error_size, "LineJob is not supported on this platform.");
+        return false;
+    }
+    #endif
+}
+
+static void file_LineJob_map(WrenVM* vm)
+{
+    const char* path = wrenGetSlotString(vm, 1);
+    const char* module = wrenGetSlotString(vm, 2);
+    const int num_threads = wrenGetSlotInt(vm, 3);
+    const double chunk_bytes = wrenGetSlotDouble(vm, 4);
+
+    std::vector<file_Value> results;
+    char error[1024 * 4];
+
+    if (!fileLineJobMap(vm, path, module, num_threads, chunk_bytes > 0 ? (size_t)chunk_bytes : 0, &results, error, sizeof(error)))
+    {
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    wrenEnsureSlots(vm, 2);
+    wrenSetSlotNewList(vm, 0);
+
+    for (const file_Value& result : results)
+    {
+        fileValueWrite(vm, 1, &result);
+        wrenInsertInList(vm, 0, -1, 1);
+    }
+}
+
+/*
+================================================================================
+ * ~~ [ path ] ~~ *
+--------------------------------------------------------------------------------
+*/
+
+static void file_Path_list(WrenVM* vm)
+{
+    const char* path = wrenGetSlotString(vm, 1);
+    const bool recursive = wrenGetSlotBool(vm, 2);
+    const bool include_subdirectories = wrenGetSlotBool(vm, 3);
+
+    const std::filesystem::path p{path};
+
+    // TODO: Abort if directory doesn't exist, or empty list?
+    wrenSetSlotNewList(vm, 0);
+
+    #define ENTRY() do                                                      \
+    {                                                                       \
+        if (include_subdirectories == false && dir_entry.is_directory())    \
+        {                                                                   \
+            continue;                                                       \
+        }                                                                   \
+                                                                            \
+        wrenSetSlotString(vm, 1, dir_entry.path().c_str());                 \
+        wrenInsertInList(vm, 0, -1, 1);                                     \
+    }                                                                       \
+    while (0)
+
+    if (recursive)
+    {
+        for (auto const& dir_entry : std::filesystem::recursive_directory_iterator{p})
+        {
+            ENTRY();
+        }
+    }
+    else
+    {
+        for (auto const& dir_entry : std::filesystem::directory_iterator{p})
+        {
+            ENTRY();
+        }
+    }
+
+    #undef ENTRY
+}
+
+static void file_Path_exists(WrenVM* vm)
+{
+    file_Stat st;
+    wrenSetSlotBool(vm, 0, fileStatAt(-1, wrenGetSlotString(vm, 1), true, &st));
+}
+
+static void file_Path_isDirectory(WrenVM* vm)
+{
+    file_Stat st;
+    wrenSetSlotBool(vm, 0, fileStatAt(-1, wrenGetSlotString(vm, 1), true, &st) && (((int)st.mode) & S_IFMT) == S_IFDIR);
+}
+
+static void file_Path_isFile(WrenVM* vm)
+{
+    file_Stat st;
+    wrenSetSlotBool(vm, 0, fileStatAt(-1, wrenGetSlotString(vm, 1), true, &st) && (((int)st.mode) & S_IFMT) == S_IFREG);
+}
+
+/* Stat a list of paths in one foreign call. Returns [sizes, mtimes, modes, inodes];
+ * paths that don't exist get a size of -1.
+ */
+static void file_Path_stat(WrenVM* vm)
+{
+    if (wrenGetSlotType(vm, 1) != WREN_TYPE_LIST)
+    {
+        wrenSetSlotString(vm, 0, "Path.stat expects a list of paths");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    const int count = wrenGetListCount(vm, 1);
+    file_Entries entries;
+
+    wrenEnsureSlots(vm, 7);
+
+    for (int i = 0; i < count; i++)
+    {
+        wrenGetListElement(vm, 1, i, 2);
+
+        if (wrenGetSlotType(vm, 2) != WREN_TYPE_STRING)
+        {
+            wrenSetSlotString(vm, 0, "Path.stat expects a list of paths");
+            wrenAbortFiber(vm, 0);
+
+            return;
+        }
+
+        file_Stat st;
+        fileStatAt(-1, wrenGetSlotString(vm, 2), true, &st);
+
+        entries.sizes.push_back(st.size);
+        entries.mtimes.push_back(st.mtime);
+        entries.modes.push_back(st.mode);
+        entries.inodes.push_back(st.inode);
+    }
+
+    fileSetSlotNumList(vm, 2, 6, entries.sizes);
+    fileSetSlotNumList(vm, 3, 6, entries.mtimes);
+    fileSetSlotNumList(vm, 4, 6, entries.modes);
+    fileSetSlotNumList(vm, 5, 6, entries.inodes);
+
+    wrenSetSlotNewList(vm, 0);
+
+    for (int i = 2; i <= 5; i++)
+    {
+        wrenInsertInList(vm, 0, -1, i);
+    }
+}
+
+static void file_Path_copyFile(WrenVM* vm)
+{
+    char error[1024 * 4];
+
+    if (!fileCopyFile(wrenGetSlotString(vm, 1), wrenGetSlotString(vm, 2), error, sizeof(error)))
+    {
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+    }
+}
+
+static void file_Path_moveFile(WrenVM* vm)
+{
+    char error[1024 * 4];
+
+    if (!fileMoveFile(wrenGetSlotString(vm, 1), wrenGetSlotString(vm, 2), error, sizeof(error)))
+    {
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+    }
+}
+
+static void file_Path_copyTree(WrenVM* vm)
+{
+    char error[1024 * 4];
+
+    if (!fileCopyTree(wrenGetSlotString(vm, 1), wrenGetSlotString(vm, 2), wrenGetSlotInt(vm, 3), error, sizeof(error)))
+    {
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+    }
+}
+
+/* Like list(), but returns [paths, sizes, mtimes, modes, inodes]. If `with_stat` is false,
+ * only modes (from d_type) and inodes are filled in, and sizes are -1.
+ */
+static void file_Path_listStat(WrenVM* vm)
+{
+    std::string path = wrenGetSlotString(vm, 1);
+    const bool recursive = wrenGetSlotBool(vm, 2);
+    const bool include_subdirectories = wrenGetSlotBool(vm, 3);
+    const bool with_stat = wrenGetSlotBool(vm, 4);
+
+    file_Entries entries;
+
+    if (!fileWalk(path, recursive, include_subdirectories, with_stat, &entries))
+    {
+        char error[1024 * 4];
+        wrench_snprintf(error, sizeof(error), "failed to open directory \"%s\"", wrenGetSlotString(vm, 1));
+
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    wrenEnsureSlots(vm, 7);
+
+    fileSetSlotStringList(vm, 1, 6, entries.paths);
+    fileSetSlotNumList(vm, 2, 6, entries.sizes);
+    fileSetSlotNumList(vm, 3, 6, entries.mtimes);
+    fileSetSlotNumList(vm, 4, 6, entries.modes);
+    fileSetSlotNumList(vm, 5, 6, entries.inodes);
+
+    wrenSetSlotNewList(vm, 0);
+
+    for (int i = 1; i <= 5; i++)
+    {
+        wrenInsertInList(vm, 0, -1, i);
+    }
+}
+
+/*
+================================================================================
+ * ~~ [ snapshot ] ~~ *
+--------------------------------------------------------------------------------
+*/
+
+/* A persistent listing of a tree (`DirSnapshot`). Every directory keeps its mtime, which
+ * changes whenever an entry is added, removed or renamed - so a refresh stats each known
+ * directory once and only lists the ones that changed. Edits to existing files don't touch
+ * the directory, so a deep refresh also stats the files of unchanged directories (which is
+ * still much cheaper than listing them).
+ */
+typedef struct file_SnapshotEntry
+{
+    std::string name;
+    double size;
+    double mtime;
+    double mode;
+}
+file_SnapshotEntry;
+
+typedef struct file_SnapshotDir
+{
+    double mtime; // -1 forces a rescan.
+    std::vector<file_SnapshotEntry> entries; // Sorted by name.
+}
+file_SnapshotDir;
+
+typedef struct file_Snapshot
+{
+    std::string root; // Ends with a separator.
+    std::map<std::string, file_SnapshotDir> dirs; // Relative to the root, with a trailing separator ("" is the root).
+}
+file_Snapshot;
+
+typedef struct file_SnapshotChanges
+{
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    std::vector<std::string> modified;
+}
+file_SnapshotChanges;
+
+static const char file_snapshot_magic[8] = { 'W', 'R', 'D', 'S', 'N', 'P', '1', '\0' };
+
+/* Directories modified this recently (in seconds) may change again within the resolution
+ * of their mtime without it moving, so they're rescanned on the next refresh regardless.
+ */
+#ifndef FILE_SNAPSHOT_RACY_SECONDS
+#define FILE_SNAPSHOT_RACY_SECONDS 2.0
+#endif
+
+static bool fileSnapshotList(const std::string& path, std::vector<file_SnapshotEntry>* entries)
+{
+    entries->clear();
+
+    #if !_WIN32
+    {
+        DIR* dir = opendir(path.c_str());
+
+        if (dir == NULL)
+        {
+            return false;
+        }
+
+        const int fd = dirfd(dir);
+
+        for (struct dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
+        {
+            const char* name = entry->d_name;
+
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            {
+                continue;
+            }
+
+            file_Stat st;
+
+            if (fileStatAt(fd, name, false, &st))
+            {
+                entries->push_back({ name, st.size, st.mtime, st.mode });
+            }
+        }
+
+        closedir(dir);
+    }
+    #else
+    {
+        std::error_code ec;
+        std::filesystem::directory_iterator it{path, ec};
+
+        if (ec)
+        {
+            return false;
+        }
+
+        for (auto const& dir_entry : it)
+        {
+            file_Stat st;
+
+            if (fileStatAt(-1, dir_entry.path().string().c_str(), false, &st))
+            {
+                entries->push_back({ dir_entry.path().filename().string(), st.size, st.mtime, st.mode });
+            }
+        }
+    }
+    #endif
+
+    std::sort(entries->begin(), entries->end(), [](const file_SnapshotEntry& a, const file_SnapshotEntry& b) { return a.name < b.name; });
+    return true;
+}
+
+static inline bool fileSnapshotIsDir(const file_SnapshotEntry& entry)
+{
+    return (((int)entry.mode) & S_IFMT) == S_IFDIR;
+}
+
+static double fileSnapshotDirMtime(const file_Snapshot* snap, const std::string& rel, double now)
+{
+    file_Stat st;
+
+    if (!fileStatAt(-1, (snap->root + rel).c_str(), false, &st) || (((int)st.mode) & S_IFMT) != S_IFDIR)
+    {
+        return -2.0; // Gone (or no longer a directory).
+    }
+
+    return (now - st.mtime < FILE_SNAPSHOT_RACY_SECONDS) ? -1.0 : st.mtime;
+}
+
+/* Add the directory `rel` and everything under it, reporting all of it as added.
+ */
+static void fileSnapshotAdd(file_Snapshot* snap, const std::string& rel, double now, file_SnapshotChanges* changes)
+{
+    const double mtime = fileSnapshotDirMtime(snap, rel, now);
+    file_SnapshotDir dir;
+
+    if (mtime == -2.0 || !fileSnapshotList(snap->root + rel, &dir.entries))
+    {
+        return;
+    }
+
+    dir.mtime = mtime;
+
+    for (const file_SnapshotEntry& entry : dir.entries)
+    {
+        changes->added.push_back(snap->root + rel + entry.name + (fileSnapshotIsDir(entry) ? "/" : ""));
+    }
+
+    const std::vector<file_SnapshotEntry>& entries = (snap->dirs[rel] = std::move(dir)).entries;
+
+    for (const file_SnapshotEntry& entry : entries)
+    {
+        if (fileSnapshotIsDir(entry))
+        {
+            fileSnapshotAdd(snap, rel + entry.name + "/", now, changes);
+        }
+    }
+}
+
+/* Drop the directory `rel` and everything under it, reporting all of it as removed.
+ */
+static void fileSnapshotRemove(file_Snapshot* snap, const std::string& rel, file_SnapshotChanges* changes)
+{
+    auto it = snap->dirs.lower_bound(rel);
+
+    while (it != snap->dirs.end() && it->first.compare(0, rel.size(), rel) == 0)
+    {
+        for (const file_SnapshotEntry& entry : it->second.entries)
+        {
+            changes->removed.push_back(snap->root + it->first + entry.name + (fileSnapshotIsDir(entry) ? "/" : ""));
+        }
+
+        it = snap->dirs.erase(it);
+    }
+}
+
+static void fileSnapshotRefresh(file_Snapshot* snap, bool deep, file_SnapshotChanges* changes)
+{
+    const double now = (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count() * 1e-6;
+
+    if (snap->dirs.find("") == snap->dirs.end())
+    {
+        fileSnapshotAdd(snap, "", now, changes);
+        return;
+    }
+
+    std::vector<std::string> rels;
+    rels.reserve(snap->dirs.size());
+
+    for (const auto& it : snap->dirs)
+    {
+        rels.push_back(it.first);
+    }
+
+    std::vector<file_SnapshotEntry> listed;
+
+    for (const std::string& rel : rels)
+    {
+        auto it = snap->dirs.find(rel);
+
+        if (it == snap->dirs.end())
+        {
+            continue; // Its parent was removed (or stopped being a directory).
+        }
+
+        file_SnapshotDir& dir = it->second;
+        const double mtime = fileSnapshotDirMtime(snap, rel, now);
+
+        if (mtime == -2.0)
+        {
+            if (rel.empty())
+            {
+                fileSnapshotRemove(snap, rel, changes); // The root itself is gone.
+            }
+
+            continue; // Otherwise the parent reports it.
+        }
+
+        if (mtime == dir.mtime && mtime != -1.0)
+        {
+            if (deep)
+            {
+                for (file_SnapshotEntry& entry : dir.entries)
+                {
+                    file_Stat st;
+
+                    if (!fileSnapshotIsDir(entry) && fileStatAt(-1, (snap->root + rel + entry.name).c_str(), false, &st) &&
+                        (st.size != entry.size || st.mtime != entry.mtime))
+                    {
+                        entry.size = st.size;
+                        entry.mtime = st.mtime;
+
+                        changes->modified.push_back(snap->root + rel + entry.name);
+                    }
+                }
+            }
+
+            continue;
+        }
+
+        if (!fileSnapshotList(snap->root + rel, &listed))
+        {
+            continue; // Raced with a delete; the next refresh will see it.
+        }
+
+        // Merge the sorted old and new listings.
+        std::vector<file_SnapshotEntry> old = std::move(dir.entries);
+        std::vector<std::string> added_dirs;
+
+        dir.mtime = mtime;
+        dir.entries = listed;
+
+        size_t i = 0, j = 0;
+
+        while (i < old.size() || j < listed.size())
+        {
+            const int order = (i == old.size()) ? 1 : (j == listed.size()) ? -1 : old[i].name.compare(listed[j].name);
+
+            const bool was_dir = (order <= 0) && fileSnapshotIsDir(old[i]);
+            const bool is_dir = (order >= 0) && fileSnapshotIsDir(listed[j]);
+
+            if (order == 0 && was_dir == is_dir)
+            {
+                if (!is_dir && (old[i].size != listed[j].size || old[i].mtime != listed[j].mtime))
+                {
+                    changes->modified.push_back(snap->root + rel + listed[j].name);
+                }
+            }
+            else
+            {
+                if (order <= 0)
+                {
+                    changes->removed.push_back(snap->root + rel + old[i].name + (was_dir ? "/" : ""));
+
+                    if (was_dir)
+                    {
+                        fileSnapshotRemove(snap, rel + old[i].name + "/", changes);
+                    }
+                }
+
+                if (order >= 0)
+                {
+                    changes->added.push_back(snap->root + rel + listed[j].name + (is_dir ? "/" : ""));
+
+                    if (is_dir)
+                    {
+                        added_dirs.push_back(rel + listed[j].name + "/");
+                    }
+                }
+            }
+
+            i += (order <= 0);
+            j += (order >= 0);
+        }
+
+        for (const std::string& added : added_dirs)
+        {
+            fileSnapshotAdd(snap, added, now, changes);
+        }
+    }
+}
+
+static void fileSnapshotPut(std::string& out, const void* data, size_t size)
+{
+    out.append((const char*)data, size);
+}
+
+static void fileSnapshotPutString(std::string& out, const std::string& s)
+{
+    const unsigned int length = (unsigned int)s.size();
+
+    fileSnapshotPut(out, &length, sizeof(length));
+    out += s;
+}
+
+static bool fileSnapshotSave(const file_Snapshot* snap, const char* path, char* error, size_t error_size)
+{
+    std::string out;
+    fileSnapshotPut(out, file_snapshot_magic, sizeof(file_snapshot_magic));
+    fileSnapshotPutString(out, snap->root);
+
+    const unsigned long long num_dirs = snap->dirs.size();
+    fileSnapshotPut(out, &num_dirs, sizeof(num_dirs));
+
+    for (const auto& it : snap->dirs)
+    {
+        const unsigned int num_entries = (unsigned int)it.second.entries.size();
+
+        fileSnapshotPutString(out, it.first);
+        fileSnapshotPut(out, &it.second.mtime, sizeof(double));
+        fileSnapshotPut(out, &num_entries, sizeof(num_entries));
+
+        for (const file_SnapshotEntry& entry : it.second.entries)
+        {
+            const unsigned int mode = (unsigned int)entry.mode;
+
+            fileSnapshotPutString(out, entry.name);
+            fileSnapshotPut(out, &entry.size, sizeof(double));
+            fileSnapshotPut(out, &entry.mtime, sizeof(double));
+            fileSnapshotPut(out, &mode, sizeof(mode));
+        }
+    }
+
+    #if _WIN32
+        std::string temp_path = std::string(path) + ".tmp" + std::to_string((long long)_getpid());
+    #else
+        std::string temp_path = std::string(path) + ".tmp" + std::to_string((long long)getpid());
+    #endif
+
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    bool ok = (file != NULL) && fwrite(out.data(), 1, out.size(), file) == out.size();
+
+    ok = (file != NULL) && (fclose(file) == 0) && ok;
+
+    #if _WIN32
+        remove(path); // rename() doesn't replace on Windows.
+    #endif
+
+    if (!ok || rename(temp_path.c_str(), path) != 0)
+    {
+        wrench_snprintf(error, error_size, "Failed to write directory snapshot \"%s\": %s", path, strerror(errno));
+        remove(temp_path.c_str());
+
+        return false;
+    }
+
+    return true;
+}
+
+/* Read a saved snapshot of `snap->root`. Returns false (leaving `snap` empty) if the file is
+ * missing, corrupt, or of a different root.
+ */
+static bool fileSnapshotLoad(file_Snapshot* snap, const char* path)
+{
+    FILE* file = fopen(path, "rb");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    std::string data;
+    char buffer[1024 * 16];
+
+    for (size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) != 0; )
+    {
+        data.append(buffer, n);
+    }
+
+    fclose(file);
+
+    const char* p = data.data();
+    const char* end = p + data.size();
+
+    auto get = [&](void* out, size_t size) -> bool
+    {
+        if ((size_t)(end - p) < size) { return false; }
+
+        wrench_memcpy(out, p, size);
+        p += size;
+
+        return true;
+    };
+
+    auto get_string = [&](std::string* out) -> bool
+    {
+        unsigned int length;
+
+        if (!get(&length, sizeof(length)) || (size_t)(end - p) < length) { return false; }
+
+        out->assign(p, length);
+        p += length;
+
+        return true;
+    };
+
+    char magic[sizeof(file_snapshot_magic)];
+    std::string root;
+    unsigned long long num_dirs;
+
+    bool ok = get(magic, sizeof(magic)) && wrench_memcmp(magic, file_snapshot_magic, sizeof(magic)) == 0 &&
+              get_string(&root) && root == snap->root && get(&num_dirs, sizeof(num_dirs));
+
+    for (unsigned long long i = 0; ok && i < num_dirs; i++)
+    {
+        std::string rel;
+        file_SnapshotDir dir;
+        unsigned int num_entries;
+
+        ok = get_string(&rel) && get(&dir.mtime, sizeof(double)) && get(&num_entries, sizeof(num_entries)) &&
+             (size_t)(end - p) / 24 >= num_entries; // Don't trust a corrupt count with the allocation.
+
+        dir.entries.resize(ok ? num_entries : 0);
+
+        for (file_SnapshotEntry& entry : dir.entries)
+        {
+            unsigned int mode = 0;
+
+            ok = ok && get_string(&entry.name) && get(&entry.size, sizeof(double)) && get(&entry.mtime, sizeof(double)) && get(&mode, sizeof(mode));
+            entry.mode = mode;
+        }
+
+        if (ok)
+        {
+            snap->dirs[rel] = std::move(dir);
+        }
+    }
+
+    if (!ok || p != end)
+    {
+        snap->dirs.clear();
+        return false;
+    }
+
+    return true;
+}
+
+static void file_DirSnapshot_ctor(WrenVM* vm)
+{
+    file_DirSnapshot* self = (file_DirSnapshot*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(file_DirSnapshot));
+    WRENCH_SET_MAGIC_TAG(self, file, DirSnapshot);
+
+    self->snapshot = NULL;
+    self->path = NULL;
+
+    std::string root = wrenGetSlotString(vm, 1);
+
+    if (root.empty() || (root.back() != '/' && root.back() != '\\'))
+    {
+        root += '/';
+    }
+
+    if (wrenGetSlotType(vm, 2) == WREN_TYPE_STRING)
+    {
+        self->path = wrench_strdup(wrenGetSlotString(vm, 2));
+    }
+    else
+    {
+        // Next to the tree rather than in it, so saving doesn't change the root's mtime. The
+        // root is made absolute first, so that "." and "dir/.." name the directory itself.
+        std::error_code ec;
+        const std::filesystem::path tree = std::filesystem::absolute(root, ec).lexically_normal().parent_path();
+
+        if (ec || !tree.has_relative_path())
+        {
+            char error[1024 * 4];
+            wrench_snprintf(error, sizeof(error), "DirSnapshot can't be saved next to \"%s\" - pass a snapshotPath.", root.c_str());
+
+            wrenSetSlotString(vm, 0, (const char*)error);
+            wrenAbortFiber(vm, 0);
+
+            return;
+        }
+
+        self->path = wrench_strdup((tree.string() + ".dirsnap").c_str());
+    }
+
+    self->snapshot = new file_Snapshot();
+    self->snapshot->root = root;
+
+    if (self->path == NULL)
+    {
+        wrenSetSlotString(vm, 0, "Out of memory.");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    fileSnapshotLoad(self->snapshot, self->path);
+}
+
+static void file_DirSnapshot_dtor(void* data)
+{
+    WRENCH_CHECK_MAGIC_TAG(data, file, DirSnapshot);
+    file_DirSnapshot* self = (file_DirSnapshot*)data;
+
+    delete self->snapshot;
+    wrench_free(self->path);
+}
+
+static void file_DirSnapshot_root(WrenVM* vm)
+{
+    file_DirSnapshot* self = (file_DirSnapshot*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, DirSnapshot);
+
+    wrenSetSlotString(vm, 0, self->snapshot->root.c_str());
+}
+
+static void file_DirSnapshot_path(WrenVM* vm)
+{
+    file_DirSnapshot* self = (file_DirSnapshot*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, DirSnapshot);
+
+    wrenSetSlotString(vm, 0, self->path);
+}
+
+static void file_DirSnapshot_paths(WrenVM* vm)
+{
+    file_DirSnapshot* self = (file_DirSnapshot*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, DirSnapshot);
+
+    const file_Snapshot* snap = self->snapshot;
+    std::vector<std::string> paths;
+
+    for (const auto& it : snap->dirs)
+    {
+        for (const file_SnapshotEntry& entry : it.second.entries)
+        {
+            paths.push_back(snap->root + it.first + entry.name + (fileSnapshotIsDir(entry) ? "/" : ""));
+        }
+    }
+
+    wrenEnsureSlots(vm, 2);
+    fileSetSlotStringList(vm, 0, 1, paths);
+}
+
+static void file_DirSnapshot_refresh(WrenVM* vm)
+{
+    file_DirSnapshot* self = (file_DirSnapshot*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, DirSnapshot);
+
+    file_SnapshotChanges changes;
+    fileSnapshotRefresh(self->snapshot, wrenGetSlotBool(vm, 1), &changes);
+
+    wrenEnsureSlots(vm, 5);
+
+    fileSetSlotStringList(vm, 1, 4, changes.added);
+    fileSetSlotStringList(vm, 2, 4, changes.removed);
+    fileSetSlotStringList(vm, 3, 4, changes.modified);
+
+    wrenSetSlotNewList(vm, 0);
+
+    for (int i = 1; i <= 3; i++)
+    {
+        wrenInsertInList(vm, 0, -1, i);
+    }
+}
+
+static void file_DirSnapshot_save(WrenVM* vm)
+{
+    file_DirSnapshot* self = (file_DirSnapshot*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, DirSnapshot);
+
+    char error[1024 * 4];
+
+    if (!fileSnapshotSave(self->snapshot, self->path, error, sizeof(error)))
+    {
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+    }
+}
+
+/*
+================================================================================
+ * ~~ [ search ] ~~ *
+--------------------------------------------------------------------------------
+*/
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+/* Literal substring search for `Path.search`. One needle uses an SSE2 scan that matches its
+ * first and last bytes 16 positions at a time and verifies candidates; several needles use a
+ * bitmap of their first two bytes, so most positions are rejected with one lookup.
+ * Case folding (when ignoring case) is ASCII only.
+ */
+typedef struct file_Searcher
+{
+    std::vector<std::string> needles; // Folded if `ignore_case`.
+    bool ignore_case;
+
+    std::vector<unsigned long long> pairs; // 64K bits, indexed by the first two (folded) bytes.
+    std::vector<unsigned int> by_first[256]; // Needle indices by first byte.
+    std::vector<unsigned char> firsts; // The distinct first bytes.
+}
+file_Searcher;
+
+typedef struct file_SearchHit
+{
+    size_t offset;
+    unsigned int needle;
+}
+file_SearchHit;
+
+static inline unsigned char fileFold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c | 0x20) : c;
+}
+
+static void fileSearcherInit(file_Searcher* searcher, const std::vector<std::string>& needles, bool ignore_case)
+{
+    searcher->ignore_case = ignore_case;
+    searcher->needles = needles;
+    searcher->pairs.assign(65536 / 64, 0);
+
+    for (unsigned int i = 0; i < needles.size(); i++)
+    {
+        std::string& needle = searcher->needles[i];
+
+        if (ignore_case)
+        {
+            std::transform(needle.begin(), needle.end(), needle.begin(), [](char c) { return (char)fileFold((unsigned char)c); });
+        }
+
+        const unsigned char a = (unsigned char)needle[0];
+
+        if (searcher->by_first[a].empty())
+        {
+            searcher->firsts.push_back(a);
+        }
+
+        searcher->by_first[a].push_back(i);
+
+        for (unsigned int b = 0; b < 256; b++)
+        {
+            if (needle.size() == 1 || b == (unsigned char)needle[1])
+            {
+                searcher->pairs[(a << 8 | b) >> 6] |= 1ull << ((a << 8 | b) & 63);
+            }
+        }
+    }
+}
+
+static inline bool fileSearchEqual(const char* text, const std::string& needle, bool ignore_case)
+{
+    if (!ignore_case)
+    {
+        return wrench_memcmp(text, needle.data(), needle.size()) == 0;
+    }
+
+    for (size_t i = 0; i < needle.size(); i++)
+    {
+        if (fileFold((unsigned char)text[i]) != (unsigned char)needle[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Find needles in `data`, in order of position, stopping after `max_hits` (if non-zero).
+ */
+static void fileSearchBuffer(const file_Searcher* searcher, const char* data, size_t size, size_t max_hits, std::vector<file_SearchHit>* hits)
+{
+    auto full = [&]() { return max_hits != 0 && hits->size() >= max_hits; };
+
+    if (searcher->needles.size() == 1)
+    {
+        const std::string& needle = searcher->needles[0];
+        const size_t n = needle.size();
+
+        if (n > size)
+        {
+            return;
+        }
+
+        size_t i = 0;
+
+        #if defined(__SSE2__)
+        {
+            // Letters match either case by setting their 0x20 bit; verification weeds out the
+            // other bytes this also lets through.
+            const unsigned char first = (unsigned char)needle[0], last = (unsigned char)needle[n - 1];
+            const char first_fold = (searcher->ignore_case && first >= 'a' && first <= 'z') ? 0x20 : 0;
+            const char last_fold = (searcher->ignore_case && last >= 'a' && last <= 'z') ? 0x20 : 0;
+
+            const __m128i first_bytes = _mm_set1_epi8((char)first), first_bits = _mm_set1_epi8(first_fold);
+            const __m128i last_bytes = _mm_set1_epi8((char)last), last_bits = _mm_set1_epi8(last_fold);
+
+            for (; i + n - 1 + 16 <= size; i += 16)
+            {
+                const __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i*)(data + i)), first_bits);
+                const __m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i*)(data + i + n - 1)), last_bits);
+
+                for (unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first_bytes), _mm_cmpeq_epi8(b, last_bytes)));
+                     mask != 0; mask &= mask - 1)
+                {
+                    const size_t at = i + (size_t)__builtin_ctz(mask);
+
+                    if (fileSearchEqual(data + at, needle, searcher->ignore_case))
+                    {
+                        hits->push_back({ at, 0 });
+
+                        if (full()) { return; }
+                    }
+                }
+            }
+        }
+        #endif
+
+        for (; i + n <= size; i++)
+        {
+            const unsigned char c = searcher->ignore_case ? fileFold((unsigned char)data[i]) : (unsigned char)data[i];
+
+            if (c == (unsigned char)needle[0] && fileSearchEqual(data + i, needle, searcher->ignore_case))
+            {
+                hits->push_back({ i, 0 });
+
+                if (full()) { return; }
+            }
+        }
+
+        return;
+    }
+
+    auto check = [&](size_t i) -> bool
+    {
+        const unsigned int a = searcher->ignore_case ? fileFold((unsigned char)data[i]) : (unsigned char)data[i];
+
+        for (const unsigned int k : searcher->by_first[a])
+        {
+            const std::string& needle = searcher->needles[k];
+
+            if (needle.size() <= size - i && fileSearchEqual(data + i, needle, searcher->ignore_case))
+            {
+                hits->push_back({ i, k });
+
+                if (full()) { return false; }
+            }
+        }
+
+        return true;
+    };
+
+    size_t i = 0;
+
+    #if defined(__SSE2__)
+    if (searcher->firsts.size() <= 4)
+    {
+        // Few distinct first bytes: find them 16 at a time, like the single needle scan.
+        __m128i bytes[4], bits[4];
+
+        for (size_t k = 0; k < 4; k++)
+        {
+            const unsigned char c = searcher->firsts[std::min(k, searcher->firsts.size() - 1)];
+
+            bytes[k] = _mm_set1_epi8((char)c);
+            bits[k] = _mm_set1_epi8((searcher->ignore_case && c >= 'a' && c <= 'z') ? 0x20 : 0);
+        }
+
+        for (; i + 16 <= size; i += 16)
+        {
+            const __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+            __m128i match = _mm_cmpeq_epi8(_mm_or_si128(block, bits[0]), bytes[0]);
+
+            for (size_t k = 1; k < 4; k++)
+            {
+                match = _mm_or_si128(match, _mm_cmpeq_epi8(_mm_or_si128(block, bits[k]), bytes[k]));
+            }
+
+            for (unsigned int mask = (unsigned int)_mm_movemask_epi8(match); mask != 0; mask &= mask - 1)
+            {
+                if (!check(i + (size_t)__builtin_ctz(mask)))
+                {
+                    return;
+                }
+            }
+        }
+    }
+    #endif
+
+    for (; i < size; i++)
+    {
+        const unsigned int a = searcher->ignore_case ? fileFold((unsigned char)data[i]) : (unsigned char)data[i];
+        const unsigned int b = (i + 1 == size) ? 0 : searcher->ignore_case ? fileFold((unsigned char)data[i + 1]) : (unsigned char)data[i + 1];
+
+        if ((searcher->pairs[(a << 8 | b) >> 6] >> ((a << 8 | b) & 63) & 1) != 0 && !check(i))
+        {
+            return;
+        }
+    }
+}
+
+typedef struct file_SearchResult
+{
+    std::vector<unsigned int> lines;
+    std::vector<unsigned int> columns;
+    std::vector<unsigned int> needles;
+}
+file_SearchResult;
+
+typedef struct file_SearchOptions
+{
+    bool ignore_case;
+    bool binary; // Search files with NUL bytes in their first 8 KiB too.
+    size_t max_per_file;
+    double max_size;
+}
+file_SearchOptions;
+
+static void fileSearchFile(const char* path, const file_Searcher* searcher, const file_SearchOptions* options, file_SearchResult* result)
+{
+    const char* data = NULL;
+    size_t size = 0;
+
+    #if !_WIN32
+        const int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat sb;
+
+        if (fd < 0)
+        {
+            return;
+        }
+
+        if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size == 0 || (options->max_size > 0 && (double)sb.st_size > options->max_size))
+        {
+            close(fd);
+            return;
+        }
+
+        size = (size_t)sb.st_size;
+        void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        close(fd);
+
+        if (map == MAP_FAILED)
+        {
+            return;
+        }
+
+        madvise(map, size, MADV_SEQUENTIAL);
+        data = (const char*)map;
+    #else
+        std::string contents;
+        FILE* file = fopen(path, "rb");
+
+        if (file == NULL)
+        {
+            return;
+        }
+
+        char buffer[1024 * 16];
+
+        for (size_t n; (n = fread(buffer, 1, sizeof(buffer), file)) != 0; )
+        {
+            contents.append(buffer, n);
+
+            if (options->max_size > 0 && (double)contents.size() > options->max_size)
+            {
+                contents.clear();
+                break;
+            }
+        }
+
+        fclose(file);
+
+        data = contents.data();
+        size = contents.size();
+    #endif
+
+    std::vector<file_SearchHit> hits;
+
+    if (options->binary || wrench_memchr(data, '\0', std::min<size_t>(size, 8192)) == NULL)
+    {
+        fileSearchBuffer(searcher, data, size, options->max_per_file, &hits);
+    }
+
+    // Hits are in order, so lines are counted in one pass.
+    unsigned int line = 1;
+    size_t line_start = 0, counted = 0;
+
+    for (const file_SearchHit& hit : hits)
+    {
+        for (const char* p; counted < hit.offset && (p = (const char*)wrench_memchr(data + counted, '\n', hit.offset - counted)) != NULL; )
+        {
+            line++;
+            counted = line_start = (size_t)(p - data) + 1;
+        }
+
+        counted = hit.offset;
+
+        result->lines.push_back(line);
+        result->columns.push_back((unsigned int)(hit.offset - line_start + 1));
+        result->needles.push_back(hit.needle);
+    }
+
+    #if !_WIN32
+        munmap((void*)data, size);
+    #endif
+}
+
+/* Read an option from the map in `options_slot` into `value_slot`. Returns false if the
+ * options aren't a map or don't have a non-null value for `key`.
+ */
+static bool fileGetOption(WrenVM* vm, int options_slot, const char* key, int value_slot)
+{
+    if (wrenGetSlotType(vm, options_slot) != WREN_TYPE_MAP)
+    {
+        return false;
+    }
+
+    wrenSetSlotString(vm, value_slot, key);
+
+    if (!wrenGetMapContainsKey(vm, options_slot, value_slot))
+    {
+        return false;
+    }
+
+    wrenGetMapValue(vm, options_slot, value_slot, value_slot);
+    return wrenGetSlotType(vm, value_slot) != WREN_TYPE_NULL;
+}
+
+/* Read a String or a List of Strings from `slot`.
+ */
+static bool fileGetSlotStrings(WrenVM* vm, int slot, int scratch, std::vector<std::string>* out)
+{
+    if (wrenGetSlotType(vm, slot) == WREN_TYPE_STRING)
+    {
+        int length;
+        const char* s = wrenGetSlotBytes(vm, slot, &length);
+
+        out->emplace_back(s, (size_t)length);
+        return true;
+    }
+
+    if (wrenGetSlotType(vm, slot) != WREN_TYPE_LIST)
+    {
+        return false;
+    }
+
+    for (int i = 0, count = wrenGetListCount(vm, slot); i < count; i++)
+    {
+        wrenGetListElement(vm, slot, i, scratch);
+
+        if (wrenGetSlotType(vm, scratch) != WREN_TYPE_STRING)
+        {
+            return false;
+        }
+
+        int length;
+        const char* s = wrenGetSlotBytes(vm, scratch, &length);
+
+        out->emplace_back(s, (size_t)length);
+    }
+
+    return true;
+}
+
+/* Search every file under `root` for one or more literal strings, returning the hits as
+ * [paths, lines, columns, needles] (1-based lines and byte columns, and the index of the
+ * needle that matched). Options: "threads" (0 = one per core), "ignoreCase", "include" and
+ * "exclude" (globs, see file_Filter), "binary" (search files that look binary too),
+ * "maxPerFile" (stop after this many hits in a file, e.g. 1 to just find files) and
+ * "maxSize" (skip larger files).
+ */
+static void file_Path_search(WrenVM* vm)
+{
+    std::string root = wrenGetSlotString(vm, 1);
+    std::vector<std::string> needles;
+
+    wrenEnsureSlots(vm, 9);
+
+    if (!fileGetSlotStrings(vm, 2, 4, &needles) || needles.empty() ||
+        std::any_of(needles.begin(), needles.end(), [](const std::string& needle) { return needle.empty(); }))
+    {
+        wrenSetSlotString(vm, 0, "Path.search expects a non-empty String or List of them");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    file_SearchOptions options = {};
+    file_Filter filter;
+    int num_threads = 0;
+
+    if (fileGetOption(vm, 3, "threads", 4)) { num_threads = wrenGetSlotInt(vm, 4); }
+    if (fileGetOption(vm, 3, "ignoreCase", 4)) { options.ignore_case = wrenGetSlotBool(vm, 4); }
+    if (fileGetOption(vm, 3, "binary", 4)) { options.binary = wrenGetSlotBool(vm, 4); }
+    if (fileGetOption(vm, 3, "maxPerFile", 4)) { options.max_per_file = (size_t)std::max(0.0, wrenGetSlotDouble(vm, 4)); }
+    if (fileGetOption(vm, 3, "maxSize", 4)) { options.max_size = wrenGetSlotDouble(vm, 4); }
+
+    if ((fileGetOption(vm, 3, "include", 4) && !fileGetSlotStrings(vm, 4, 5, &filter.include)) ||
+        (fileGetOption(vm, 3, "exclude", 4) && !fileGetSlotStrings(vm, 4, 5, &filter.exclude)))
+    {
+        wrenSetSlotString(vm, 0, "Path.search filters must be a String or List of globs");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    if (root.empty() || (root.back() != '/' && root.back() != '\\'))
+    {
+        root += '/';
+    }
+
+    filter.root_size = root.size();
+    file_Entries entries;
+
+    if (!fileWalk(root, true, false, false, &entries, &filter))
+    {
+        char error[1024 * 4];
+        wrench_snprintf(error, sizeof(error), "failed to open directory \"%s\"", wrenGetSlotString(vm, 1));
+
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    file_Searcher searcher;
+    fileSearcherInit(&searcher, needles, options.ignore_case);
+
+    std::vector<file_SearchResult> results(entries.paths.size());
+
+    fileParallelFor(entries.paths.size(), num_threads, [&](size_t i)
+    {
+        fileSearchFile(entries.paths[i].c_str(), &searcher, &options, &results[i]);
+    });
+
+    wrenSetSlotNewList(vm, 1);
+    wrenSetSlotNewList(vm, 2);
+    wrenSetSlotNewList(vm, 3);
+    wrenSetSlotNewList(vm, 4);
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const file_SearchResult& result = results[i];
+
+        if (result.lines.empty())
+        {
+            continue;
+        }
+
+        wrenSetSlotString(vm, 5, entries.paths[i].c_str());
+
+        for (size_t k = 0; k < result.lines.size(); k++)
+        {
+            wrenInsertInList(vm, 1, -1, 5);
+
+            wrenSetSlotDouble(vm, 6, result.lines[k]);
+            wrenInsertInList(vm, 2, -1, 6);
+
+            wrenSetSlotDouble(vm, 6, result.columns[k]);
+            wrenInsertInList(vm, 3, -1, 6);
+
+            wrenSetSlotDouble(vm, 6, result.needles[k]);
+            wrenInsertInList(vm, 4, -1, 6);
+        }
+    }
+
+    wrenSetSlotNewList(vm, 0);
+
+    for (int i = 1; i <= 4; i++)
+    {
+        wrenInsertInList(vm, 0, -1, i);
+    }
+}
+
+/*
+================================================================================
+ * ~~ [ file ] ~~ *
+--------------------------------------------------------------------------------
+*/
+
+/* Page cache hints for `File.open` and `File.openPrefetched`, given as a string of words.
+ * "sequential" and "noreuse" go to posix_fadvise when the file is opened. "dontneed" drops
+ * pages behind the file position as it's read or written, so a one-pass scan over a huge
+ * file doesn't evict the working set of everything else on the machine. "direct" bypasses
+ * the page cache entirely (O_DIRECT); stdio can't guarantee aligned transfers, so it's only
+ * accepted by `openPrefetched`, whose ring buffers are page aligned.
+ */
+enum
+{
+    FILE_HINT_SEQUENTIAL = 1 << 0,
+    FILE_HINT_NOREUSE = 1 << 1,
+    FILE_HINT_DONTNEED = 1 << 2,
+    FILE_HINT_DIRECT = 1 << 3,
+};
+
+#ifndef FILE_DONTNEED_WINDOW
+#define FILE_DONTNEED_WINDOW (8 * 1024 * 1024)
+#endif
+
+static bool fileParseHints(const char* hints, int* flags, char* error, size_t error_size)
+{
+    static const struct { const char* name; int flag; } names[] =
+    {
+        { "sequential", FILE_HINT_SEQUENTIAL },
+        { "noreuse", FILE_HINT_NOREUSE },
+        { "dontneed", FILE_HINT_DONTNEED },
+        { "direct", FILE_HINT_DIRECT },
+    };
+
+    *flags = 0;
+
+    for (const char* s = hints; *s != '\0'; )
+    {
+        if (*s == ' ' || *s == ',')
+        {
+            s++;
+            continue;
+        }
+
+        const size_t n = strcspn(s, " ,");
+        size_t i = 0;
+
+        while (i < WRENCH_ARRAY_COUNT(names) && (strlen(names[i].name) != n || wrench_memcmp(names[i].name, s, n) != 0))
+        {
+            i++;
+        }
+
+        if (i == WRENCH_ARRAY_COUNT(names))
+        {
+            wrench_snprintf(error, error_size, "unknown file hint \"%.*s\" (expected sequential, noreuse, dontneed or direct)", (int)n, s);
+            return false;
+        }
+
+        *flags |= names[i].flag;
+        s += n;
+    }
+
+    return true;
+}
+
+#if !_WIN32
+    static void fileAdviseOpen(int fd, int hints)
+    {
+        #if defined(POSIX_FADV_SEQUENTIAL)
+            if (hints & FILE_HINT_SEQUENTIAL) { posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL); }
+            if (hints & FILE_HINT_NOREUSE) { posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE); }
+        #endif
+    }
+
+    /* Evict the cached pages of [start, end), or to the end of the file if `end` is negative.
+     * Dirty pages can't be dropped, so written ranges are pushed to disk first. The kernel skips
+     * large folios straddling the edges of the range, so it reaches back over the previous one.
+     */
+    static void fileDropCache(int fd, long long start, long long end, bool written)
+    {
+        #if defined(POSIX_FADV_DONTNEED)
+            start = std::max(0LL, start - (2LL << 20));
+            const long long length = (end < 0) ? 0 : (end & ~4095LL) - start;
+
+            if (end >= 0 && length <= 0)
+            {
+                return;
+            }
+
+            if (written)
+            {
+                #if __linux__
+                    sync_file_range(fd, start, length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+                #else
+                    fdatasync(fd);
+                #endif
+            }
+
+            posix_fadvise(fd, start, length, POSIX_FADV_DONTNEED);
+        #endif
+    }
+#endif
+
+/* Read-ahead for sequential scans (`File.openPrefetched`). A reader thread fills a ring of
+ * `depth` aligned chunks while the VM consumes them, so I/O and compute overlap. The read
+ * methods slice directly out of the ring; stalls are counted on both sides so `depth` can be
+ * tuned (consumer stalls: the disk is too slow; producer stalls: the ring is full).
+ */
+typedef struct file_Prefetch
+{
+    #if _WIN32
+        FILE* file; // Only touched by the reader thread.
+    #else
+        int fd;
+    #endif
+
+    std::thread thread;
+
+    std::mutex lock;
+    std::condition_variable filled;
+    std::condition_variable drained;
+
+    char* buffers;
+    size_t chunk_size;
+    size_t depth;
+    std::vector<size_t> lengths;
+
+    int hints;
+    bool direct; // Whether O_DIRECT (or F_NOCACHE) actually took.
+    unsigned long long cache_mark; // Pages before this offset have been dropped ("dontneed").
+
+    // Guarded by `lock`.
+    unsigned long long produced;
+    unsigned long long consumed;
+    unsigned long long producer_stalls;
+    unsigned long long bytes;
+    int error;
+    bool done;
+    bool quit;
+
+    // Consumer side (VM thread only).
+    const char* data;
+    size_t length;
+    size_t offset;
+    unsigned long long chunk_offset; // Position of `data` in the file.
+    bool has_chunk;
+    bool eof; // Like feof(): set once a read runs off the end.
+    unsigned long long consumer_stalls;
+}
+file_Prefetch;
+
+static void filePrefetchReader(file_Prefetch* p)
+{
+    for (;;)
+    {
+        size_t slot;
+        {
+            std::unique_lock<std::mutex> lock{p->lock};
+
+            while (p->produced - p->consumed >= p->depth && !p->quit)
+            {
+                p->producer_stalls++;
+                p->drained.wait(lock);
+            }
+
+            if (p->quit)
+            {
+                return;
+            }
+
+            slot = (size_t)(p->produced % p->depth);
+        }
+
+        char* buffer = p->buffers + slot * p->chunk_size;
+        size_t n = 0;
+        int error = 0;
+
+        while (n < p->chunk_size)
+        {
+            #if _WIN32
+                const size_t got = fread(buffer + n, 1, p->chunk_size - n, p->file);
+
+                if (got == 0)
+                {
+                    error = ferror(p->file) ? errno : 0;
+                    break;
+                }
+            #else
+                const ssize_t got = read(p->fd, buffer + n, p->chunk_size - n);
+
+                if (got < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+
+                if (got <= 0)
+                {
+                    error = (got < 0) ? errno : 0;
+                    break;
+                }
+            #endif
+
+            n += (size_t)got;
+
+            if (p->direct && (n & 4095) != 0)
+            {
+                break; // A short direct read is the end of the file (and the offset is now unaligned).
+            }
+        }
+
+        std::lock_guard<std::mutex> lock{p->lock};
+
+        if (n > 0)
+        {
+            p->lengths[slot] = n;
+            p->produced++;
+            p->bytes += n;
+        }
+
+        if (n < p->chunk_size)
+        {
+            p->error = error;
+            p->done = true;
+        }
+
+        p->filled.notify_one();
+
+        if (p->done)
+        {
+            return;
+        }
+    }
+}
+
+static file_Prefetch* filePrefetchOpen(const char* path, size_t chunk_size, size_t depth, int hints)
+{
+    bool direct = false;
+
+    #if _WIN32
+        FILE* file = fopen(path, "rb");
+
+        if (file == NULL)
+        {
+            return NULL;
+        }
+
+        setvbuf(file, NULL, _IONBF, 0); // The ring is the buffer.
+    #else
+        int fd = -1;
+
+        #if defined(O_DIRECT)
+            if (hints & FILE_HINT_DIRECT)
+            {
+                fd = open(path, O_RDONLY | O_CLOEXEC | O_DIRECT);
+                direct = (fd >= 0);
+            }
+        #endif
+
+        if (fd < 0)
+        {
+            fd = open(path, O_RDONLY | O_CLOEXEC); // Some filesystems (tmpfs) refuse O_DIRECT.
+        }
+
+        if (fd < 0)
+        {
+            return NULL;
+        }
+
+        #if !defined(O_DIRECT) && defined(F_NOCACHE)
+            if (hints & FILE_HINT_DIRECT)
+            {
+                direct = (fcntl(fd, F_NOCACHE, 1) != -1);
+            }
+        #endif
+
+        fileAdviseOpen(fd, hints);
+    #endif
+
+    // Page aligned, so chunks line up with the page cache and satisfy O_DIRECT.
+    chunk_size = (std::max<size_t>(chunk_size, 4096) + 4095) & ~(size_t)4095;
+    depth = std::max<size_t>(depth, 2);
+
+    file_Prefetch* p = new file_Prefetch();
+
+    #if _WIN32
+        p->buffers = (char*)_aligned_malloc(chunk_size * depth, 4096);
+    #else
+        if (posix_memalign((void**)&p->buffers, 4096, chunk_size * depth) != 0) { p->buffers = NULL; }
+    #endif
+
+    if (p->buffers == NULL)
+    {
+        #if _WIN32
+            fclose(file);
+        #else
+            close(fd);
+        #endif
+
+        delete p;
+
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    #if _WIN32
+        p->file = file;
+    #else
+        p->fd = fd;
+    #endif
+
+    p->chunk_size = chunk_size;
+    p->depth = depth;
+    p->lengths.resize(depth);
+    p->hints = hints;
+    p->direct = direct;
+
+    p->thread = std::thread(filePrefetchReader, p);
+    return p;
+}
+
+static void filePrefetchClose(file_Prefetch* p)
+{
+    {
+        std::lock_guard<std::mutex> lock{p->lock};
+        p->quit = true;
+    }
+
+    p->drained.notify_one();
+    p->thread.join();
+
+    #if _WIN32
+        fclose(p->file);
+    #else
+        close(p->fd);
+    #endif
+
+    #if _WIN32
+        _aligned_free(p->buffers);
+    #else
+        free(p->buffers);
+    #endif
+
+    delete p;
+}
+
+/* Make sure unread bytes are available at `p->data + p->offset`, moving to the next chunk
+ * (and waiting for the reader if it's behind). Returns false at the end of the file.
+ */
+static bool filePrefetchAvailable(file_Prefetch* p)
+{
+    if (p->offset < p->length)
+    {
+        return true;
+    }
+
+    #if !_WIN32
+        if (p->has_chunk && (p->hints & FILE_HINT_DONTNEED) && !p->direct &&
+            p->chunk_offset + p->length - p->cache_mark >= FILE_DONTNEED_WINDOW)
+        {
+            fileDropCache(p->fd, (long long)p->cache_mark, (long long)(p->chunk_offset + p->length), false);
+            p->cache_mark = (p->chunk_offset + p->length) & ~4095ULL;
+        }
+    #endif
+
+    std::unique_lock<std::mutex> lock{p->lock};
+
+    if (p->has_chunk)
+    {
+        p->consumed++;
+        p->chunk_offset += p->length;
+        p->has_chunk = false;
+
+        p->drained.notify_one();
+    }
+
+    if (p->produced == p->consumed && !p->done)
+    {
+        p->consumer_stalls++;
+        p->filled.wait(lock, [p] { return p->produced != p->consumed || p->done; });
+    }
+
+    if (p->produced == p->consumed)
+    {
+        #if !_WIN32
+            if ((p->hints & FILE_HINT_DONTNEED) && !p->direct && !p->eof)
+            {
+                fileDropCache(p->fd, (long long)p->cache_mark, -1, false);
+            }
+        #endif
+
+        p->eof = true;
+        return false;
+    }
+
+    const size_t slot = (size_t)(p->consumed % p->depth);
+
+    p->data = p->buffers + slot * p->chunk_size;
+    p->length = p->lengths[slot];
+    p->offset = 0;
+    p->has_chunk = true;
+
+    return true;
+}
+
+/* Raise the reader thread's error, if any, once the consumer has reached the end.
+ */
+static bool filePrefetchFailed(WrenVM* vm, file_Prefetch* p)
+{
+    if (!p->eof || p->error == 0)
+    {
+        return false;
+    }
+
+    char error[1024];
+    wrench_snprintf(error, sizeof(error), "failed to read prefetched file: %s", strerror(p->error));
+
+    wrenSetSlotString(vm, 0, (const char*)error);
+    wrenAbortFiber(vm, 0);
+
+    return true;
+}
+
+static file_File* fileNewFile(WrenVM* vm, FILE* file)
+{
+    file_File* data = (file_File*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(file_File));
+    wrench_memset(data, 0, sizeof(file_File));
+
+    WRENCH_SET_MAGIC_TAG(data, file, File);
+    data->file = file;
+
+    return data;
+}
+
+/* Drop pages behind the position of a file opened with the "dontneed" hint, once it has moved
+ * a whole window past the last drop.
+ */
+static void fileDropBehind(file_File* self, bool written, bool closing)
+{
+    #if !_WIN32
+        if (!(self->hints & FILE_HINT_DONTNEED) || self->file == NULL)
+        {
+            return;
+        }
+
+        const long long position = ftello(self->file);
+
+        if (!closing && (position < 0 || position - self->cache_mark < FILE_DONTNEED_WINDOW))
+        {
+            return;
+        }
+
+        if (written)
+        {
+            fflush(self->file);
+        }
+
+        fileDropCache(fileno(self->file), self->cache_mark, closing ? -1 : position, written);
+
+        if (position >= 0)
+        {
+            self->cache_mark = position & ~4095LL;
+        }
+    #endif
+}
+
+static int fileCloseFile(file_File* self)
+{
+    if (self->prefetch != NULL)
+    {
+        filePrefetchClose(self->prefetch);
+        self->prefetch = NULL;
+
+        return 0;
+    }
+
+    if (self->file == NULL || self->file == stdout || self->file == stderr || self->file == stdin)
+    {
+        return 0;
+    }
+
+    fileDropBehind(self, true, true);
+
+    FILE* file = self->file;
+    self->file = NULL; // The finalizer must not close it again.
+
+    return fclose(file);
+}
+
+/* Returns the file from slot 0, aborting the fiber if it was closed.
+ */
+static file_File* fileGetOpenFile(WrenVM* vm)
+{
+    file_File* self = (file_File*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, File);
+
+    if (self->file == NULL && self->prefetch == NULL)
+    {
+        wrenSetSlotString(vm, 0, "File is closed.");
+        wrenAbortFiber(vm, 0);
+
+        return NULL;
+    }
+
+    return self;
+}
+
+static void file_File_ctor(WrenVM* vm)
+{
+    WRENCH_STUB();
+}
+
+static void file_File_dtor(void* data)
+{
+    WRENCH_CHECK_MAGIC_TAG(data, file, File);
+    fileCloseFile((file_File*)data);
+}
+
+static void file_File_open(WrenVM* vm)
+{
+    const char* path = wrenGetSlotString(vm, 1);
+    const char* mode = wrenGetSlotString(vm, 2);
+
+    char error[1024];
+    int hints;
+
+    if (!fileParseHints(wrenGetSlotString(vm, 3), &hints, error, sizeof(error)))
+    {
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    if (hints & FILE_HINT_DIRECT)
+    {
+        wrenSetSlotString(vm, 0, "the \"direct\" hint is only supported by File.openPrefetched");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    FILE* file = fopen(path, mode);
+
+    if (file != NULL)
+    {
+        #if !_WIN32
+            fileAdviseOpen(fileno(file), hints);
+        #endif
+
+        fileNewFile(vm, file)->hints = hints;
+    }
+    else
+    {
+        wrench_snprintf(error, sizeof(error), "failed to open file \"%s\" with mode \"%s\"", path, mode);
+
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+    }
+}
+
+static void file_File_openPrefetched(WrenVM* vm)
+{
+    const char* path = wrenGetSlotString(vm, 1);
+    const double chunk_size = wrenGetSlotDouble(vm, 2);
+    const int depth = wrenGetSlotInt(vm, 3);
+
+    char error[1024];
+    int hints;
+
+    if (!fileParseHints(wrenGetSlotString(vm, 4), &hints, error, sizeof(error)))
+    {
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    file_Prefetch* prefetch = filePrefetchOpen(path, chunk_size > 0 ? (size_t)chunk_size : 0, depth > 0 ? (size_t)depth : 0, hints);
+
+    if (prefetch != NULL)
+    {
+        file_File* data = fileNewFile(vm, NULL);
+
+        data->prefetch = prefetch;
+        data->hints = hints;
+    }
+    else
+    {
+        wrench_snprintf(error, sizeof(error), "failed to open file \"%s\" for prefetched reading: %s", path, strerror(errno));
+
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+    }
+}
+
+static void file_File_close(WrenVM* vm)
+{
+    file_File* self = (file_File*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, File);
+
+    if (fileCloseFile(self) != 0)
+    {
+        /* TODO: Keep/copy the name and mode of the file.
+         */
+        wrenSetSlotString(vm, 0, "failed to close file");
+        wrenAbortFiber(vm, 0);
+    }
+}
+
+static void file_File_stdout(WrenVM* vm)
+{
+    fileNewFile(vm, stdout);
+}
+
+static void file_File_stderr(WrenVM* vm)
+{
+    fileNewFile(vm, stderr);
+}
+
+static void file_File_stdin(WrenVM* vm)
+{
+    fileNewFile(vm, stdin);
+}
+
+static void file_File_getc(WrenVM* vm)
+{
+    file_File* self = fileGetOpenFile(vm);
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    if (self->prefetch != NULL)
+    {
+        file_Prefetch* p = self->prefetch;
+
+        if (filePrefetchAvailable(p))
+        {
+            wrenSetSlotInt(vm, 0, (unsigned char)p->data[p->offset++]);
+        }
+        else if (!filePrefetchFailed(vm, p))
+        {
+            wrenSetSlotInt(vm, 0, EOF);
+        }
+
+        return;
+    }
+
+    wrenSetSlotInt(vm, 0, getc(self->file));
+}
+
+static void file_File_putc(WrenVM* vm)
+{
+    file_File* self = fileGetOpenFile(vm);
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    if (self->prefetch != NULL)
+    {
+        wrenSetSlotString(vm, 0, "Prefetched files are read-only.");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    if (self->file == stdout || self->file == stderr)
+    {
+        wrenFlushOutput(vm); // Keep order with buffered `System.print` output.
+    }
+
+    switch (wrenGetSlotType(vm, 1))
+    {
+        case WREN_TYPE_NUM:
+        {
+            wrenSetSlotInt(vm, 0, putc(wrenGetSlotInt(vm, 1), self->file));
+        }
+        break;
+
+        case WREN_TYPE_STRING:
+        {
+            const char* s = wrenGetSlotString(vm, 1);
+
+            if (s[0] != '\0')
+            {
+                wrench_assert(s[1] == '\0', "multi-char string \"%s\"", s);
+                wrenSetSlotInt(vm, 0, putc(s[0], self->file));
+            }
+            else
+            {
+                wrenSetSlotInt(vm, 0, 0);
+            }
+        }
+        break;
+
+        default:
+        {
+            wrenSetSlotString(vm, 0, "Invalid type for arg 1 of File.putc");
+            wrenAbortFiber(vm, 0);
+        }
+        break;
+    }
+}
+
+static void file_File_EOF(WrenVM* vm)
+{
+    wrenSetSlotInt(vm, 0, EOF);
+}
+
+static void file_File_eof(WrenVM* vm)
+{
+    file_File* self = fileGetOpenFile(vm);
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    wrenSetSlotBool(vm, 0, (self->prefetch != NULL) ? self->prefetch->eof : feof(self->file) != 0);
+}
+
+static void file_File_read(WrenVM* vm)
+{
+    file_File* self = fileGetOpenFile(vm);
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    const double count_arg = wrenGetSlotDouble(vm, 1);
+    const size_t count = (count_arg <= 0) ? 0 : (count_arg >= (double)SIZE_MAX) ? SIZE_MAX : (size_t)count_arg;
+
+    std::string out;
+
+    if (self->prefetch != NULL)
+    {
+        file_Prefetch* p = self->prefetch;
+
+        if (count > 0 && filePrefetchAvailable(p) && p->length - p->offset >= count)
+        {
+            wrenSetSlotBytes(vm, 0, p->data + p->offset, count); // Straight out of the ring.
+            p->offset += count;
+
+            return;
+        }
+
+        while (out.size() < count && filePrefetchAvailable(p))
+        {
+            const size_t n = std::min(count - out.size(), p->length - p->offset);
+
+            out.append(p->data + p->offset, n);
+            p->offset += n;
+        }
+
+        if (filePrefetchFailed(vm, p))
+        {
+            return;
+        }
+    }
+    else
+    {
+        char buffer[1024 * 16];
+
+        while (out.size() < count)
+        {
+            const size_t n = fread(buffer, 1, std::min(sizeof(buffer), count - out.size()), self->file);
+
+            if (n == 0)
+            {
+                break;
+            }
+
+            out.append(buffer, n);
+        }
+
+        fileDropBehind(self, false, false);
+    }
+
+    wrenSetSlotBytes(vm, 0, out.data(), out.size());
+}
+
+/* Fill a buffer from the file, returning the number of bytes read (less than its size at the
+ * end of the file).
+ */
+static void file_File_readInto_(WrenVM* vm)
+{
+    file_File* self = fileGetOpenFile(vm);
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    size_t size;
+    char* data = (char*)wrenGetSlotBuffer(vm, 1, &size, NULL);
+
+    if (data == NULL)
+    {
+        wrenSetSlotString(vm, 0, "File.readInto expects a Buffer.");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    size_t done = 0;
+
+    if (self->prefetch != NULL)
+    {
+        file_Prefetch* p = self->prefetch;
+
+        while (done < size && filePrefetchAvailable(p))
+        {
+            const size_t n = std::min(size - done, p->length - p->offset);
+
+            wrench_memcpy(data + done, p->data + p->offset, n);
+            p->offset += n;
+            done += n;
+        }
+
+        if (filePrefetchFailed(vm, p))
+        {
+            return;
+        }
+    }
+    else
+    {
+        while (done < size)
+        {
+            const size_t n = fread(data + done, 1, size - done, self->file);
+
+            if (n == 0)
+            {
+                break;
+            }
+
+            done += n;
+        }
+
+        fileDropBehind(self, false, false);
+    }
+
+    wrenSetSlotDouble(vm, 0, (double)done);
+}
+
+static void file_File_readLine(WrenVM* vm)
+{
+    file_File* self = fileGetOpenFile(vm);
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    const bool strip_newlines = wrenGetSlotBool(vm, 1);
+    std::string line;
+
+    if (self->prefetch != NULL)
+    {
+        file_Prefetch* p = self->prefetch;
+
+        while (filePrefetchAvailable(p))
+        {
+            const char* start = p->data + p->offset;
+            const char* newline = (const char*)wrench_memchr(start, '\n', p->length - p->offset);
+
+            if (newline == NULL)
+            {
+                line.append(start, p->length - p->offset);
+                p->offset = p->length;
+
+                continue;
+            }
+
+            const size_t n = (size_t)(newline - start) + (strip_newlines ? 0 : 1);
+            p->offset += (size_t)(newline - start) + 1;
+
+            if (line.empty())
+            {
+                wrenSetSlotBytes(vm, 0, start, n); // Straight out of the ring.
+                return;
+            }
+
+            line.append(start, n);
+            break;
+        }
+
+        if (filePrefetchFailed(vm, p))
+        {
+            return;
+        }
+    }
+    else
+    {
+        for (int c; (c = getc(self->file)) != EOF; )
+        {
+            if (c == '\n')
+            {
+                if (!strip_newlines) { line += '\n'; }
+                break;
+            }
+
+            line += (char)c;
+        }
+
+        fileDropBehind(self, false, false);
+    }
+
+    wrenSetSlotBytes(vm, 0, line.data(), line.size());
+}
+
+static void file_File_prefetchStats(WrenVM* vm)
+{
+    file_File* self = (file_File*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, File);
+
+    file_Prefetch* p = self->prefetch;
+
+    if (p == NULL)
+    {
+        wrenSetSlotNull(vm, 0);
+        return;
+    }
+
+    double producer_stalls, bytes;
+    {
+        std::lock_guard<std::mutex> lock{p->lock};
+
+        producer_stalls = (double)p->producer_stalls;
+        bytes = (double)p->bytes;
+    }
+
+    wrenEnsureSlots(vm, 3);
+    wrenSetSlotNewMap(vm, 0);
+
+    const char* keys[] = { "consumerStalls", "producerStalls", "bytesRead", "chunkSize", "depth" };
+    const double values[] = { (double)p->consumer_stalls, producer_stalls, bytes, (double)p->chunk_size, (double)p->depth };
+
+    for (size_t i = 0; i < WRENCH_ARRAY_COUNT(keys); i++)
+    {
+        wrenSetSlotString(vm, 1, keys[i]);
+        wrenSetSlotDouble(vm, 2, values[i]);
+        wrenSetMapValue(vm, 0, 1, 2);
+    }
+
+    wrenSetSlotString(vm, 1, "direct");
+    wrenSetSlotBool(vm, 2, p->direct);
+    wrenSetMapValue(vm, 0, 1, 2);
+}
+
+/* Shared by `write` (strings) and `writeBytes` (buffers).
+ */
+static void fileWriteData(WrenVM* vm, file_File* self, const char* data, size_t length)
+{
+    if (self->prefetch != NULL)
+    {
+        wrenSetSlotString(vm, 0, "Prefetched files are read-only.");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    if (self->file == stdout || self->file == stderr)
+    {
+        wrenFlushOutput(vm); // Keep order with buffered `System.print` output.
+    }
+
+    if (fwrite(data, 1, length, self->file) != length)
+    {
+        char error[1024];
+        wrench_snprintf(error, sizeof(error), "failed to write %zu bytes to file: %s", length, strerror(errno));
+
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    fileDropBehind(self, true, false);
+}
+
+static void file_File_write(WrenVM* vm)
+{
+    file_File* self = fileGetOpenFile(vm);
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    int length;
+    const char* data = wrenGetSlotBytes(vm, 1, &length);
+
+    fileWriteData(vm, self, data, (size_t)length);
+}
+
+static void file_File_writeBytes_(WrenVM* vm)
+{
+    file_File* self = fileGetOpenFile(vm);
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    size_t size;
+    const char* data = (const char*)wrenGetSlotBuffer(vm, 1, &size, NULL);
+
+    if (data == NULL)
+    {
+        wrenSetSlotString(vm, 0, "File.writeBytes expects a Buffer.");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    fileWriteData(vm, self, data, size);
+}
+
+static void file_File_preallocate(WrenVM* vm)
+{
+    file_File* self = fileGetOpenFile(vm);
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    const double size = wrenGetSlotDouble(vm, 1);
+
+    if (self->prefetch != NULL)
+    {
+        wrenSetSlotString(vm, 0, "Prefetched files are read-only.");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    #if __linux__
+        // Reserve blocks without changing the file size, so appends don't fragment.
+        if (size > 0 && fallocate(fileno(self->file), FALLOC_FL_KEEP_SIZE, 0, (off_t)size) != 0)
+        {
+            if (errno == EOPNOTSUPP)
+            {
+                wrenSetSlotBool(vm, 0, false);
+                return;
+            }
+
+            char error[1024];
+            wrench_snprintf(error, sizeof(error), "failed to preallocate %.0f bytes: %s", size, strerror(errno));
+
+            wrenSetSlotString(vm, 0, (const char*)error);
+            wrenAbortFiber(vm, 0);
+
+            return;
+        }
+
+        wrenSetSlotBool(vm, 0, true);
+    #else
+        wrenSetSlotBool(vm, 0, false);
+    #endif
+}
+
+static void file_File_flush(WrenVM* vm)
+{
+    file_File* self = fileGetOpenFile(vm);
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    if (self->prefetch != NULL)
+    {
+        return; // Nothing to flush on a read-only file.
+    }
+
+    if (fflush(self->file) != 0)
+    {
+        /* TODO: Keep/copy the name and mode of the file.
+         */
+        wrenSetSlotString(vm, 0, "failed to flush file");
+        wrenAbortFiber(vm, 0);
+    }
+}
+
+/*
+================================================================================
+ * ~~ [ struct ] ~~ *
+--------------------------------------------------------------------------------
+*/
+
+/* Fixed-layout binary records, with Python `struct` format strings: an optional byte order
+ * ('@' native with alignment, '=' native, '<' little, '>' or '!' big endian) followed by
+ * codes with optional repeat counts - x (pad byte), c (1-byte string), b B ? h H i I l L
+ * q Q, f d, and s (a byte string of the given count). As in Python, l and L are a native
+ * long in '@' mode (8 bytes on LP64) and 4 bytes otherwise. 64-bit values become Nums, so
+ * they're exact up to 2^53.
+ */
+typedef struct file_StructField
+{
+    int offset;
+    int size; // The length of the string for 's'.
+    char code;
+}
+file_StructField;
+
+static bool fileStructCompile(const char* format, std::vector<file_StructField>& fields, int* record_size, bool* swap, char* error, size_t error_size)
+{
+    const char* codes = format;
+    const unsigned short endian_test = 1;
+    const bool little_endian = *(const unsigned char*)&endian_test == 1;
+
+    bool align = true;
+    *swap = false;
+
+    switch (*codes)
+    {
+        case '@': align = true; codes++; break;
+        case '=': align = false; codes++; break;
+        case '<': align = false; *swap = !little_endian; codes++; break;
+        case '>': case '!': align = false; *swap = little_endian; codes++; break;
+        default: break;
+    }
+
+    int offset = 0;
+    fields.clear();
+
+    for (const char* s = codes; *s != '\0'; )
+    {
+        if (*s == ' ')
+        {
+            s++;
+            continue;
+        }
+
+        int count = 1;
+
+        if (*s >= '0' && *s <= '9')
+        {
+            for (count = 0; *s >= '0' && *s <= '9'; s++)
+            {
+                count = count * 10 + (*s - '0');
+
+                if (count > (1 << 24))
+                {
+                    wrench_snprintf(error, error_size, "repeat count too large in struct format \"%s\"", format);
+                    return false;
+                }
+            }
+        }
+
+        int size;
+
+        switch (*s)
+        {
+            case 'x': case 'c': case 'b': case 'B': case '?': case 's': size = 1; break;
+            case 'h': case 'H': size = 2; break;
+            case 'i': case 'I': case 'f': size = 4; break;
+            case 'l': case 'L': size = align ? (int)sizeof(long) : 4; break;
+            case 'q': case 'Q': case 'd': size = 8; break;
+
+            default:
+            {
+                if (*s == '\0')
+                {
+                    wrench_snprintf(error, error_size, "repeat count without a code in struct format \"%s\"", format);
+                }
+                else
+                {
+                    wrench_snprintf(error, error_size, "bad code '%c' in struct format \"%s\"", *s, format);
+                }
+
+                return false;
+            }
+        }
+
+        if (align)
+        {
+            offset = (offset + size - 1) / size * size;
+        }
+
+        if (*s == 's')
+        {
+            fields.push_back({ offset, count, 's' });
+            offset += count;
+        }
+        else if (*s == 'x')
+        {
+            offset += count;
+        }
+        else for (int i = 0; i < count; i++)
+        {
+            fields.push_back({ offset, size, *s });
+            offset += size;
+        }
+
+        if (offset > (1 << 24))
+        {
+            wrench_snprintf(error, error_size, "record too large for struct format \"%s\"", format);
+            return false;
+        }
+
+        s++;
+    }
+
+    *record_size = offset;
+    return true;
+}
+
+/* The code that decides how a field is stored, with l and L resolved to their 4 or 8 byte
+ * equivalents.
+ */
+static inline char fileStructStorage(const file_StructField& field)
+{
+    switch (field.code)
+    {
+        case 'l': return field.size == 8 ? 'q' : 'i';
+        case 'L': return field.size == 8 ? 'Q' : 'I';
+        default: return field.code;
+    }
+}
+
+static inline unsigned short fileByteSwap(unsigned short v) { return (unsigned short)((v >> 8) | (v << 8)); }
+static inline unsigned int fileByteSwap(unsigned int v) { return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24); }
+static inline unsigned long long fileByteSwap(unsigned long long v) { return ((unsigned long long)fileByteSwap((unsigned int)v) << 32) | fileByteSwap((unsigned int)(v >> 32)); }
+static inline unsigned char fileByteSwap(unsigned char v) { return v; }
+
+/* Decode one field of `count` records into `out`, a column at a time so the type dispatch is
+ * out of the loop. `U` is the unsigned integer of the same size as `T`, for swapping.
+ */
+template <typename T, typename U>
+static void fileStructLoadColumn(const unsigned char* data, size_t stride, size_t count, bool swap, std::vector<double>& out)
+{
+    static_assert(sizeof(T) == sizeof(U), "mismatched swap type");
+
+    for (size_t i = 0; i < count; i++, data += stride)
+    {
+        U bits;
+        wrench_memcpy(&bits, data, sizeof(bits)); // Unaligned load.
+
+        if (swap)
+        {
+            bits = fileByteSwap(bits);
+        }
+
+        T value;
+        wrench_memcpy(&value, &bits, sizeof(value));
+
+        out.push_back((double)value);
+    }
+}
+
+typedef struct file_StructColumns
+{
+    std::vector<std::vector<double>> numbers;
+    std::vector<std::vector<std::string>> strings;
+}
+file_StructColumns;
+
+static void fileStructLoad(const file_Struct* self, const unsigned char* data, size_t count, file_StructColumns& columns)
+{
+    for (int f = 0; f < self->num_fields; f++)
+    {
+        const file_StructField& field = self->fields[f];
+        const unsigned char* base = data + field.offset;
+
+        std::vector<double>& out = columns.numbers[f];
+        const size_t stride = (size_t)self->size;
+
+        switch (fileStructStorage(field))
+        {
+            case 'b': fileStructLoadColumn<signed char, unsigned char>(base, stride, count, false, out); break;
+            case 'B': fileStructLoadColumn<unsigned char, unsigned char>(base, stride, count, false, out); break;
+            case '?': fileStructLoadColumn<unsigned char, unsigned char>(base, stride, count, false, out); break;
+            case 'h': fileStructLoadColumn<short, unsigned short>(base, stride, count, self->swap, out); break;
+            case 'H': fileStructLoadColumn<unsigned short, unsigned short>(base, stride, count, self->swap, out); break;
+            case 'i': fileStructLoadColumn<int, unsigned int>(base, stride, count, self->swap, out); break;
+            case 'I': fileStructLoadColumn<unsigned int, unsigned int>(base, stride, count, self->swap, out); break;
+            case 'q': fileStructLoadColumn<long long, unsigned long long>(base, stride, count, self->swap, out); break;
+            case 'Q': fileStructLoadColumn<unsigned long long, unsigned long long>(base, stride, count, self->swap, out); break;
+            case 'f': fileStructLoadColumn<float, unsigned int>(base, stride, count, self->swap, out); break;
+            case 'd': fileStructLoadColumn<double, unsigned long long>(base, stride, count, self->swap, out); break;
+
+            case 'c': case 's':
+            {
+                for (size_t i = 0; i < count; i++)
+                {
+                    columns.strings[f].emplace_back((const char*)base + i * stride, (size_t)field.size);
+                }
+            }
+            break;
+        }
+    }
+}
+
+static void fileStructSetSlotValue(WrenVM* vm, int slot, const file_StructField& field, const file_StructColumns& columns, int f, size_t i)
+{
+    switch (field.code)
+    {
+        case 'c': case 's':
+        {
+            const std::string& value = columns.strings[f][i];
+            wrenSetSlotBytes(vm, slot, value.data(), value.size());
+        }
+        break;
+
+        case '?': wrenSetSlotBool(vm, slot, columns.numbers[f][i] != 0); break;
+        default: wrenSetSlotDouble(vm, slot, columns.numbers[f][i]); break;
+    }
+}
+
+/* Store the value in `slot` into one field of the record at `data`.
+ */
+static bool fileStructStore(WrenVM* vm, const file_Struct* self, int f, unsigned char* data, int slot, char* error, size_t error_size)
+{
+    const file_StructField& field = self->fields[f];
+    data += field.offset;
+
+    if (field.code == 's' || field.code == 'c')
+    {
+        if (wrenGetSlotType(vm, slot) != WREN_TYPE_STRING)
+        {
+            wrench_snprintf(error, error_size, "field %d ('%c') of struct \"%s\" expects a String", f, field.code, self->format);
+            return false;
+        }
+
+        int length;
+        const char* bytes = wrenGetSlotBytes(vm, slot, &length);
+
+        if (field.code == 'c' && length != 1)
+        {
+            wrench_snprintf(error, error_size, "field %d ('c') of struct \"%s\" expects a 1-byte String", f, self->format);
+            return false;
+        }
+
+        // Truncated or zero padded, like Python.
+        wrench_memcpy(data, bytes, (size_t)std::min(length, field.size));
+        wrench_memset(data + std::min(length, field.size), 0, (size_t)(field.size - std::min(length, field.size)));
+
+        return true;
+    }
+
+    double value;
+
+    if (field.code == '?' && wrenGetSlotType(vm, slot) == WREN_TYPE_BOOL)
+    {
+        value = wrenGetSlotBool(vm, slot) ? 1 : 0;
+    }
+    else if (wrenGetSlotType(vm, slot) == WREN_TYPE_NUM)
+    {
+        value = wrenGetSlotDouble(vm, slot);
+    }
+    else
+    {
+        wrench_snprintf(error, error_size, "field %d ('%c') of struct \"%s\" expects a Num", f, field.code, self->format);
+        return false;
+    }
+
+    if (field.code == '?')
+    {
+        value = (value != 0);
+    }
+
+    const char storage = fileStructStorage(field);
+    double lo = 0, hi = 0;
+
+    switch (storage)
+    {
+        case 'b': lo = -128.0; hi = 127.0; break;
+        case 'B': case '?': lo = 0.0; hi = 255.0; break;
+        case 'h': lo = -32768.0; hi = 32767.0; break;
+        case 'H': lo = 0.0; hi = 65535.0; break;
+        case 'i': lo = -2147483648.0; hi = 2147483647.0; break;
+        case 'I': lo = 0.0; hi = 4294967295.0; break;
+        case 'q': lo = -9223372036854775808.0; hi = 9223372036854774784.0; break; // The largest doubles below 2^63 and 2^64.
+        case 'Q': lo = 0.0; hi = 18446744073709549568.0; break;
+        default: lo = -HUGE_VAL; hi = HUGE_VAL; break;
+    }
+
+    if (!(value >= lo && value <= hi)) // Also catches NaN for integer fields.
+    {
+        if (field.code != 'f' && field.code != 'd')
+        {
+            wrench_snprintf(error, error_size, "value %.17g out of range for field %d ('%c') of struct \"%s\"", value, f, field.code, self->format);
+            return false;
+        }
+    }
+
+    unsigned char bytes[8];
+
+    switch (storage)
+    {
+        case 'b': case 'B': case '?': bytes[0] = (unsigned char)(value < 0 ? (int)value : (unsigned)value); break;
+        case 'h': case 'H': { unsigned short v = (unsigned short)(value < 0 ? (int)value : (unsigned)value); if (self->swap) { v = fileByteSwap(v); } wrench_memcpy(bytes, &v, 2); } break;
+        case 'i': case 'I': { unsigned int v = (unsigned int)(value < 0 ? (long long)value : (unsigned long long)value); if (self->swap) { v = fileByteSwap(v); } wrench_memcpy(bytes, &v, 4); } break;
+        case 'q': { unsigned long long v = (unsigned long long)(long long)value; if (self->swap) { v = fileByteSwap(v); } wrench_memcpy(bytes, &v, 8); } break;
+        case 'Q': { unsigned long long v = (value >= 9223372036854775808.0) ? (unsigned long long)value : (unsigned long long)(long long)value; if (self->swap) { v = fileByteSwap(v); } wrench_memcpy(bytes, &v, 8); } break;
+        case 'f': { float x = (float)value; unsigned int v; wrench_memcpy(&v, &x, 4); if (self->swap) { v = fileByteSwap(v); } wrench_memcpy(bytes, &v, 4); } break;
+        case 'd': { unsigned long long v; wrench_memcpy(&v, &value, 8); if (self->swap) { v = fileByteSwap(v); } wrench_memcpy(bytes, &v, 8); } break;
+    }
+
+    wrench_memcpy(data, bytes, (size_t)field.size);
+    return true;
+}
+
+static void file_Struct_ctor(WrenVM* vm)
+{
+    file_Struct* self = (file_Struct*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(file_Struct));
+    wrench_memset(self, 0, sizeof(file_Struct));
+
+    WRENCH_SET_MAGIC_TAG(self, file, Struct);
+
+    const char* format = wrenGetSlotString(vm, 1);
+    std::vector<file_StructField> fields;
+
+    char error[1024];
+
+    if (!fileStructCompile(format, fields, &self->size, &self->swap, error, sizeof(error)))
+    {
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    self->format = wrench_strdup(format);
+    self->fields = (file_StructField*)wrench_malloc(sizeof(file_StructField) * std::max<size_t>(fields.size(), 1));
+    self->num_fields = (int)fields.size();
+
+    if (self->format == NULL || self->fields == NULL)
+    {
+        wrenSetSlotString(vm, 0, "Out of memory.");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    std::copy(fields.begin(), fields.end(), self->fields);
+}
+
+static void file_Struct_dtor(void* data)
+{
+    WRENCH_CHECK_MAGIC_TAG(data, file, Struct);
+    file_Struct* self = (file_Struct*)data;
+
+    wrench_free(self->fields);
+    wrench_free(self->format);
+}
+
+static void file_Struct_format(WrenVM* vm)
+{
+    file_Struct* self = (file_Struct*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, Struct);
+
+    wrenSetSlotString(vm, 0, self->format);
+}
+
+static void file_Struct_size(WrenVM* vm)
+{
+    file_Struct* self = (file_Struct*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, Struct);
+
+    wrenSetSlotDouble(vm, 0, self->size);
+}
+
+static void file_Struct_count(WrenVM* vm)
+{
+    file_Struct* self = (file_Struct*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, Struct);
+
+    wrenSetSlotDouble(vm, 0, self->num_fields);
+}
+
+static void file_Struct_unpack(WrenVM* vm)
+{
+    file_Struct* self = (file_Struct*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, Struct);
+
+    int length;
+    const char* data = wrenGetSlotBytes(vm, 1, &length);
+    const double offset = wrenGetSlotDouble(vm, 2);
+
+    if (!(offset >= 0 && offset + self->size <= length))
+    {
+        char error[1024];
+        wrench_snprintf(error, sizeof(error), "struct \"%s\" needs %d bytes at offset %.0f, but the data is %d bytes", self->format, self->size, offset, length);
+
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    file_StructColumns columns;
+    columns.numbers.resize(self->num_fields);
+    columns.strings.resize(self->num_fields);
+
+    fileStructLoad(self, (const unsigned char*)data + (size_t)offset, 1, columns);
+
+    wrenEnsureSlots(vm, 2);
+    wrenSetSlotNewList(vm, 0);
+
+    for (int f = 0; f < self->num_fields; f++)
+    {
+        fileStructSetSlotValue(vm, 1, self->fields[f], columns, f, 0);
+        wrenInsertInList(vm, 0, -1, 1);
+    }
+}
+
+/* Decode up to `count` records (all of them if negative) from a String or a File into one
+ * list per field. Files are read natively; prefetched files are decoded straight out of
+ * their ring buffers, with only records straddling two chunks copied.
+ */
+static void file_Struct_unpackAll_(WrenVM* vm)
+{
+    file_Struct* self = (file_Struct*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, Struct);
+
+    const double count_arg = wrenGetSlotDouble(vm, 2);
+    const size_t limit = (count_arg < 0) ? SIZE_MAX : (size_t)count_arg;
+    const size_t size = (size_t)self->size;
+
+    file_StructColumns columns;
+    columns.numbers.resize(self->num_fields);
+    columns.strings.resize(self->num_fields);
+
+    size_t count = 0;
+    size_t leftover = 0; // Bytes of a trailing partial record.
+
+    char error[1024];
+
+    if (size == 0)
+    {
+        wrenSetSlotString(vm, 0, "can't unpack records of zero size");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    if (wrenGetSlotType(vm, 1) == WREN_TYPE_STRING)
+    {
+        int length;
+        const char* data = wrenGetSlotBytes(vm, 1, &length);
+
+        count = std::min((size_t)length / size, limit);
+        leftover = (count == limit) ? 0 : (size_t)length % size;
+
+        fileStructLoad(self, (const unsigned char*)data, count, columns);
+    }
+    else
+    {
+        file_File* file = (file_File*)wrenGetSlotForeign(vm, 1);
+        WRENCH_CHECK_MAGIC_TAG(file, file, File);
+
+        std::vector<unsigned char> carry(size);
+        size_t carried = 0;
+
+        if (file->prefetch != NULL)
+        {
+            file_Prefetch* p = file->prefetch;
+
+            while (count < limit && filePrefetchAvailable(p))
+            {
+                if (carried > 0 || p->length - p->offset < size)
+                {
+                    const size_t n = std::min(size - carried, p->length - p->offset);
+
+                    wrench_memcpy(carry.data() + carried, p->data + p->offset, n);
+                    p->offset += n;
+
+                    if ((carried += n) == size)
+                    {
+                        fileStructLoad(self, carry.data(), 1, columns);
+
+                        carried = 0;
+                        count++;
+                    }
+
+                    continue;
+                }
+
+                const size_t n = std::min((p->length - p->offset) / size, limit - count);
+
+                fileStructLoad(self, (const unsigned char*)p->data + p->offset, n, columns);
+
+                p->offset += n * size;
+                count += n;
+            }
+
+            if (filePrefetchFailed(vm, p))
+            {
+                return;
+            }
+        }
+        else if (file->file != NULL)
+        {
+            const size_t batch = std::max<size_t>(1, (64 * 1024) / size);
+            std::vector<unsigned char> buffer(batch * size);
+
+            while (count < limit)
+            {
+                const size_t want = std::min(batch, limit - count) * size - carried;
+                const size_t got = fread(buffer.data() + carried, 1, want, file->file);
+
+                const size_t n = (carried + got) / size;
+                fileStructLoad(self, buffer.data(), n, columns);
+
+                count += n;
+                carried = (carried + got) % size;
+
+                if (carried > 0)
+                {
+                    wrench_memmove(buffer.data(), buffer.data() + n * size, carried);
+                }
+
+                if (got < want)
+                {
+                    break;
+                }
+            }
+        }
+
+        leftover = carried;
+    }
+
+    if (leftover != 0)
+    {
+        wrench_snprintf(error, sizeof(error), "%zu trailing bytes after %zu records of struct \"%s\" (%d bytes each)", leftover, count, self->format, self->size);
+
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    wrenEnsureSlots(vm, 3);
+    wrenSetSlotNewList(vm, 0);
+
+    for (int f = 0; f < self->num_fields; f++)
+    {
+        const file_StructField& field = self->fields[f];
+
+        if (field.code != 's' && field.code != 'c' && field.code != '?')
+        {
+            fileSetSlotNumList(vm, 1, 2, columns.numbers[f]);
+        }
+        else
+        {
+            wrenSetSlotNewList(vm, 1);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                fileStructSetSlotValue(vm, 2, field, columns, f, i);
+                wrenInsertInList(vm, 1, -1, 2);
+            }
+        }
+
+        wrenInsertInList(vm, 0, -1, 1);
+    }
+}
+
+static void file_Struct_pack(WrenVM* vm)
+{
+    file_Struct* self = (file_Struct*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, Struct);
+
+    char error[1024];
+
+    if (wrenGetSlotType(vm, 1) != WREN_TYPE_LIST || wrenGetListCount(vm, 1) != self->num_fields)
+    {
+        wrench_snprintf(error, sizeof(error), "struct \"%s\" packs a list of %d values", self->format, self->num_fields);
+
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    std::vector<unsigned char> record(self->size);
+    wrenEnsureSlots(vm, 3);
+
+    for (int f = 0; f < self->num_fields; f++)
+    {
+        wrenGetListElement(vm, 1, f, 2);
+
+        if (!fileStructStore(vm, self, f, record.data(), 2, error, sizeof(error)))
+        {
+            wrenSetSlotString(vm, 0, (const char*)error);
+            wrenAbortFiber(vm, 0);
+
+            return;
+        }
+    }
+
+    wrenSetSlotBytes(vm, 0, (const char*)record.data(), record.size());
+}
+
+/* The inverse of `unpackAll`: one list per field, all the same length.
+ */
+static void file_Struct_packAll(WrenVM* vm)
+{
+    file_Struct* self = (file_Struct*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, Struct);
+
+    char error[1024];
+    int count = 0;
+
+    wrenEnsureSlots(vm, 4);
+
+    bool valid = wrenGetSlotType(vm, 1) == WREN_TYPE_LIST && wrenGetListCount(vm, 1) == self->num_fields;
+
+    for (int f = 0; valid && f < self->num_fields; f++)
+    {
+        wrenGetListElement(vm, 1, f, 2);
+        valid = wrenGetSlotType(vm, 2) == WREN_TYPE_LIST && (f == 0 || wrenGetListCount(vm, 2) == count);
+
+        if (valid)
+        {
+            count = wrenGetListCount(vm, 2);
+        }
+    }
+
+    if (!valid)
+    {
+        wrench_snprintf(error, sizeof(error), "struct \"%s\" packs a list of %d equally long lists", self->format, self->num_fields);
+
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    std::vector<unsigned char> records((size_t)count * self->size);
+
+    for (int f = 0; f < self->num_fields; f++)
+    {
+        wrenGetListElement(vm, 1, f, 2);
+
+        for (int i = 0; i < count; i++)
+        {
+            wrenGetListElement(vm, 2, i, 3);
+
+            if (!fileStructStore(vm, self, f, records.data() + (size_t)i * self->size, 3, error, sizeof(error)))
+            {
+                wrenSetSlotString(vm, 0, (const char*)error);
+                wrenAbortFiber(vm, 0);
+
+                return;
+            }
+        }
+    }
+
+    wrenSetSlotBytes(vm, 0, (const char*)records.data(), records.size());
+}
+
+/*
+================================================================================
+ * ~~ [ async ] ~~ *
+--------------------------------------------------------------------------------
+*/
+
+enum
+{
+    FILE_ASYNC_OPEN,
+    FILE_ASYNC_READ,
+    FILE_ASYNC_WRITE,
+    FILE_ASYNC_STAT,
+    FILE_ASYNC_CLOSE,
+};
+
+static const char* file_async_op_names[] = { "open", "read", "write", "stat", "close" };
+
+typedef struct file_AsyncOp
+{
+    struct file_AsyncOp* next;
+    WrenHandle* fiber;
+
+    int opcode;
+    int fd;
+    int flags;
+
+    char* path;
+    char* buffer;
+    size_t length;
+    long long offset; // -1 uses (and advances) the file position.
+
+    long long result; // -errno on failure.
+    double size; // STAT result.
+
+    #if FILE_HAVE_IO_URING
+    struct statx stx;
+    #endif
+}
+file_AsyncOp;
+
+/* Per-VM async state, registered as a wrench event source. Operations go through io_uring
+ * when the kernel supports every opcode we need, and through the wrench thread pool otherwise
+ * (old kernels, seccomp sandboxes that block io_uring, non-Linux systems).
+ */
+typedef struct file_Async
+{
+    int inflight; // Submitted (or waiting for queue space) but not yet completed.
+
+    #if FILE_HAVE_IO_URING
+    int ring_fd;
+    unsigned to_submit;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe* sqes;
+
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* sq_ptr;
+    size_t sq_size;
+    void* cq_ptr;
+    size_t cq_size;
+    size_t sqes_size;
+
+    file_AsyncOp* backlog_head; // Waiting for submission queue space.
+    file_AsyncOp* backlog_tail;
+    #endif
+}
+file_Async;
+
+static void fileAsyncPush(file_AsyncOp** head, file_AsyncOp** tail, file_AsyncOp* op)
+{
+    op->next = NULL;
+
+    if (*tail != NULL) { (*tail)->next = op; } else { *head = op; }
+    *tail = op;
+}
+
+static file_AsyncOp* fileAsyncPop(file_AsyncOp** head, file_AsyncOp** tail)
+{
+    file_AsyncOp* op = *head;
+
+    if (op != NULL)
+    {
+        *head = op->next;
+        if (*head == NULL) { *tail = NULL; }
+    }
+
+    return op;
+}
+
+static void fileAsyncFreeOp(WrenVM* vm, file_AsyncOp* op)
+{
+    if (op->fiber != NULL) { wrenReleaseHandle(vm, op->fiber); }
+
+    wrench_free(op->path);
+    wrench_free(op->buffer);
+    wrench_free(op);
+}
+
+/* Translate an fopen() mode string into open() flags.
+ */
+static int fileOpenFlags(const char* mode)
+{
+    int flags;
+
+    switch (mode[0])
+    {
+        case 'w': flags = O_WRONLY | O_CREAT | O_TRUNC; break;
+        case 'a': flags = O_WRONLY | O_CREAT | O_APPEND; break;
+        default: flags = O_RDONLY; break;
+    }
+
+    for (const char* c = mode + 1; *c != '\0'; c++)
+    {
+        if (*c == '+') { flags = (flags & ~(O_RDONLY | O_WRONLY)) | O_RDWR; }
+        if (*c == 'x') { flags |= O_EXCL; }
+    }
+
+    return flags | O_CLOEXEC;
+}
+
+#if _WIN32
+
+/* pread/pwrite: a synchronous ReadFile/WriteFile at an explicit offset. An offset of -1 uses
+ * (and advances) the file position, like read/write.
+ */
+static long long fileAsyncTransfer(file_AsyncOp* op, bool write)
+{
+    const DWORD length = (DWORD)std::min<size_t>(op->length, 0x7FFFFFFF); // A short transfer is a valid result.
+
+    if (op->offset < 0)
+    {
+        return write ? _write(op->fd, op->buffer, (unsigned)length) : _read(op->fd, op->buffer, (unsigned)length);
+    }
+
+    const HANDLE handle = (HANDLE)_get_osfhandle(op->fd);
+
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    OVERLAPPED at = {};
+    at.Offset = (DWORD)((unsigned long long)op->offset & 0xFFFFFFFF);
+    at.OffsetHigh = (DWORD)((unsigned long long)op->offset >> 32);
+
+    DWORD done = 0;
+    const BOOL ok = write ? WriteFile(handle, op->buffer, length, &done, &at) : ReadFile(handle, op->buffer, length, &done, &at);
+
+    if (!ok && GetLastError() != ERROR_HANDLE_EOF)
+    {
+        errno = EIO;
+        return -1;
+    }
+
+    return (long long)done;
+}
+
+#endif /* _WIN32 */
+
+/* Blocking implementation of an operation, used by the thread pool.
+ */
+static void fileAsyncExecute(void* data)
+{
+    file_AsyncOp* op = (file_AsyncOp*)data;
+    long long r = -1;
+
+    switch (op->opcode)
+    {
+        case FILE_ASYNC_OPEN:
+        {
+            #if _WIN32
+                r = _open(op->path, op->flags | _O_BINARY, _S_IREAD | _S_IWRITE);
+            #else
+                r = open(op->path, op->flags, 0666);
+            #endif
+        }
+        break;
+
+        case FILE_ASYNC_READ:
+        {
+            #if _WIN32
+                r = fileAsyncTransfer(op, false);
+            #else
+                r = (op->offset < 0) ? read(op->fd, op->buffer, op->length) : pread(op->fd, op->buffer, op->length, (off_t)op->offset);
+            #endif
+        }
+        break;
+
+        case FILE_ASYNC_WRITE:
+        {
+            #if _WIN32
+                r = fileAsyncTransfer(op, true);
+            #else
+                r = (op->offset < 0) ? write(op->fd, op->buffer, op->length) : pwrite(op->fd, op->buffer, op->length, (off_t)op->offset);
+            #endif
+        }
+        break;
+
+        case FILE_ASYNC_STAT:
+        {
+            file_Stat st;
+            r = fileStatAt(-1, op->path, true, &st) ? 0 : -1;
+            op->size = st.size;
+        }
+        break;
+
+        case FILE_ASYNC_CLOSE:
+        {
+            #if _WIN32
+                r = _close(op->fd);
+            #else
+                r = close(op->fd);
+            #endif
+        }
+        break;
+    }
+
+    op->result = (r < 0) ? -(long long)errno : r;
+}
+
+#if FILE_HAVE_IO_URING
+
+static bool fileAsyncSetupRing(file_Async* async)
+{
+    #ifndef FILE_ASYNC_RING_ENTRIES
+    #define FILE_ASYNC_RING_ENTRIES 64
+    #endif
+    struct io_uring_params params;
+    wrench_memset(&params, 0, sizeof(params));
+
+    async->ring_fd = (int)syscall(__NR_io_uring_setup, FILE_ASYNC_RING_ENTRIES, &params);
+
+    if (async->ring_fd < 0)
+    {
+        return false;
+    }
+
+    /* Make sure every opcode we issue is supported (OPENAT/STATX/CLOSE need Linux 5.6).
+     */
+    const size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*)wrench_calloc(1, probe_size);
+
+    bool supported = probe != NULL && syscall(__NR_io_uring_register, async->ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    const int required[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_STATX, IORING_OP_CLOSE };
+
+    for (size_t i = 0; supported && i < WRENCH_ARRAY_COUNT(required); i++)
+    {
+        supported = required[i] <= probe->last_op && (probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    wrench_free(probe);
+
+    if (!supported)
+    {
+        close(async->ring_fd);
+        async->ring_fd = -1;
+
+        return false;
+    }
+
+    async->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    async->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (async->cq_size > async->sq_size) { async->sq_size = async->cq_size; }
+        async->cq_size = 0;
+    }
+
+    async->sq_ptr = mmap(NULL, async->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, async->ring_fd, IORING_OFF_SQ_RING);
+    async->cq_ptr = async->sq_ptr;
+
+    if (async->sq_ptr != MAP_FAILED && async->cq_size != 0)
+    {
+        async->cq_ptr = mmap(NULL, async->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, async->ring_fd, IORING_OFF_CQ_RING);
+    }
+
+    async->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    async->sqes = (struct io_uring_sqe*)mmap(NULL, async->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, async->ring_fd, IORING_OFF_SQES);
+
+    if (async->sq_ptr == MAP_FAILED || async->cq_ptr == MAP_FAILED || async->sqes == MAP_FAILED)
+    {
+        if (async->sqes != MAP_FAILED) { munmap(async->sqes, async->sqes_size); }
+        if (async->cq_size != 0 && async->cq_ptr != MAP_FAILED) { munmap(async->cq_ptr, async->cq_size); }
+        if (async->sq_ptr != MAP_FAILED) { munmap(async->sq_ptr, async->sq_size); }
+
+        close(async->ring_fd);
+        async->ring_fd = -1;
+
+        return false;
+    }
+
+    char* sq = (char*)async->sq_ptr;
+    char* cq = (char*)async->cq_ptr;
+
+    async->sq_head = (unsigned*)(sq + params.sq_off.head);
+    async->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    async->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    async->sq_array = (unsigned*)(sq + params.sq_off.array);
+    async->sq_entries = params.sq_entries;
+
+    async->cq_head = (unsigned*)(cq + params.cq_off.head);
+    async->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    async->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    async->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+/* Queue an SQE for `op`. Returns false if the submission queue is full.
+ */
+static bool fileAsyncPrepare(file_Async* async, file_AsyncOp* op)
+{
+    const unsigned tail = *async->sq_tail;
+    const unsigned head = __atomic_load_n(async->sq_head, __ATOMIC_ACQUIRE);
+
+    if (tail - head >= async->sq_entries)
+    {
+        return false;
+    }
+
+    const unsigned index = tail & *async->sq_mask;
+    struct io_uring_sqe* sqe = &async->sqes[index];
+
+    wrench_memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (unsigned long long)(uintptr_t)op;
+
+    switch (op->opcode)
+    {
+        case FILE_ASYNC_OPEN:
+        {
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long long)(uintptr_t)op->path;
+            sqe->len = 0666;
+            sqe->open_flags = (unsigned)op->flags;
+        }
+        break;
+
+        case FILE_ASYNC_READ:
+        case FILE_ASYNC_WRITE:
+        {
+            sqe->opcode = (op->opcode == FILE_ASYNC_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->fd = op->fd;
+            sqe->addr = (unsigned long long)(uintptr_t)op->buffer;
+            sqe->len = (unsigned)op->length; // At most INT_MAX (checked by read_, and write_ takes a String).
+            sqe->off = (unsigned long long)op->offset; // -1 means "current position".
+        }
+        break;
+
+        case FILE_ASYNC_STAT:
+        {
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long long)(uintptr_t)op->path;
+            sqe->len = STATX_SIZE;
+            sqe->off = (unsigned long long)(uintptr_t)&op->stx;
+        }
+        break;
+
+        case FILE_ASYNC_CLOSE:
+        {
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = op->fd;
+        }
+        break;
+    }
+
+    async->sq_array[index] = index;
+    __atomic_store_n(async->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    async->to_submit++;
+    return true;
+}
+
+static void fileAsyncEnter(file_Async* async, unsigned min_complete)
+{
+    const unsigned flags = (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0;
+
+    for (;;)
+    {
+        const long r = syscall(__NR_io_uring_enter, async->ring_fd, async->to_submit, min_complete, flags, NULL, 0);
+
+        if (r >= 0)
+        {
+            async->to_submit -= (unsigned)r;
+            return;
+        }
+
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            return;
+        }
+    }
+}
+
+#endif /* FILE_HAVE_IO_URING */
+
+/* Build the result of a finished operation in slot 0 and free it. Returns false on error.
+ */
+static bool fileAsyncResult(WrenVM* vm, void* data)
+{
+    file_AsyncOp* op = (file_AsyncOp*)data;
+
+    if (op->result < 0)
+    {
+        char error[1024 * 4];
+
+        wrench_snprintf(error, sizeof(error), "AsyncFile %s failed%s%s%s: %s", file_async_op_names[op->opcode],
+                    op->path != NULL ? " for \"" : "", op->path != NULL ? op->path : "", op->path != NULL ? "\"" : "",
+                                                                                        strerror((int)-op->result));
+
+        wrenSetSlotString(vm, 0, (const char*)error);
+        fileAsyncFreeOp(vm, op);
+
+        return false;
+    }
+
+    switch (op->opcode)
+    {
+        case FILE_ASYNC_OPEN:
+        case FILE_ASYNC_WRITE:
+        {
+            wrenSetSlotDouble(vm, 0, (double)op->result);
+        }
+        break;
+
+        case FILE_ASYNC_READ:
+        {
+            wrenSetSlotBytes(vm, 0, op->buffer, (size_t)op->result);
+        }
+        break;
+
+        case FILE_ASYNC_STAT:
+        {
+            wrenSetSlotDouble(vm, 0, op->size);
+        }
+        break;
+
+        case FILE_ASYNC_CLOSE:
+        {
+            wrenSetSlotNull(vm, 0);
+        }
+        break;
+    }
+
+    fileAsyncFreeOp(vm, op);
+    return true;
+}
+
+static void fileAsyncComplete(WrenVM* vm, file_AsyncOp* op)
+{
+    WrenHandle* fiber = op->fiber;
+    op->fiber = NULL;
+
+    wrenEnsureSlots(vm, 1);
+
+    const bool ok = fileAsyncResult(vm, op);
+    wrenResumeFiber(vm, fiber, !ok);
+}
+
+static int fileAsyncPoll(WrenVM* vm, int timeout_ms, void* data)
+{
+    file_Async* async = (file_Async*)data;
+
+    if (async->inflight == 0)
+    {
+        return 0;
+    }
+
+    #if FILE_HAVE_IO_URING
+    if (async->ring_fd >= 0)
+    {
+        while (async->backlog_head != NULL && fileAsyncPrepare(async, async->backlog_head))
+        {
+            fileAsyncPop(&async->backlog_head, &async->backlog_tail);
+        }
+
+        const bool empty = *async->cq_head == __atomic_load_n(async->cq_tail, __ATOMIC_ACQUIRE);
+        fileAsyncEnter(async, (empty && timeout_ms < 0) ? 1 : 0);
+
+        if (empty && timeout_ms > 0)
+        {
+            struct pollfd pfd = { async->ring_fd, POLLIN, 0 };
+            poll(&pfd, 1, timeout_ms);
+        }
+
+        /* Copy each CQE out and advance the head before resuming, since the resumed
+         * fiber may submit (and even reap) more operations.
+         */
+        for (;;)
+        {
+            const unsigned head = *async->cq_head;
+
+            if (head == __atomic_load_n(async->cq_tail, __ATOMIC_ACQUIRE))
+            {
+                break;
+            }
+
+            struct io_uring_cqe* cqe = &async->cqes[head & *async->cq_mask];
+            file_AsyncOp* op = (file_AsyncOp*)(uintptr_t)cqe->user_data;
+
+            op->result = cqe->res;
+            __atomic_store_n(async->cq_head, head + 1, __ATOMIC_RELEASE);
+
+            if (op->opcode == FILE_ASYNC_STAT && op->result >= 0)
+            {
+                op->size = (double)op->stx.stx_size;
+            }
+
+            async->inflight--;
+            fileAsyncComplete(vm, op);
+        }
+
+        return async->inflight;
+    }
+    #endif
+
+    return 0;
+}
+
+static void fileAsyncFree(WrenVM* vm, void* data)
+{
+    file_Async* async = (file_Async*)data;
+
+    #if FILE_HAVE_IO_URING
+    if (async->ring_fd >= 0)
+    {
+        /* The kernel may still be writing into buffers, so wait everything out first.
+         */
+        while (file_AsyncOp* op = fileAsyncPop(&async->backlog_head, &async->backlog_tail))
+        {
+            async->inflight--;
+            fileAsyncFreeOp(vm, op);
+        }
+
+        while (async->inflight > 0)
+        {
+            fileAsyncEnter(async, 1);
+
+            while (*async->cq_head != __atomic_load_n(async->cq_tail, __ATOMIC_ACQUIRE))
+            {
+                struct io_uring_cqe* cqe = &async->cqes[*async->cq_head & *async->cq_mask];
+                fileAsyncFreeOp(vm, (file_AsyncOp*)(uintptr_t)cqe->user_data);
+
+                __atomic_store_n(async->cq_head, *async->cq_head + 1, __ATOMIC_RELEASE);
+                async->inflight--;
+            }
+        }
+
+        munmap(async->sqes, async->sqes_size);
+        if (async->cq_size != 0) { munmap(async->cq_ptr, async->cq_size); }
+        munmap(async->sq_ptr, async->sq_size);
+
+        close(async->ring_fd);
+    }
+    #endif
+
+    delete async;
+}
+
+/* Get (creating on first use) the async state for this VM.
+ */
+static file_Async* fileAsyncGet(WrenVM* vm)
+{
+    file_Async* async = (file_Async*)wrenGetEventSourceData(vm, fileAsyncPoll);
+
+    if (async != NULL)
+    {
+        return async;
+    }
+
+    async = new file_Async();
+
+    #if FILE_HAVE_IO_URING
+    if (!fileAsyncSetupRing(async))
+    {
+        async->ring_fd = -1;
+    }
+    #endif
+
+    if (!wrenRegisterEventSource(vm, fileAsyncPoll, fileAsyncFree, async))
+    {
+        fileAsyncFree(vm, async);
+        return NULL;
+    }
+
+    return async;
+}
+
+/* Submit an operation on behalf of the fiber in `fiber_slot`. On failure, the fiber is aborted.
+ */
+static void fileAsyncSubmit(WrenVM* vm, file_AsyncOp* op, int fiber_slot)
+{
+    file_Async* async = fileAsyncGet(vm);
+
+    if (async == NULL)
+    {
+        fileAsyncFreeOp(vm, op);
+
+        wrenSetSlotString(vm, 0, wrenGetErrorString(vm));
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    #if FILE_HAVE_IO_URING
+    if (async->ring_fd >= 0)
+    {
+        op->fiber = wrenGetSlotHandle(vm, fiber_slot);
+        async->inflight++;
+
+        if (async->backlog_head != NULL || !fileAsyncPrepare(async, op))
+        {
+            fileAsyncPush(&async->backlog_head, &async->backlog_tail, op);
+        }
+
+        return; // Submitted in bulk by the next poll.
+    }
+    #endif
+
+    WrenHandle* fiber = wrenGetSlotHandle(vm, fiber_slot);
+
+    if (!wrenSubmitAsync(vm, fiber, op, fileAsyncExecute, fileAsyncResult))
+    {
+        wrenReleaseHandle(vm, fiber);
+        fileAsyncFreeOp(vm, op);
+
+        wrenSetSlotString(vm, 0, "Out of memory - failed to submit async task.");
+        wrenAbortFiber(vm, 0);
+    }
+}
+
+static file_AsyncOp* fileAsyncNewOp(WrenVM* vm, int opcode)
+{
+    file_AsyncOp* op = (file_AsyncOp*)wrench_calloc(1, sizeof(file_AsyncOp));
+
+    if (op == NULL)
+    {
+        wrenSetSlotString(vm, 0, "Out of memory - failed to allocate async operation.");
+        wrenAbortFiber(vm, 0);
+
+        return NULL;
+    }
+
+    op->opcode = opcode;
+    op->fd = -1;
+
+    return op;
+}
+
+/* Offsets are -1 (the current position) or a byte offset a double holds exactly.
+ */
+static bool fileAsyncCheckOffset(WrenVM* vm, double offset)
+{
+    if (offset >= -1.0 && offset <= 9007199254740992.0)
+    {
+        return true;
+    }
+
+    wrenSetSlotString(vm, 0, "AsyncFile expects an offset of -1 (the current position) or more.");
+    wrenAbortFiber(vm, 0);
+
+    return false;
+}
+
+static void file_AsyncFile_ctor(WrenVM* vm)
+{
+    file_AsyncFile* data = (file_AsyncFile*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(file_AsyncFile));
+    WRENCH_SET_MAGIC_TAG(data, file, AsyncFile);
+
+    data->fd = wrenGetSlotInt(vm, 1);
+}
+
+static void file_AsyncFile_dtor(void* data)
+{
+    WRENCH_CHECK_MAGIC_TAG(data, file, AsyncFile);
+
+    if (((file_AsyncFile*)data)->fd >= 0)
+    {
+        close(((file_AsyncFile*)data)->fd);
+    }
+}
+
+static void file_AsyncFile_open_(WrenVM* vm)
+{
+    file_AsyncOp* op = fileAsyncNewOp(vm, FILE_ASYNC_OPEN);
+
+    if (op != NULL)
+    {
+        op->path = wrench_strdup(wrenGetSlotString(vm, 1));
+        op->flags = fileOpenFlags(wrenGetSlotString(vm, 2));
+
+        fileAsyncSubmit(vm, op, 3);
+    }
+}
+
+static void file_AsyncFile_size_(WrenVM* vm)
+{
+    file_AsyncOp* op = fileAsyncNewOp(vm, FILE_ASYNC_STAT);
+
+    if (op != NULL)
+    {
+        op->path = wrench_strdup(wrenGetSlotString(vm, 1));
+        fileAsyncSubmit(vm, op, 2);
+    }
+}
+
+static void file_AsyncFile_read_(WrenVM* vm)
+{
+    file_AsyncFile* self = (file_AsyncFile*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, AsyncFile);
+
+    const double count = wrenGetSlotDouble(vm, 1);
+
+    // The count sizes the buffer and is handed to the kernel as an int, so check it first.
+    if (!(count >= 0.0 && count <= (double)INT_MAX))
+    {
+        wrenSetSlotString(vm, 0, "AsyncFile.read expects a count from 0 to 2147483647.");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    const double offset = wrenGetSlotDouble(vm, 2);
+
+    if (!fileAsyncCheckOffset(vm, offset))
+    {
+        return;
+    }
+
+    file_AsyncOp* op = fileAsyncNewOp(vm, FILE_ASYNC_READ);
+
+    if (op != NULL)
+    {
+        op->fd = self->fd;
+        op->length = (size_t)count;
+        op->offset = (long long)offset;
+        op->buffer = (char*)wrench_malloc(op->length + 1);
+
+        if (op->buffer == NULL)
+        {
+            fileAsyncFreeOp(vm, op);
+
+            wrenSetSlotString(vm, 0, "Out of memory - failed to allocate read buffer.");
+            wrenAbortFiber(vm, 0);
+
+            return;
+        }
+
+        fileAsyncSubmit(vm, op, 3);
+    }
+}
+
+static void file_AsyncFile_write_(WrenVM* vm)
+{
+    file_AsyncFile* self = (file_AsyncFile*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, AsyncFile);
+
+    int length;
+    const char* bytes = wrenGetSlotBytes(vm, 1, &length);
+
+    const double offset = wrenGetSlotDouble(vm, 2);
+
+    if (!fileAsyncCheckOffset(vm, offset))
+    {
+        return;
+    }
+
+    file_AsyncOp* op = fileAsyncNewOp(vm, FILE_ASYNC_WRITE);
+
+    if (op != NULL)
+    {
+        op->fd = self->fd;
+        op->length = (size_t)length;
+        op->offset = (long long)offset;
+        op->buffer = (char*)wrench_malloc(op->length + 1);
+
+        if (op->buffer == NULL)
+        {
+            fileAsyncFreeOp(vm, op);
+
+            wrenSetSlotString(vm, 0, "Out of memory - failed to allocate write buffer.");
+            wrenAbortFiber(vm, 0);
+
+            return;
+        }
+
+        wrench_memcpy(op->buffer, bytes, op->length);
+        fileAsyncSubmit(vm, op, 3);
+    }
+}
+
+static void file_AsyncFile_close_(WrenVM* vm)
+{
+    file_AsyncFile* self = (file_AsyncFile*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, AsyncFile);
+
+    file_AsyncOp* op = fileAsyncNewOp(vm, FILE_ASYNC_CLOSE);
+
+    if (op != NULL)
+    {
+        op->fd = self->fd;
+        self->fd = -1; // The finalizer must not close it again.
+
+        fileAsyncSubmit(vm, op, 1);
+    }
+}
+
+static void file_AsyncFile_fd_get(WrenVM* vm)
+{
+    file_AsyncFile* self = (file_AsyncFile*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, AsyncFile);
+
+    wrenSetSlotInt(vm, 0, self->fd);
+}
+
+/*
+================================================================================
+ * ~~ [ watch ] ~~ *
+--------------------------------------------------------------------------------
+*/
+
+typedef struct file_Watch
+{
+    std::string path; // No trailing separator.
+    bool recursive;
+
+    /* Roots (paths passed to `add`) keep an O_PATH descriptor, so that if the root itself is
+     * renamed we can find out where it went through /proc/self/fd.
+     */
+    int path_fd;
+}
+file_Watch;
+
+struct file_Watches
+{
+    std::unordered_map<int, file_Watch> by_wd;
+};
+
+/* One poll's worth of events, as parallel lists. `from` is only set for moves.
+ */
+typedef struct file_WatchEvents
+{
+    std::vector<const char*> kinds;
+    std::vector<std::string> paths;
+    std::vector<std::string> from;
+
+    void push(const char* kind, const std::string& path, const std::string& from_path = std::string())
+    {
+        // Writes usually arrive as a burst of modify events for the same file.
+        if (!kinds.empty() && kinds.back() == kind && paths.back() == path && from.back() == from_path)
+        {
+            return;
+        }
+
+        kinds.push_back(kind);
+        paths.push_back(path);
+        from.push_back(from_path);
+    }
+}
+file_WatchEvents;
+
+#if __linux__
+
+#define FILE_WATCH_MASK (IN_CREATE | IN_MODIFY | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static std::string fileWatchReportPath(const std::string& path, bool is_directory)
+{
+    return is_directory ? path + '/' : path;
+}
+
+static bool fileWatchHasPrefix(const std::string& path, const std::string& prefix)
+{
+    return path.size() >= prefix.size() && path.compare(0, prefix.size(), prefix) == 0
+                    && (path.size() == prefix.size() || path[prefix.size()] == '/');
+}
+
+/* Watch `path`, and every directory below it if `recursive`. When `events` is set (a directory
+ * appeared inside a recursive watch), entries that were created before the new watches were in
+ * place are reported as creates.
+ */
+static bool fileWatchAdd(file_Watcher* self, std::string path, bool recursive, bool root, file_WatchEvents* events)
+{
+    while (path.size() > 1 && path.back() == '/')
+    {
+        path.pop_back();
+    }
+
+    const int wd = inotify_add_watch(self->fd, path.c_str(), FILE_WATCH_MASK);
+
+    if (wd < 0)
+    {
+        return false;
+    }
 
-                "file.close()\n"
-                "return text\n"
-            "}\n"
+    file_Watch& watch = self->watches->by_wd[wd];
+
+    // Re-adding a path updates the existing watch.
+    if (watch.path.empty())
+    {
+        watch.path_fd = -1;
+    }
+
+    watch.path = path;
+    watch.recursive = watch.recursive || recursive;
+
+    if (root && watch.path_fd < 0)
+    {
+        watch.path_fd = open(path.c_str(), O_PATH | O_CLOEXEC);
+    }
+
+    file_Stat st;
+
+    if (recursive && fileStatAt(-1, path.c_str(), true, &st) && S_ISDIR((mode_t)st.mode))
+    {
+        file_Entries entries;
+        std::string walk_path = path;
+
+        fileWalk(walk_path, true, true, false, &entries);
+
+        for (size_t i = 0; i < entries.paths.size(); i++)
+        {
+            const bool is_directory = S_ISDIR((mode_t)entries.modes[i]);
+
+            if (is_directory)
+            {
+                const int sub_wd = inotify_add_watch(self->fd, entries.paths[i].c_str(), FILE_WATCH_MASK);
+
+                if (sub_wd >= 0)
+                {
+                    file_Watch& sub = self->watches->by_wd[sub_wd];
+
+                    if (sub.path.empty()) { sub.path_fd = -1; }
+
+                    sub.path = entries.paths[i];
+                    sub.recursive = true;
+                }
+            }
+
+            if (events != NULL)
+            {
+                events->push("create", fileWatchReportPath(entries.paths[i], is_directory));
+            }
+        }
+    }
+
+    return true;
+}
+
+/* Stop watching `path` and everything registered below it.
+ */
+static void fileWatchRemove(file_Watcher* self, const std::string& path)
+{
+    auto& by_wd = self->watches->by_wd;
+
+    for (auto it = by_wd.begin(); it != by_wd.end(); )
+    {
+        if (fileWatchHasPrefix(it->second.path, path))
+        {
+            inotify_rm_watch(self->fd, it->first);
+            if (it->second.path_fd >= 0) { close(it->second.path_fd); }
+
+            it = by_wd.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+/* A watched directory moved from `old_path` to `new_path`: rewrite it and everything below.
+ */
+static void fileWatchRename(file_Watcher* self, const std::string& old_path, const std::string& new_path)
+{
+    for (auto& entry : self->watches->by_wd)
+    {
+        std::string& path = entry.second.path;
+
+        if (fileWatchHasPrefix(path, old_path))
+        {
+            path = new_path + path.substr(old_path.size());
+        }
+    }
+}
+
+/* Drain every pending inotify event into `events`. Returns false on a read error.
+ */
+static bool fileWatchRead(file_Watcher* self, file_WatchEvents* events)
+{
+    alignas(struct inotify_event) char buffer[1024 * 64];
+
+    struct file_WatchMove
+    {
+        uint32_t cookie;
+        std::string path;
+        bool is_directory;
+    };
+
+    std::vector<file_WatchMove> moves; // MOVED_FROM events waiting for their MOVED_TO.
+
+    for (;;)
+    {
+        const ssize_t length = read(self->fd, buffer, sizeof(buffer));
+
+        if (length < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (length <= 0)
+        {
+            if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                return false;
+            }
+
+            break;
+        }
+
+        for (ssize_t offset = 0; offset < length; )
+        {
+            const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                events->push("overflow", std::string());
+                continue;
+            }
+
+            auto it = self->watches->by_wd.find(event->wd);
+
+            if (it == self->watches->by_wd.end())
+            {
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED)
+            {
+                if (it->second.path_fd >= 0) { close(it->second.path_fd); }
+
+                self->watches->by_wd.erase(it);
+                continue;
+            }
+
+            const file_Watch& watch = it->second;
+            const bool is_directory = (event->mask & IN_ISDIR) != 0;
+
+            std::string path = watch.path;
+
+            if (event->len > 0 && event->name[0] != '\0')
+            {
+                path += '/';
+                path += event->name;
+            }
+
+            if (event->mask & IN_CREATE)
+            {
+                events->push("create", fileWatchReportPath(path, is_directory));
+
+                if (is_directory && watch.recursive)
+                {
+                    fileWatchAdd(self, path, true, false, events);
+                }
+            }
+            else if (event->mask & IN_MODIFY)
+            {
+                events->push("modify", path);
+            }
+            else if (event->mask & IN_DELETE)
+            {
+                events->push("delete", fileWatchReportPath(path, is_directory));
+            }
+            else if (event->mask & IN_MOVED_FROM)
+            {
+                moves.push_back({ event->cookie, path, is_directory });
+            }
+            else if (event->mask & IN_MOVED_TO)
+            {
+                size_t i = 0;
+
+                while (i < moves.size() && moves[i].cookie != event->cookie) { i++; }
+
+                if (i < moves.size())
+                {
+                    events->push("move", fileWatchReportPath(path, is_directory), fileWatchReportPath(moves[i].path, is_directory));
+
+                    if (is_directory)
+                    {
+                        fileWatchRename(self, moves[i].path, path);
+                    }
+
+                    moves.erase(moves.begin() + i);
+                }
+                else
+                {
+                    // Moved in from outside the watched tree.
+                    events->push("create", fileWatchReportPath(path, is_directory));
+
+                    if (is_directory && watch.recursive)
+                    {
+                        fileWatchAdd(self, path, true, false, events);
+                    }
+                }
+            }
+            else if (event->mask & IN_DELETE_SELF)
+            {
+                if (watch.path_fd >= 0)
+                {
+                    events->push("delete", path); // Subdirectories were reported by their parent.
+                }
+            }
+            else if ((event->mask & IN_MOVE_SELF) && watch.path_fd >= 0)
+            {
+                char link[64], new_path[1024 * 4];
+                wrench_snprintf(link, sizeof(link), "/proc/self/fd/%i", watch.path_fd);
+
+                const ssize_t n = readlink(link, new_path, sizeof(new_path) - 1);
+
+                if (n > 0 && wrench_strstr(new_path, " (deleted)") == NULL)
+                {
+                    const std::string old_path = path;
+
+                    new_path[n] = '\0';
+                    fileWatchRename(self, old_path, new_path);
+
+                    file_Stat st;
+                    const bool moved_directory = fileStatAt(-1, new_path, false, &st) && S_ISDIR((mode_t)st.mode);
+
+                    events->push("move", fileWatchReportPath(new_path, moved_directory), fileWatchReportPath(old_path, moved_directory));
+                }
+                else
+                {
+                    events->push("delete", path);
+                }
+            }
+        }
+    }
+
+    // Moved out of the watched tree.
+    for (const file_WatchMove& move : moves)
+    {
+        events->push("delete", fileWatchReportPath(move.path, move.is_directory));
+
+        if (move.is_directory)
+        {
+            fileWatchRemove(self, move.path);
+        }
+    }
+
+    return true;
+}
+
+#endif /* __linux__ */
+
+static void file_Watcher_ctor(WrenVM* vm)
+{
+    file_Watcher* self = (file_Watcher*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(file_Watcher));
+    WRENCH_SET_MAGIC_TAG(self, file, Watcher);
+
+    self->fd = -1;
+    self->watches = NULL;
+
+    #if __linux__
+    {
+        self->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+        if (self->fd < 0)
+        {
+            char error[1024 * 4];
+            wrench_snprintf(error, sizeof(error), "Failed to create file watcher: %s", strerror(errno));
+
+            wrenSetSlotString(vm, 0, (const char*)error);
+            wrenAbortFiber(vm, 0);
+
+            return;
+        }
+
+        self->watches = new file_Watches();
+    }
+    #else
+    {
+        wrenSetSlotString(vm, 0, "Watcher is not supported on this platform.");
+        wrenAbortFiber(vm, 0);
+    }
+    #endif
+}
+
+static void file_Watcher_dtor(void* data)
+{
+    WRENCH_CHECK_MAGIC_TAG(data, file, Watcher);
+    file_Watcher* self = (file_Watcher*)data;
+
+    #if __linux__
+    {
+        if (self->watches != NULL)
+        {
+            for (auto& entry : self->watches->by_wd)
+            {
+                if (entry.second.path_fd >= 0) { close(entry.second.path_fd); }
+            }
+
+            delete self->watches;
+        }
+
+        if (self->fd >= 0)
+        {
+            close(self->fd);
+        }
+    }
+    #endif
+}
+
+/* Returns the watcher from slot 0, aborting the fiber if it was closed.
+ */
+static file_Watcher* fileGetWatcher(WrenVM* vm)
+{
+    file_Watcher* self = (file_Watcher*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, Watcher);
+
+    if (self->fd < 0)
+    {
+        wrenSetSlotString(vm, 0, "Watcher is closed.");
+        wrenAbortFiber(vm, 0);
+
+        return NULL;
+    }
+
+    return self;
+}
+
+static void file_Watcher_add(WrenVM* vm)
+{
+    file_Watcher* self = fileGetWatcher(vm);
+
+    #if __linux__
+    if (self != NULL)
+    {
+        const char* path = wrenGetSlotString(vm, 1);
+        const bool recursive = wrenGetSlotBool(vm, 2);
+
+        if (!fileWatchAdd(self, path, recursive, true, NULL))
+        {
+            char error[1024 * 4];
+            wrench_snprintf(error, sizeof(error), "Failed to watch \"%s\": %s", path, strerror(errno));
+
+            wrenSetSlotString(vm, 0, (const char*)error);
+            wrenAbortFiber(vm, 0);
+        }
+    }
+    #endif
+}
+
+static void file_Watcher_remove(WrenVM* vm)
+{
+    file_Watcher* self = fileGetWatcher(vm);
+
+    #if __linux__
+    if (self != NULL)
+    {
+        std::string path = wrenGetSlotString(vm, 1);
+
+        while (path.size() > 1 && path.back() == '/')
+        {
+            path.pop_back();
+        }
+
+        fileWatchRemove(self, path);
+    }
+    #endif
+}
+
+/* Wait up to `timeout_ms` (0 = don't block, -1 = forever) for events, and return them in slot 0
+ * as [kinds, paths, fromPaths].
+ */
+static void fileWatchCollect(WrenVM* vm, int timeout_ms)
+{
+    file_Watcher* self = fileGetWatcher(vm);
+
+    #if __linux__
+    if (self != NULL)
+    {
+        if (timeout_ms != 0)
+        {
+            struct pollfd pfd = { self->fd, POLLIN, 0 };
+
+            while (poll(&pfd, 1, timeout_ms) < 0 && errno == EINTR) {}
+        }
+
+        file_WatchEvents events;
+
+        if (!fileWatchRead(self, &events))
+        {
+            char error[1024 * 4];
+            wrench_snprintf(error, sizeof(error), "Failed to read file watch events: %s", strerror(errno));
+
+            wrenSetSlotString(vm, 0, (const char*)error);
+            wrenAbortFiber(vm, 0);
+
+            return;
+        }
+
+        wrenEnsureSlots(vm, 5);
+        wrenSetSlotNewList(vm, 0);
+
+        wrenSetSlotNewList(vm, 1);
+        wrenSetSlotNewList(vm, 2);
+        wrenSetSlotNewList(vm, 3);
+
+        for (size_t i = 0; i < events.kinds.size(); i++)
+        {
+            wrenSetSlotString(vm, 4, events.kinds[i]);
+            wrenInsertInList(vm, 1, -1, 4);
+
+            if (events.paths[i].empty()) { wrenSetSlotNull(vm, 4); } else { wrenSetSlotString(vm, 4, events.paths[i].c_str()); }
+            wrenInsertInList(vm, 2, -1, 4);
 
-            )) { return false; }
+            if (events.from[i].empty()) { wrenSetSlotNull(vm, 4); } else { wrenSetSlotString(vm, 4, events.from[i].c_str()); }
+            wrenInsertInList(vm, 3, -1, 4);
         }
-        WREN_END_CLASS();
+
+        wrenInsertInList(vm, 0, -1, 1);
+        wrenInsertInList(vm, 0, -1, 2);
+        wrenInsertInList(vm, 0, -1, 3);
+    }
+    #endif
+}
+
+static void file_Watcher_poll(WrenVM* vm)
+{
+    fileWatchCollect(vm, 0);
+}
+
+static void file_Watcher_wait(WrenVM* vm)
+{
+    fileWatchCollect(vm, wrenGetSlotInt(vm, 1));
+}
+
+static void file_Watcher_close(WrenVM* vm)
+{
+    file_Watcher* self = (file_Watcher*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, file, Watcher);
+
+    file_Watcher_dtor(self);
+
+    self->fd = -1;
+    self->watches = NULL;
+}
+
+/*
+================================================================================
+ * ~~ [ (un)hook ] ~~ *
+--------------------------------------------------------------------------------
+*/
+
+#if WRENCH_FILE_EXTENDED
+    /*
+     * Enable user extension of stdlib modules.
+     */
+    #include <file_ex.inl>
+#else
+    static bool fileWrenInitEx(WrenVM* vm)
+    {
+        return true;
+    }
+
+    static void fileWrenQuitEx(void)
+    {
+        //
+    }
+#endif /* WRENCH_FILE_EXTENDED */
+
+/* TODO: current, base, home, desktop, documents, downloads, music, pictures, public_share,
+ * saved_games, screenshots, templates, videos, path, fileName, extension, split, join,
+ * createDirectory, createFile, deleteFile
+ */
+#define FILE_PATH_CLASS(X)                                                                                                               \
+                                                                                                                                         \
+    X(BEGIN_CLASS_EX)(file, Path, NULL, NULL)                                                                                            \
+        X(METHOD)(file, Path, true, exists, "(path)", "(_)")                                                                             \
+                                                                                                                                         \
+        X(METHOD)(file, Path, true, isDirectory, "(path)", "(_)")                                                                        \
+        X(METHOD)(file, Path, true, isFile, "(path)", "(_)")                                                                             \
+                                                                                                                                         \
+        X(METHOD)(file, Path, true, stat, "(paths)", "(_)")                                                                              \
+                                                                                                                                         \
+        X(CODE)("static modeIsDirectory(mode) { (mode & 0xF000) == 0x4000 }")                                                            \
+        X(CODE)("static modeIsFile(mode) { (mode & 0xF000) == 0x8000 }")                                                                 \
+        X(CODE)("static modeIsLink(mode) { (mode & 0xF000) == 0xA000 }")                                                                 \
+                                                                                                                                         \
+        X(METHOD)(file, Path, true, copyFile, "(src, dst)", "(_,_)")                                                                     \
+        X(METHOD)(file, Path, true, moveFile, "(src, dst)", "(_,_)")                                                                     \
+                                                                                                                                         \
+        /* Copies files on `threads` threads (0 = one per core).                                                                         \
+         */                                                                                                                              \
+        X(METHOD)(file, Path, true, copyTree, "(src, dst, threads)", "(_,_,_)")                                                          \
+        X(CODE)("static copyTree(src, dst) { copyTree(src, dst, 1) }")                                                                   \
+                                                                                                                                         \
+        X(METHOD)(file, Path, true, list, "(path, recursive, include_subdirectories)", "(_,_,_)")                                        \
+        X(CODE)("static list(path, recursive) { list(path, recursive, true) }")                                                          \
+        X(CODE)("static list(path) { list(path, false, true) }")                                                                         \
+        X(CODE)("static walk(path) { list(path, true, true) }")                                                                          \
+                                                                                                                                         \
+        /* Bulk metadata: [paths, sizes, mtimes, modes, inodes]. The `Types` variants                                                    \
+         * skip the per-entry stat and only report the entry type from d_type.                                                           \
+         */                                                                                                                              \
+        X(METHOD)(file, Path, true, listStat, "(path, recursive, include_subdirectories, with_stat)", "(_,_,_,_)")                       \
+        X(CODE)("static listStat(path, recursive) { listStat(path, recursive, true, true) }")                                            \
+        X(CODE)("static walkStat(path) { listStat(path, true, true, true) }")                                                            \
+        X(CODE)("static walkTypes(path) { listStat(path, true, true, false) }")                                                          \
+                                                                                                                                         \
+        /* Native grep: `Path.search(root, "token")` or `Path.search(root, ["a", "b"], {                                                 \
+         * "include": "*.cpp", "exclude": ".git", "ignoreCase": true })`. Returns [paths, lines,                                         \
+         * columns, needles], with one entry per hit. Files that look binary are skipped.                                                \
+         */                                                                                                                              \
+        X(METHOD)(file, Path, true, search, "(root, needles, options)", "(_,_,_)")                                                       \
+        X(CODE)("static search(root, needles) { search(root, needles, null) }")                                                          \
+    X(END_CLASS)(file, Path)
+
+/* A saved listing of a tree that can be brought up to date cheaply: `refresh()` only
+ * lists directories whose mtime changed, and `refresh(true)` also stats the files in
+ * the rest (to catch edits in place). Both return [added, removed, modified] paths,
+ * with directories ending in a separator. The first refresh of a new snapshot reports
+ * everything as added. Snapshots are saved next to the tree as "<path>.dirsnap" (with the
+ * path made absolute), so a filesystem root needs an explicit snapshotPath.
+ */
+#define FILE_DIR_SNAPSHOT_CLASS(X)                                                                                                       \
+                                                                                                                                         \
+    X(BEGIN_CLASS)(file, DirSnapshot)                                                                                                    \
+        X(CODE)("construct load_(path, snapshotPath) {}")                                                                                \
+        X(CODE)("static load(path) { load_(path, null) }")                                                                               \
+        X(CODE)("static load(path, snapshotPath) { load_(path, snapshotPath) }")                                                         \
+                                                                                                                                         \
+        X(METHOD)(file, DirSnapshot, false, root, "", "")                                                                                \
+        X(METHOD)(file, DirSnapshot, false, path, "", "")                                                                                \
+        X(METHOD)(file, DirSnapshot, false, paths, "", "")                                                                               \
+                                                                                                                                         \
+        X(METHOD)(file, DirSnapshot, false, refresh, "(deep)", "(_)")                                                                    \
+        X(CODE)("refresh() { refresh(false) }")                                                                                          \
+        X(METHOD)(file, DirSnapshot, false, save, "()", "()")                                                                            \
+    X(END_CLASS)(file, DirSnapshot)
+
+/* TODO: name, mode, toString, seek, tell, size */
+#define FILE_FILE_CLASS(X)                                                                                                               \
+                                                                                                                                         \
+    X(BEGIN_CLASS)(file, File)                                                                                                           \
+        /* `hints` is a string of page cache hints: "sequential", "noreuse", "dontneed", and                                             \
+         * (prefetched only) "direct". E.g. `File.open(path, "rb", "sequential dontneed")`.                                              \
+         */                                                                                                                              \
+        X(METHOD)(file, File, true, open, "(path, mode, hints)", "(_,_,_)")                                                              \
+        X(CODE)("static open(path, mode) { open(path, mode, \"\") }")                                                                    \
+                                                                                                                                         \
+        /* Read-only, sequential reading with a background thread reading `depth` chunks of                                              \
+         * `chunkSize` bytes ahead. `prefetchStats` reports how often each side waited.                                                  \
+         */                                                                                                                              \
+        X(METHOD)(file, File, true, openPrefetched, "(path, chunkSize, depth, hints)", "(_,_,_,_)")                                      \
+        X(CODE)("static openPrefetched(path, chunkSize, depth) { openPrefetched(path, chunkSize, depth, \"\") }")                        \
+        X(CODE)("static openPrefetched(path) { openPrefetched(path, 1024 * 1024, 4, \"\") }")                                            \
+        X(METHOD)(file, File, false, prefetchStats, "()", "()")                                                                          \
+                                                                                                                                         \
+        /* Follow a growing file like `tail -f`, from its end (or start). See `Follower`.                                                \
+         */                                                                                                                              \
+        X(CODE)("static follow(path) { Follower.open_(path, false) }")                                                                   \
+        X(CODE)("static follow(path, fromStart) { Follower.open_(path, fromStart) }")                                                    \
+        X(METHOD)(file, File, false, close, "()", "()")                                                                                  \
+                                                                                                                                         \
+        /* XXX: `stdout` et al. are #defined on most platforms, requiring a bit of a workaround here.                                    \
+         */                                                                                                                              \
+        X(METHOD_EX)(file, File, true, stdout, "", "", file_File_stdout)                                                                 \
+        X(METHOD_EX)(file, File, true, stderr, "", "", file_File_stderr)                                                                 \
+        X(METHOD_EX)(file, File, true, stdin, "", "", file_File_stdin)                                                                   \
+                                                                                                                                         \
+        /* XXX: getc and putc are also macros (which is all that differentiates them from fgetc/fputc).                                  \
+         */                                                                                                                              \
+        X(METHOD_EX)(file, File, false, getc, "()", "()", file_File_getc)                                                                \
+        X(METHOD_EX)(file, File, false, putc, "(c)", "(_)", file_File_putc)                                                              \
+                                                                                                                                         \
+        X(METHOD_EX)(file, File, true, EOF, "", "", file_File_EOF)                                                                       \
+        X(METHOD)(file, File, false, eof, "()", "()")                                                                                    \
+                                                                                                                                         \
+        X(METHOD)(file, File, false, read, "(count)", "(_)")                                                                             \
+                                                                                                                                         \
+        X(CODE)(                                                                                                                         \
+                                                                                                                                         \
+            "read() { read(Num.maxSafeInteger) }\n"                                                                                      \
+                                                                                                                                         \
+            "static read(path) {\n"                                                                                                      \
+                "var file = open(path, \"rb\")\n"                                                                                        \
+                "var data = file.read()\n"                                                                                               \
+                                                                                                                                         \
+                "file.close()\n"                                                                                                         \
+                "return data\n"                                                                                                          \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+        )                                                                                                                                \
+                                                                                                                                         \
+        X(METHOD)(file, File, false, write, "(data)", "(_)")                                                                             \
+                                                                                                                                         \
+        /* Read into / write from a `Buffer` (from the built-in "wrench" module) without                                                 \
+         * going through strings. `readInto` returns the number of bytes read.                                                           \
+         */                                                                                                                              \
+        X(METHOD)(file, File, false, readInto_, "(buffer)", "(_)")                                                                       \
+        X(METHOD)(file, File, false, writeBytes_, "(buffer)", "(_)")                                                                     \
+                                                                                                                                         \
+        X(CODE)(                                                                                                                         \
+                                                                                                                                         \
+            "readInto(buffer) {\n"                                                                                                       \
+                "if (!(buffer is Buffer)) Fiber.abort(\"File.readInto expects a Buffer.\")\n"                                            \
+                "return readInto_(buffer)\n"                                                                                             \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+            "writeBytes(buffer) {\n"                                                                                                     \
+                "if (!(buffer is Buffer)) Fiber.abort(\"File.writeBytes expects a Buffer.\")\n"                                          \
+                "return writeBytes_(buffer)\n"                                                                                           \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+        )                                                                                                                                \
+                                                                                                                                         \
+        /* Reserve disk space for a large write without changing the file size. Returns false                                            \
+         * if the platform or filesystem can't (which is harmless - it's only a hint).                                                   \
+         */                                                                                                                              \
+        X(METHOD)(file, File, false, preallocate, "(size)", "(_)")                                                                       \
+                                                                                                                                         \
+        X(METHOD)(file, File, false, flush, "()", "()")                                                                                  \
+                                                                                                                                         \
+        /* Content hashes as hex strings: "xxh64" (fast), "crc32c" (hardware accelerated),                                               \
+         * or "sha256". Files are streamed natively and never loaded into the VM.                                                        \
+         */                                                                                                                              \
+        X(METHOD)(file, File, true, hash, "(path, algo)", "(_,_)")                                                                       \
+        X(CODE)("static hash(path) { hash(path, \"xxh64\") }")                                                                           \
+        X(METHOD)(file, File, true, hashBytes, "(data, algo)", "(_,_)")                                                                  \
+        X(METHOD)(file, File, true, hashAll, "(paths, algo, threads)", "(_,_,_)")                                                        \
+        X(CODE)("static hashAll(paths, algo) { hashAll(paths, algo, 0) }")                                                               \
+                                                                                                                                         \
+        X(METHOD)(file, File, false, readLine, "(strip_newlines)", "(_)")                                                                \
+                                                                                                                                         \
+        X(CODE)(                                                                                                                         \
+                                                                                                                                         \
+            "readLine() { readLine(true) }\n"                                                                                            \
+                                                                                                                                         \
+            "readLines(strip_newlines) {\n"                                                                                              \
+                "var s = []\n"                                                                                                           \
+                                                                                                                                         \
+                "while (!eof()) {\n"                                                                                                     \
+                    "s.insert(-1, readLine(strip_newlines))\n"                                                                           \
+                "}\n"                                                                                                                    \
+                                                                                                                                         \
+                "return s\n"                                                                                                             \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+            "readLines() { readLines(true) }\n"                                                                                          \
+                                                                                                                                         \
+            "static readLines(path) {\n"                                                                                                 \
+                "var file = open(path, \"rb\")\n"                                                                                        \
+                "var text = file.readLines()\n"                                                                                          \
+                                                                                                                                         \
+                "file.close()\n"                                                                                                         \
+                "return text\n"                                                                                                          \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+        )                                                                                                                                \
+    X(END_CLASS)(file, File)
+
+/* Binary records: `Struct.new("<IIdH")`, then `unpackAll(fileOrString)` for one list per
+ * field, `unpack(string)` for a single record, and `pack`/`packAll` to go the other way.
+ */
+#define FILE_STRUCT_CLASS(X)                                                                                                             \
+                                                                                                                                         \
+    X(BEGIN_CLASS)(file, Struct)                                                                                                         \
+        X(CODE)("construct new(format) {}")                                                                                              \
+                                                                                                                                         \
+        X(METHOD)(file, Struct, false, format, "", "")                                                                                   \
+        X(METHOD)(file, Struct, false, size, "", "")                                                                                     \
+        X(METHOD)(file, Struct, false, count, "", "")                                                                                    \
+                                                                                                                                         \
+        X(METHOD)(file, Struct, false, unpack, "(data, offset)", "(_,_)")                                                                \
+        X(CODE)("unpack(data) { unpack(data, 0) }")                                                                                      \
+                                                                                                                                         \
+        X(METHOD)(file, Struct, false, unpackAll_, "(source, count)", "(_,_)")                                                           \
+                                                                                                                                         \
+        X(CODE)(                                                                                                                         \
+                                                                                                                                         \
+            "unpackAll(source, count) {\n"                                                                                               \
+                "if (!(source is String || source is File)) Fiber.abort(\"Struct.unpackAll expects a String or a File.\")\n"             \
+                "return unpackAll_(source, count)\n"                                                                                     \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+            "unpackAll(source) { unpackAll(source, -1) }\n"                                                                              \
+                                                                                                                                         \
+        )                                                                                                                                \
+                                                                                                                                         \
+        X(METHOD)(file, Struct, false, pack, "(values)", "(_)")                                                                          \
+        X(METHOD)(file, Struct, false, packAll, "(columns)", "(_)")                                                                      \
+    X(END_CLASS)(file, Struct)
+
+/* Non-blocking file I/O. Each operation parks the calling fiber until it completes, and
+ * other scheduled fibers keep running (see `Scheduler` in the built-in "wrench" module).
+ * Offsets of -1 use the file position. Hosts other than `run_wren` must call `wrenRunEventLoop`.
+ */
+#define FILE_ASYNC_FILE_CLASS(X)                                                                                                         \
+                                                                                                                                         \
+    X(BEGIN_CLASS)(file, AsyncFile)                                                                                                      \
+        X(CODE)("construct fromFd_(fd) {}")                                                                                              \
+                                                                                                                                         \
+        X(METHOD)(file, AsyncFile, true, open_, "(path, mode, fiber)", "(_,_,_)")                                                        \
+        X(METHOD)(file, AsyncFile, true, size_, "(path, fiber)", "(_,_)")                                                                \
+        X(METHOD)(file, AsyncFile, false, read_, "(count, offset, fiber)", "(_,_,_)")                                                    \
+        X(METHOD)(file, AsyncFile, false, write_, "(data, offset, fiber)", "(_,_,_)")                                                    \
+        X(METHOD)(file, AsyncFile, false, close_, "(fiber)", "(_)")                                                                      \
+                                                                                                                                         \
+        X(GETTER)(file, AsyncFile, false, fd)                                                                                            \
+                                                                                                                                         \
+        X(CODE)(                                                                                                                         \
+                                                                                                                                         \
+            "static open(path, mode) {\n"                                                                                                \
+                "open_(path, mode, Fiber.current)\n"                                                                                     \
+                "return fromFd_(Scheduler.await_())\n"                                                                                   \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+            "static open(path) { open(path, \"r\") }\n"                                                                                  \
+                                                                                                                                         \
+            "static size(path) {\n"                                                                                                      \
+                "size_(path, Fiber.current)\n"                                                                                           \
+                "return Scheduler.await_()\n"                                                                                            \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+            "read(count, offset) {\n"                                                                                                    \
+                "read_(count, offset, Fiber.current)\n"                                                                                  \
+                "return Scheduler.await_()\n"                                                                                            \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+            "read(count) { read(count, -1) }\n"                                                                                          \
+                                                                                                                                         \
+            "write(data, offset) {\n"                                                                                                    \
+                "write_(data, offset, Fiber.current)\n"                                                                                  \
+                "return Scheduler.await_()\n"                                                                                            \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+            "write(data) { write(data, -1) }\n"                                                                                          \
+                                                                                                                                         \
+            "close() {\n"                                                                                                                \
+                "close_(Fiber.current)\n"                                                                                                \
+                "return Scheduler.await_()\n"                                                                                            \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+            "static read(path) {\n"                                                                                                      \
+                "var size = size(path)\n"                                                                                                \
+                "var file = open(path, \"r\")\n"                                                                                         \
+                "var data = file.read(size, 0)\n"                                                                                        \
+                                                                                                                                         \
+                "file.close()\n"                                                                                                         \
+                "return data\n"                                                                                                          \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+            "static write(path, data) {\n"                                                                                               \
+                "var file = open(path, \"w\")\n"                                                                                         \
+                "file.write(data, 0)\n"                                                                                                  \
+                "file.close()\n"                                                                                                         \
+            "}\n"                                                                                                                        \
+                                                                                                                                         \
+        )                                                                                                                                \
+    X(END_CLASS)(file, AsyncFile)
+
+/* Random access to lines of large text files through a persistent `.lidx` sidecar
+ * (see the line index section). `open` reuses a valid sidecar and rebuilds a missing or
+ * stale one; `build` always rescans. An index that goes stale (the file's size or mtime
+ * changed) is rebuilt on the next lookup.
+ */
+#define FILE_LINE_INDEX_CLASS(X)                                                                                                         \
+                                                                                                                                         \
+    X(BEGIN_CLASS)(file, LineIndex)                                                                                                      \
+        X(CODE)("construct open_(path, rebuild, indexPath) {}")                                                                          \
+                                                                                                                                         \
+        X(CODE)("static open(path) { open_(path, false, null) }")                                                                        \
+        X(CODE)("static open(path, indexPath) { open_(path, false, indexPath) }")                                                        \
+        X(CODE)("static build(path) { open_(path, true, null) }")                                                                        \
+        X(CODE)("static build(path, indexPath) { open_(path, true, indexPath) }")                                                        \
+                                                                                                                                         \
+        X(GETTER)(file, LineIndex, false, count)                                                                                         \
+        X(METHOD)(file, LineIndex, false, offset, "(n)", "(_)")                                                                          \
+                                                                                                                                         \
+        X(METHOD)(file, LineIndex, false, line, "(n)", "(_)")                                                                            \
+        X(METHOD)(file, LineIndex, false, range, "(a, b)", "(_,_)")                                                                      \
+                                                                                                                                         \
+        X(METHOD)(file, LineIndex, false, close, "()", "()")                                                                             \
+    X(END_CLASS)(file, LineIndex)
+
+/* Map a huge text file across cores. The file is split into newline-aligned chunks, and
+ * each chunk's lines are passed to `map` (a top-level `var map = Fn.new {|lines| ... }` in
+ * `module`), running in one worker VM per thread. Returns the per-chunk results in file
+ * order; results are deep-copied, so they may only contain nums, strings, bools, null,
+ * lists and maps. `chunkBytes` of 0 picks a size from the file size and thread count.
+ */
+#define FILE_LINE_JOB_CLASS(X)                                                                                                           \
+                                                                                                                                         \
+    X(BEGIN_CLASS_EX)(file, LineJob, NULL, NULL)                                                                                         \
+        X(METHOD)(file, LineJob, true, map, "(path, module, threads, chunkBytes)", "(_,_,_,_)")                                          \
+        X(CODE)("static map(path, module, threads) { map(path, module, threads, 0) }")                                                   \
+        X(CODE)("static map(path, module) { map(path, module, 0, 0) }")                                                                  \
+                                                                                                                                         \
+        X(CODE)("static mapReduce(path, module, threads, reduce) { map(path, module, threads, 0).reduce(reduce) }")                      \
+        X(CODE)("static mapReduce(path, module, threads, initial, reduce) { map(path, module, threads, 0).reduce(initial, reduce) }")    \
+    X(END_CLASS)(file, LineJob)
+
+/* New lines of a followed file, in batches: `next(timeoutMs)` returns every complete line
+ * written since the last call (waiting for at least one), [] on timeout, or null once
+ * closed. Iterating yields batches forever: `for (lines in File.follow(path)) { ... }`.
+ * Truncation and rotation (the path replaced by a new file) are followed transparently.
+ */
+#define FILE_FOLLOWER_CLASS(X)                                                                                                           \
+                                                                                                                                         \
+    X(BEGIN_CLASS)(file, Follower)                                                                                                       \
+        X(CODE)("construct open_(path, fromStart) {}")                                                                                   \
+                                                                                                                                         \
+        X(METHOD)(file, Follower, false, next, "(timeoutMs)", "(_)")                                                                     \
+        X(CODE)("next() { next(-1) }")                                                                                                   \
+                                                                                                                                         \
+        X(CODE)("iterate(iterator) { next(-1) }")                                                                                        \
+        X(CODE)("iteratorValue(iterator) { iterator }")                                                                                  \
+                                                                                                                                         \
+        X(METHOD)(file, Follower, false, close, "()", "()")                                                                              \
+    X(END_CLASS)(file, Follower)
+
+/* Directory and file change notification. Each poll returns every pending event as
+ * [kinds, paths, fromPaths], where kind is "create", "modify", "delete", "move" (with the
+ * old path in fromPaths), or "overflow" (events were dropped - rescan). Directory paths
+ * end with a separator, and directories renamed inside a watch keep reporting their
+ * new paths. `poll` never blocks, so it can be called from a scheduled fiber.
+ */
+#define FILE_WATCHER_CLASS(X)                                                                                                            \
+                                                                                                                                         \
+    X(BEGIN_CLASS)(file, Watcher)                                                                                                        \
+        X(CODE)("construct new() {}")                                                                                                    \
+                                                                                                                                         \
+        X(METHOD)(file, Watcher, false, add, "(path, recursive)", "(_,_)")                                                               \
+        X(CODE)("add(path) { add(path, false) }")                                                                                        \
+        X(METHOD)(file, Watcher, false, remove, "(path)", "(_)")                                                                         \
+                                                                                                                                         \
+        X(METHOD)(file, Watcher, false, poll, "()", "()")                                                                                \
+        X(METHOD)(file, Watcher, false, wait, "(timeoutMs)", "(_)")                                                                      \
+        X(CODE)("wait() { wait(-1) }")                                                                                                   \
+                                                                                                                                         \
+        X(METHOD)(file, Watcher, false, close, "()", "()")                                                                               \
+    X(END_CLASS)(file, Watcher)
+
+#define FILE_MODULE(X)                                                                                                                   \
+                                                                                                                                         \
+    X(CODE)("import \"wrench\" for Scheduler, Buffer")                                                                                   \
+                                                                                                                                         \
+    FILE_PATH_CLASS(X)                                                                                                                   \
+    FILE_DIR_SNAPSHOT_CLASS(X)                                                                                                           \
+    FILE_FILE_CLASS(X)                                                                                                                   \
+    FILE_STRUCT_CLASS(X)                                                                                                                 \
+    FILE_ASYNC_FILE_CLASS(X)                                                                                                             \
+    FILE_LINE_INDEX_CLASS(X)                                                                                                             \
+    FILE_LINE_JOB_CLASS(X)                                                                                                               \
+    FILE_FOLLOWER_CLASS(X)                                                                                                               \
+    FILE_WATCHER_CLASS(X)
+
+WRENCH_EXPORT bool fileWrenInit(WrenVM* vm)
+{
+#if WRENCH_STATIC_MODULE_SOURCE && !WRENCH_FILE_EXTENDED
+    /*
+     * One read-only copy of the source, shared by every VM that imports the module.
+     */
+    WREN_MODULE_STATIC("file", FILE_MODULE);
+
+    return fileWrenInitEx(vm);
+#else
+    if (!wrenBeginModule(vm, "file")) { return false; } else
+    {
+        WREN_MODULE_BUILD(FILE_MODULE);
     }
 
     if (!fileWrenInitEx(vm))
@@ -396,6 +7550,7 @@ WRENCH_EXPORT bool fileWrenInit(WrenVM* vm)
     }
 
     return wrenEndModule(vm);
+#endif /* WRENCH_STATIC_MODULE_SOURCE && !WRENCH_FILE_EXTENDED */
 }
 
 WRENCH_EXPORT void fileWrenQuit(void)
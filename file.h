@@ -11,7 +11,75 @@ typedef struct file_File
 {
     WRENCH_MAGIC_TAG;
     FILE* file;
+    struct file_Prefetch* prefetch; // Set by `File.openPrefetched` (and `file` is NULL).
+
+    int hints; // FILE_HINT_* page cache hints.
+    long long cache_mark; // Pages before this offset have been dropped ("dontneed").
 }
 file_File;
 
+typedef struct file_DirSnapshot
+{
+    WRENCH_MAGIC_TAG;
+    struct file_Snapshot* snapshot;
+    char* path; // Where it's saved.
+}
+file_DirSnapshot;
+
+typedef struct file_Struct
+{
+    WRENCH_MAGIC_TAG;
+    struct file_StructField* fields;
+    int num_fields;
+    int size; // Bytes per record.
+    bool swap; // Non-native byte order.
+    char* format;
+}
+file_Struct;
+
+typedef struct file_AsyncFile
+{
+    WRENCH_MAGIC_TAG;
+    int fd;
+}
+file_AsyncFile;
+
+typedef struct file_Watcher
+{
+    WRENCH_MAGIC_TAG;
+    int fd;
+    struct file_Watches* watches;
+}
+file_Watcher;
+
+typedef struct file_Follower
+{
+    WRENCH_MAGIC_TAG;
+    struct file_Follow* follow;
+}
+file_Follower;
+
+typedef struct file_LineIndex
+{
+    WRENCH_MAGIC_TAG;
+    int fd; // The indexed file, for reading lines.
+
+    void* map; // The mapped sidecar.
+    size_t map_size;
+
+    const void* offsets; // u32 deltas from `bases`, or absolute u64 offsets if `wide`.
+    const unsigned long long* bases;
+
+    double num_lines;
+    double file_size;
+    double mtime;
+
+    int block_shift;
+    bool wide;
+
+    char* path;
+    char* index_path;
+}
+file_LineIndex;
+
 #endif /* __WRENCH_FILE_H__ */
@@ -53,6 +53,7 @@ static void image_Image_ctor(WrenVM* vm)
         self->height = height;
         self->color_channels = color_channels;
         self->bytes_per_channel = bytes_per_channel;
+        self->storage = NULL;
     }
     else
     {
@@ -66,65 +67,124 @@ static void image_Image_ctor(WrenVM* vm)
 
 static void image_Image_dtor(void* data)
 {
-    if (((image_Image*)data)->pixels != NULL)
+    if (((image_Image*)data)->storage != NULL)
+    {
+        wrenReleaseBufferStorage(((image_Image*)data)->storage); // Buffers may still use the pixels.
+    }
+    else if (((image_Image*)data)->pixels != NULL)
     {
         wrench_free(((image_Image*)data)->pixels);
     }
 }
 
-static void image_Image_load(WrenVM* vm)
+/* Shared by the blocking and async paths. These don't touch the VM, so they can run on the
+ * thread pool; stb's failure reason is thread-local, so errors are formatted here as well.
+ */
+static bool imageLoad(const char* filename, int desired_color_channels, int desired_bytes_per_channel,
+                                                    image_Image* result, char* error, size_t error_size)
 {
-    const char* filename = wrenGetSlotString(vm, 1);
-    const int desired_color_channels = wrenGetSlotInt(vm, 2);
-    const int desired_bytes_per_channel = wrenGetSlotInt(vm, 3);
-
-    image_Image result = {};
-    char error[1024 * 4];
-
     switch (desired_bytes_per_channel)
     {
         case 0:
         case sizeof(uint8_t):
         {
-            result.pixels = (void*)stbi_load(filename, &result.width, &result.height, &result.color_channels, desired_color_channels);
-            result.bytes_per_channel = 1;
+            result->pixels = (void*)stbi_load(filename, &result->width, &result->height, &result->color_channels, desired_color_channels);
+            result->bytes_per_channel = 1;
         }
         break;
 
         case sizeof(uint16_t):
         {
-            result.pixels = (void*)stbi_load_16(filename, &result.width, &result.height, &result.color_channels, desired_color_channels);
-            result.bytes_per_channel = 2;
+            result->pixels = (void*)stbi_load_16(filename, &result->width, &result->height, &result->color_channels, desired_color_channels);
+            result->bytes_per_channel = 2;
         }
         break;
 
         case sizeof(float):
         {
-            result.pixels = (void*)stbi_loadf(filename, &result.width, &result.height, &result.color_channels, desired_color_channels);
-            result.bytes_per_channel = 4;
+            result->pixels = (void*)stbi_loadf(filename, &result->width, &result->height, &result->color_channels, desired_color_channels);
+            result->bytes_per_channel = 4;
         }
         break;
 
         default:
         {
-            if (1)
-            {
-                wrench_snprintf(error, sizeof(error), "Invalid bytes per channel hint for image file \"%s\": %i",
-                                                                            filename, desired_bytes_per_channel);
-                wrenSetSlotString(vm, 0, (const char*)error);
-                wrenAbortFiber(vm, 0);
-
-                return;
-            }
-            else
-            {
-                stbi__g_failure_reason = "Invalid bytes per channel hint";
-            }
+            wrench_snprintf(error, error_size, "Invalid bytes per channel hint for image file \"%s\": %i",
+                                                                    filename, desired_bytes_per_channel);
+            return false;
         }
         break;
     }
 
-    if (result.pixels != NULL)
+    if (result->pixels == NULL)
+    {
+        wrench_snprintf(error, error_size, "Failed to load image file \"%s\": %s.", filename, stbi_failure_reason());
+        return false;
+    }
+
+    // stb reports the file's channel count, but the pixels have the requested number.
+    if (desired_color_channels != 0)
+    {
+        result->color_channels = desired_color_channels;
+    }
+
+    return true;
+}
+
+static bool imageSave(const image_Image* self, const char* filename, char* error, size_t error_size)
+{
+    if (self->pixels == NULL)
+    {
+        wrench_snprintf(error, error_size, "Failed to save invalid image to \"%s\".", filename);
+        return false;
+    }
+
+    bool ok;
+
+    if (wrench_strstr(filename, ".png") != NULL)
+    {
+        ok = stbi_write_png(filename, self->width, self->height, self->color_channels, self->pixels, self->width * self->color_channels * self->bytes_per_channel);
+    }
+    else if (wrench_strstr(filename, ".bmp") != NULL)
+    {
+        ok = stbi_write_bmp(filename, self->width, self->height, self->color_channels, self->pixels);
+    }
+    else if (wrench_strstr(filename, ".tga") != NULL)
+    {
+        ok = stbi_write_tga(filename, self->width, self->height, self->color_channels, self->pixels);
+    }
+    else if (wrench_strstr(filename, ".hdr") != NULL)
+    {
+        ok = stbi_write_hdr(filename, self->width, self->height, self->color_channels, (const float*)self->pixels);
+    }
+    else if (wrench_strstr(filename, ".jpg") != NULL)
+    {
+        ok = stbi_write_jpg(filename, self->width, self->height, self->color_channels, self->pixels, 0);
+    }
+    else
+    {
+        wrench_snprintf(error, error_size, "No encoder for image file \"%s\".", filename);
+        return false;
+    }
+
+    if (!ok)
+    {
+        wrench_snprintf(error, error_size, "Failed to save image to \"%s\".", filename);
+    }
+
+    return ok;
+}
+
+static void image_Image_load(WrenVM* vm)
+{
+    const char* filename = wrenGetSlotString(vm, 1);
+    const int desired_color_channels = wrenGetSlotInt(vm, 2);
+    const int desired_bytes_per_channel = wrenGetSlotInt(vm, 3);
+
+    image_Image result = {};
+    char error[1024 * 4];
+
+    if (imageLoad(filename, desired_color_channels, desired_bytes_per_channel, &result, error, sizeof(error)))
     {
         image_Image* data = (image_Image*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(image_Image));
         *data = result;
@@ -133,9 +193,6 @@ static void image_Image_load(WrenVM* vm)
     }
     else
     {
-        wrench_snprintf(error, sizeof(error), "Failed to load image file \"%s\": %s.",
-                                                    filename, stbi_failure_reason());
-
         wrenSetSlotString(vm, 0, (const char*)error);
         wrenAbortFiber(vm, 0);
     }
@@ -149,70 +206,161 @@ static void image_Image_save(WrenVM* vm)
     const char* filename = wrenGetSlotString(vm, 1);
     char error[1024 * 4];
 
-    if (self->pixels == NULL)
+    if (!imageSave(self, filename, error, sizeof(error)))
     {
-        wrench_snprintf(error, sizeof(error), "Failed to save invalid image to \"%s\".", filename);
+        wrenSetSlotString(vm, 0, (const char*)error);
+        wrenAbortFiber(vm, 0);
+    }
+}
 
-        error:
-        {
-            if (error[0] == '\0')
-            {
-                wrench_snprintf(error, sizeof(error), "Failed to save image to \"%s\".", filename);
-            }
+/*
+================================================================================
+ * ~~ [ async ] ~~ *
+--------------------------------------------------------------------------------
+*/
 
-            wrenSetSlotString(vm, 0, (const char*)error);
-            wrenAbortFiber(vm, 0);
+typedef struct image_Task
+{
+    WrenHandle* handle; // Image class (load) or the image being saved (save), kept alive.
+    image_Image image;
+    void* save_pixels;
 
-            return;
-        }
-    }
-    else
+    char* filename;
+    int desired_color_channels;
+    int desired_bytes_per_channel;
+
+    bool ok;
+    char error[1024];
+}
+image_Task;
+
+static image_Task* imageNewTask(WrenVM* vm)
+{
+    image_Task* task = (image_Task*)wrench_calloc(1, sizeof(image_Task));
+    const char* filename = wrenGetSlotString(vm, 1);
+
+    if (task == NULL || (task->filename = (char*)wrench_malloc(wrench_strlen(filename) + 1)) == NULL)
     {
-        error[0] = '\0';
+        wrench_free(task);
+
+        wrenSetSlotString(vm, 0, "Out of memory.");
+        wrenAbortFiber(vm, 0);
+
+        return NULL;
     }
 
-    if (wrench_strstr(filename, ".png") != NULL)
+    wrench_memcpy(task->filename, filename, wrench_strlen(filename) + 1);
+    task->handle = wrenGetSlotHandle(vm, 0);
+
+    return task;
+}
+
+static void imageFreeTask(WrenVM* vm, image_Task* task)
+{
+    wrenReleaseHandle(vm, task->handle);
+
+    wrench_free(task->image.pixels);
+    wrench_free(task->filename);
+    wrench_free(task);
+}
+
+static void* image_Image_loadAsync_begin(WrenVM* vm)
+{
+    image_Task* task = imageNewTask(vm);
+
+    if (task != NULL)
     {
-        if (!stbi_write_png(filename, self->width, self->height, self->color_channels, self->pixels, self->width * self->color_channels * self->bytes_per_channel))
-        {
-            goto error;
-        }
+        task->desired_color_channels = wrenGetSlotInt(vm, 2);
+        task->desired_bytes_per_channel = wrenGetSlotInt(vm, 3);
     }
-    else if (wrench_strstr(filename, ".bmp") != NULL)
+
+    return task;
+}
+
+static void image_Image_loadAsync_work(void* data)
+{
+    image_Task* task = (image_Task*)data;
+
+    task->ok = imageLoad(task->filename, task->desired_color_channels, task->desired_bytes_per_channel,
+                                                            &task->image, task->error, sizeof(task->error));
+}
+
+static bool image_Image_loadAsync_done(WrenVM* vm, void* data)
+{
+    image_Task* task = (image_Task*)data;
+    const bool ok = task->ok;
+
+    if (ok)
     {
-        if (!stbi_write_bmp(filename, self->width, self->height, self->color_channels, self->pixels))
-        {
-            goto error;
-        }
+        wrenEnsureSlots(vm, 2);
+        wrenSetSlotHandle(vm, 1, task->handle);
+
+        image_Image* image = (image_Image*)wrenSetSlotNewForeign(vm, 0, 1, sizeof(image_Image));
+        *image = task->image;
+
+        WRENCH_SET_MAGIC_TAG(image, image, Image);
+        task->image.pixels = NULL; // Moved into the new object.
     }
-    else if (wrench_strstr(filename, ".tga") != NULL)
+    else
     {
-        if (!stbi_write_tga(filename, self->width, self->height, self->color_channels, self->pixels))
-        {
-            goto error;
-        }
+        wrenSetSlotString(vm, 0, (const char*)task->error);
     }
-    else if (wrench_strstr(filename, ".hdr") != NULL)
+
+    imageFreeTask(vm, task);
+    return ok;
+}
+
+WREN_ASYNC_FUNCTION(image, Image, loadAsync);
+
+static void* image_Image_saveAsync_begin(WrenVM* vm)
+{
+    image_Image* self = (image_Image*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, image, Image);
+
+    image_Task* task = imageNewTask(vm);
+
+    if (task != NULL)
     {
-        if (!stbi_write_hdr(filename, self->width, self->height, self->color_channels, self->pixels))
-        {
-            goto error;
-        }
+        task->image = *self;
+        task->image.pixels = NULL; // Borrowed through the handle, see the work function.
+        task->save_pixels = self->pixels;
     }
-    else if (wrench_strstr(filename, ".jpg") != NULL)
+
+    return task;
+}
+
+static void image_Image_saveAsync_work(void* data)
+{
+    image_Task* task = (image_Task*)data;
+
+    /* The handle keeps the image alive, and foreign data doesn't move. Don't mutate the image
+     * from Wren until the save completes.
+     */
+    image_Image image = task->image;
+    image.pixels = task->save_pixels;
+
+    task->ok = imageSave(&image, task->filename, task->error, sizeof(task->error));
+}
+
+static bool image_Image_saveAsync_done(WrenVM* vm, void* data)
+{
+    image_Task* task = (image_Task*)data;
+    const bool ok = task->ok;
+
+    if (ok)
     {
-        if (!stbi_write_jpg(filename, self->width, self->height, self->color_channels, self->pixels, 0))
-        {
-            goto error;
-        }
+        wrenSetSlotNull(vm, 0);
     }
     else
     {
-        wrench_snprintf(error, sizeof(error), "No encoder for image file \"%s\".", filename);
-        goto error;
+        wrenSetSlotString(vm, 0, (const char*)task->error);
     }
+
+    imageFreeTask(vm, task);
+    return ok;
 }
 
+WREN_ASYNC_FUNCTION(image, Image, saveAsync);
 static void image_Image_width_get(WrenVM* vm)
 {
     image_Image* self = (image_Image*)wrenGetSlotForeign(vm, 0);
@@ -245,6 +393,38 @@ static void image_Image_bytesPerChannel_get(WrenVM* vm)
     wrenSetSlotInt(vm, 0, self->bytes_per_channel);
 }
 
+static void imageFreePixels(void* pixels)
+{
+    wrench_free(pixels);
+}
+
+static void image_Image_data_get(WrenVM* vm)
+{
+    image_Image* self = (image_Image*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, image, Image);
+
+    const size_t size = (size_t)self->width * self->height * self->color_channels * self->bytes_per_channel;
+
+    // The pixels move into shared storage the first time they're asked for, so that buffers
+    // can outlive the image.
+    if (self->storage == NULL && (self->storage = wrenNewBufferStorage(self->pixels, size, imageFreePixels)) == NULL)
+    {
+        wrenSetSlotString(vm, 0, "Out of memory.");
+        wrenAbortFiber(vm, 0);
+
+        return;
+    }
+
+    const WrenBufferType type = (self->bytes_per_channel == 4) ? WREN_BUFFER_F32 :
+                                (self->bytes_per_channel == 2) ? WREN_BUFFER_U16 : WREN_BUFFER_U8;
+
+    if (!wrenSetSlotBuffer(vm, 0, self->storage, 0, size, type))
+    {
+        wrenSetSlotString(vm, 0, "Image data requires the \"wrench\" module.");
+        wrenAbortFiber(vm, 0);
+    }
+}
+
 /*
 ================================================================================
  * ~~ [ (un)hook ] ~~ *
@@ -268,66 +448,73 @@ static void image_Image_bytesPerChannel_get(WrenVM* vm)
     }
 #endif /* WRENCH_IMAGE_EXTENDED */
 
+/* TODO: loadFromBytes, info, infoFromBytes, saveToBytes, name, path, toString, `[x, y]`,
+ * `[x, y]=`, resize, convert
+ */
+#define IMAGE_MODULE(X)                                                                                                      \
+                                                                                                                             \
+    X(CODE)("import \"wrench\" for Scheduler, Buffer")                                                                       \
+                                                                                                                             \
+    X(BEGIN_CLASS)(image, Image)                                                                                             \
+                                                                                                                             \
+        X(CODE)("construct new(width, height, colorChannels, bytesPerChannel) {}")                                           \
+                                                                                                                             \
+        X(METHOD)(image, Image, true, load, "(filename, desiredColorChannels, desiredBytesPerChannel)", "(_,_,_)")           \
+        X(CODE)("static load(filename) { load(filename, 0, 0) }")                                                            \
+                                                                                                                             \
+        /* Decode on the thread pool while the calling fiber waits. */                                                       \
+        X(ASYNC_METHOD)(image, Image, true, loadAsync, "filename, desiredColorChannels, desiredBytesPerChannel", "_,_,_")    \
+        X(CODE)("static loadAsync(filename) { loadAsync(filename, 0, 0) }")                                                  \
+                                                                                                                             \
+        X(METHOD)(image, Image, false, save, "(path)", "(_)")                                                                \
+        X(ASYNC_METHOD)(image, Image, false, saveAsync, "path", "_")                                                         \
+                                                                                                                             \
+        X(CODE)("static MONO { 1 }")                                                                                         \
+        X(CODE)("static RGB { 3 }")                                                                                          \
+        X(CODE)("static RGBA { 4 }")                                                                                         \
+                                                                                                                             \
+        X(CODE)("static BYTE { 1 }")                                                                                         \
+        X(CODE)("static SHORT { 2 }")                                                                                        \
+        X(CODE)("static FLOAT { 4 }")                                                                                        \
+                                                                                                                             \
+        /* The pixels as a `Buffer` of bytes, shorts (u16) or floats (f32), without copying.                                 \
+         * Writes through it change the image.                                                                               \
+         */                                                                                                                  \
+        X(GETTER)(image, Image, false, data)                                                                                 \
+                                                                                                                             \
+        X(GETTER)(image, Image, false, width)                                                                                \
+        X(GETTER)(image, Image, false, height)                                                                               \
+        X(GETTER)(image, Image, false, colorChannels)                                                                        \
+        X(GETTER)(image, Image, false, bytesPerChannel)                                                                      \
+                                                                                                                             \
+        X(CODE)("bytesPerPixel { colorChannels * bytesPerChannel }")                                                         \
+                                                                                                                             \
+        X(CODE)("isMono { colorChannels == 1 }")                                                                             \
+        X(CODE)("isRGB { colorChannels == 3 }")                                                                              \
+        X(CODE)("isRGBA { colorChannels == 4 }")                                                                             \
+                                                                                                                             \
+        X(CODE)("isBytes { bytesPerChannel == 1 }")                                                                          \
+        X(CODE)("isShorts { bytesPerChannel == 2 }")                                                                         \
+        X(CODE)("isFloats { bytesPerChannel == 4 }")                                                                         \
+                                                                                                                             \
+        X(CODE)("bytes { width * height * colorChannels * bytesPerChannel }")                                                \
+        X(CODE)("pitch { width * colorChannels * bytesPerChannel }")                                                         \
+                                                                                                                             \
+    X(END_CLASS)(image, Image)
+
 WRENCH_EXPORT bool imageWrenInit(WrenVM* vm)
 {
+#if WRENCH_STATIC_MODULE_SOURCE && !WRENCH_IMAGE_EXTENDED
+    /*
+     * One read-only copy of the source, shared by every VM that imports the module.
+     */
+    WREN_MODULE_STATIC("image", IMAGE_MODULE);
+
+    return imageWrenInitEx(vm);
+#else
     if (!wrenBeginModule(vm, "image")) { return false; } else
     {
-        WREN_BEGIN_CLASS(image, Image);
-        {
-            WREN_CODE("construct new(width, height, colorChannels, bytesPerChannel) {}");
-
-            WREN_METHOD(image, Image, true, load, "(filename, desiredColorChannels, desiredBytesPerChannel)", "(_,_,_)");
-            WREN_CODE("static load(filename) { load(filename, 0, 0) }");
-
-            // TODO: loadFromBytes
-
-            // TODO: info
-            // TODO: infoFromBytes
-
-            WREN_METHOD(image, Image, false, save, "(path)", "(_)");
-
-            // TODO: saveToBytes
-
-            // TODO: name
-            // TODO: path
-
-            // TODO: toString
-
-            // TODO: [x, y]
-            // TODO: [x, y]=
-
-            WREN_CODE("static MONO { 1 }");
-            WREN_CODE("static RGB { 3 }");
-            WREN_CODE("static RGBA { 4 }");
-
-            WREN_CODE("static BYTE { 1 }");
-            WREN_CODE("static SHORT { 2 }");
-            WREN_CODE("static FLOAT { 4 }");
-
-            // TODO: data
-
-            WREN_GETTER(image, Image, false, width);
-            WREN_GETTER(image, Image, false, height);
-            WREN_GETTER(image, Image, false, colorChannels);
-            WREN_GETTER(image, Image, false, bytesPerChannel);
-
-            WREN_CODE("bytesPerPixel { colorChannels * bytesPerChannel }");
-
-            WREN_CODE("isMono { colorChannels == 1 }");
-            WREN_CODE("isRGB { colorChannels == 3 }");
-            WREN_CODE("isRGBA { colorChannels == 4 }");
-
-            WREN_CODE("isBytes { bytesPerChannel == 1 }");
-            WREN_CODE("isShorts { bytesPerChannel == 2 }");
-            WREN_CODE("isFloats { bytesPerChannel == 4 }");
-
-            WREN_CODE("bytes { width * height * colorChannels * bytesPerChannel }");
-            WREN_CODE("pitch { width * colorChannels * bytesPerChannel }");
-
-            // TODO: resize
-            // TODO: convert
-        }
-        WREN_END_CLASS();
+        WREN_MODULE_BUILD(IMAGE_MODULE);
     }
 
     if (!imageWrenInitEx(vm))
@@ -336,6 +523,7 @@ WRENCH_EXPORT bool imageWrenInit(WrenVM* vm)
     }
 
     return wrenEndModule(vm);
+#endif /* WRENCH_STATIC_MODULE_SOURCE && !WRENCH_IMAGE_EXTENDED */
 }
 
 WRENCH_EXPORT void imageWrenQuit(void)
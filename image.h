@@ -16,6 +16,8 @@ typedef struct image_Image
     int height;
     int color_channels;
     int bytes_per_channel;
+
+    WrenBufferStorage* storage; // Owns `pixels` once shared through `data`, otherwise NULL.
 }
 image_Image;
 
@@ -5,4 +5,12 @@
 
 #define WRENCH_IMPLEMENTATION
 #define WRENCH_MAIN main
+
+#if WRENCH_STATIC_STDLIB
+    /*
+     * Link the standard library into run_wren instead of loading it from shared libraries.
+     */
+    #define WRENCH_STATIC_MODULES(X) X(file) X(image)
+#endif
+
 #include <wrench.h>
@@ -0,0 +1,62 @@
+# Runs each script in tests/ with run_wren (so ./build.sh first). Scripts abort on their first
+# failed check, so any non-zero exit is a failure. Scratch files go in tests/scratch. The checks
+# after the loop run scripts from tests/support and check run_wren's exit status.
+cd "$(dirname "$0")"
+
+rm -rf tests/scratch
+mkdir -p tests/scratch
+
+failed=0
+
+# expect <what> <exit status> <command...>
+expect() {
+    what=$1
+    status=$2
+    shift 2
+
+    "$@"
+    actual=$?
+
+    if [ "$actual" -eq "$status" ]; then
+        echo "PASS $what"
+    else
+        echo "FAIL $what (exit status $actual, expected $status)"
+        failed=1
+    fi
+}
+
+for test in tests/*.wren; do
+    expect "$test" 0 ./run_wren "$test"
+done
+
+# Output is buffered when stdout isn't a terminal, and must still arrive complete and in order.
+./run_wren tests/support/print_lines.wren > tests/scratch/print_lines.txt
+seq 1 20000 > tests/scratch/print_lines.expected
+expect "buffered output is complete and in order" 0 cmp -s tests/scratch/print_lines.txt tests/scratch/print_lines.expected
+
+# Buffered output (stdout is a file here) must not wait for the script to finish.
+./run_wren tests/support/print_then_spin.wren > tests/scratch/print_then_spin.txt &
+sleep 1
+expect "output is flushed while a script computes" 0 grep -q "printed" tests/scratch/print_then_spin.txt
+wait
+
+# The fork server runs each client's script in a forked copy of its VM, and returns its status.
+./run_wren --serve tests/scratch/serve.sock file &
+server=$!
+sleep 1
+expect "a script runs in the fork server" 0 ./run_wren --client tests/scratch/serve.sock tests/support/hello.wren
+expect "the fork server returns a failing script's status" 1 ./run_wren --client tests/scratch/serve.sock tests/support/fails.wren
+kill $server
+wait $server 2>/dev/null
+
+# Batch mode runs many scripts in one process, and fails if any of them does.
+expect "batch mode runs every script" 0 ./run_wren --batch tests/support/hello.wren tests/support/goodbye.wren
+expect "batch mode with one reused VM" 0 ./run_wren --batch -j 1 --reuse tests/support/hello.wren tests/support/goodbye.wren
+expect "batch mode fails if a script does" 1 ./run_wren --batch -j 2 tests/support/hello.wren tests/support/fails.wren
+
+expect "main() runs after the script" 0 sh -c './run_wren tests/support/main_called.wren | grep -qx "main ran"'
+expect "main's result is the exit status" 3 ./run_wren tests/support/main_status.wren
+expect "main can't return a fraction" 1 ./run_wren tests/support/main_fraction.wren
+
+rm -rf tests/scratch
+exit $failed
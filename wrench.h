@@ -30,22 +30,55 @@ typedef void  (*wrenFileFreeFn)(WrenVM* vm, void* data, size_t size);
 typedef bool (*wrenLibraryInitFn)(WrenVM* vm);
 typedef void (*wrenLibraryQuitFn)(void);
 
+/* Event sources let native modules complete work outside of foreign calls. `poll` runs on
+ * the VM thread, resumes fibers for finished operations, and returns how many are still
+ * pending. It must wait at most `timeout_ms` (-1 = until something completes, 0 = never),
+ * and must return immediately if nothing is pending.
+ */
+typedef int  (*wrenEventPollFn)(WrenVM* vm, int timeout_ms, void* data);
+typedef void (*wrenEventFreeFn)(WrenVM* vm, void* data);
+
+/* Async foreign methods (see `WREN_ASYNC_METHOD`). `begin` runs on the VM thread and reads
+ * arguments from slots into a task (returning NULL only if it aborted the fiber). `work` runs
+ * on a pool thread and must not touch the VM. `done` runs back on the VM thread, writes the
+ * result (or an error message, returning false) into slot 0, and frees the task. `done` is
+ * always called exactly once, even if the VM is freed while work is still in flight.
+ */
+typedef void* (*wrenAsyncBeginFn)(WrenVM* vm);
+typedef void  (*wrenAsyncWorkFn)(void* task);
+typedef bool  (*wrenAsyncDoneFn)(WrenVM* vm, void* task);
+
 /*
 ================================================================================
  * ~~ [ macros ] ~~ *
 --------------------------------------------------------------------------------
 */
 
+/* Gives the implementation internal linkage, so that foreign libraries linked into the same
+ * executable as the host (see `WRENCH_STATIC_MODULES`) can each keep their own copy of it.
+ */
+#ifndef WRENCH_PRIVATE_IMPLEMENTATION
+#define WRENCH_PRIVATE_IMPLEMENTATION 0
+#endif
+
 /* Function declaration.
  */
 #ifndef WRENCH_DECL
-#define WRENCH_DECL(ret, name, args) WREN_API ret wren ## name args
+    #if WRENCH_PRIVATE_IMPLEMENTATION
+        #define WRENCH_DECL(ret, name, args) static ret wren ## name args
+    #else
+        #define WRENCH_DECL(ret, name, args) WREN_API ret wren ## name args
+    #endif
 #endif
 
 /* Function definition.
  */
 #ifndef WRENCH_IMPL
-#define WRENCH_IMPL(ret, name, args) ret wren ## name args
+    #if WRENCH_PRIVATE_IMPLEMENTATION
+        #define WRENCH_IMPL(ret, name, args) static ret wren ## name args
+    #else
+        #define WRENCH_IMPL(ret, name, args) ret wren ## name args
+    #endif
 #endif
 
 /* Helper for foreign library init and quit functions.
@@ -216,6 +249,43 @@ while (0)
 
 #endif /* WREN_PROPERTY */
 
+/* Registers `methodName(args)` as a Wren method that suspends the calling fiber while the work
+ * runs on the thread pool, backed by a foreign `methodName_(args..., fiber)`. The module must
+ * import `Scheduler` from "wrench". Define the foreign function with `WREN_ASYNC_FUNCTION`.
+ */
+#ifndef WREN_ASYNC_METHOD_EX
+#define WREN_ASYNC_METHOD_EX(moduleName, className, is_static, methodName, args, signature, func) do     \
+{                                                                                                       \
+    if (!wrenRegisterAsyncMethod(vm, #moduleName, #className, is_static, #methodName, args, func))      \
+    {                                                                                                   \
+        return false;                                                                                   \
+    }                                                                                                   \
+}                                                                                                       \
+while (0)
+
+#endif /* WREN_ASYNC_METHOD_EX */
+
+#ifndef WREN_ASYNC_METHOD
+#define WREN_ASYNC_METHOD(moduleName, className, is_static, methodName, args, signature)                                                         \
+                                                                                                                                                \
+    WREN_ASYNC_METHOD_EX(moduleName, className, is_static, methodName, args, signature, moduleName ## _ ## className ## _ ## methodName ## _async) \
+
+#endif /* WREN_ASYNC_METHOD */
+
+/* Defines `module_Class_method_async` from `_begin`, `_work`, and `_done` functions.
+ */
+#ifndef WREN_ASYNC_FUNCTION
+#define WREN_ASYNC_FUNCTION(moduleName, className, methodName)                                  \
+                                                                                                \
+    static void moduleName ## _ ## className ## _ ## methodName ## _async(WrenVM* vm)           \
+    {                                                                                           \
+        wrenCallAsync(vm, moduleName ## _ ## className ## _ ## methodName ## _begin,            \
+                          moduleName ## _ ## className ## _ ## methodName ## _work,             \
+                          moduleName ## _ ## className ## _ ## methodName ## _done);            \
+    }                                                                                           \
+
+#endif /* WREN_ASYNC_FUNCTION */
+
 // TODO: WREN_INDEX
 
 // TODO: WREN_ADD
@@ -235,6 +305,90 @@ while (0)
 
 #endif /* WREN_CODE */
 
+/* Modules defined once as a list of entries, then either registered as a single string the
+ * compiler assembles (`WREN_MODULE_STATIC`), which every VM shares without copying it into its
+ * source arena, or copied into the arena between `wrenBeginModule` and `wrenEndModule`
+ * (`WREN_MODULE_BUILD`), where more `WREN_CODE` can follow. Each entry mirrors the macro of
+ * the same name, except `ASYNC_METHOD`, which takes its parameters and signature without
+ * parentheses (and needs at least one parameter):
+ *
+ *  #define IMAGE_MODULE(X)                                                         \
+ *      X(CODE)("import \"wrench\" for Scheduler")                                  \
+ *      X(BEGIN_CLASS)(image, Image)                                                \
+ *      X(METHOD)(image, Image, true, load, "(filename)", "(_)")                    \
+ *      X(ASYNC_METHOD)(image, Image, true, loadAsync, "filename", "_")             \
+ *      X(GETTER)(image, Image, false, width)                                       \
+ *      X(END_CLASS)(image, Image)                                                  \
+ *
+ *  WREN_MODULE_STATIC("image", IMAGE_MODULE);
+ *
+ * Arguments go straight to the entry (not through a variadic macro), so names like `stdout`
+ * and `EOF` aren't expanded before they're stringized, same as with `WREN_METHOD_EX`.
+ */
+#ifndef WRENCH_STATIC_MODULE_SOURCE
+#define WRENCH_STATIC_MODULE_SOURCE 1
+#endif
+
+#define _WREN_SOURCE(kind) _WREN_SOURCE_ ## kind
+#define _WREN_SOURCE_CODE(text) text "\n"
+#define _WREN_SOURCE_BEGIN_CLASS(moduleName, className) "foreign class " #className " {\n"
+#define _WREN_SOURCE_BEGIN_CLASS_EX(moduleName, className, ctor, dtor) "foreign class " #className " {\n"
+#define _WREN_SOURCE_END_CLASS(moduleName, className) "}\n"
+#define _WREN_SOURCE_METHOD(moduleName, className, is_static, methodName, args, signature) "foreign " _wren_static_ ## is_static #methodName args "\n"
+#define _WREN_SOURCE_METHOD_EX(moduleName, className, is_static, methodName, args, signature, func) "foreign " _wren_static_ ## is_static #methodName args "\n"
+#define _WREN_SOURCE_GETTER(moduleName, className, is_static, propertyName) "foreign " _wren_static_ ## is_static #propertyName "\n"
+#define _WREN_SOURCE_SETTER(moduleName, className, is_static, propertyName) "foreign " _wren_static_ ## is_static #propertyName "=(value)\n"
+#define _WREN_SOURCE_ASYNC_METHOD(moduleName, className, is_static, methodName, params, signature)    \
+                                                                                                        \
+    "foreign " _wren_static_ ## is_static #methodName "_(" params ", fiber)\n"                          \
+    _wren_static_ ## is_static #methodName "(" params ") {\n"                                           \
+        #methodName "_(" params ", Fiber.current)\n"                                                    \
+        "return Scheduler.await_()\n"                                                                   \
+    "}\n"                                                                                               \
+
+#define _WREN_BIND(kind) _WREN_BIND_ ## kind
+#define _WREN_TRY(call) if (!(call)) { return false; }
+#define _WREN_BIND_CODE(text)
+#define _WREN_BIND_BEGIN_CLASS(moduleName, className) _WREN_TRY(wrenRegisterClass(vm, #moduleName, #className, moduleName ## _ ## className ## _ctor, moduleName ## _ ## className ## _dtor))
+#define _WREN_BIND_BEGIN_CLASS_EX(moduleName, className, ctor, dtor) _WREN_TRY(wrenRegisterClass(vm, #moduleName, #className, ctor, dtor))
+#define _WREN_BIND_END_CLASS(moduleName, className)
+#define _WREN_BIND_METHOD(moduleName, className, is_static, methodName, args, signature) _WREN_TRY(wrenRegisterMethod(vm, #moduleName, #className, is_static, #methodName signature, moduleName ## _ ## className ## _ ## methodName))
+#define _WREN_BIND_METHOD_EX(moduleName, className, is_static, methodName, args, signature, func) _WREN_TRY(wrenRegisterMethod(vm, #moduleName, #className, is_static, #methodName signature, func))
+#define _WREN_BIND_GETTER(moduleName, className, is_static, propertyName) _WREN_TRY(wrenRegisterMethod(vm, #moduleName, #className, is_static, #propertyName, moduleName ## _ ## className ## _ ## propertyName ## _get))
+#define _WREN_BIND_SETTER(moduleName, className, is_static, propertyName) _WREN_TRY(wrenRegisterMethod(vm, #moduleName, #className, is_static, #propertyName "=(_)", moduleName ## _ ## className ## _ ## propertyName ## _set))
+#define _WREN_BIND_ASYNC_METHOD(moduleName, className, is_static, methodName, params, signature) _WREN_TRY(wrenRegisterMethod(vm, #moduleName, #className, is_static, #methodName "_(" signature ",_)", moduleName ## _ ## className ## _ ## methodName ## _async))
+
+#ifndef WREN_MODULE_STATIC
+#define WREN_MODULE_STATIC(moduleName, list) do                                                     \
+{                                                                                                   \
+    static const char _wren_module_source[] = list(_WREN_SOURCE);                                   \
+                                                                                                    \
+    if (!wrenRegisterModuleEx(vm, moduleName, _wren_module_source,                                  \
+                                sizeof(_wren_module_source) - 1, false))                            \
+    {                                                                                               \
+        return false;                                                                               \
+    }                                                                                               \
+                                                                                                    \
+    list(_WREN_BIND)                                                                                \
+}                                                                                                   \
+while (0)
+
+#endif /* WREN_MODULE_STATIC */
+
+#ifndef WREN_MODULE_BUILD
+#define WREN_MODULE_BUILD(list) do              \
+{                                               \
+    if (!wrenCode(vm, list(_WREN_SOURCE)))      \
+    {                                           \
+        return false;                           \
+    }                                           \
+                                                \
+    list(_WREN_BIND)                            \
+}                                               \
+while (0)
+
+#endif /* WREN_MODULE_BUILD */
+
 /* ===== [ foreign type checking ] ========================================== */
 
 #if WRENCH_DEBUG
@@ -266,6 +420,12 @@ WRENCH_DECL(void, FreeExtendedVM, (WrenVM* vm, bool call_global_quit_funcs));
 WRENCH_DECL(void, RegisterGlobalInitFunction, (wrenLibraryInitFn init));
 WRENCH_DECL(void, RegisterGlobalQuitFunction, (wrenLibraryQuitFn quit));
 
+/* Foreign libraries linked into the executable. `wrenDefaultLoadModule` calls `init` instead
+ * of loading a shared library of the same name, and `quit` is called when the VM is freed.
+ * Register these before creating any VMs (the table isn't locked).
+ */
+WRENCH_DECL(void, RegisterStaticModule, (const char* name, wrenLibraryInitFn init, wrenLibraryQuitFn quit));
+
 /* Enabled by default - may be disabled for security hardening purposes.
  */
 WRENCH_DECL(bool, GetForeignLibraryLoadEnabled, (WrenVM* vm));
@@ -294,6 +454,23 @@ WRENCH_DECL(bool, SetCommandLine, (WrenVM* vm, int argc, char** argv));
  */
 WRENCH_DECL(const char*, GetModuleSource, (WrenVM* vm, const char* name));
 
+/* What happens to a module's source once Wren has compiled it (the bytecode doesn't need it).
+ * Dropped source is gone for good (`wrenGetModuleSource` returns NULL), and compressed source
+ * (LZ4) is decompressed on the first `wrenGetModuleSource`. Source that wasn't copied into the
+ * VM (static strings, `copy_source` false) is always kept as is. Applies to modules compiled
+ * after the policy is set.
+ */
+typedef enum WrenSourcePolicy
+{
+    WREN_SOURCE_KEEP,
+    WREN_SOURCE_DROP,
+    WREN_SOURCE_COMPRESS,
+}
+WrenSourcePolicy;
+
+WRENCH_DECL(WrenSourcePolicy, GetSourcePolicy, (WrenVM* vm));
+WRENCH_DECL(void, SetSourcePolicy, (WrenVM* vm, WrenSourcePolicy policy));
+
 /* Main EXE path (prefixed onto file paths passed into `wrenLoadSourceFile`).
  */
 WRENCH_DECL(const char*, GetBasePath, (WrenVM* vm));
@@ -336,6 +513,72 @@ WRENCH_DECL(bool, RegisterClass, (WrenVM* vm, const char* moduleName, const char
  */
 WRENCH_DECL(bool, RegisterMethod, (WrenVM* vm, const char* moduleName, const char* className, bool isStatic, const char* signature, WrenForeignMethodFn method));
 
+/* Fiber scheduling. The built-in "wrench" module provides a `Scheduler` class (modeled on
+ * wren-cli): foreign methods capture `Fiber.current`, start some work, and the Wren side calls
+ * `Scheduler.await_()`, which runs other scheduled fibers or suspends back to the host.
+ * Hosts call `wrenRunEventLoop` after `wrenInterpret` to drive registered event sources
+ * until no work remains. Returns false if a resumed fiber hit a runtime error.
+ */
+WRENCH_DECL(bool, RegisterEventSource, (WrenVM* vm, wrenEventPollFn poll, wrenEventFreeFn free, void* data));
+WRENCH_DECL(void*, GetEventSourceData, (WrenVM* vm, wrenEventPollFn poll));
+WRENCH_DECL(bool, RunEventLoop, (WrenVM* vm));
+
+/* Resume a suspended fiber (and release its handle) with the value in slot 0. If `is_error`
+ * is set, slot 0 should hold an error message, which is raised in the fiber instead.
+ */
+WRENCH_DECL(bool, ResumeFiber, (WrenVM* vm, WrenHandle* fiber, bool is_error));
+
+/* Run work on the shared thread pool while the fiber is suspended. `wrenCallAsync` is meant to
+ * be called from a foreign method whose last argument is the fiber (see `WREN_ASYNC_METHOD`).
+ * `wrenSubmitAsync` takes ownership of the fiber handle if it succeeds.
+ */
+WRENCH_DECL(void, CallAsync, (WrenVM* vm, wrenAsyncBeginFn begin, wrenAsyncWorkFn work, wrenAsyncDoneFn done));
+WRENCH_DECL(bool, SubmitAsync, (WrenVM* vm, WrenHandle* fiber, void* task, wrenAsyncWorkFn work, wrenAsyncDoneFn done));
+
+/* Declare an async method (code and foreign binding) within the module being built.
+ */
+WRENCH_DECL(bool, RegisterAsyncMethod, (WrenVM* vm, const char* moduleName, const char* className, bool isStatic, const char* name, const char* args, WrenForeignMethodFn method));
+
+/* `System.print` output (through `wrenDefaultWrite`) is buffered per VM by default when stdout
+ * isn't a terminal (`WRENCH_OUTPUT_BUFFER_SIZE` bytes), with a writer thread that flushes it
+ * within `WRENCH_OUTPUT_FLUSH_MS`. A `buffer_size` of 0 writes every fragment straight through.
+ * Without `threaded` (or `WRENCH_OUTPUT_THREADED` false for the default), the VM's own thread
+ * buffers and only checks the deadline on the next write, event loop pass or resumed fiber, so
+ * output can wait through a long computation unless it's flushed. If the writer thread can't be
+ * started, output is written straight through. Output is always flushed before errors are
+ * reported, and (best effort) before a failed assert, so the streams stay in order. Wren code
+ * can flush with `Output.flush()` from "wrench".
+ */
+WRENCH_DECL(bool, SetOutputBuffering, (WrenVM* vm, size_t buffer_size, bool threaded));
+WRENCH_DECL(void, FlushOutput, (WrenVM* vm));
+
+/* Send error reports (and `wrenLog` messages) from every VM to a shared log instead of stderr:
+ * a lock-free queue written out by a background thread, one line per entry with a UTC time,
+ * the VM id, the module and line. `wrenOpenLog` appends to a file (NULL for stderr), and
+ * `wrenOpenLogFd` writes to a descriptor the host keeps. Entries are dropped (and counted in the
+ * log) if the queue fills faster than it can be written. Logged errors are no longer ordered
+ * with `System.print` output. Open and close the log while no VMs are running.
+ */
+WRENCH_DECL(bool, OpenLog, (const char* path));
+WRENCH_DECL(bool, OpenLogFd, (int fd));
+WRENCH_DECL(void, CloseLog, (void));
+WRENCH_DECL(void, FlushLog, (void));
+
+WRENCH_DECL(bool, Log, (WrenVM* vm, const char* moduleName, int line, const char* message));
+WRENCH_DECL(int, GetVMId, (WrenVM* vm));
+
+/* Handles cached by the VM, so hosts that call into scripts repeatedly skip Wren's string lookups
+ * and don't have to manage handles. `wrenGetVariableCached` puts a top-level variable (e.g. the
+ * `File` class, for `wrenSetSlotNewForeign`) in a slot. The value is looked up once and reused,
+ * so it's for variables that are never reassigned, like classes. `wrenCallCached` calls a method
+ * on a top-level variable, with the arguments already in slots 1 and up; the receiver goes in
+ * slot 0, as does the result. Only the call handle is cached - the receiver is looked up again
+ * on every call. Variables that don't exist (yet) aren't cached. Handles are released with the VM.
+ */
+WRENCH_DECL(bool, GetVariableCached, (WrenVM* vm, const char* moduleName, const char* name, int slot));
+WRENCH_DECL(WrenHandle*, GetCachedCallHandle, (WrenVM* vm, const char* signature));
+WRENCH_DECL(WrenInterpretResult, CallCached, (WrenVM* vm, const char* moduleName, const char* receiver, const char* signature));
+
 /* Usually the first VM opened.
  */
 WRENCH_DECL(WrenVM*, GetPrimaryVM, (void));
@@ -371,6 +614,58 @@ WRENCH_DECL(void, SetSlotInt, (WrenVM* vm, int slot, int value));
 WRENCH_DECL(uint8_t, GetSlotByte, (WrenVM* vm, int slot));
 WRENCH_DECL(void, SetSlotByte, (WrenVM* vm, int slot, uint8_t value));
 
+/* Whole lists (and maps with string keys) in one call. These are a convenience, not a fast
+ * path: the public API can't pre-size a list, so they cost the same as the equivalent loop.
+ * Like `wrenGetListElement`, elements pass through the `scratch` slot (maps use `scratch` and
+ * `scratch + 1`), which must already exist. `wrenGetSlotListAs*` copy up to `capacity`
+ * elements and return the list's count (which may be larger), or -1 if the slot isn't a list
+ * of numbers that fit the element type (whole numbers in range for ints, in range for floats).
+ * Maps take parallel arrays of keys and values.
+ */
+WRENCH_DECL(void, SetSlotListFromDoubles, (WrenVM* vm, int slot, int scratch, const double* values, int count));
+WRENCH_DECL(void, SetSlotListFromFloats, (WrenVM* vm, int slot, int scratch, const float* values, int count));
+WRENCH_DECL(void, SetSlotListFromInts, (WrenVM* vm, int slot, int scratch, const int* values, int count));
+WRENCH_DECL(void, SetSlotListFromStrings, (WrenVM* vm, int slot, int scratch, const char* const* values, int count));
+
+WRENCH_DECL(int, GetSlotListAsDoubles, (WrenVM* vm, int slot, int scratch, double* values, int capacity));
+WRENCH_DECL(int, GetSlotListAsFloats, (WrenVM* vm, int slot, int scratch, float* values, int capacity));
+WRENCH_DECL(int, GetSlotListAsInts, (WrenVM* vm, int slot, int scratch, int* values, int capacity));
+
+WRENCH_DECL(void, SetSlotMapFromDoubles, (WrenVM* vm, int slot, int scratch, const char* const* keys, const double* values, int count));
+WRENCH_DECL(void, SetSlotMapFromStrings, (WrenVM* vm, int slot, int scratch, const char* const* keys, const char* const* values, int count));
+
+/* Raw memory shared between modules without copying: `Buffer` in the built-in "wrench" module.
+ * Storage is reference counted and remembers how to free itself, so any module can create it
+ * and any other can hold it. Buffers are typed views (offset, size, element type) of storage;
+ * slicing or retyping one makes a new view of the same bytes. `data` passed to
+ * `wrenNewBufferStorage` is adopted and given to `release` (if not NULL) with the last
+ * reference; NULL data allocates `size` zeroed bytes instead.
+ *
+ * Setting slots needs the "wrench" module to have been imported - stdlib modules that return
+ * buffers import it themselves. As with `wrenGetSlotForeign`, the slot passed to
+ * `wrenGetSlotBuffer` must hold a Buffer - check `is Buffer` in the Wren code that calls the
+ * foreign method. It returns NULL only for slots that aren't foreign objects at all.
+ */
+typedef struct WrenBufferStorage WrenBufferStorage;
+
+typedef enum WrenBufferType
+{
+    WREN_BUFFER_U8,
+    WREN_BUFFER_U16,
+    WREN_BUFFER_I32,
+    WREN_BUFFER_F32,
+    WREN_BUFFER_F64,
+}
+WrenBufferType;
+
+WRENCH_DECL(WrenBufferStorage*, NewBufferStorage, (void* data, size_t size, void (*release)(void* data)));
+WRENCH_DECL(void, RetainBufferStorage, (WrenBufferStorage* storage));
+WRENCH_DECL(void, ReleaseBufferStorage, (WrenBufferStorage* storage));
+
+WRENCH_DECL(bool, SetSlotBuffer, (WrenVM* vm, int slot, WrenBufferStorage* storage, size_t offset, size_t size, WrenBufferType type));
+WRENCH_DECL(void*, SetSlotNewBuffer, (WrenVM* vm, int slot, size_t size));
+WRENCH_DECL(void*, GetSlotBuffer, (WrenVM* vm, int slot, size_t* size, WrenBufferType* type));
+
 /* WrenConfiguration callbacks.
  */
 WRENCH_DECL(void*, DefaultReallocate, (void* ptr, size_t newSize, void* userData));
@@ -422,9 +717,22 @@ WRENCH_DECL(void, DefaultError, (WrenVM* vm, WrenErrorType type, const char* mod
     #include <windows.h>
 #endif
 
+#if _WIN32 && !WRENCH_NO_CSTDLIB
+    #include <fcntl.h>
+    #include <io.h>
+    #include <sys/stat.h>
+    #include <time.h>
+#endif
+
 #if !_WIN32 && !WRENCH_NO_POSIX_HEADERS
     #include <dlfcn.h>
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <pthread.h>
+    #include <sched.h>
     #include <signal.h>
+    #include <time.h>
+    #include <unistd.h>
 #endif
 
 /* TODO: Some of these #defines are vestigial.
@@ -439,12 +747,22 @@ WRENCH_DECL(void, DefaultError, (WrenVM* vm, WrenErrorType type, const char* mod
 #ifndef wrench_calloc
 #define wrench_calloc calloc
 #endif
+#if !defined(wrench_close)
+    #if _WIN32
+        #define wrench_close _close
+    #else
+        #define wrench_close close
+    #endif
+#endif
 #ifndef wrench_fabs
 #define wrench_fabs fabs
 #endif
 #ifndef wrench_fclose
 #define wrench_fclose fclose
 #endif
+#ifndef wrench_fflush
+#define wrench_fflush fflush
+#endif
 #ifndef wrench_fopen
 #define wrench_fopen fopen
 #endif
@@ -463,9 +781,18 @@ WRENCH_DECL(void, DefaultError, (WrenVM* vm, WrenErrorType type, const char* mod
 #ifndef wrench_ftell
 #define wrench_ftell ftell
 #endif
+#ifndef wrench_fwrite
+#define wrench_fwrite fwrite
+#endif
 #ifndef wrench_malloc
 #define wrench_malloc malloc
 #endif
+#ifndef wrench_memchr
+#define wrench_memchr memchr
+#endif
+#ifndef wrench_memcmp
+#define wrench_memcmp memcmp
+#endif
 #ifndef wrench_memcpy
 #define wrench_memcpy memcpy
 #endif
@@ -512,6 +839,13 @@ WRENCH_DECL(void, DefaultError, (WrenVM* vm, WrenErrorType type, const char* mod
 #ifndef wrench_trunc
 #define wrench_trunc trunc
 #endif
+#if !defined(wrench_write)
+    #if _WIN32
+        #define wrench_write _write
+    #else
+        #define wrench_write write
+    #endif
+#endif
 
 /* ===== [ utilities ] ====================================================== */
 
@@ -590,8 +924,12 @@ WRENCH_DECL(void, DefaultError, (WrenVM* vm, WrenErrorType type, const char* mod
 #endif /* !wrench_breakpoint */
 
 #ifndef wrench_assert
+#define WRENCH_ASSERT_FLUSHES_OUTPUT
+static void wrenchFlushAllOutput(void);
+
 #define wrench_assert(cnd, ...) if ((cnd) == 0)                                                     \
 {                                                                                                   \
+    wrenchFlushAllOutput();                                                                         \
     wrench_fprintf(wrench_stderr, "assert \"%s\" failed in func \"%s\" (file \"%s\", line %i): ",   \
                                         WRENCH_STRINGIFY(cnd), __FUNCTION__, __FILE__, __LINE__);   \
                                                                                                     \
@@ -629,149 +967,661 @@ WRENCH_DECL(void, DefaultError, (WrenVM* vm, WrenErrorType type, const char* mod
     #endif
 #endif /* WRENCH_DEBUG */
 
-/* ===== [ context & nodes ] ================================================ */
+/* ===== [ threads ] ======================================================== */
 
-typedef struct WrenchMethod
-{
-//  struct WrenchMethod* prev;
-    struct WrenchMethod* next;
+#if _WIN32
+    typedef CRITICAL_SECTION wrench_mutex;
+    typedef CONDITION_VARIABLE wrench_cond;
 
-//  struct WrenchClass* klass;
+    #define wrench_mutex_init(m) InitializeCriticalSection(m)
+    #define wrench_mutex_destroy(m) DeleteCriticalSection(m)
+    #define wrench_mutex_lock(m) EnterCriticalSection(m)
+    #define wrench_mutex_unlock(m) LeaveCriticalSection(m)
+    #define wrench_mutex_trylock(m) (TryEnterCriticalSection(m) != 0)
 
-    bool is_static;
-    const char* signature;
-    WrenForeignMethodFn method;
-}
-WrenchMethod;
+    #define wrench_cond_init(c) InitializeConditionVariable(c)
+    #define wrench_cond_destroy(c) ((void)0)
+    #define wrench_cond_wait(c, m) SleepConditionVariableCS((c), (m), INFINITE)
+    #define wrench_cond_timedwait(c, m, ms) SleepConditionVariableCS((c), (m), (DWORD)(ms))
+    #define wrench_cond_signal(c) WakeConditionVariable(c)
+    #define wrench_cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+    typedef pthread_mutex_t wrench_mutex;
+    typedef pthread_cond_t wrench_cond;
 
-typedef struct WrenchClass
-{
-//  struct WrenchClass* prev;
-    struct WrenchClass* next;
+    #define wrench_mutex_init(m) pthread_mutex_init((m), NULL)
+    #define wrench_mutex_destroy(m) pthread_mutex_destroy(m)
+    #define wrench_mutex_lock(m) pthread_mutex_lock(m)
+    #define wrench_mutex_unlock(m) pthread_mutex_unlock(m)
+    #define wrench_mutex_trylock(m) (pthread_mutex_trylock(m) == 0)
 
-    WrenchMethod* method_head;
-    WrenchMethod* method_tail;
+    #define wrench_cond_init(c) pthread_cond_init((c), NULL)
+    #define wrench_cond_destroy(c) pthread_cond_destroy(c)
+    #define wrench_cond_wait(c, m) pthread_cond_wait((c), (m))
+    #define wrench_cond_timedwait(c, m, ms) wrenchCondTimedWait((c), (m), (ms))
+    #define wrench_cond_signal(c) pthread_cond_signal(c)
+    #define wrench_cond_broadcast(c) pthread_cond_broadcast(c)
 
-//  struct WrenchModule* module;
+    static void wrenchCondTimedWait(pthread_cond_t* cond, pthread_mutex_t* mutex, int ms)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
 
-    const char* name;
-    WrenForeignMethodFn ctor;
-    WrenFinalizerFn dtor;
-}
-WrenchClass;
+        ts.tv_sec += ms / 1000;
+        ts.tv_nsec += (long)(ms % 1000) * 1000000L;
 
-typedef struct WrenchModule
+        if (ts.tv_nsec >= 1000000000L)
+        {
+            ts.tv_sec += 1;
+            ts.tv_nsec -= 1000000000L;
+        }
+
+        pthread_cond_timedwait(cond, mutex, &ts);
+    }
+#endif
+
+/* Sequentially consistent read-modify-writes, acquire loads, and release stores on `long long`.
+ */
+#if _MSC_VER
+    #define wrench_atomic_load(p) InterlockedOr64((volatile LONG64*)(p), 0)
+    #define wrench_atomic_store(p, v) InterlockedExchange64((volatile LONG64*)(p), (LONG64)(v))
+    #define wrench_atomic_add(p, v) InterlockedExchangeAdd64((volatile LONG64*)(p), (LONG64)(v))
+    #define wrench_atomic_cas(p, expected, desired) (InterlockedCompareExchange64((volatile LONG64*)(p), (LONG64)(desired), (LONG64)(expected)) == (LONG64)(expected))
+#else
+    #define wrench_atomic_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+    #define wrench_atomic_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+    #define wrench_atomic_add(p, v) __atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST)
+    #define wrench_atomic_cas(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+#endif
+
+/* Start a detached thread.
+ */
+static bool wrenchThreadStart(void (*func)(void* arg), void* arg)
 {
-//  struct WrenchModule* prev;
-    struct WrenchModule* next;
+    #if _WIN32
+    {
+        HANDLE thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)(void*)func, arg, 0, NULL);
 
-    WrenchClass* class_head;
-    WrenchClass* class_tail;
+        if (thread == NULL)
+        {
+            return false;
+        }
 
-    const char* name;
-    const char* source;
+        CloseHandle(thread);
+        return true;
+    }
+    #else
+    {
+        pthread_t thread;
 
-    void* library;
+        if (pthread_create(&thread, NULL, (void* (*)(void*))(void*)func, arg) != 0)
+        {
+            return false;
+        }
+
+        pthread_detach(thread);
+        return true;
+    }
+    #endif
 }
-WrenchModule;
 
-typedef struct WrenchContext
+static int wrenchCountProcessors(void)
 {
-    struct WrenchContext* prev;
-    struct WrenchContext* next;
+    #if _WIN32
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
 
-    char error[1024 * 4];
-    char* base_path;
+        return (int)info.dwNumberOfProcessors;
+    }
+    #else
+    {
+        const long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return n > 0 ? (int)n : 1;
+    }
+    #endif
+}
 
-    int argc;
-    char** argv;
+/* Monotonic clock.
+ */
+static long long wrenchMilliseconds(void)
+{
+    #if _WIN32
+    {
+        return (long long)GetTickCount64();
+    }
+    #else
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
 
-    WrenchModule* module_head;
-    WrenchModule* module_tail;
+        return (long long)ts.tv_sec * 1000 + (long long)(ts.tv_nsec / 1000000L);
+    }
+    #endif
+}
 
-    char* node_alloc_base;
-    char* node_alloc_end;
-    char* node_alloc_mark;
+/* The monotonic clock to a few milliseconds, where it's cheaper to read (for per-write checks).
+ */
+static long long wrenchCoarseMilliseconds(void)
+{
+    #if defined(CLOCK_MONOTONIC_COARSE)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
 
-    char* source_code_alloc_base;
-    char* source_code_alloc_end;
-    char* source_code_alloc_mark;
+        return (long long)ts.tv_sec * 1000 + (long long)(ts.tv_nsec / 1000000L);
+    }
+    #else
+    {
+        return wrenchMilliseconds();
+    }
+    #endif
+}
 
-    // Avoiding O(n^2) module iteration.
-    WrenchModule* last_accessed_module;
+static long long wrenchWallClockMilliseconds(void)
+{
+    #if _WIN32
+    {
+        FILETIME ft; // 100ns intervals since 1601.
+        GetSystemTimeAsFileTime(&ft);
 
-    WrenchModule* module_being_built;
-    char* module_builder_base;
-    bool foreign_library_load_disabled;
+        const unsigned long long t = ((unsigned long long)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+        return (long long)(t / 10000ULL) - 11644473600000LL;
+    }
+    #else
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
 
-    wrenFileReadFn file_read_callback;
-    wrenFileFreeFn file_free_callback;
+        return (long long)ts.tv_sec * 1000 + (long long)(ts.tv_nsec / 1000000L);
+    }
+    #endif
+}
 
-    WrenVM* vm;
-    void* userdata[16];
+static void wrenchYield(void)
+{
+    #if _WIN32
+        SwitchToThread();
+    #else
+        sched_yield();
+    #endif
 }
-WrenchContext;
 
-static WrenchContext* wrench_primary_context;
+static bool wrenchStdoutIsTerminal(void)
+{
+    #if _WIN32
+    {
+        return GetFileType(GetStdHandle(STD_OUTPUT_HANDLE)) == FILE_TYPE_CHAR;
+    }
+    #else
+    {
+        return isatty(fileno(wrench_stdout)) != 0;
+    }
+    #endif
+}
 
-static WrenchContext* wrench_context_head;
-static WrenchContext* wrench_context_tail;
+/* ===== [ source compression ] ============================================= */
 
-static WrenchMethod* wrenchGetMethod(WrenchContext* context, WrenchClass* klass, bool is_static, const char* signature, WrenchMethod** previous)
-{
-    wrench_assert(klass != NULL, "%i %s", (int)is_static, signature);
+/* LZ4 block format, so that liblz4 can be dropped in with `#define WRENCH_LZ4_COMPRESS
+ * LZ4_compress_default` and `#define WRENCH_LZ4_DECOMPRESS LZ4_decompress_safe`. The built-in
+ * encoder is a simple greedy one, within a few percent of liblz4's default.
+ */
+#ifndef WRENCH_LZ4_COMPRESS
+#define WRENCH_LZ4_COMPRESS wrenchLZ4Compress
+#endif
 
-    WrenchMethod* node = klass->method_head;
-    WrenchMethod* prev = NULL;
+#ifndef WRENCH_LZ4_DECOMPRESS
+#define WRENCH_LZ4_DECOMPRESS wrenchLZ4Decompress
+#endif
 
-    while (node != NULL)
-    {
-        if (is_static == node->is_static && wrench_strcmp(signature, node->signature) == 0)
-        {
-            if (previous != NULL)
-            {
-                *previous = prev;
-            }
+#define WRENCH_LZ4_HASH_BITS 12
+#define WRENCH_LZ4_MIN_MATCH 4
+#define WRENCH_LZ4_MAX_OFFSET 65535
 
-            return node;
-        }
+static uint32_t wrenchLZ4Read32(const unsigned char* p)
+{
+    uint32_t value;
+    wrench_memcpy(&value, p, sizeof(value));
 
-        prev = node;
-        node = node->next;
-    }
+    return value;
+}
 
-    if (previous != NULL)
+static unsigned char* wrenchLZ4WriteLength(unsigned char* dst, size_t length)
+{
+    for (; length >= 255; length -= 255)
     {
-        *previous = NULL;
+        *dst++ = 255;
     }
 
-    return NULL;
+    *dst++ = (unsigned char)length;
+    return dst;
 }
 
-static WrenchClass* wrenchGetClass(WrenchContext* context, WrenchModule* module, const char* name, WrenchClass** previous)
+/* Returns the compressed size, or 0 if it wouldn't fit in `dst_capacity` bytes.
+ */
+static int wrenchLZ4Compress(const char* source, char* dest, int source_size, int dst_capacity)
 {
-    wrench_assert(module != NULL, "%s", name);
+    const unsigned char* src = (const unsigned char*)source;
+    const unsigned char* end = src + source_size;
 
-    WrenchClass* node = module->class_head;
-    WrenchClass* prev = NULL;
+    unsigned char* dst = (unsigned char*)dest;
+    unsigned char* dst_end = dst + dst_capacity;
 
-    while (node != NULL)
-    {
-        if (wrench_strcmp(name, node->name) == 0)
-        {
-            if (previous != NULL)
-            {
-                *previous = prev;
-            }
+    const unsigned char* anchor = src;
+    const unsigned char* ip = src;
 
-            return node;
-        }
+    // The format ends with at least 5 literals, and the last match starts 12 bytes from the end.
+    const unsigned char* match_limit = source_size > 12 ? end - 12 : src;
+    const unsigned char* copy_limit = end - 5;
 
-        prev = node;
-        node = node->next;
-    }
+    int table[1 << WRENCH_LZ4_HASH_BITS];
+    wrench_memset(table, 0xFF, sizeof(table));
 
-    if (previous != NULL)
+    while (ip < match_limit)
+    {
+        const uint32_t sequence = wrenchLZ4Read32(ip);
+        const uint32_t hash = (sequence * 2654435761u) >> (32 - WRENCH_LZ4_HASH_BITS);
+
+        const int candidate = table[hash];
+        table[hash] = (int)(ip - src);
+
+        if (candidate < 0 || (ip - src) - candidate > WRENCH_LZ4_MAX_OFFSET ||
+            wrenchLZ4Read32(src + candidate) != sequence)
+        {
+            ip++;
+            continue;
+        }
+
+        const unsigned char* ref = src + candidate;
+        const unsigned char* match_end = ip + WRENCH_LZ4_MIN_MATCH;
+
+        while (match_end < copy_limit && *match_end == ref[match_end - ip])
+        {
+            match_end++;
+        }
+
+        const size_t num_literals = (size_t)(ip - anchor);
+        const size_t match_length = (size_t)(match_end - ip) - WRENCH_LZ4_MIN_MATCH;
+
+        if ((size_t)(dst_end - dst) < 1 + num_literals / 255 + 1 + num_literals + 2 + match_length / 255 + 1)
+        {
+            return 0;
+        }
+
+        unsigned char* token = dst++;
+
+        *token = (unsigned char)((num_literals < 15 ? num_literals : 15) << 4);
+        dst = num_literals >= 15 ? wrenchLZ4WriteLength(dst, num_literals - 15) : dst;
+
+        wrench_memcpy(dst, anchor, num_literals);
+        dst += num_literals;
+
+        const size_t offset = (size_t)(ip - ref);
+
+        *dst++ = (unsigned char)(offset & 0xFF);
+        *dst++ = (unsigned char)(offset >> 8);
+
+        *token |= (unsigned char)(match_length < 15 ? match_length : 15);
+        dst = match_length >= 15 ? wrenchLZ4WriteLength(dst, match_length - 15) : dst;
+
+        ip = anchor = match_end;
+    }
+
+    const size_t num_literals = (size_t)(end - anchor);
+
+    if ((size_t)(dst_end - dst) < 1 + num_literals / 255 + 1 + num_literals)
+    {
+        return 0;
+    }
+
+    unsigned char* token = dst++;
+
+    *token = (unsigned char)((num_literals < 15 ? num_literals : 15) << 4);
+    dst = num_literals >= 15 ? wrenchLZ4WriteLength(dst, num_literals - 15) : dst;
+
+    wrench_memcpy(dst, anchor, num_literals);
+    dst += num_literals;
+
+    return (int)(dst - (unsigned char*)dest);
+}
+
+/* Returns the decompressed size, or a negative number if the input is malformed.
+ */
+static int wrenchLZ4Decompress(const char* source, char* dest, int compressed_size, int dst_capacity)
+{
+    const unsigned char* ip = (const unsigned char*)source;
+    const unsigned char* end = ip + compressed_size;
+
+    unsigned char* dst = (unsigned char*)dest;
+    unsigned char* op = dst;
+    unsigned char* dst_end = dst + dst_capacity;
+
+    while (ip < end)
+    {
+        const unsigned token = *ip++;
+        size_t num_literals = token >> 4;
+
+        if (num_literals == 15)
+        {
+            unsigned char b;
+
+            do
+            {
+                if (ip >= end) { return -1; }
+
+                b = *ip++;
+                num_literals += b;
+            }
+            while (b == 255);
+        }
+
+        if ((size_t)(end - ip) < num_literals || (size_t)(dst_end - op) < num_literals)
+        {
+            return -1;
+        }
+
+        wrench_memcpy(op, ip, num_literals);
+
+        op += num_literals;
+        ip += num_literals;
+
+        if (ip == end) // The last sequence has no match.
+        {
+            return (int)(op - dst);
+        }
+
+        if (end - ip < 2)
+        {
+            return -1;
+        }
+
+        const size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > (size_t)(op - dst))
+        {
+            return -1;
+        }
+
+        size_t match_length = token & 15;
+
+        if (match_length == 15)
+        {
+            unsigned char b;
+
+            do
+            {
+                if (ip >= end) { return -1; }
+
+                b = *ip++;
+                match_length += b;
+            }
+            while (b == 255);
+        }
+
+        match_length += WRENCH_LZ4_MIN_MATCH;
+
+        if ((size_t)(dst_end - op) < match_length)
+        {
+            return -1;
+        }
+
+        // Byte by byte, since the match may overlap the bytes it produces.
+        for (const unsigned char* ref = op - offset; match_length > 0; match_length--)
+        {
+            *op++ = *ref++;
+        }
+    }
+
+    return -1;
+}
+
+/* ===== [ context & nodes ] ================================================ */
+
+typedef struct WrenchMethod
+{
+//  struct WrenchMethod* prev;
+    struct WrenchMethod* next;
+
+//  struct WrenchClass* klass;
+
+    bool is_static;
+    const char* signature;
+    WrenForeignMethodFn method;
+}
+WrenchMethod;
+
+typedef struct WrenchClass
+{
+//  struct WrenchClass* prev;
+    struct WrenchClass* next;
+
+    WrenchMethod* method_head;
+    WrenchMethod* method_tail;
+
+//  struct WrenchModule* module;
+
+    const char* name;
+    WrenForeignMethodFn ctor;
+    WrenFinalizerFn dtor;
+}
+WrenchClass;
+
+typedef struct WrenchModule
+{
+//  struct WrenchModule* prev;
+    struct WrenchModule* next;
+
+    WrenchClass* class_head;
+    WrenchClass* class_tail;
+
+    const char* name;
+    const char* source;
+
+    size_t num_chars;
+    const char* compressed; // Source after compilation with WREN_SOURCE_COMPRESS.
+    int compressed_size;
+
+    void* library;
+    wrenLibraryQuitFn quit; // Statically linked libraries.
+}
+WrenchModule;
+
+typedef struct WrenchEventSource
+{
+    wrenEventPollFn poll;
+    wrenEventFreeFn free;
+    void* data;
+}
+WrenchEventSource;
+
+typedef struct WrenchAsyncTask
+{
+    struct WrenchAsyncTask* next;
+    struct WrenchContext* context;
+
+    WrenHandle* fiber;
+    void* data;
+
+    wrenAsyncWorkFn work;
+    wrenAsyncDoneFn done;
+}
+WrenchAsyncTask;
+
+typedef struct WrenchCachedHandle
+{
+    unsigned int hash; // 0 if unused.
+    const char* module; // NULL for call handles.
+    const char* name; // Variable name or method signature.
+
+    WrenHandle* handle;
+}
+WrenchCachedHandle;
+
+#ifndef WRENCH_OUTPUT_BUFFER_SIZE
+#define WRENCH_OUTPUT_BUFFER_SIZE (1024 * 64)
+#endif
+
+#ifndef WRENCH_OUTPUT_FLUSH_MS
+#define WRENCH_OUTPUT_FLUSH_MS 50 // Longest time buffered output may wait for a flush.
+#endif
+
+#ifndef WRENCH_OUTPUT_THREADED
+#define WRENCH_OUTPUT_THREADED true // Whether default stdout buffering uses a writer thread.
+#endif
+
+typedef struct WrenchOutput
+{
+    char* data; // Being filled (NULL if unbuffered).
+    size_t size;
+    size_t capacity;
+    long long first_write_ms; // When `data` last went from empty to non-empty.
+
+    /* Guards everything (while threaded). Exactly one of `spare` and `pending` is set.
+     */
+    bool threaded;
+    wrench_mutex lock;
+    wrench_cond cond;
+
+    char* pending; // Being written by the writer thread.
+    size_t pending_size;
+    char* spare;
+
+    bool running;
+    bool quit;
+}
+WrenchOutput;
+
+typedef struct WrenchContext
+{
+    struct WrenchContext* prev;
+    struct WrenchContext* next;
+
+    char error[1024 * 4];
+    char* base_path;
+
+    int argc;
+    char** argv;
+
+    WrenchModule* module_head;
+    WrenchModule* module_tail;
+
+    char* node_alloc_base;
+    char* node_alloc_end;
+    char* node_alloc_mark;
+
+    char* source_code_alloc_base;
+    char* source_code_alloc_end;
+    char* source_code_alloc_mark;
+
+    WrenSourcePolicy source_policy;
+
+    // Avoiding O(n^2) module iteration.
+    WrenchModule* last_accessed_module;
+
+    WrenchModule* module_being_built;
+    char* module_builder_base;
+    bool foreign_library_load_disabled;
+
+    wrenFileReadFn file_read_callback;
+    wrenFileFreeFn file_free_callback;
+
+    WrenchEventSource event_sources[8];
+    int num_event_sources;
+    bool event_loop_error;
+
+    WrenHandle* scheduler_class;
+    WrenHandle* scheduler_resume;
+    WrenHandle* scheduler_resume_error;
+
+    WrenchCachedHandle* handles; // See `wrenCallCached`.
+    int handle_capacity;
+    int num_handles;
+
+    /* Finished async tasks, pushed by pool threads and reaped by the event loop. Submission
+     * goes through a function pointer so that every native module (each with its own copy of
+     * this implementation) shares the thread pool owned by the host executable.
+     */
+    void (*async_submit)(struct WrenchContext* context, WrenchAsyncTask* task);
+    wrench_mutex async_lock;
+    wrench_cond async_cond;
+    WrenchAsyncTask* async_done_head;
+    WrenchAsyncTask* async_done_tail;
+    int async_pending;
+    bool async_registered;
+
+    WrenchOutput output;
+
+    /* The log is owned by the host executable too (see `async_submit`).
+     */
+    bool (*log_add)(int vm_id, int type, const char* module, int line, const char* message);
+
+    int id; // Unique for the life of the process (for log entries).
+    WrenVM* vm;
+    void* userdata[16];
+}
+WrenchContext;
+
+static WrenchContext* wrench_primary_context;
+
+static WrenchContext* wrench_context_head;
+static WrenchContext* wrench_context_tail;
+
+static WrenchMethod* wrenchGetMethod(WrenchContext* context, WrenchClass* klass, bool is_static, const char* signature, WrenchMethod** previous)
+{
+    wrench_assert(klass != NULL, "%i %s", (int)is_static, signature);
+
+    WrenchMethod* node = klass->method_head;
+    WrenchMethod* prev = NULL;
+
+    while (node != NULL)
+    {
+        if (is_static == node->is_static && wrench_strcmp(signature, node->signature) == 0)
+        {
+            if (previous != NULL)
+            {
+                *previous = prev;
+            }
+
+            return node;
+        }
+
+        prev = node;
+        node = node->next;
+    }
+
+    if (previous != NULL)
+    {
+        *previous = NULL;
+    }
+
+    return NULL;
+}
+
+static WrenchClass* wrenchGetClass(WrenchContext* context, WrenchModule* module, const char* name, WrenchClass** previous)
+{
+    wrench_assert(module != NULL, "%s", name);
+
+    WrenchClass* node = module->class_head;
+    WrenchClass* prev = NULL;
+
+    while (node != NULL)
+    {
+        if (wrench_strcmp(name, node->name) == 0)
+        {
+            if (previous != NULL)
+            {
+                *previous = prev;
+            }
+
+            return node;
+        }
+
+        prev = node;
+        node = node->next;
+    }
+
+    if (previous != NULL)
     {
         *previous = NULL;
     }
@@ -987,6 +1837,26 @@ static const char* wrenchSourceCodeCopy(WrenchContext* context, const char* sour
     return wrenchSourceCodeCopyEx(context, source, wrench_strlen(source));
 }
 
+static bool wrenchSourceCodeOwns(WrenchContext* context, const char* data)
+{
+    return data >= context->source_code_alloc_base && data < context->source_code_alloc_end;
+}
+
+/* Gives back `num_chars` bytes (plus the terminator) no longer needed at `data`. The buffer is
+ * a stack, so this only reclaims the region if it was the last allocated, and anything else stays
+ * dead until the VM is freed. That's the usual case for imports (Wren compiles each module as soon
+ * as it's loaded, and runs its imports afterwards), but not for the main script.
+ */
+static void wrenchSourceCodeFree(WrenchContext* context, const char* data, size_t num_chars)
+{
+    wrench_assert(wrenchSourceCodeOwns(context, data), "");
+
+    if (data + num_chars + 1 == context->source_code_alloc_mark && context->module_builder_base == NULL)
+    {
+        context->source_code_alloc_mark = (char*)data;
+    }
+}
+
 static bool wrenchGetForeignLibraryLoadEnabled(WrenchContext* context)
 {
     return !context->foreign_library_load_disabled;
@@ -1101,14 +1971,28 @@ static const char* wrenchGetModuleSource(WrenchContext* context, const char* nam
 {
     WrenchModule* module = wrenchGetModule(context, name, NULL);
 
-    if (module != NULL)
+    if (module == NULL)
     {
-        return module->source;
+        return NULL;
     }
-    else
+
+    if (module->source == NULL && module->compressed != NULL && context->module_being_built == NULL)
     {
-        return NULL;
+        char* data = wrenchSourceCodeAlloc(context, module->num_chars);
+
+        if (data == NULL)
+        {
+            return NULL;
+        }
+
+        const int num_chars = WRENCH_LZ4_DECOMPRESS(module->compressed, data, module->compressed_size, (int)module->num_chars);
+        wrench_assert(num_chars == (int)module->num_chars, "corrupt source for module \"%s\"", name);
+
+        module->source = (const char*)data;
+        module->compressed = NULL;
     }
+
+    return module->source;
 }
 
 static const char* wrenchGetBasePath(WrenchContext* context)
@@ -1314,6 +2198,8 @@ static bool wrenchRegisterModuleImpl(WrenchContext* context, WrenchModule* node,
         node->source = source;
     }
 
+    node->num_chars = num_chars;
+
     if (context->module_head == NULL)
     {
         context->module_head = node;
@@ -1445,6 +2331,45 @@ static bool wrenchRegisterModule(WrenchContext* context, const char* moduleName,
     return wrenchRegisterModuleEx(context, moduleName, source, source != NULL ? wrench_strlen(source) : 0, true);
 }
 
+/* Drop or compress a module's source after Wren has compiled it (see `WrenSourcePolicy`).
+ */
+static void wrenchApplySourcePolicy(WrenchContext* context, WrenchModule* module)
+{
+    if (context->source_policy == WREN_SOURCE_KEEP || module->source == NULL || !wrenchSourceCodeOwns(context, module->source))
+    {
+        return;
+    }
+
+    char* data = (char*)module->source;
+    const size_t num_chars = module->num_chars;
+
+    if (context->source_policy == WREN_SOURCE_COMPRESS)
+    {
+        const int capacity = (int)(num_chars - num_chars / 8); // Not worth it for less than 1/8 saved.
+        char* packed = num_chars >= 256 ? (char*)wrench_malloc((size_t)capacity) : NULL;
+
+        const int size = packed != NULL ? WRENCH_LZ4_COMPRESS((const char*)data, packed, (int)num_chars, capacity) : 0;
+
+        if (size > 0)
+        {
+            wrench_memcpy(data, packed, (size_t)size);
+
+            module->compressed = (const char*)data;
+            module->compressed_size = size;
+            module->source = NULL;
+
+            // The compressed bytes stay at the start of the region, so only the tail is dead.
+            wrenchSourceCodeFree(context, data + size, num_chars - (size_t)size);
+        }
+
+        wrench_free(packed);
+        return;
+    }
+
+    module->source = NULL;
+    wrenchSourceCodeFree(context, (const char*)data, num_chars);
+}
+
 static bool wrenchRegisterClass(WrenchContext* context, const char* moduleName, const char* className, WrenForeignMethodFn ctor, WrenFinalizerFn dtor)
 {
     WrenchModule* module = context->module_being_built;
@@ -1669,13 +2594,17 @@ static void* wrenchLibraryFunc(WrenchContext* context, void* library, const char
     #endif
 }
 
+/* Set by batch mode, where libraries are shared by the VMs that come and go.
+ */
+static bool wrench_library_keep_loaded;
+
 static void wrenchFreeLibrary(WrenchContext* context, void* library)
 {
     if (0)
     {
         wrench_assert(library != NULL, "");
     }
-    else if (library == NULL)
+    else if (library == NULL || wrench_library_keep_loaded)
     {
         return;
     }
@@ -1695,1065 +2624,4451 @@ static void wrenchFreeLibrary(WrenchContext* context, void* library)
     #endif
 }
 
-static WrenchContext* wrenchNewContext(WrenVM* vm)
+/* The built-in "wrench" module, shared read-only by every VM.
+ */
+static const char wrench_module_source[] =
+
+"class Scheduler {\n"
+    "static add(callable) {\n"
+        "if (__scheduled == null) {\n"
+            "__scheduled = []\n"
+            "__active = 0\n"
+        "}\n"
+
+        "__active = __active + 1\n"
+        "__scheduled.add(Fiber.new {\n"
+            "callable.call()\n"
+            "__active = __active - 1\n"
+
+            "if (__active == 0 && __joiner != null) {\n"
+                "var joiner = __joiner\n"
+                "__joiner = null\n"
+                "joiner.transfer()\n"
+            "}\n"
+
+            "runNextScheduled_()\n"
+        "})\n"
+    "}\n"
+
+    // Run scheduled fibers until all of them have finished.
+    "static join() {\n"
+        "if (__active == null || __active == 0) return\n"
+        "__joiner = Fiber.current\n"
+        "runNextScheduled_()\n"
+    "}\n"
+
+    "static await_() { runNextScheduled_() }\n"
+
+    "static resume_(fiber, value) { fiber.transfer(value) }\n"
+    "static resumeError_(fiber, error) { fiber.transferError(error) }\n"
+
+    "static runNextScheduled_() {\n"
+        "if (__scheduled == null || __scheduled.isEmpty) {\n"
+            "return Fiber.suspend()\n"
+        "} else {\n"
+            "return __scheduled.removeAt(0).transfer()\n"
+        "}\n"
+    "}\n"
+"}\n"
+
+// Write out buffered `System.print` output now (see `wrenSetOutputBuffering`).
+"class Output {\n"
+    "foreign static flush()\n"
+"}\n"
+
+// Module source as kept by the source policy (see `wrenSetSourcePolicy`): "keep", "drop" or
+// "compress", for modules compiled after it's set. `source` is null once dropped.
+"class Module {\n"
+    "foreign static source(name)\n"
+    "foreign static sourcePolicy\n"
+    "foreign static sourcePolicy=(policy)\n"
+"}\n"
+
+// Raw memory shared with foreign code (see `wrenGetSlotBuffer`). `u8` to `f64` are views of the
+// same bytes as other element types, and slices don't copy either. `toString` copies them out.
+"foreign class Buffer is Sequence {\n"
+    "construct new(size) {}\n"
+    "construct fromString(string) {}\n"
+
+    "foreign size\n"
+    "foreign count\n"
+    "foreign type\n"
+
+    "foreign [index]\n"
+    "foreign [index]=(value)\n"
+
+    "foreign view_(type)\n"
+    "u8 { view_(0) }\n"
+    "u16 { view_(1) }\n"
+    "i32 { view_(2) }\n"
+    "f32 { view_(3) }\n"
+    "f64 { view_(4) }\n"
+
+    "foreign slice(start, count)\n"
+    "slice(start) { slice(start, count - start) }\n"
+
+    "foreign fill(value)\n"
+    "foreign toString\n"
+
+    "iterate(i) {\n"
+        "if (i == null) return count > 0 ? 0 : false\n"
+        "return i + 1 < count ? i + 1 : false\n"
+    "}\n"
+
+    "iteratorValue(i) { this[i] }\n"
+"}\n"
+
+;
+
+static bool wrenchGetScheduler(WrenchContext* context)
 {
-    WrenchContext* context = (WrenchContext*)wrench_calloc(1, sizeof(WrenchContext));
-
-    if (context == NULL)
+    if (context->scheduler_class != NULL)
     {
-        // Don't set error string here, as we're going to free the VM soon anyways.
-        return NULL;
+        return true;
     }
 
-    // For Wren calls.
-    context->vm = vm;
-
-    #ifndef WRENCH_NODE_BUFFER_SIZE
-    #define WRENCH_NODE_BUFFER_SIZE (1024 * 1024 * 1)
-    #endif
-    context->node_alloc_base = (char*)wrench_malloc(WRENCH_NODE_BUFFER_SIZE);
-
-    if (context->node_alloc_base == NULL)
+    if (!wrenHasModule(context->vm, "wrench") || !wrenHasVariable(context->vm, "wrench", "Scheduler"))
     {
-        wrench_free(context);
-        return NULL;
+        wrenchSetErrorString(context, "Cannot resume fiber: module \"wrench\" was never imported.");
+        return false;
     }
 
-    context->node_alloc_end = context->node_alloc_base + WRENCH_NODE_BUFFER_SIZE;
-    context->node_alloc_mark = context->node_alloc_base;
+    wrenGetVariable(context->vm, "wrench", "Scheduler", 0);
 
-    #ifndef WRENCH_SOURCE_CODE_BUFFER_SIZE
-    #define WRENCH_SOURCE_CODE_BUFFER_SIZE (1024 * 1024 * 2)
-    #endif
-    context->source_code_alloc_base = (char*)wrench_malloc(WRENCH_SOURCE_CODE_BUFFER_SIZE);
+    context->scheduler_class = wrenGetSlotHandle(context->vm, 0);
+    context->scheduler_resume = wrenMakeCallHandle(context->vm, "resume_(_,_)");
+    context->scheduler_resume_error = wrenMakeCallHandle(context->vm, "resumeError_(_,_)");
 
-    if (context->source_code_alloc_base == NULL)
+    return true;
+}
+
+/* Must run before the VM is freed, as event sources may hold fiber handles.
+ */
+static void wrenchFreeEventSources(WrenchContext* context)
+{
+    for (int i = context->num_event_sources - 1; i >= 0; i--)
     {
-        wrench_free(context->node_alloc_base);
-        wrench_free(context);
+        WrenchEventSource* source = &context->event_sources[i];
 
-        return NULL;
+        if (source->free != NULL)
+        {
+            source->free(context->vm, source->data);
+        }
     }
 
-    context->source_code_alloc_end = context->source_code_alloc_base + WRENCH_SOURCE_CODE_BUFFER_SIZE;
-    context->source_code_alloc_mark = context->source_code_alloc_base;
+    context->num_event_sources = 0;
 
-    /* Link.
-     */
-    if (wrench_context_head == NULL && wrench_context_tail == NULL)
-    {
-        wrench_context_head =
-        wrench_context_tail = context;
-    }
-    else
+    if (context->scheduler_class != NULL)
     {
-        wrench_context_tail->next = context;
-        context->prev = wrench_context_tail;
+        wrenReleaseHandle(context->vm, context->scheduler_class);
+        wrenReleaseHandle(context->vm, context->scheduler_resume);
+        wrenReleaseHandle(context->vm, context->scheduler_resume_error);
 
-        wrench_context_tail = context;
+        context->scheduler_class = NULL;
     }
+}
 
-    return context;
+/* The thread pool, shared by every VM in the process.
+ */
+static struct
+{
+    wrench_mutex lock;
+    wrench_cond ready;
+
+    WrenchAsyncTask* head;
+    WrenchAsyncTask* tail;
 }
+wrench_pool;
 
-static void wrenchFreeContext(WrenchContext* context)
+static void wrenchPoolWorker(void* arg)
 {
-    for (WrenchModule* node = context->module_head; node != NULL; node = node->next)
+    for (;;)
     {
-        if (node->library != NULL)
+        wrench_mutex_lock(&wrench_pool.lock);
+
+        while (wrench_pool.head == NULL)
         {
-            char quit_name[1024];
-            wrench_snprintf(quit_name, sizeof(quit_name), "%sWrenQuit", node->name);
+            wrench_cond_wait(&wrench_pool.ready, &wrench_pool.lock);
+        }
 
-            wrenLibraryQuitFn quit = (
-            wrenLibraryQuitFn)wrenchLibraryFunc(context, node->library, (const char*)quit_name);
+        WrenchAsyncTask* task = wrench_pool.head;
+        wrench_pool.head = task->next;
 
-            if (quit != NULL)
-            {
-                quit();
-            }
+        if (wrench_pool.head == NULL)
+        {
+            wrench_pool.tail = NULL;
+        }
 
-            wrenchFreeLibrary(context, node->library);
+        wrench_mutex_unlock(&wrench_pool.lock);
+
+        task->work(task->data);
+        task->next = NULL;
+
+        WrenchContext* context = task->context;
+        wrench_mutex_lock(&context->async_lock);
+
+        if (context->async_done_tail != NULL)
+        {
+            context->async_done_tail->next = task;
         }
+        else
+        {
+            context->async_done_head = task;
+        }
+
+        context->async_done_tail = task;
+
+        wrench_cond_signal(&context->async_cond);
+        wrench_mutex_unlock(&context->async_lock);
     }
+}
 
-    if (0) // Internal, vestigial debugging code.
+static void wrenchPoolInit(void)
+{
+    wrench_mutex_init(&wrench_pool.lock);
+    wrench_cond_init(&wrench_pool.ready);
+
+    #ifndef WRENCH_POOL_THREADS
+    #define WRENCH_POOL_THREADS wrenchCountProcessors()
+    #endif
+    for (int i = 0, n = WRENCH_POOL_THREADS; i < n; i++)
     {
-        for (int i = 0; i < 80; i++)
+        if (!wrenchThreadStart(wrenchPoolWorker, NULL))
         {
-            wrench_putchar('-');
+            wrench_assert(i > 0, "failed to start any thread pool workers");
+            break;
         }
+    }
+}
 
-        wrench_putchar('\n');
+#if _WIN32
+    static INIT_ONCE wrench_pool_once = INIT_ONCE_STATIC_INIT;
 
-        for (char* s = context->source_code_alloc_base; s < context->source_code_alloc_mark; s++)
+    static BOOL CALLBACK wrenchPoolInitOnce(PINIT_ONCE once, PVOID param, PVOID* ctx)
+    {
+        wrenchPoolInit();
+        return TRUE;
+    }
+#else
+    static pthread_once_t wrench_pool_once = PTHREAD_ONCE_INIT;
+
+    #if defined(WRENCH_MAIN)
+    /* A forked child has none of its parent's threads, so it starts its own pool on first use.
+     * Only the fork server in the `main` section forks.
+     */
+    static void wrenchPoolAfterFork(void)
+    {
+        static const pthread_once_t once = PTHREAD_ONCE_INIT;
+        wrench_memcpy(&wrench_pool_once, &once, sizeof(once));
+
+        wrench_pool.head = wrench_pool.tail = NULL;
+    }
+    #endif
+#endif
+
+/* Take the finished task list, waiting up to `timeout_ms` for one if none are ready.
+ */
+static WrenchAsyncTask* wrenchAsyncTakeDone(WrenchContext* context, int timeout_ms)
+{
+    wrench_mutex_lock(&context->async_lock);
+
+    if (context->async_done_head == NULL && timeout_ms != 0)
+    {
+        if (timeout_ms < 0)
         {
-            if (*s)
+            while (context->async_done_head == NULL)
             {
-                wrench_putchar(*s);
+                wrench_cond_wait(&context->async_cond, &context->async_lock);
             }
         }
-
-        for (int i = 0; i < 80; i++)
+        else
         {
-            wrench_putchar('-');
+            wrench_cond_timedwait(&context->async_cond, &context->async_lock, timeout_ms);
         }
-
-        wrench_putchar('\n');
     }
 
-    /* Unlink.
-     */
-    if (context->prev) context->prev->next = context->next;
-    if (context->next) context->next->prev = context->prev;
+    WrenchAsyncTask* done = context->async_done_head;
+    context->async_done_head = context->async_done_tail = NULL;
 
-    if (wrench_context_head == context) wrench_context_head = context->next;
-    if (wrench_context_tail == context) wrench_context_tail = context->prev;
+    wrench_mutex_unlock(&context->async_lock);
+    return done;
+}
 
-    if (wrench_primary_context == context)
+static int wrenchAsyncPoll(WrenVM* vm, int timeout_ms, void* data)
+{
+    WrenchContext* context = (WrenchContext*)data;
+
+    if (context->async_pending == 0)
     {
-        wrench_primary_context = NULL;
+        return 0;
     }
 
-    wrenchFreeCommandLine(context);
+    WrenchAsyncTask* task = wrenchAsyncTakeDone(context, timeout_ms);
 
-    wrench_free(context->source_code_alloc_base);
-    wrench_free(context->node_alloc_base);
-    wrench_free(context->base_path);
+    while (task != NULL)
+    {
+        WrenchAsyncTask* next = task->next;
+        context->async_pending--;
 
-    wrench_free(context);
-}
+        wrenEnsureSlots(vm, 1);
+        const bool ok = task->done(vm, task->data);
 
-static wrenLibraryInitFn wrenchGlobalInitFunc[16];
-static size_t wrenchGlobalInitFuncCount;
+        if (!context->event_loop_error)
+        {
+            wrenResumeFiber(vm, task->fiber, !ok);
+        }
+        else
+        {
+            wrenReleaseHandle(vm, task->fiber);
+        }
 
-static wrenLibraryQuitFn wrenchGlobalQuitFunc[16];
-static size_t wrenchGlobalQuitFuncCount;
+        wrench_free(task);
+        task = next;
+    }
 
-/* ===== [ public API ] ===================================================== */
+    return context->async_pending;
+}
 
-WRENCH_IMPL(WrenConfiguration*, GetConfig, (void))
+static void wrenchAsyncFree(WrenVM* vm, void* data)
 {
-    static WrenConfiguration wrench_config;
-    static bool wrench_config_is_init;
+    WrenchContext* context = (WrenchContext*)data;
 
-    if (!wrench_config_is_init)
+    while (context->async_pending > 0)
     {
-        wrenInitConfiguration(&wrench_config);
+        for (WrenchAsyncTask* task = wrenchAsyncTakeDone(context, -1); task != NULL; )
+        {
+            WrenchAsyncTask* next = task->next;
+            context->async_pending--;
 
-        wrench_config.reallocateFn = wrenDefaultReallocate;
-        wrench_config.resolveModuleFn = wrenDefaultResolveModule;
-        wrench_config.loadModuleFn = wrenDefaultLoadModule;
-        wrench_config.bindForeignMethodFn = wrenDefaultBindForeignMethod;
-        wrench_config.bindForeignClassFn = wrenDefaultBindForeignClass;
-        wrench_config.writeFn = wrenDefaultWrite;
-        wrench_config.errorFn = wrenDefaultError;
+            wrenEnsureSlots(vm, 1);
+            task->done(vm, task->data);
 
-        wrench_config_is_init = true;
+            wrenReleaseHandle(vm, task->fiber);
+            wrench_free(task);
+
+            task = next;
+        }
     }
 
-    return &wrench_config;
+    context->async_registered = false;
 }
 
-WRENCH_IMPL(WrenVM*, NewExtendedVM, (int argc, char** argv, bool call_global_init_funcs))
+static void wrenchAsyncSubmit(WrenchContext* context, WrenchAsyncTask* task)
 {
-    WrenVM* vm = wrenNewVM(wrenGetConfig());
+    #if _WIN32
+        InitOnceExecuteOnce(&wrench_pool_once, wrenchPoolInitOnce, NULL, NULL);
+    #else
+        pthread_once(&wrench_pool_once, wrenchPoolInit);
+    #endif
 
-    if (vm == NULL)
+    if (!context->async_registered)
     {
-        return NULL;
+        context->async_registered = wrenRegisterEventSource(context->vm, wrenchAsyncPoll, wrenchAsyncFree, context);
+        wrench_assert(context->async_registered, "%s", context->error);
     }
 
-    WrenchContext* context = wrenchNewContext(vm);
+    task->context = context;
+    task->next = NULL;
 
-    if (context == NULL)
-    {
-        wrenFreeVM(vm);
-        return NULL;
-    }
+    context->async_pending++;
 
-    wrenSetUserData(vm, context);
+    wrench_mutex_lock(&wrench_pool.lock);
 
-    if (!wrenchSetCommandLine(context, argc, argv))
+    if (wrench_pool.tail != NULL)
     {
-        wrenFreeExtendedVM(vm, false);
-        return NULL;
+        wrench_pool.tail->next = task;
     }
-
-    if (call_global_init_funcs)
+    else
     {
-        for (size_t i = 0; i < wrenchGlobalInitFuncCount; i++)
-        {
-            wrench_assert(wrenchGlobalInitFunc[i] != NULL, "");
-
-            if (!wrenchGlobalInitFunc[i](vm))
-            {
-                wrenFreeExtendedVM(vm, false);
-                return NULL;
-            }
-        }
+        wrench_pool.head = task;
     }
 
-    return vm;
+    wrench_pool.tail = task;
+
+    wrench_cond_signal(&wrench_pool.ready);
+    wrench_mutex_unlock(&wrench_pool.lock);
 }
 
-WRENCH_IMPL(void, FreeExtendedVM, (WrenVM* vm, bool call_global_quit_funcs))
+/* Emit the Wren side of an async method:
+ *
+ *      foreign static name_(a, b, fiber)
+ *      static name(a, b) {
+ *          name_(a, b, Fiber.current)
+ *          return Scheduler.await_()
+ *      }
+ */
+static bool wrenchRegisterAsyncMethod(WrenchContext* context, const char* moduleName, const char* className,
+                                bool is_static, const char* name, const char* args, WrenForeignMethodFn method)
 {
-    if (vm == NULL)
+    wrench_assert(args[0] == '(' && args[wrench_strlen(args) - 1] == ')', "async method %s.%s needs an argument list", className, name);
+    wrench_assert(context->module_being_built != NULL, "async method %s.%s must be declared inside a module", className, name);
+
+    char params[1024], signature[1024], code[1024 * 4];
+    const size_t num_chars = wrench_strlen(args) - 2; // Strip the parentheses.
+
+    int num_params = 0;
+
+    for (size_t i = 0; i < num_chars; i++)
     {
-        return;
+        if (args[1 + i] == ',') { num_params++; }
     }
 
-    if (call_global_quit_funcs)
+    if (num_chars > 0)
     {
-        /* TODO: Call in reverse order?
-         */
-        for (size_t i = 0; i < wrenchGlobalQuitFuncCount; i++)
-        {
-            wrench_assert(wrenchGlobalQuitFunc[i] != NULL, "");
-            wrenchGlobalQuitFunc[i]();
-        }
+        num_params++;
     }
 
-    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-    wrench_assert(context != NULL, "");
+    wrench_snprintf(params, sizeof(params), "%.*s%s", (int)num_chars, args + 1, num_chars > 0 ? ", " : "");
 
-    // We must free the VM first, before dtors in shared libs are unmapped.
-    wrenFreeVM(vm);
-
-    wrenchFreeContext(context);
-}
-
-WRENCH_IMPL(void, RegisterGlobalInitFunction, (wrenLibraryInitFn init))
-{
-    wrench_assert(init != NULL, ""); // TODO: Don't register funcs that are already in array.
-    wrench_assert(wrenchGlobalInitFuncCount < WRENCH_ARRAY_COUNT(wrenchGlobalInitFunc), "");
+    int length = wrench_snprintf(signature, sizeof(signature), "%s_(", name);
 
-    wrenchGlobalInitFunc[wrenchGlobalInitFuncCount++] = init;
-}
+    for (int i = 0; i <= num_params; i++)
+    {
+        length += wrench_snprintf(signature + length, sizeof(signature) - length, i > 0 ? ",_" : "_");
+    }
 
-WRENCH_IMPL(void, RegisterGlobalQuitFunction, (wrenLibraryQuitFn quit))
-{
-    wrench_assert(quit != NULL, ""); // TODO: Don't register funcs that are already in array.
-    wrench_assert(wrenchGlobalQuitFuncCount < WRENCH_ARRAY_COUNT(wrenchGlobalQuitFunc), "");
+    wrench_snprintf(signature + length, sizeof(signature) - length, ")");
 
-    wrenchGlobalQuitFunc[wrenchGlobalQuitFuncCount++] = quit;
-}
+    wrench_snprintf(code, sizeof(code), "foreign %s%s_(%sfiber)\n"
+                                        "%s%s%s {\n"
+                                            "%s_(%sFiber.current)\n"
+                                            "return Scheduler.await_()\n"
+                                        "}\n",
 
-WRENCH_IMPL(bool, GetForeignLibraryLoadEnabled, (WrenVM* vm))
-{
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+                    is_static ? "static " : "", name, (const char*)params,
+                    is_static ? "static " : "", name, args,
+                    name, (const char*)params);
 
-        return wrenchGetForeignLibraryLoadEnabled(context);
-    }
-    else
+    if (!wrenchCode(context, (const char*)code))
     {
         return false;
     }
-}
-
-WRENCH_IMPL(void, SetForeignLibraryLoadEnabled, (WrenVM* vm, bool enabled))
-{
-    if (vm == NULL)
-    {
-        return;
-    }
 
-    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-    wrench_assert(context != NULL, "");
-
-    wrenchSetForeignLibraryLoadEnabled(context, enabled);
+    return wrenchRegisterMethod(context, moduleName, className, is_static, (const char*)signature, method);
 }
 
-WRENCH_IMPL(const char*, GetErrorString, (WrenVM* vm))
+/* ===== [ handle cache ] =================================================== */
+
+/* Variable handles (keyed by module and name) and call handles (keyed by signature), kept for
+ * the life of the VM in an open-addressed table, so repeated host->script calls don't pay for
+ * Wren's own string lookups and handle creation every time.
+ */
+static unsigned int wrenchHandleHash(const char* module, const char* name)
 {
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+    unsigned int hash = 2166136261u;
 
-        return wrenchGetErrorString(context);
-    }
-    else
+    for (const char* s = (module != NULL) ? module : ""; *s != '\0'; s++)
     {
-        return "NULL Wren virtual machine.";
+        hash = (hash ^ (unsigned char)*s) * 16777619u;
     }
-}
 
-WRENCH_IMPL(void, SetErrorString, (WrenVM* vm, const char* error))
-{
-    if (vm == NULL)
+    hash = (hash ^ (module != NULL ? 0xFFu : 0u)) * 16777619u;
+
+    for (const char* s = name; *s != '\0'; s++)
     {
-        return;
+        hash = (hash ^ (unsigned char)*s) * 16777619u;
     }
 
-    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-    wrench_assert(context != NULL, "");
-
-    wrenchSetErrorString(context, error);
+    return (hash != 0) ? hash : 1; // 0 marks an empty entry.
 }
 
-WRENCH_IMPL(void*, GetUserDataEx, (WrenVM* vm, int slot))
+/* The entry for the key, or the empty entry where it would go.
+ */
+static WrenchCachedHandle* wrenchFindHandle(WrenchContext* context, const char* module, const char* name, unsigned int hash)
 {
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+    const int mask = context->handle_capacity - 1;
 
-        return wrenchGetUserDataEx(context, slot);
-    }
-    else
+    for (int i = (int)(hash & (unsigned int)mask); ; i = (i + 1) & mask)
     {
-        return NULL;
+        WrenchCachedHandle* entry = &context->handles[i];
+
+        if (entry->hash == 0)
+        {
+            return entry;
+        }
+
+        if (entry->hash == hash && wrench_strcmp(entry->name, name) == 0 && (module == NULL ?
+            entry->module == NULL : (entry->module != NULL && wrench_strcmp(entry->module, module) == 0)))
+        {
+            return entry;
+        }
     }
 }
 
-WRENCH_IMPL(void, SetUserDataEx, (WrenVM* vm, int slot, void* userData))
+/* Returns false if out of memory.
+ */
+static bool wrenchAddHandle(WrenchContext* context, const char* module, const char* name, unsigned int hash, WrenHandle* handle)
 {
-    if (vm == NULL)
+    if ((context->num_handles + 1) * 4 > context->handle_capacity * 3)
     {
-        return;
-    }
+        const int capacity = context->handle_capacity ? context->handle_capacity * 2 : 64;
+        WrenchCachedHandle* handles = (WrenchCachedHandle*)wrench_calloc((size_t)capacity, sizeof(WrenchCachedHandle));
 
-    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-    wrench_assert(context != NULL, "");
+        if (handles == NULL)
+        {
+            return false;
+        }
 
-    wrenchSetUserDataEx(context, slot, userData);
-}
+        WrenchCachedHandle* old = context->handles;
+        const int old_capacity = context->handle_capacity;
 
-WRENCH_IMPL(char**, GetCommandLine, (WrenVM* vm, int* argc))
-{
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+        context->handles = handles;
+        context->handle_capacity = capacity;
 
-        return wrenchGetCommandLine(context, argc);
-    }
-    else
-    {
-        if (argc != NULL)
+        for (int i = 0; i < old_capacity; i++)
         {
-            *argc = 0;
+            if (old[i].hash != 0)
+            {
+                *wrenchFindHandle(context, old[i].module, old[i].name, old[i].hash) = old[i];
+            }
         }
 
-        return NULL;
+        wrench_free(old);
     }
-}
 
-WRENCH_IMPL(bool, SetCommandLine, (WrenVM* vm, int argc, char** argv))
-{
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+    WrenchCachedHandle* entry = wrenchFindHandle(context, module, name, hash);
 
-        return wrenchSetCommandLine(context, argc, argv);
-    }
-    else
+    entry->module = (module != NULL) ? wrench_strdup(module) : NULL;
+    entry->name = wrench_strdup(name);
+
+    if (entry->name == NULL || (module != NULL && entry->module == NULL))
     {
+        wrench_free((void*)entry->module);
+        wrench_free((void*)entry->name);
+
+        entry->module = entry->name = NULL;
         return false;
     }
+
+    entry->hash = hash;
+    entry->handle = handle;
+
+    context->num_handles++;
+    return true;
 }
 
-WRENCH_IMPL(const char*, GetModuleSource, (WrenVM* vm, const char* name))
+/* Put the current value of a top-level variable in `slot`.
+ */
+static bool wrenchGetVariable(WrenchContext* context, const char* module, const char* name, int slot)
 {
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+    WrenVM* vm = context->vm;
 
-        return wrenchGetModuleSource(context, name);
-    }
-    else
+    if (!wrenHasModule(vm, module) || !wrenHasVariable(vm, module, name))
     {
-        return "";
+        char error[1024];
+        wrench_snprintf(error, sizeof(error), "Variable \"%s\" not found in module \"%s\".", name, module);
+
+        wrenchSetErrorString(context, (const char*)error);
+        return false;
     }
+
+    wrenEnsureSlots(vm, slot + 1);
+    wrenGetVariable(vm, module, name, slot);
+
+    return true;
 }
 
-WRENCH_IMPL(const char*, GetBasePath, (WrenVM* vm))
+/* Put a top-level variable in `slot`, as it was the first time it was asked for.
+ */
+static bool wrenchGetVariableCached(WrenchContext* context, const char* module, const char* name, int slot)
 {
-    if (vm != NULL)
+    WrenVM* vm = context->vm;
+    const unsigned int hash = wrenchHandleHash(module, name);
+
+    wrenEnsureSlots(vm, slot + 1);
+
+    if (context->handle_capacity > 0)
     {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+        WrenchCachedHandle* entry = wrenchFindHandle(context, module, name, hash);
 
-        return wrenchGetBasePath(context);
+        if (entry->hash != 0)
+        {
+            wrenSetSlotHandle(vm, slot, entry->handle);
+            return true;
+        }
     }
-    else
+
+    if (!wrenchGetVariable(context, module, name, slot))
     {
-        return "./";
+        return false;
     }
-}
 
-WRENCH_IMPL(bool, SetBasePath, (WrenVM* vm, const char* path))
-{
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+    WrenHandle* handle = wrenGetSlotHandle(vm, slot);
 
-        return wrenchSetBasePath(context, path);
-    }
-    else
+    if (!wrenchAddHandle(context, module, name, hash, handle))
     {
-        return false;
+        wrenReleaseHandle(vm, handle); // Still in the slot, just not cached.
     }
+
+    return true;
 }
 
-WRENCH_IMPL(wrenFileReadFn, GetFileReadCallback, (WrenVM* vm))
+static WrenHandle* wrenchGetCachedCallHandle(WrenchContext* context, const char* signature)
 {
-    if (vm != NULL)
+    const unsigned int hash = wrenchHandleHash(NULL, signature);
+
+    if (context->handle_capacity > 0)
     {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+        WrenchCachedHandle* entry = wrenchFindHandle(context, NULL, signature, hash);
 
-        return wrenchGetFileReadCallback(context);
+        if (entry->hash != 0)
+        {
+            return entry->handle;
+        }
     }
-    else
+
+    WrenHandle* handle = wrenMakeCallHandle(context->vm, signature);
+
+    if (!wrenchAddHandle(context, NULL, signature, hash, handle))
     {
+        wrenReleaseHandle(context->vm, handle);
+        wrenchSetErrorString(context, "Out of memory - failed to cache a call handle.");
+
         return NULL;
     }
+
+    return handle;
 }
 
-WRENCH_IMPL(void, SetFileReadCallback, (WrenVM* vm, wrenFileReadFn callback))
+/* Must run before the VM is freed.
+ */
+static void wrenchFreeHandleCache(WrenchContext* context)
 {
-    if (vm == NULL)
+    for (int i = 0; i < context->handle_capacity; i++)
     {
-        return;
+        WrenchCachedHandle* entry = &context->handles[i];
+
+        if (entry->hash != 0)
+        {
+            wrenReleaseHandle(context->vm, entry->handle);
+
+            wrench_free((void*)entry->module);
+            wrench_free((void*)entry->name);
+        }
     }
 
-    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-    wrench_assert(context != NULL, "");
+    wrench_free(context->handles);
 
-    wrenchSetFileReadCallback(context, callback);
+    context->handles = NULL;
+    context->handle_capacity = context->num_handles = 0;
 }
 
-WRENCH_IMPL(wrenFileFreeFn, GetFileFreeCallback, (WrenVM* vm))
-{
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+/* ===== [ output ] ========================================================= */
 
-        return wrenchGetFileFreeCallback(context);
-    }
-    else
-    {
-        return NULL;
-    }
+/* `System.print` output. Unbuffered, every fragment is its own `fprintf` (a stdio lock, and a
+ * write per fragment on a pipe). Buffered, fragments are appended to a per-VM buffer, which is
+ * written out when full, when its oldest byte is `WRENCH_OUTPUT_FLUSH_MS` old (noticed on the
+ * next write, event loop pass or resumed fiber), before any error output, before the event loop
+ * blocks, and on `wrenFlushOutput`.
+ * Threaded, full buffers are handed to a writer thread instead (which also does the timed
+ * flushes), so the VM only ever copies bytes.
+ */
+static void wrenchOutputWriteThrough(const char* data, size_t size)
+{
+    wrench_fwrite(data, 1, size, wrench_stdout);
+    wrench_fflush(wrench_stdout);
 }
 
-WRENCH_IMPL(void, SetFileFreeCallback, (WrenVM* vm, wrenFileFreeFn callback))
+/* Give the filled buffer to the writer thread, waiting for the previous one to be written.
+ */
+static void wrenchOutputHandOff(WrenchOutput* output)
 {
-    if (vm == NULL)
+    while (output->pending != NULL)
     {
-        return;
+        wrench_cond_wait(&output->cond, &output->lock);
     }
 
-    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-    wrench_assert(context != NULL, "");
+    output->pending = output->data;
+    output->pending_size = output->size;
 
-    wrenchSetFileFreeCallback(context, callback);
+    output->data = output->spare;
+    output->spare = NULL;
+    output->size = 0;
+
+    wrench_cond_broadcast(&output->cond);
 }
 
-WRENCH_IMPL(void*, DefaultFileRead, (WrenVM* vm, const char* name, size_t* file_size))
+static void wrenchOutputWriter(void* arg)
 {
-    char path[1024 * 4], error[1024 * 4];
+    WrenchOutput* output = (WrenchOutput*)arg;
+    wrench_mutex_lock(&output->lock);
 
-    if (wrench_snprintf(path, sizeof(path), "%s%s.wren", wrenGetBasePath(vm), name) < 0)
+    while (!output->quit)
     {
-        // TODO: Handle truncation error.
-    }
-
-    FILE* file = wrench_fopen((const char*)path, "rb");
+        if (output->pending == NULL)
+        {
+            if (output->size == 0)
+            {
+                wrench_cond_wait(&output->cond, &output->lock);
+                continue;
+            }
 
-    if (file == NULL)
-    {
-        wrench_snprintf(error, sizeof(error), "Source file \"%s\" not found.", (const char*)path);
-        wrenSetErrorString(vm, (const char*)error);
+            const long long age = wrenchMilliseconds() - output->first_write_ms;
 
-        return NULL;
-    }
+            if (age < WRENCH_OUTPUT_FLUSH_MS)
+            {
+                wrench_cond_timedwait(&output->cond, &output->lock, (int)(WRENCH_OUTPUT_FLUSH_MS - age));
+                continue;
+            }
 
-    if (wrench_fseek(file, 0, SEEK_END) != 0)
-    {
-        wrench_snprintf(error, sizeof(error), "Failed to get size of source file \"%s\".", (const char*)path);
-        wrenSetErrorString(vm, (const char*)error);
+            wrenchOutputHandOff(output);
+        }
 
-        wrench_fclose(file);
-        return NULL;
-    }
+        char* data = output->pending;
+        const size_t size = output->pending_size;
 
-    *file_size = (size_t)wrench_ftell(file);
+        wrench_mutex_unlock(&output->lock);
+        wrenchOutputWriteThrough(data, size);
+        wrench_mutex_lock(&output->lock);
 
-    if (wrench_fseek(file, 0, SEEK_SET) != 0)
-    {
-        wrench_snprintf(error, sizeof(error), "Failed to rewind source file \"%s\".", (const char*)path);
-        wrenSetErrorString(vm, (const char*)error);
+        output->pending = NULL;
+        output->spare = data;
 
-        wrench_fclose(file);
-        return NULL;
+        wrench_cond_broadcast(&output->cond);
     }
 
-    void* file_data = wrench_malloc(*file_size);
+    output->running = false;
 
-    if (file_data == NULL)
-    {
-        wrench_snprintf(error, sizeof(error), "Failed to allocate space for source file \"%s\".", (const char*)path);
-        wrenSetErrorString(vm, (const char*)error);
+    wrench_cond_broadcast(&output->cond);
+    wrench_mutex_unlock(&output->lock);
+}
 
-        wrench_fclose(file);
-        return NULL;
-    }
+/* Write out everything buffered so far (and wait for it to be written).
+ */
+static void wrenchFlushOutput(WrenchContext* context)
+{
+    WrenchOutput* output = &context->output;
 
-    if (wrench_fread(file_data, *file_size, 1, file) != 1)
+    if (output->threaded)
     {
-        wrench_snprintf(error, sizeof(error), "Failed to read source file \"%s\".", (const char*)path);
-        wrenSetErrorString(vm, (const char*)error);
+        wrench_mutex_lock(&output->lock);
 
-        wrench_fclose(file);
-        return NULL;
-    }
+        if (output->size > 0)
+        {
+            wrenchOutputHandOff(output);
+        }
 
-    if (wrench_fclose(file) != 0)
-    {
-        wrench_snprintf(error, sizeof(error), "Failed to close source file \"%s\".", (const char*)path);
-        wrenSetErrorString(vm, (const char*)error);
+        while (output->pending != NULL)
+        {
+            wrench_cond_wait(&output->cond, &output->lock);
+        }
 
-        return NULL;
+        wrench_mutex_unlock(&output->lock);
+    }
+    else if (output->size > 0)
+    {
+        wrenchOutputWriteThrough(output->data, output->size);
+        output->size = 0;
     }
-
-    return file_data;
 }
 
-WRENCH_IMPL(void, DefaultFileFree, (WrenVM* vm, void* data, size_t size))
+/* Unthreaded, write out output that has waited `WRENCH_OUTPUT_FLUSH_MS` (the writer thread
+ * does this itself).
+ */
+static void wrenchFlushOutputIfDue(WrenchContext* context)
 {
-    wrench_free(data);
+    WrenchOutput* output = &context->output;
+
+    if (!output->threaded && output->size > 0 && wrenchCoarseMilliseconds() - output->first_write_ms >= WRENCH_OUTPUT_FLUSH_MS)
+    {
+        wrenchFlushOutput(context);
+    }
 }
 
-WRENCH_IMPL(const char*, LoadSourceFile, (WrenVM* vm, const char* name, size_t* num_chars))
+static void wrenchOutputWrite(WrenchContext* context, const char* text, size_t length)
 {
-    if (vm != NULL)
+    WrenchOutput* output = &context->output;
+
+    if (output->threaded)
     {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+        wrench_mutex_lock(&output->lock);
 
-        return wrenchLoadSourceFile(context, name, num_chars);
+        if (output->size + length > output->capacity)
+        {
+            if (output->size > 0)
+            {
+                wrenchOutputHandOff(output);
+            }
+
+            if (length > output->capacity)
+            {
+                while (output->pending != NULL)
+                {
+                    wrench_cond_wait(&output->cond, &output->lock);
+                }
+
+                wrench_mutex_unlock(&output->lock);
+                wrenchOutputWriteThrough(text, length);
+
+                return;
+            }
+        }
+
+        if (output->size == 0)
+        {
+            output->first_write_ms = wrenchMilliseconds();
+            wrench_cond_broadcast(&output->cond); // Start the writer's flush timer.
+        }
+
+        wrench_memcpy(output->data + output->size, text, length);
+        output->size += length;
+
+        wrench_mutex_unlock(&output->lock);
     }
     else
     {
-        return NULL;
+        if (output->size + length > output->capacity)
+        {
+            wrenchFlushOutput(context);
+
+            if (length > output->capacity)
+            {
+                wrenchOutputWriteThrough(text, length);
+                return;
+            }
+        }
+
+        if (output->size == 0)
+        {
+            output->first_write_ms = wrenchCoarseMilliseconds();
+        }
+
+        wrench_memcpy(output->data + output->size, text, length);
+        output->size += length;
+
+        wrenchFlushOutputIfDue(context);
     }
 }
 
-WRENCH_IMPL(bool, BeginModule, (WrenVM* vm, const char* moduleName))
+#ifdef WRENCH_ASSERT_FLUSHES_OUTPUT
+/* Best effort, for a failed assert: write out every VM's buffer. Threaded ones are skipped if
+ * their lock is taken (the failing thread may hold it) or their writer is busy, as writing
+ * alongside it would interleave the output.
+ */
+static void wrenchFlushAllOutput(void)
 {
-    if (vm != NULL)
+    for (WrenchContext* context = wrench_context_head; context != NULL; context = context->next)
     {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+        WrenchOutput* output = &context->output;
 
-        return wrenchBeginModule(context, moduleName);
-    }
-    else
-    {
-        return false;
+        if (output->threaded)
+        {
+            if (wrench_mutex_trylock(&output->lock))
+            {
+                if (output->pending == NULL && output->size > 0)
+                {
+                    const size_t size = output->size;
+                    output->size = 0;
+
+                    wrenchOutputWriteThrough(output->data, size);
+                }
+
+                wrench_mutex_unlock(&output->lock);
+            }
+        }
+        else if (output->size > 0)
+        {
+            const size_t size = output->size;
+            output->size = 0; // First, in case writing asserts too.
+
+            wrenchOutputWriteThrough(output->data, size);
+        }
     }
 }
+#endif
 
-WRENCH_IMPL(bool, CodeEx, (WrenVM* vm, const char* source, size_t num_chars))
+/* Flush, stop the writer thread, and free the buffers.
+ */
+static void wrenchFreeOutput(WrenchContext* context)
 {
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+    WrenchOutput* output = &context->output;
+    wrenchFlushOutput(context);
 
-        return wrenchCodeEx(context, source, num_chars);
-    }
-    else
+    if (output->threaded)
     {
-        return false;
+        wrench_mutex_lock(&output->lock);
+        output->quit = true;
+
+        wrench_cond_broadcast(&output->cond);
+
+        while (output->running)
+        {
+            wrench_cond_wait(&output->cond, &output->lock);
+        }
+
+        wrench_mutex_unlock(&output->lock);
     }
+
+    wrench_free(output->data);
+    wrench_free(output->spare);
+
+    output->data = output->spare = NULL;
+    output->size = output->capacity = 0;
+
+    output->threaded = output->running = output->quit = false;
 }
 
-WRENCH_IMPL(bool, Code, (WrenVM* vm, const char* source))
+static bool wrenchSetOutputBuffering(WrenchContext* context, size_t capacity, bool threaded)
 {
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+    WrenchOutput* output = &context->output;
+    wrenchFreeOutput(context);
 
-        return wrenchCode(context, source);
+    if (capacity == 0)
+    {
+        return true;
     }
-    else
+
+    output->data = (char*)wrench_malloc(capacity);
+    output->spare = threaded ? (char*)wrench_malloc(capacity) : NULL;
+
+    if (output->data == NULL || (threaded && output->spare == NULL))
     {
+        wrench_free(output->data);
+        wrench_free(output->spare);
+
+        output->data = output->spare = NULL;
+
+        wrenchSetErrorString(context, "Out of memory for the output buffer.");
         return false;
     }
+
+    output->capacity = capacity;
+
+    if (threaded)
+    {
+        output->threaded = output->running = true;
+
+        if (!wrenchThreadStart(wrenchOutputWriter, output))
+        {
+            // Nothing would enforce the flush deadline, so write straight through.
+            output->threaded = output->running = false;
+
+            wrench_free(output->data);
+            wrench_free(output->spare);
+
+            output->data = output->spare = NULL;
+            output->capacity = 0;
+        }
+    }
+
+    return true;
 }
 
-WRENCH_IMPL(bool, EndModule, (WrenVM* vm))
+static void wrenchOutputFlushMethod(WrenVM* vm)
 {
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+    wrenFlushOutput(vm);
+}
 
-        return wrenchEndModule(context);
+static const char* wrench_source_policy_names[] = { "keep", "drop", "compress" };
+
+/* `Module.source(name)`: null for unknown modules and dropped source.
+ */
+static void wrenchModuleSourceMethod(WrenVM* vm)
+{
+    const char* source = (wrenGetSlotType(vm, 1) == WREN_TYPE_STRING) ? wrenGetModuleSource(vm, wrenGetSlotString(vm, 1)) : NULL;
+
+    if (source != NULL)
+    {
+        wrenSetSlotString(vm, 0, source);
     }
     else
     {
-        return false;
+        wrenSetSlotNull(vm, 0);
     }
 }
 
-WRENCH_IMPL(bool, RegisterModuleEx, (WrenVM* vm, const char* moduleName, const char* source, size_t num_chars, bool copy_source))
+static void wrenchModuleGetSourcePolicyMethod(WrenVM* vm)
 {
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+    wrenSetSlotString(vm, 0, wrench_source_policy_names[wrenGetSourcePolicy(vm)]);
+}
 
-        return wrenchRegisterModuleEx(context, moduleName, source, num_chars, copy_source);
-    }
-    else
+static void wrenchModuleSetSourcePolicyMethod(WrenVM* vm)
+{
+    const char* name = (wrenGetSlotType(vm, 1) == WREN_TYPE_STRING) ? wrenGetSlotString(vm, 1) : "";
+
+    for (int i = 0; i < (int)(sizeof(wrench_source_policy_names) / sizeof(wrench_source_policy_names[0])); i++)
     {
-        return false;
+        if (wrench_strcmp(name, wrench_source_policy_names[i]) == 0)
+        {
+            wrenSetSourcePolicy(vm, (WrenSourcePolicy)i);
+            return;
+        }
     }
+
+    wrenSetSlotString(vm, 0, "Module.sourcePolicy must be \"keep\", \"drop\" or \"compress\".");
+    wrenAbortFiber(vm, 0);
 }
 
-WRENCH_IMPL(bool, RegisterModule, (WrenVM* vm, const char* moduleName, const char* source))
+/* ===== [ buffer ] ========================================================= */
+
+/* Storage may be created by one copy of this implementation (e.g. a native module) and freed
+ * by another, so it carries its own destructor.
+ */
+struct WrenBufferStorage
 {
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+    long long refs;
 
-        return wrenchRegisterModule(context, moduleName, source);
-    }
-    else
+    void* data;
+    size_t size;
+
+    void (*release)(void* data);
+    void (*destroy)(WrenBufferStorage* storage);
+};
+
+/* A Buffer object.
+ */
+typedef struct wrench_Buffer
+{
+    WRENCH_MAGIC_TAG;
+
+    WrenBufferStorage* storage;
+    size_t offset;
+    size_t size;
+    WrenBufferType type;
+}
+wrench_Buffer;
+
+static const char* wrench_buffer_type_names[] = { "u8", "u16", "i32", "f32", "f64" };
+static const size_t wrench_buffer_type_sizes[] = { 1, 2, 4, 4, 8 };
+
+static void wrenchDestroyBufferStorage(WrenBufferStorage* storage)
+{
+    if (storage->release != NULL)
     {
-        return false;
+        storage->release(storage->data);
     }
+
+    wrench_free(storage);
 }
 
-WRENCH_IMPL(bool, RegisterClass, (WrenVM* vm, const char* moduleName, const char* className, WrenForeignMethodFn ctor, WrenFinalizerFn dtor))
+static wrench_Buffer* wrenchGetBuffer(WrenVM* vm, int slot)
 {
-    if (vm != NULL)
+    if (wrenGetSlotType(vm, slot) != WREN_TYPE_FOREIGN)
     {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+        return NULL;
+    }
 
-        return wrenchRegisterClass(context, moduleName, className, ctor, dtor);
+    /* The public API can't tell foreign classes apart, so callers check `is Buffer` first.
+     * Reading anything here to guess would run past the end of smaller foreign objects.
+     */
+    wrench_Buffer* self = (wrench_Buffer*)wrenGetSlotForeign(vm, slot);
+    WRENCH_CHECK_MAGIC_TAG(self, wrench, Buffer);
+
+    return self;
+}
+
+static void* wrenchBufferData(const wrench_Buffer* self)
+{
+    return (char*)self->storage->data + self->offset;
+}
+
+static size_t wrenchBufferCount(const wrench_Buffer* self)
+{
+    return self->size / wrench_buffer_type_sizes[self->type];
+}
+
+static bool wrenchBufferAbort(WrenVM* vm, const char* message)
+{
+    wrenSetSlotString(vm, 0, message);
+    wrenAbortFiber(vm, 0);
+
+    return false;
+}
+
+/* A whole-number argument in [0, limit], or aborts the fiber.
+ */
+static bool wrenchBufferArg(WrenVM* vm, int slot, size_t limit, size_t* out)
+{
+    if (wrenGetSlotType(vm, slot) != WREN_TYPE_NUM)
+    {
+        return wrenchBufferAbort(vm, "Buffer index must be a number.");
     }
-    else
+
+    const double value = wrenGetSlotDouble(vm, slot);
+
+    if (!(value >= 0.0 && value <= (double)limit) || value != (double)(size_t)value)
     {
-        return false;
+        return wrenchBufferAbort(vm, "Buffer index out of bounds.");
     }
+
+    *out = (size_t)value;
+    return true;
 }
 
-WRENCH_IMPL(bool, RegisterMethod, (WrenVM* vm, const char* moduleName, const char* className, bool isStatic, const char* signature, WrenForeignMethodFn method))
+/* An element index into the buffer, or aborts the fiber.
+ */
+static bool wrenchBufferIndex(WrenVM* vm, const wrench_Buffer* self, int slot, size_t* out)
 {
-    if (vm != NULL)
-    {
-        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-        wrench_assert(context != NULL, "");
+    const size_t count = wrenchBufferCount(self);
 
-        return wrenchRegisterMethod(context, moduleName, className, isStatic, signature, method);
-    }
-    else
+    if (!wrenchBufferArg(vm, slot, count, out))
     {
         return false;
     }
+
+    return (*out < count) || wrenchBufferAbort(vm, "Buffer index out of bounds.");
 }
 
-WRENCH_IMPL(WrenVM*, GetPrimaryVM, (void))
+/* `Buffer.new(size)` (zeroed bytes) or `Buffer.fromString(string)` (a copy of its bytes).
+ */
+static void wrenchBufferCtor(WrenVM* vm)
 {
-    if (wrench_primary_context != NULL)
+    wrench_Buffer* self = (wrench_Buffer*)wrenSetSlotNewForeign(vm, 0, 0, sizeof(wrench_Buffer));
+
+    WRENCH_SET_MAGIC_TAG(self, wrench, Buffer);
+
+    self->storage = NULL;
+    self->offset = self->size = 0;
+    self->type = WREN_BUFFER_U8;
+
+    const char* bytes = NULL;
+    size_t size;
+
+    if (wrenGetSlotType(vm, 1) == WREN_TYPE_STRING)
     {
-        return wrench_primary_context->vm;
+        int length;
+        bytes = wrenGetSlotBytes(vm, 1, &length);
+        size = (size_t)length;
     }
-    else if (wrench_context_head != NULL)
+    else if (!wrenchBufferArg(vm, 1, SIZE_MAX / 2, &size))
     {
-        return wrench_context_head->vm;
+        return;
     }
-    else
+
+    if ((self->storage = wrenNewBufferStorage(NULL, size, NULL)) == NULL)
     {
-        return NULL;
+        wrenchBufferAbort(vm, "Out of memory - failed to allocate buffer.");
+        return;
     }
-}
 
-WRENCH_IMPL(void, SetPrimaryVM, (WrenVM* vm))
-{
-    if (vm != NULL)
+    if (bytes != NULL)
     {
-        wrench_primary_context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_memcpy(self->storage->data, bytes, size);
     }
-    else
+
+    self->size = size;
+}
+
+static void wrenchBufferDtor(void* data)
+{
+    wrench_Buffer* self = (wrench_Buffer*)data;
+
+    if (self->storage != NULL)
     {
-        wrench_primary_context = NULL;
+        wrenReleaseBufferStorage(self->storage);
     }
 }
 
-WRENCH_IMPL(void, ForEachVM, (void (*func)(WrenVM* vm, void* data), void* data))
+static void wrenchBufferSize(WrenVM* vm)
 {
-    wrench_assert(func != NULL, "");
-    WrenchContext* node = wrench_context_head;
+    wrenSetSlotDouble(vm, 0, (double)((wrench_Buffer*)wrenGetSlotForeign(vm, 0))->size);
+}
 
-    while (node != NULL)
-    {
-        // In case func frees the Wren VM.
-        WrenchContext* next = node->next;
+static void wrenchBufferCountMethod(WrenVM* vm)
+{
+    wrenSetSlotDouble(vm, 0, (double)wrenchBufferCount((wrench_Buffer*)wrenGetSlotForeign(vm, 0)));
+}
 
-        func(node->vm, data);
-        node = next;
-    }
+static void wrenchBufferType(WrenVM* vm)
+{
+    wrenSetSlotString(vm, 0, wrench_buffer_type_names[((wrench_Buffer*)wrenGetSlotForeign(vm, 0))->type]);
 }
 
-WRENCH_IMPL(void, ForEachModule, (WrenVM* vm, void (*func)(WrenVM* vm, const char* moduleName, void* data), void* data))
+static void wrenchBufferGet(WrenVM* vm)
 {
-    if (vm == NULL)
+    wrench_Buffer* self = (wrench_Buffer*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, wrench, Buffer);
+
+    size_t i;
+
+    if (!wrenchBufferIndex(vm, self, 1, &i))
     {
         return;
     }
 
-    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-    wrench_assert(context != NULL, "");
+    const void* data = wrenchBufferData(self);
+    double value;
 
-    wrenchForEachModule(context, func, data);
+    // Unaligned views (odd offsets) are allowed, so copy elements out rather than casting.
+    switch (self->type)
+    {
+        case WREN_BUFFER_U8: value = ((const uint8_t*)data)[i]; break;
+        case WREN_BUFFER_U16: { uint16_t v; wrench_memcpy(&v, (const char*)data + i * 2, 2); value = v; } break;
+        case WREN_BUFFER_I32: { int32_t v; wrench_memcpy(&v, (const char*)data + i * 4, 4); value = v; } break;
+        case WREN_BUFFER_F32: { float v; wrench_memcpy(&v, (const char*)data + i * 4, 4); value = v; } break;
+        default: wrench_memcpy(&value, (const char*)data + i * 8, 8); break;
+    }
+
+    wrenSetSlotDouble(vm, 0, value);
 }
 
-WRENCH_IMPL(float, GetSlotFloat, (WrenVM* vm, int slot))
+static void wrenchBufferSet(WrenVM* vm)
 {
-    const double value = wrenGetSlotDouble(vm, slot);
+    wrench_Buffer* self = (wrench_Buffer*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, wrench, Buffer);
+
+    size_t i;
+
+    if (!wrenchBufferIndex(vm, self, 1, &i))
+    {
+        return;
+    }
+
+    if (wrenGetSlotType(vm, 2) != WREN_TYPE_NUM)
+    {
+        wrenchBufferAbort(vm, "Buffer elements must be numbers.");
+        return;
+    }
+
+    const double value = wrenGetSlotDouble(vm, 2);
+    void* data = wrenchBufferData(self);
+
+    switch (self->type)
+    {
+        case WREN_BUFFER_U8:
+        case WREN_BUFFER_U16:
+        case WREN_BUFFER_I32:
+        {
+            const double lo = (self->type == WREN_BUFFER_I32) ? (double)INT32_MIN : 0.0;
+            const double hi = (self->type == WREN_BUFFER_U8) ? (double)UINT8_MAX :
+                              (self->type == WREN_BUFFER_U16) ? (double)UINT16_MAX : (double)INT32_MAX;
+
+            if (!(value >= lo && value <= hi) || value != wrench_trunc(value))
+            {
+                wrenchBufferAbort(vm, "Value doesn't fit the buffer's element type.");
+                return;
+            }
+
+            if (self->type == WREN_BUFFER_U8) { ((uint8_t*)data)[i] = (uint8_t)value; }
+            else if (self->type == WREN_BUFFER_U16) { uint16_t v = (uint16_t)value; wrench_memcpy((char*)data + i * 2, &v, 2); }
+            else { int32_t v = (int32_t)value; wrench_memcpy((char*)data + i * 4, &v, 4); }
+        }
+        break;
+
+        case WREN_BUFFER_F32: { float v = (float)value; wrench_memcpy((char*)data + i * 4, &v, 4); } break;
+        default: wrench_memcpy((char*)data + i * 8, &value, 8); break;
+    }
+
+    wrenSetSlotDouble(vm, 0, value);
+}
+
+/* New views of the same storage.
+ */
+static void wrenchBufferView(WrenVM* vm)
+{
+    wrench_Buffer* self = (wrench_Buffer*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, wrench, Buffer);
+
+    const WrenBufferType type = (WrenBufferType)wrenGetSlotInt(vm, 1);
+    wrenSetSlotBuffer(vm, 0, self->storage, self->offset, self->size - self->size % wrench_buffer_type_sizes[type], type);
+}
+
+static void wrenchBufferSlice(WrenVM* vm)
+{
+    wrench_Buffer* self = (wrench_Buffer*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, wrench, Buffer);
+
+    const size_t count = wrenchBufferCount(self);
+    size_t start, n;
+
+    if (!wrenchBufferArg(vm, 1, count, &start) || !wrenchBufferArg(vm, 2, count - start, &n))
+    {
+        return;
+    }
+
+    const size_t element_size = wrench_buffer_type_sizes[self->type];
+    wrenSetSlotBuffer(vm, 0, self->storage, self->offset + start * element_size, n * element_size, self->type);
+}
+
+static void wrenchBufferFill(WrenVM* vm)
+{
+    wrench_Buffer* self = (wrench_Buffer*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, wrench, Buffer);
+
+    const size_t count = wrenchBufferCount(self);
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (wrenGetSlotType(vm, 1) != WREN_TYPE_NUM)
+    {
+        wrenchBufferAbort(vm, "Buffer elements must be numbers.");
+        return;
+    }
+
+    // Set the first element (with the usual checks), then double it up.
+    wrenEnsureSlots(vm, 3);
+    wrenSetSlotDouble(vm, 2, wrenGetSlotDouble(vm, 1));
+    wrenSetSlotDouble(vm, 1, 0);
+    wrenchBufferSet(vm);
+
+    if (wrenGetSlotType(vm, 0) != WREN_TYPE_NUM)
+    {
+        return; // Aborted.
+    }
+
+    char* data = (char*)wrenchBufferData(self);
+    const size_t size = count * wrench_buffer_type_sizes[self->type];
+
+    for (size_t done = wrench_buffer_type_sizes[self->type]; done < size; done *= 2)
+    {
+        wrench_memcpy(data + done, data, (done < size - done) ? done : size - done);
+    }
+
+    wrenSetSlotNull(vm, 0);
+}
+
+static void wrenchBufferToString(WrenVM* vm)
+{
+    wrench_Buffer* self = (wrench_Buffer*)wrenGetSlotForeign(vm, 0);
+    WRENCH_CHECK_MAGIC_TAG(self, wrench, Buffer);
+
+    wrenSetSlotBytes(vm, 0, (const char*)wrenchBufferData(self), self->size);
+}
+
+static bool wrenchRegisterBuffer(WrenchContext* context)
+{
+    static const struct { bool is_static; const char* signature; WrenForeignMethodFn method; } methods[] =
+    {
+        { false, "size", wrenchBufferSize },
+        { false, "count", wrenchBufferCountMethod },
+        { false, "type", wrenchBufferType },
+        { false, "[_]", wrenchBufferGet },
+        { false, "[_]=(_)", wrenchBufferSet },
+        { false, "view_(_)", wrenchBufferView },
+        { false, "slice(_,_)", wrenchBufferSlice },
+        { false, "fill(_)", wrenchBufferFill },
+        { false, "toString", wrenchBufferToString },
+    };
+
+    if (!wrenchRegisterClass(context, "wrench", "Buffer", wrenchBufferCtor, wrenchBufferDtor))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < WRENCH_ARRAY_COUNT(methods); i++)
+    {
+        if (!wrenchRegisterMethod(context, "wrench", "Buffer", methods[i].is_static, methods[i].signature, methods[i].method))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* ===== [ log ] ============================================================ */
+
+/* The error log, shared by every VM: a bounded lock-free MPSC queue (Vyukov) of fixed-size
+ * entries, so reporting an error is a few atomics and a copy, and a background thread does
+ * the formatting and writing. When the queue is full, entries are dropped (and counted)
+ * rather than stalling scripts.
+ */
+#ifndef WRENCH_LOG_CAPACITY
+#define WRENCH_LOG_CAPACITY 1024 // Entries (a power of two).
+#endif
+
+#ifndef WRENCH_LOG_MESSAGE_SIZE
+#define WRENCH_LOG_MESSAGE_SIZE 384
+#endif
+
+#ifndef WRENCH_LOG_POLL_MS
+#define WRENCH_LOG_POLL_MS 10 // How long the writer sleeps when the queue is empty.
+#endif
+
+typedef char wrench_log_capacity_check[(WRENCH_LOG_CAPACITY & (WRENCH_LOG_CAPACITY - 1)) == 0 ? 1 : -1];
+
+typedef struct WrenchLogEntry
+{
+    long long sequence;
+    long long time_ms; // Wall clock.
+
+    int vm_id;
+    int type; // WrenErrorType, or -1 for `wrenLog`.
+    int line;
+
+    char module[64];
+    char message[WRENCH_LOG_MESSAGE_SIZE];
+}
+WrenchLogEntry;
+
+static struct
+{
+    WrenchLogEntry* entries;
+
+    long long head; // Next to claim (producers).
+    long long tail; // Next to write (the writer thread).
+    long long dropped;
+
+    long long enabled;
+    long long producers; // In the middle of adding an entry.
+
+    int fd;
+    bool close_fd;
+
+    bool initialized;
+    bool running;
+    bool quit;
+
+    wrench_mutex lock; // Only for the writer's sleeps and flushes; producers never take it.
+    wrench_cond cond;
+}
+wrench_log;
+
+static bool wrenchLogAdd(int vm_id, int type, const char* module, int line, const char* message)
+{
+    wrench_atomic_add(&wrench_log.producers, 1);
+
+    if (!wrench_atomic_load(&wrench_log.enabled))
+    {
+        wrench_atomic_add(&wrench_log.producers, -1);
+        return false;
+    }
+
+    const long long mask = WRENCH_LOG_CAPACITY - 1;
+    long long position = wrench_atomic_load(&wrench_log.head);
+
+    WrenchLogEntry* entry;
+
+    for (;;)
+    {
+        entry = &wrench_log.entries[position & mask];
+        const long long difference = wrench_atomic_load(&entry->sequence) - position;
+
+        if (difference == 0)
+        {
+            if (wrench_atomic_cas(&wrench_log.head, position, position + 1))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            wrench_atomic_add(&wrench_log.dropped, 1); // Full.
+            wrench_atomic_add(&wrench_log.producers, -1);
+
+            return true;
+        }
+
+        position = wrench_atomic_load(&wrench_log.head);
+    }
+
+    entry->time_ms = wrenchWallClockMilliseconds();
+    entry->vm_id = vm_id;
+    entry->type = type;
+    entry->line = line;
+
+    wrench_snprintf(entry->module, sizeof(entry->module), "%s", module != NULL ? module : "");
+    wrench_snprintf(entry->message, sizeof(entry->message), "%s", message != NULL ? message : "");
+
+    wrench_atomic_store(&entry->sequence, position + 1);
+    wrench_atomic_add(&wrench_log.producers, -1);
+
+    return true;
+}
+
+static void wrenchLogWrite(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        const long n = (long)wrench_write(wrench_log.fd, data, (unsigned)size);
+
+        if (n <= 0)
+        {
+            #if !_WIN32
+                if (n < 0 && errno == EINTR) { continue; }
+            #endif
+
+            return; // Nowhere to report it.
+        }
+
+        data += n;
+        size -= (size_t)n;
+    }
+}
+
+/* Write out every published entry. Returns how many there were.
+ */
+static int wrenchLogDrain(void)
+{
+    static const char* types[] = { "compile", "runtime", "trace" };
+
+    const long long mask = WRENCH_LOG_CAPACITY - 1;
+    long long tail = wrench_log.tail;
+
+    char text[1024 * 16];
+    size_t size = 0;
+    int count = 0;
+
+    const long long dropped = wrench_atomic_load(&wrench_log.dropped);
+
+    if (dropped > 0)
+    {
+        wrench_atomic_add(&wrench_log.dropped, -dropped);
+        size += (size_t)wrench_snprintf(text, sizeof(text), "[wrench] %lld log entries dropped (queue full)\n", dropped);
+    }
+
+    for (;;)
+    {
+        WrenchLogEntry* entry = &wrench_log.entries[tail & mask];
+
+        if (wrench_atomic_load(&entry->sequence) != tail + 1)
+        {
+            break;
+        }
+
+        const time_t seconds = (time_t)(entry->time_ms / 1000);
+        struct tm utc;
+
+        #if _WIN32
+            gmtime_s(&utc, &seconds);
+        #else
+            gmtime_r(&seconds, &utc);
+        #endif
+
+        if (size + WRENCH_LOG_MESSAGE_SIZE + 256 > sizeof(text))
+        {
+            wrenchLogWrite(text, size);
+            size = 0;
+        }
+
+        char where[128] = ""; // Runtime errors have no location (the stack trace follows).
+
+        if (entry->module[0] != '\0')
+        {
+            wrench_snprintf(where, sizeof(where), " %s:%d", entry->module, entry->line);
+        }
+
+        int length = wrench_snprintf(text + size, sizeof(text) - size, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ vm %d %s%s: %s\n",
+                    utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec, (int)(entry->time_ms % 1000),
+                    entry->vm_id, (entry->type >= 0 && entry->type < 3) ? types[entry->type] : "log", (const char*)where, entry->message);
+
+        if (length > 0)
+        {
+            size += ((size_t)length < sizeof(text) - size) ? (size_t)length : sizeof(text) - size - 1;
+        }
+
+        wrench_atomic_store(&entry->sequence, tail + WRENCH_LOG_CAPACITY); // Free the slot.
+        wrench_atomic_store(&wrench_log.tail, ++tail);
+
+        count++;
+    }
+
+    if (size > 0)
+    {
+        wrenchLogWrite(text, size);
+    }
+
+    return count;
+}
+
+static void wrenchLogWriter(void* arg)
+{
+    wrench_mutex_lock(&wrench_log.lock);
+
+    while (!wrench_log.quit)
+    {
+        wrench_mutex_unlock(&wrench_log.lock);
+        const int count = wrenchLogDrain();
+        wrench_mutex_lock(&wrench_log.lock);
+
+        wrench_cond_broadcast(&wrench_log.cond); // For `wrenFlushLog`.
+
+        if (count == 0 && !wrench_log.quit)
+        {
+            wrench_cond_timedwait(&wrench_log.cond, &wrench_log.lock, WRENCH_LOG_POLL_MS);
+        }
+    }
+
+    wrench_mutex_unlock(&wrench_log.lock);
+    wrenchLogDrain();
+
+    wrench_mutex_lock(&wrench_log.lock);
+    wrench_log.running = false;
+
+    wrench_cond_broadcast(&wrench_log.cond);
+    wrench_mutex_unlock(&wrench_log.lock);
+}
+
+/* Wait until everything added so far has been written.
+ */
+static void wrenchFlushLog(void)
+{
+    if (!wrench_log.initialized)
+    {
+        return;
+    }
+
+    const long long target = wrench_atomic_load(&wrench_log.head);
+    wrench_mutex_lock(&wrench_log.lock);
+
+    while (wrench_log.running && wrench_atomic_load(&wrench_log.tail) < target)
+    {
+        wrench_cond_broadcast(&wrench_log.cond); // Don't wait for the writer's next poll.
+        wrench_cond_timedwait(&wrench_log.cond, &wrench_log.lock, WRENCH_LOG_POLL_MS);
+    }
+
+    wrench_mutex_unlock(&wrench_log.lock);
+}
+
+static void wrenchCloseLog(void)
+{
+    if (!wrench_log.initialized || wrench_log.entries == NULL)
+    {
+        return;
+    }
+
+    wrench_atomic_store(&wrench_log.enabled, 0);
+
+    while (wrench_atomic_load(&wrench_log.producers) > 0)
+    {
+        wrenchYield(); // Let entries being added finish.
+    }
+
+    wrench_mutex_lock(&wrench_log.lock);
+    wrench_log.quit = true;
+
+    wrench_cond_broadcast(&wrench_log.cond);
+
+    while (wrench_log.running)
+    {
+        wrench_cond_wait(&wrench_log.cond, &wrench_log.lock);
+    }
+
+    wrench_mutex_unlock(&wrench_log.lock);
+
+    if (wrench_log.close_fd)
+    {
+        wrench_close(wrench_log.fd);
+    }
+
+    wrench_free(wrench_log.entries);
+    wrench_log.entries = NULL;
+}
+
+static bool wrenchOpenLog(int fd, bool close_fd)
+{
+    wrenchCloseLog();
+
+    if (!wrench_log.initialized)
+    {
+        wrench_mutex_init(&wrench_log.lock);
+        wrench_cond_init(&wrench_log.cond);
+
+        wrench_log.initialized = true;
+    }
+
+    wrench_log.entries = (WrenchLogEntry*)wrench_malloc(sizeof(WrenchLogEntry) * WRENCH_LOG_CAPACITY);
+
+    if (wrench_log.entries == NULL)
+    {
+        if (close_fd) { wrench_close(fd); }
+        return false;
+    }
+
+    for (long long i = 0; i < WRENCH_LOG_CAPACITY; i++)
+    {
+        wrench_log.entries[i].sequence = i;
+    }
+
+    wrench_log.head = wrench_log.tail = wrench_log.dropped = 0;
+    wrench_log.fd = fd;
+    wrench_log.close_fd = close_fd;
+
+    wrench_log.quit = false;
+    wrench_log.running = true;
+
+    if (!wrenchThreadStart(wrenchLogWriter, NULL))
+    {
+        wrench_log.running = false;
+        wrenchCloseLog();
+
+        return false;
+    }
+
+    wrench_atomic_store(&wrench_log.enabled, 1);
+    return true;
+}
+
+static WrenchContext* wrenchNewContext(WrenVM* vm)
+{
+    WrenchContext* context = (WrenchContext*)wrench_calloc(1, sizeof(WrenchContext));
+
+    if (context == NULL)
+    {
+        // Don't set error string here, as we're going to free the VM soon anyways.
+        return NULL;
+    }
+
+    // For Wren calls.
+    context->vm = vm;
+
+    static long long wrench_next_vm_id;
+    context->id = (int)wrench_atomic_add(&wrench_next_vm_id, 1) + 1;
+
+    context->log_add = wrenchLogAdd;
+
+    context->async_submit = wrenchAsyncSubmit;
+    wrench_mutex_init(&context->async_lock);
+    wrench_cond_init(&context->async_cond);
+
+    wrench_mutex_init(&context->output.lock);
+    wrench_cond_init(&context->output.cond);
+
+    #ifndef WRENCH_NODE_BUFFER_SIZE
+    #define WRENCH_NODE_BUFFER_SIZE (1024 * 1024 * 1)
+    #endif
+    context->node_alloc_base = (char*)wrench_malloc(WRENCH_NODE_BUFFER_SIZE);
+
+    if (context->node_alloc_base == NULL)
+    {
+        wrench_free(context);
+        return NULL;
+    }
+
+    context->node_alloc_end = context->node_alloc_base + WRENCH_NODE_BUFFER_SIZE;
+    context->node_alloc_mark = context->node_alloc_base;
+
+    #ifndef WRENCH_SOURCE_CODE_BUFFER_SIZE
+    #define WRENCH_SOURCE_CODE_BUFFER_SIZE (1024 * 1024 * 2)
+    #endif
+    context->source_code_alloc_base = (char*)wrench_malloc(WRENCH_SOURCE_CODE_BUFFER_SIZE);
+
+    if (context->source_code_alloc_base == NULL)
+    {
+        wrench_free(context->node_alloc_base);
+        wrench_free(context);
+
+        return NULL;
+    }
+
+    context->source_code_alloc_end = context->source_code_alloc_base + WRENCH_SOURCE_CODE_BUFFER_SIZE;
+    context->source_code_alloc_mark = context->source_code_alloc_base;
+
+    #ifndef WRENCH_DEFAULT_SOURCE_POLICY
+    #define WRENCH_DEFAULT_SOURCE_POLICY WREN_SOURCE_KEEP
+    #endif
+
+    context->source_policy = WRENCH_DEFAULT_SOURCE_POLICY;
+
+    /* Link.
+     */
+    if (wrench_context_head == NULL && wrench_context_tail == NULL)
+    {
+        wrench_context_head =
+        wrench_context_tail = context;
+    }
+    else
+    {
+        wrench_context_tail->next = context;
+        context->prev = wrench_context_tail;
+
+        wrench_context_tail = context;
+    }
+
+    return context;
+}
+
+static void wrenchFreeContext(WrenchContext* context)
+{
+    for (WrenchModule* node = context->module_head; node != NULL; node = node->next)
+    {
+        if (node->library != NULL)
+        {
+            char quit_name[1024];
+            wrench_snprintf(quit_name, sizeof(quit_name), "%sWrenQuit", node->name);
+
+            wrenLibraryQuitFn quit = (
+            wrenLibraryQuitFn)wrenchLibraryFunc(context, node->library, (const char*)quit_name);
+
+            if (quit != NULL)
+            {
+                quit();
+            }
+
+            wrenchFreeLibrary(context, node->library);
+        }
+        else if (node->quit != NULL)
+        {
+            node->quit();
+        }
+    }
+
+    if (0) // Internal, vestigial debugging code.
+    {
+        for (int i = 0; i < 80; i++)
+        {
+            wrench_putchar('-');
+        }
+
+        wrench_putchar('\n');
+
+        for (char* s = context->source_code_alloc_base; s < context->source_code_alloc_mark; s++)
+        {
+            if (*s)
+            {
+                wrench_putchar(*s);
+            }
+        }
+
+        for (int i = 0; i < 80; i++)
+        {
+            wrench_putchar('-');
+        }
+
+        wrench_putchar('\n');
+    }
+
+    /* Unlink.
+     */
+    if (context->prev) context->prev->next = context->next;
+    if (context->next) context->next->prev = context->prev;
+
+    if (wrench_context_head == context) wrench_context_head = context->next;
+    if (wrench_context_tail == context) wrench_context_tail = context->prev;
+
+    if (wrench_primary_context == context)
+    {
+        wrench_primary_context = NULL;
+    }
+
+    wrenchFreeCommandLine(context);
+
+    wrenchFreeOutput(context);
+
+    wrench_cond_destroy(&context->output.cond);
+    wrench_mutex_destroy(&context->output.lock);
+
+    wrench_cond_destroy(&context->async_cond);
+    wrench_mutex_destroy(&context->async_lock);
+
+    wrench_free(context->source_code_alloc_base);
+    wrench_free(context->node_alloc_base);
+    wrench_free(context->base_path);
+
+    wrench_free(context);
+}
+
+static wrenLibraryInitFn wrenchGlobalInitFunc[16];
+static size_t wrenchGlobalInitFuncCount;
+
+static wrenLibraryQuitFn wrenchGlobalQuitFunc[16];
+static size_t wrenchGlobalQuitFuncCount;
+
+typedef struct WrenchStaticModule
+{
+    const char* name;
+
+    wrenLibraryInitFn init;
+    wrenLibraryQuitFn quit;
+}
+WrenchStaticModule;
+
+static WrenchStaticModule wrenchStaticModules[32];
+static size_t wrenchStaticModuleCount;
+
+static const WrenchStaticModule* wrenchGetStaticModule(const char* name)
+{
+    for (size_t i = 0; i < wrenchStaticModuleCount; i++)
+    {
+        if (wrench_strcmp(wrenchStaticModules[i].name, name) == 0)
+        {
+            return &wrenchStaticModules[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* ===== [ bulk slots ] ===================================================== */
+
+enum
+{
+    WRENCH_BULK_DOUBLE,
+    WRENCH_BULK_FLOAT,
+    WRENCH_BULK_INT,
+};
+
+static double wrenchLoadNum(const void* values, int i, int kind)
+{
+    switch (kind)
+    {
+        case WRENCH_BULK_DOUBLE: return ((const double*)values)[i];
+        case WRENCH_BULK_FLOAT: return (double)((const float*)values)[i];
+        default: return (double)((const int*)values)[i];
+    }
+}
+
+/* Returns false for values that don't fit (the list came from a script, so that's not a bug).
+ */
+static bool wrenchStoreNum(void* values, int i, double value, int kind)
+{
+    switch (kind)
+    {
+        case WRENCH_BULK_DOUBLE:
+        {
+            ((double*)values)[i] = value;
+        }
+        break;
+
+        case WRENCH_BULK_FLOAT:
+        {
+            if (!WRENCH_NUM_IS_SAFE_FLT(value))
+            {
+                return false;
+            }
+
+            ((float*)values)[i] = (float)value;
+        }
+        break;
+
+        default:
+        {
+            if (!(value >= (double)INT_MIN && value <= (double)INT_MAX) || value != wrench_trunc(value))
+            {
+                return false;
+            }
+
+            ((int*)values)[i] = (int)value;
+        }
+        break;
+    }
+
+    return true;
+}
+
+static void wrenchSetSlotNumList(WrenVM* vm, int slot, int scratch, const void* values, int count, int kind)
+{
+    wrench_assert(count >= 0 && (values != NULL || count == 0), "%i", count);
+
+    wrenSetSlotNewList(vm, slot);
+
+    for (int i = 0; i < count; i++)
+    {
+        wrenSetSlotDouble(vm, scratch, wrenchLoadNum(values, i, kind));
+        wrenInsertInList(vm, slot, -1, scratch);
+    }
+}
+
+static int wrenchGetSlotNumList(WrenVM* vm, int slot, int scratch, void* values, int capacity, int kind)
+{
+    wrench_assert(capacity >= 0 && (values != NULL || capacity == 0), "%i", capacity);
+
+    if (wrenGetSlotType(vm, slot) != WREN_TYPE_LIST)
+    {
+        return -1;
+    }
+
+    const int count = wrenGetListCount(vm, slot);
+    const int n = (count < capacity) ? count : capacity;
+
+    for (int i = 0; i < n; i++)
+    {
+        wrenGetListElement(vm, slot, i, scratch);
+
+        if (wrenGetSlotType(vm, scratch) != WREN_TYPE_NUM || !wrenchStoreNum(values, i, wrenGetSlotDouble(vm, scratch), kind))
+        {
+            return -1;
+        }
+    }
+
+    return count;
+}
+
+static void wrenchSetSlotStringList(WrenVM* vm, int slot, int scratch, const char* const* values, int count)
+{
+    wrench_assert(count >= 0 && (values != NULL || count == 0), "%i", count);
+
+    wrenSetSlotNewList(vm, slot);
+
+    for (int i = 0; i < count; i++)
+    {
+        wrenSetSlotString(vm, scratch, values[i]);
+        wrenInsertInList(vm, slot, -1, scratch);
+    }
+}
+
+static void wrenchSetSlotMap(WrenVM* vm, int slot, int scratch, const char* const* keys, const double* nums, const char* const* strings, int count)
+{
+    wrench_assert(count >= 0 && (keys != NULL || count == 0), "%i", count);
+
+    wrenSetSlotNewMap(vm, slot);
+
+    for (int i = 0; i < count; i++)
+    {
+        wrenSetSlotString(vm, scratch, keys[i]);
+
+        if (nums != NULL)
+        {
+            wrenSetSlotDouble(vm, scratch + 1, nums[i]);
+        }
+        else
+        {
+            wrenSetSlotString(vm, scratch + 1, strings[i]);
+        }
+
+        wrenSetMapValue(vm, slot, scratch, scratch + 1);
+    }
+}
+
+/* ===== [ public API ] ===================================================== */
+
+WRENCH_IMPL(WrenConfiguration*, GetConfig, (void))
+{
+    static WrenConfiguration wrench_config;
+    static bool wrench_config_is_init;
+
+    if (!wrench_config_is_init)
+    {
+        wrenInitConfiguration(&wrench_config);
+
+        wrench_config.reallocateFn = wrenDefaultReallocate;
+        wrench_config.resolveModuleFn = wrenDefaultResolveModule;
+        wrench_config.loadModuleFn = wrenDefaultLoadModule;
+        wrench_config.bindForeignMethodFn = wrenDefaultBindForeignMethod;
+        wrench_config.bindForeignClassFn = wrenDefaultBindForeignClass;
+        wrench_config.writeFn = wrenDefaultWrite;
+        wrench_config.errorFn = wrenDefaultError;
+
+        wrench_config_is_init = true;
+    }
+
+    return &wrench_config;
+}
+
+WRENCH_IMPL(WrenVM*, NewExtendedVM, (int argc, char** argv, bool call_global_init_funcs))
+{
+    WrenVM* vm = wrenNewVM(wrenGetConfig());
+
+    if (vm == NULL)
+    {
+        return NULL;
+    }
+
+    WrenchContext* context = wrenchNewContext(vm);
+
+    if (context == NULL)
+    {
+        wrenFreeVM(vm);
+        return NULL;
+    }
+
+    wrenSetUserData(vm, context);
+
+    if (!wrenchSetCommandLine(context, argc, argv))
+    {
+        wrenFreeExtendedVM(vm, false);
+        return NULL;
+    }
+
+    if (!wrenchRegisterModuleEx(context, "wrench", wrench_module_source, sizeof(wrench_module_source) - 1, false) ||
+        !wrenchRegisterClass(context, "wrench", "Output", NULL, NULL) ||
+        !wrenchRegisterMethod(context, "wrench", "Output", true, "flush()", wrenchOutputFlushMethod) ||
+        !wrenchRegisterClass(context, "wrench", "Module", NULL, NULL) ||
+        !wrenchRegisterMethod(context, "wrench", "Module", true, "source(_)", wrenchModuleSourceMethod) ||
+        !wrenchRegisterMethod(context, "wrench", "Module", true, "sourcePolicy", wrenchModuleGetSourcePolicyMethod) ||
+        !wrenchRegisterMethod(context, "wrench", "Module", true, "sourcePolicy=(_)", wrenchModuleSetSourcePolicyMethod) ||
+        !wrenchRegisterBuffer(context))
+    {
+        wrenFreeExtendedVM(vm, false);
+        return NULL;
+    }
+
+    if (!wrenchStdoutIsTerminal())
+    {
+        wrenchSetOutputBuffering(context, WRENCH_OUTPUT_BUFFER_SIZE, WRENCH_OUTPUT_THREADED);
+    }
+
+    if (call_global_init_funcs)
+    {
+        for (size_t i = 0; i < wrenchGlobalInitFuncCount; i++)
+        {
+            wrench_assert(wrenchGlobalInitFunc[i] != NULL, "");
+
+            if (!wrenchGlobalInitFunc[i](vm))
+            {
+                wrenFreeExtendedVM(vm, false);
+                return NULL;
+            }
+        }
+    }
+
+    return vm;
+}
+
+WRENCH_IMPL(void, FreeExtendedVM, (WrenVM* vm, bool call_global_quit_funcs))
+{
+    if (vm == NULL)
+    {
+        return;
+    }
+
+    if (call_global_quit_funcs)
+    {
+        /* TODO: Call in reverse order?
+         */
+        for (size_t i = 0; i < wrenchGlobalQuitFuncCount; i++)
+        {
+            wrench_assert(wrenchGlobalQuitFunc[i] != NULL, "");
+            wrenchGlobalQuitFunc[i]();
+        }
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    wrenchFreeEventSources(context);
+    wrenchFreeHandleCache(context);
+
+    // We must free the VM first, before dtors in shared libs are unmapped.
+    wrenFreeVM(vm);
+
+    wrenchFreeContext(context);
+}
+
+WRENCH_IMPL(void, RegisterGlobalInitFunction, (wrenLibraryInitFn init))
+{
+    wrench_assert(init != NULL, ""); // TODO: Don't register funcs that are already in array.
+    wrench_assert(wrenchGlobalInitFuncCount < WRENCH_ARRAY_COUNT(wrenchGlobalInitFunc), "");
+
+    wrenchGlobalInitFunc[wrenchGlobalInitFuncCount++] = init;
+}
+
+WRENCH_IMPL(void, RegisterGlobalQuitFunction, (wrenLibraryQuitFn quit))
+{
+    wrench_assert(quit != NULL, ""); // TODO: Don't register funcs that are already in array.
+    wrench_assert(wrenchGlobalQuitFuncCount < WRENCH_ARRAY_COUNT(wrenchGlobalQuitFunc), "");
+
+    wrenchGlobalQuitFunc[wrenchGlobalQuitFuncCount++] = quit;
+}
+
+WRENCH_IMPL(void, RegisterStaticModule, (const char* name, wrenLibraryInitFn init, wrenLibraryQuitFn quit))
+{
+    wrench_assert(name != NULL && init != NULL, "");
+    wrench_assert(wrenchGetStaticModule(name) == NULL, "static module \"%s\" already registered", name);
+    wrench_assert(wrenchStaticModuleCount < WRENCH_ARRAY_COUNT(wrenchStaticModules), "");
+
+    WrenchStaticModule* entry = &wrenchStaticModules[wrenchStaticModuleCount++];
+
+    entry->name = name;
+    entry->init = init;
+    entry->quit = quit;
+}
+
+WRENCH_IMPL(bool, GetForeignLibraryLoadEnabled, (WrenVM* vm))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchGetForeignLibraryLoadEnabled(context);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+WRENCH_IMPL(void, SetForeignLibraryLoadEnabled, (WrenVM* vm, bool enabled))
+{
+    if (vm == NULL)
+    {
+        return;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    wrenchSetForeignLibraryLoadEnabled(context, enabled);
+}
+
+WRENCH_IMPL(const char*, GetErrorString, (WrenVM* vm))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchGetErrorString(context);
+    }
+    else
+    {
+        return "NULL Wren virtual machine.";
+    }
+}
+
+WRENCH_IMPL(void, SetErrorString, (WrenVM* vm, const char* error))
+{
+    if (vm == NULL)
+    {
+        return;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    wrenchSetErrorString(context, error);
+}
+
+WRENCH_IMPL(void*, GetUserDataEx, (WrenVM* vm, int slot))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchGetUserDataEx(context, slot);
+    }
+    else
+    {
+        return NULL;
+    }
+}
+
+WRENCH_IMPL(void, SetUserDataEx, (WrenVM* vm, int slot, void* userData))
+{
+    if (vm == NULL)
+    {
+        return;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    wrenchSetUserDataEx(context, slot, userData);
+}
+
+WRENCH_IMPL(char**, GetCommandLine, (WrenVM* vm, int* argc))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchGetCommandLine(context, argc);
+    }
+    else
+    {
+        if (argc != NULL)
+        {
+            *argc = 0;
+        }
+
+        return NULL;
+    }
+}
+
+WRENCH_IMPL(bool, SetCommandLine, (WrenVM* vm, int argc, char** argv))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchSetCommandLine(context, argc, argv);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+WRENCH_IMPL(const char*, GetModuleSource, (WrenVM* vm, const char* name))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchGetModuleSource(context, name);
+    }
+    else
+    {
+        return "";
+    }
+}
+
+WRENCH_IMPL(WrenSourcePolicy, GetSourcePolicy, (WrenVM* vm))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return context->source_policy;
+    }
+    else
+    {
+        return WREN_SOURCE_KEEP;
+    }
+}
+
+WRENCH_IMPL(void, SetSourcePolicy, (WrenVM* vm, WrenSourcePolicy policy))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        context->source_policy = policy;
+    }
+}
+
+WRENCH_IMPL(const char*, GetBasePath, (WrenVM* vm))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchGetBasePath(context);
+    }
+    else
+    {
+        return "./";
+    }
+}
+
+WRENCH_IMPL(bool, SetBasePath, (WrenVM* vm, const char* path))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchSetBasePath(context, path);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+WRENCH_IMPL(wrenFileReadFn, GetFileReadCallback, (WrenVM* vm))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchGetFileReadCallback(context);
+    }
+    else
+    {
+        return NULL;
+    }
+}
+
+WRENCH_IMPL(void, SetFileReadCallback, (WrenVM* vm, wrenFileReadFn callback))
+{
+    if (vm == NULL)
+    {
+        return;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    wrenchSetFileReadCallback(context, callback);
+}
+
+WRENCH_IMPL(wrenFileFreeFn, GetFileFreeCallback, (WrenVM* vm))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchGetFileFreeCallback(context);
+    }
+    else
+    {
+        return NULL;
+    }
+}
+
+WRENCH_IMPL(void, SetFileFreeCallback, (WrenVM* vm, wrenFileFreeFn callback))
+{
+    if (vm == NULL)
+    {
+        return;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    wrenchSetFileFreeCallback(context, callback);
+}
+
+WRENCH_IMPL(void*, DefaultFileRead, (WrenVM* vm, const char* name, size_t* file_size))
+{
+    char path[1024 * 4], error[1024 * 4];
+
+    if (wrench_snprintf(path, sizeof(path), "%s%s.wren", wrenGetBasePath(vm), name) < 0)
+    {
+        // TODO: Handle truncation error.
+    }
+
+    FILE* file = wrench_fopen((const char*)path, "rb");
+
+    if (file == NULL)
+    {
+        wrench_snprintf(error, sizeof(error), "Source file \"%s\" not found.", (const char*)path);
+        wrenSetErrorString(vm, (const char*)error);
+
+        return NULL;
+    }
+
+    if (wrench_fseek(file, 0, SEEK_END) != 0)
+    {
+        wrench_snprintf(error, sizeof(error), "Failed to get size of source file \"%s\".", (const char*)path);
+        wrenSetErrorString(vm, (const char*)error);
+
+        wrench_fclose(file);
+        return NULL;
+    }
+
+    *file_size = (size_t)wrench_ftell(file);
+
+    if (wrench_fseek(file, 0, SEEK_SET) != 0)
+    {
+        wrench_snprintf(error, sizeof(error), "Failed to rewind source file \"%s\".", (const char*)path);
+        wrenSetErrorString(vm, (const char*)error);
+
+        wrench_fclose(file);
+        return NULL;
+    }
+
+    void* file_data = wrench_malloc(*file_size);
+
+    if (file_data == NULL)
+    {
+        wrench_snprintf(error, sizeof(error), "Failed to allocate space for source file \"%s\".", (const char*)path);
+        wrenSetErrorString(vm, (const char*)error);
+
+        wrench_fclose(file);
+        return NULL;
+    }
+
+    if (wrench_fread(file_data, *file_size, 1, file) != 1)
+    {
+        wrench_snprintf(error, sizeof(error), "Failed to read source file \"%s\".", (const char*)path);
+        wrenSetErrorString(vm, (const char*)error);
+
+        wrench_fclose(file);
+        return NULL;
+    }
+
+    if (wrench_fclose(file) != 0)
+    {
+        wrench_snprintf(error, sizeof(error), "Failed to close source file \"%s\".", (const char*)path);
+        wrenSetErrorString(vm, (const char*)error);
+
+        return NULL;
+    }
+
+    return file_data;
+}
+
+WRENCH_IMPL(void, DefaultFileFree, (WrenVM* vm, void* data, size_t size))
+{
+    wrench_free(data);
+}
+
+WRENCH_IMPL(const char*, LoadSourceFile, (WrenVM* vm, const char* name, size_t* num_chars))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchLoadSourceFile(context, name, num_chars);
+    }
+    else
+    {
+        return NULL;
+    }
+}
+
+WRENCH_IMPL(bool, BeginModule, (WrenVM* vm, const char* moduleName))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchBeginModule(context, moduleName);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+WRENCH_IMPL(bool, CodeEx, (WrenVM* vm, const char* source, size_t num_chars))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchCodeEx(context, source, num_chars);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+WRENCH_IMPL(bool, Code, (WrenVM* vm, const char* source))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchCode(context, source);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+WRENCH_IMPL(bool, EndModule, (WrenVM* vm))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchEndModule(context);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+WRENCH_IMPL(bool, RegisterModuleEx, (WrenVM* vm, const char* moduleName, const char* source, size_t num_chars, bool copy_source))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchRegisterModuleEx(context, moduleName, source, num_chars, copy_source);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+WRENCH_IMPL(bool, RegisterModule, (WrenVM* vm, const char* moduleName, const char* source))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchRegisterModule(context, moduleName, source);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+WRENCH_IMPL(bool, RegisterClass, (WrenVM* vm, const char* moduleName, const char* className, WrenForeignMethodFn ctor, WrenFinalizerFn dtor))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchRegisterClass(context, moduleName, className, ctor, dtor);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+WRENCH_IMPL(bool, RegisterMethod, (WrenVM* vm, const char* moduleName, const char* className, bool isStatic, const char* signature, WrenForeignMethodFn method))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchRegisterMethod(context, moduleName, className, isStatic, signature, method);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+WRENCH_IMPL(bool, RegisterEventSource, (WrenVM* vm, wrenEventPollFn poll, wrenEventFreeFn free, void* data))
+{
+    if (vm == NULL)
+    {
+        return false;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+    wrench_assert(poll != NULL, "");
+
+    if (context->num_event_sources >= (int)WRENCH_ARRAY_COUNT(context->event_sources))
+    {
+        wrenchSetErrorString(context, "Too many event sources registered.");
+        return false;
+    }
+
+    WrenchEventSource* source = &context->event_sources[context->num_event_sources++];
+
+    source->poll = poll;
+    source->free = free;
+    source->data = data;
+
+    return true;
+}
+
+WRENCH_IMPL(void*, GetEventSourceData, (WrenVM* vm, wrenEventPollFn poll))
+{
+    if (vm == NULL)
+    {
+        return NULL;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    for (int i = 0; i < context->num_event_sources; i++)
+    {
+        if (context->event_sources[i].poll == poll)
+        {
+            return context->event_sources[i].data;
+        }
+    }
+
+    return NULL;
+}
+
+WRENCH_IMPL(bool, RunEventLoop, (WrenVM* vm))
+{
+    if (vm == NULL)
+    {
+        return false;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    /* If only one source has work, block on it. Otherwise, round-robin with a short timeout.
+     * Sources are re-counted every pass, as resumed fibers may register new ones.
+     */
+    int block_on = -1;
+
+    while (!context->event_loop_error)
+    {
+        int num_busy = 0, busy = -1;
+
+        if (block_on != -1)
+        {
+            wrenchFlushOutput(context); // Don't hold output back while waiting.
+        }
+        else
+        {
+            wrenchFlushOutputIfDue(context);
+        }
+
+        for (int i = 0; i < context->num_event_sources; i++)
+        {
+            WrenchEventSource* source = &context->event_sources[i];
+            const int timeout = (i == block_on) ? -1 : (block_on == -2 ? 1 : 0);
+
+            if (source->poll(vm, timeout, source->data) > 0)
+            {
+                busy = i;
+                num_busy++;
+            }
+
+            if (context->event_loop_error)
+            {
+                break;
+            }
+        }
+
+        if (num_busy == 0)
+        {
+            break;
+        }
+
+        block_on = (num_busy == 1) ? busy : -2;
+    }
+
+    return !context->event_loop_error;
+}
+
+WRENCH_IMPL(bool, ResumeFiber, (WrenVM* vm, WrenHandle* fiber, bool is_error))
+{
+    if (vm == NULL)
+    {
+        return false;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+    wrench_assert(fiber != NULL, "");
+
+    WrenHandle* value = wrenGetSlotHandle(vm, 0);
+    wrenEnsureSlots(vm, 3);
+
+    if (!wrenchGetScheduler(context))
+    {
+        wrenReleaseHandle(vm, value);
+        wrenReleaseHandle(vm, fiber);
+
+        context->event_loop_error = true;
+        return false;
+    }
+
+    wrenSetSlotHandle(vm, 0, context->scheduler_class);
+    wrenSetSlotHandle(vm, 1, fiber);
+    wrenSetSlotHandle(vm, 2, value);
+
+    wrenReleaseHandle(vm, value);
+    wrenReleaseHandle(vm, fiber);
+
+    const WrenInterpretResult result = wrenCall(vm, is_error ? context->scheduler_resume_error : context->scheduler_resume);
+    wrenchFlushOutputIfDue(context);
+
+    if (result != WREN_RESULT_SUCCESS)
+    {
+        context->event_loop_error = true;
+        return false;
+    }
+
+    return true;
+}
+
+WRENCH_IMPL(void, CallAsync, (WrenVM* vm, wrenAsyncBeginFn begin, wrenAsyncWorkFn work, wrenAsyncDoneFn done))
+{
+    // Grab the fiber first, as `begin` may use slot 0 to abort.
+    WrenHandle* fiber = wrenGetSlotHandle(vm, wrenGetSlotCount(vm) - 1);
+    void* task = begin(vm);
+
+    if (task == NULL)
+    {
+        wrenReleaseHandle(vm, fiber);
+        return;
+    }
+
+    if (!wrenSubmitAsync(vm, fiber, task, work, done))
+    {
+        wrenReleaseHandle(vm, fiber);
+        done(vm, task);
+
+        wrenSetSlotString(vm, 0, "Out of memory - failed to submit async task.");
+        wrenAbortFiber(vm, 0);
+    }
+}
+
+WRENCH_IMPL(bool, SubmitAsync, (WrenVM* vm, WrenHandle* fiber, void* task, wrenAsyncWorkFn work, wrenAsyncDoneFn done))
+{
+    if (vm == NULL)
+    {
+        return false;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    WrenchAsyncTask* node = (WrenchAsyncTask*)wrench_calloc(1, sizeof(WrenchAsyncTask));
+
+    if (node == NULL)
+    {
+        return false;
+    }
+
+    node->fiber = fiber;
+    node->data = task;
+    node->work = work;
+    node->done = done;
+
+    context->async_submit(context, node);
+    return true;
+}
+
+WRENCH_IMPL(bool, RegisterAsyncMethod, (WrenVM* vm, const char* moduleName, const char* className, bool isStatic, const char* name, const char* args, WrenForeignMethodFn method))
+{
+    if (vm != NULL)
+    {
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        wrench_assert(context != NULL, "");
+
+        return wrenchRegisterAsyncMethod(context, moduleName, className, isStatic, name, args, method);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+WRENCH_IMPL(bool, SetOutputBuffering, (WrenVM* vm, size_t buffer_size, bool threaded))
+{
+    if (vm == NULL)
+    {
+        return false;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    return wrenchSetOutputBuffering(context, buffer_size, threaded);
+}
+
+WRENCH_IMPL(void, FlushOutput, (WrenVM* vm))
+{
+    if (vm == NULL)
+    {
+        return;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+
+    if (context != NULL)
+    {
+        wrenchFlushOutput(context);
+    }
+}
+
+WRENCH_IMPL(bool, GetVariableCached, (WrenVM* vm, const char* moduleName, const char* name, int slot))
+{
+    if (vm == NULL)
+    {
+        return false;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    return wrenchGetVariableCached(context, moduleName, name, slot);
+}
+
+WRENCH_IMPL(WrenHandle*, GetCachedCallHandle, (WrenVM* vm, const char* signature))
+{
+    if (vm == NULL)
+    {
+        return NULL;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    return wrenchGetCachedCallHandle(context, signature);
+}
+
+WRENCH_IMPL(WrenInterpretResult, CallCached, (WrenVM* vm, const char* moduleName, const char* receiver, const char* signature))
+{
+    if (vm == NULL)
+    {
+        return WREN_RESULT_RUNTIME_ERROR;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    WrenHandle* method = wrenchGetCachedCallHandle(context, signature);
+
+    if (method == NULL || !wrenchGetVariable(context, moduleName, receiver, 0))
+    {
+        return WREN_RESULT_RUNTIME_ERROR;
+    }
+
+    return wrenCall(vm, method);
+}
+
+WRENCH_IMPL(bool, OpenLog, (const char* path))
+{
+    if (path == NULL)
+    {
+        return wrenchOpenLog(2, false);
+    }
+
+    #if _WIN32
+        const int fd = _open(path, _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+    #else
+        const int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    #endif
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    return wrenchOpenLog(fd, true);
+}
+
+WRENCH_IMPL(bool, OpenLogFd, (int fd))
+{
+    return fd >= 0 && wrenchOpenLog(fd, false);
+}
+
+WRENCH_IMPL(void, CloseLog, (void))
+{
+    wrenchCloseLog();
+}
+
+WRENCH_IMPL(void, FlushLog, (void))
+{
+    wrenchFlushLog();
+}
+
+WRENCH_IMPL(bool, Log, (WrenVM* vm, const char* moduleName, int line, const char* message))
+{
+    WrenchContext* context = (vm != NULL) ? (WrenchContext*)wrenGetUserData(vm) : NULL;
+
+    if (context != NULL)
+    {
+        return context->log_add(context->id, -1, moduleName, line, message);
+    }
+
+    return wrenchLogAdd(0, -1, moduleName, line, message);
+}
+
+WRENCH_IMPL(int, GetVMId, (WrenVM* vm))
+{
+    WrenchContext* context = (vm != NULL) ? (WrenchContext*)wrenGetUserData(vm) : NULL;
+    return (context != NULL) ? context->id : 0;
+}
+
+WRENCH_IMPL(WrenVM*, GetPrimaryVM, (void))
+{
+    if (wrench_primary_context != NULL)
+    {
+        return wrench_primary_context->vm;
+    }
+    else if (wrench_context_head != NULL)
+    {
+        return wrench_context_head->vm;
+    }
+    else
+    {
+        return NULL;
+    }
+}
+
+WRENCH_IMPL(void, SetPrimaryVM, (WrenVM* vm))
+{
+    if (vm != NULL)
+    {
+        wrench_primary_context = (WrenchContext*)wrenGetUserData(vm);
+    }
+    else
+    {
+        wrench_primary_context = NULL;
+    }
+}
+
+WRENCH_IMPL(void, ForEachVM, (void (*func)(WrenVM* vm, void* data), void* data))
+{
+    wrench_assert(func != NULL, "");
+    WrenchContext* node = wrench_context_head;
+
+    while (node != NULL)
+    {
+        // In case func frees the Wren VM.
+        WrenchContext* next = node->next;
+
+        func(node->vm, data);
+        node = next;
+    }
+}
+
+WRENCH_IMPL(void, ForEachModule, (WrenVM* vm, void (*func)(WrenVM* vm, const char* moduleName, void* data), void* data))
+{
+    if (vm == NULL)
+    {
+        return;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    wrenchForEachModule(context, func, data);
+}
+
+WRENCH_IMPL(float, GetSlotFloat, (WrenVM* vm, int slot))
+{
+    const double value = wrenGetSlotDouble(vm, slot);
 
     /* TODO: Check for NaN.
      * TODO: Check for Inf.
      */
-    wrench_assert(WRENCH_NUM_IS_SAFE_FLT(value), "%f is out of range", value);
-    return (float)value;
+    wrench_assert(WRENCH_NUM_IS_SAFE_FLT(value), "%f is out of range", value);
+    return (float)value;
+}
+
+WRENCH_IMPL(void, SetSlotFloat, (WrenVM* vm, int slot, float value))
+{
+    wrenSetSlotDouble(vm, slot, (double)value);
+}
+
+WRENCH_IMPL(int, GetSlotInt, (WrenVM* vm, int slot))
+{
+    const WrenType type = wrenGetSlotType(vm, slot);
+
+    switch (type)
+    {
+        case WREN_TYPE_NUM:
+        {
+            const double value = wrenGetSlotDouble(vm, slot);
+
+            /* TODO: Check for NaN.
+             * TODO: Check for Inf.
+             */
+            wrench_assert(WRENCH_NUM_IS_INT(value), "%f is not a whole number", value);
+            wrench_assert(WRENCH_NUM_IS_SAFE_INT(value), "%f is out of range", value);
+
+            return WRENCH_NUM_TO_INT(value);
+        }
+        break;
+
+        case WREN_TYPE_BOOL:
+        {
+            return (int)wrenGetSlotBool(vm, slot);
+        }
+        break;
+
+        default:
+        {
+            wrench_assert(0, "%i", type);
+        }
+        break;
+    }
+
+    return 0;
+}
+
+WRENCH_IMPL(void, SetSlotInt, (WrenVM* vm, int slot, int value))
+{
+    // This will always be within the range of a signed 32-bit int.
+    wrenSetSlotDouble(vm, slot, (double)value);
+}
+
+WRENCH_IMPL(uint8_t, GetSlotByte, (WrenVM* vm, int slot))
+{
+    const int value = wrenGetSlotInt(vm, slot);
+
+    wrench_assert(value >= 0 && value <= UINT8_MAX, "%i", value);
+    return (uint8_t)value;
+}
+
+WRENCH_IMPL(void, SetSlotByte, (WrenVM* vm, int slot, uint8_t value))
+{
+    wrenSetSlotInt(vm, slot, (int)value);
+}
+
+WRENCH_IMPL(void, SetSlotListFromDoubles, (WrenVM* vm, int slot, int scratch, const double* values, int count))
+{
+    wrenchSetSlotNumList(vm, slot, scratch, values, count, WRENCH_BULK_DOUBLE);
+}
+
+WRENCH_IMPL(void, SetSlotListFromFloats, (WrenVM* vm, int slot, int scratch, const float* values, int count))
+{
+    wrenchSetSlotNumList(vm, slot, scratch, values, count, WRENCH_BULK_FLOAT);
+}
+
+WRENCH_IMPL(void, SetSlotListFromInts, (WrenVM* vm, int slot, int scratch, const int* values, int count))
+{
+    wrenchSetSlotNumList(vm, slot, scratch, values, count, WRENCH_BULK_INT);
+}
+
+WRENCH_IMPL(void, SetSlotListFromStrings, (WrenVM* vm, int slot, int scratch, const char* const* values, int count))
+{
+    wrenchSetSlotStringList(vm, slot, scratch, values, count);
+}
+
+WRENCH_IMPL(int, GetSlotListAsDoubles, (WrenVM* vm, int slot, int scratch, double* values, int capacity))
+{
+    return wrenchGetSlotNumList(vm, slot, scratch, values, capacity, WRENCH_BULK_DOUBLE);
+}
+
+WRENCH_IMPL(int, GetSlotListAsFloats, (WrenVM* vm, int slot, int scratch, float* values, int capacity))
+{
+    return wrenchGetSlotNumList(vm, slot, scratch, values, capacity, WRENCH_BULK_FLOAT);
+}
+
+WRENCH_IMPL(int, GetSlotListAsInts, (WrenVM* vm, int slot, int scratch, int* values, int capacity))
+{
+    return wrenchGetSlotNumList(vm, slot, scratch, values, capacity, WRENCH_BULK_INT);
+}
+
+WRENCH_IMPL(void, SetSlotMapFromDoubles, (WrenVM* vm, int slot, int scratch, const char* const* keys, const double* values, int count))
+{
+    wrench_assert(values != NULL || count == 0, "");
+    wrenchSetSlotMap(vm, slot, scratch, keys, values, NULL, count);
+}
+
+WRENCH_IMPL(void, SetSlotMapFromStrings, (WrenVM* vm, int slot, int scratch, const char* const* keys, const char* const* values, int count))
+{
+    wrench_assert(values != NULL || count == 0, "");
+    wrenchSetSlotMap(vm, slot, scratch, keys, NULL, values, count);
+}
+
+WRENCH_IMPL(WrenBufferStorage*, NewBufferStorage, (void* data, size_t size, void (*release)(void* data)))
+{
+    // Owned memory goes in the same block as the header.
+    WrenBufferStorage* storage = (WrenBufferStorage*)wrench_calloc(1, sizeof(WrenBufferStorage) + ((data == NULL) ? size : 0));
+
+    if (storage == NULL)
+    {
+        return NULL;
+    }
+
+    storage->refs = 1;
+    storage->data = (data != NULL) ? data : (void*)(storage + 1);
+    storage->size = size;
+    storage->release = (data != NULL) ? release : NULL;
+    storage->destroy = wrenchDestroyBufferStorage;
+
+    return storage;
+}
+
+WRENCH_IMPL(void, RetainBufferStorage, (WrenBufferStorage* storage))
+{
+    wrench_atomic_add(&storage->refs, 1);
+}
+
+WRENCH_IMPL(void, ReleaseBufferStorage, (WrenBufferStorage* storage))
+{
+    if (wrench_atomic_add(&storage->refs, -1) == 1)
+    {
+        storage->destroy(storage);
+    }
+}
+
+WRENCH_IMPL(bool, SetSlotBuffer, (WrenVM* vm, int slot, WrenBufferStorage* storage, size_t offset, size_t size, WrenBufferType type))
+{
+    wrench_assert(storage != NULL && offset <= storage->size && size <= storage->size - offset, "");
+    wrench_assert((int)type >= 0 && (size_t)type < WRENCH_ARRAY_COUNT(wrench_buffer_type_sizes), "%i", (int)type);
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    /* Retain first: the storage may belong to a view only reachable from the slot about to be
+     * overwritten, and the allocations below can collect it.
+     */
+    wrenRetainBufferStorage(storage);
+
+    if (!wrenchGetVariableCached(context, "wrench", "Buffer", slot))
+    {
+        wrenReleaseBufferStorage(storage);
+        return false;
+    }
+
+    wrench_Buffer* self = (wrench_Buffer*)wrenSetSlotNewForeign(vm, slot, slot, sizeof(wrench_Buffer));
+
+    WRENCH_SET_MAGIC_TAG(self, wrench, Buffer);
+
+    self->storage = storage;
+    self->offset = offset;
+    self->size = size;
+    self->type = type;
+
+    return true;
+}
+
+WRENCH_IMPL(void*, SetSlotNewBuffer, (WrenVM* vm, int slot, size_t size))
+{
+    WrenBufferStorage* storage = wrenNewBufferStorage(NULL, size, NULL);
+
+    if (storage == NULL)
+    {
+        return NULL;
+    }
+
+    void* data = storage->data;
+    const bool ok = wrenSetSlotBuffer(vm, slot, storage, 0, size, WREN_BUFFER_U8);
+
+    wrenReleaseBufferStorage(storage); // The Buffer holds its own reference.
+    return ok ? data : NULL;
+}
+
+WRENCH_IMPL(void*, GetSlotBuffer, (WrenVM* vm, int slot, size_t* size, WrenBufferType* type))
+{
+    const wrench_Buffer* self = wrenchGetBuffer(vm, slot);
+
+    if (self == NULL || self->storage == NULL)
+    {
+        return NULL;
+    }
+
+    if (size != NULL)
+    {
+        *size = self->size;
+    }
+
+    if (type != NULL)
+    {
+        *type = self->type;
+    }
+
+    return wrenchBufferData(self);
+}
+
+WRENCH_IMPL(void*, DefaultReallocate, (void* ptr, size_t newSize, void* userData))
+{
+    // TODO: Put a fixed-size small-block allocator in front of this.
+
+    if (newSize == 0)
+    {
+        wrench_free(ptr);
+        return NULL;
+    }
+
+    return wrench_realloc(ptr, newSize);
+}
+
+WRENCH_IMPL(const char*, DefaultResolveModule, (WrenVM* vm, const char* importer, const char* name))
+{
+    WRENCH_TEMP(); return name;
+}
+
+/* Called by Wren once it has compiled the source we gave it.
+ */
+static void wrenchLoadModuleComplete(WrenVM* vm, const char* name, WrenLoadModuleResult result)
+{
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    WrenchModule* module = wrenchGetModule(context, name, NULL);
+
+    if (module != NULL && module->source == result.source)
+    {
+        wrenchApplySourcePolicy(context, module);
+    }
+}
+
+WRENCH_IMPL(WrenLoadModuleResult, DefaultLoadModule, (WrenVM* vm, const char* name))
+{
+    WrenLoadModuleResult result = {};
+
+    if (wrench_strcmp(name, "meta") == 0 || wrench_strcmp(name, "random") == 0)
+    {
+        return result;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    // Libraries linked into the executable are initialized directly, without dlopen.
+    const WrenchStaticModule* linked = wrenchGetStaticModule(name);
+
+    if (linked != NULL)
+    {
+        if (!linked->init(vm))
+        {
+            return result;
+        }
+    }
+
+    // The built-in module has no native library to look for.
+    void* library = (linked == NULL && wrench_strcmp(name, "wrench") != 0) ? wrenchLoadLibrary(context, name) : NULL;
+
+    if (library != NULL)
+    {
+        char init_name[1024];
+        wrench_snprintf(init_name, sizeof(init_name), "%sWrenInit", name);
+
+        wrenLibraryInitFn init = ( // TODO: Should lib initialization be able to fail?
+        wrenLibraryInitFn)wrenchLibraryFunc(context, library, (const char*)init_name);
+
+        if (init != NULL)
+        {
+            if (!init(vm))
+            {
+                wrenchFreeLibrary(context, library);
+                return result;
+            }
+        }
+    }
+
+    WrenchModule* module = wrenchGetModule(context, name, NULL);
+
+    if (module != NULL)
+    {
+        module->library = library;
+        module->quit = linked != NULL ? linked->quit : NULL;
+
+        result.source = module->source;
+
+        if (result.source != NULL)
+        {
+            result.onComplete = context->source_policy != WREN_SOURCE_KEEP ? wrenchLoadModuleComplete : NULL;
+            return result;
+        }
+    }
+
+    size_t num_chars;
+    result.source = wrenchLoadSourceFile(context, name, &num_chars);
+
+    if (result.source == NULL)
+    {
+        return result;
+    }
+
+    if (module == NULL)
+    {
+        if (!wrenchRegisterModuleEx(context, name, result.source, num_chars, false))
+        {
+            // TODO: Should we do something if this fails? Set result.source = NULL?
+            return result;
+        }
+    }
+    else
+    {
+        module->source = result.source;
+        module->num_chars = num_chars;
+    }
+
+    result.onComplete = context->source_policy != WREN_SOURCE_KEEP ? wrenchLoadModuleComplete : NULL;
+    return result;
+}
+
+WRENCH_IMPL(WrenForeignMethodFn, DefaultBindForeignMethod, (WrenVM* vm, const char* moduleName, const char* className, bool is_static, const char* signature))
+{
+    if (wrench_strcmp(moduleName, "meta") == 0 || wrench_strcmp(moduleName, "random") == 0)
+    {
+        return NULL;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    WrenchModule* previous_module;
+    WrenchModule* module = wrenchGetModule(context, moduleName, &previous_module);
+
+    wrench_assert(module != NULL, "%s %s %i %s", moduleName, className, (int)is_static, signature);
+
+    WrenchClass* previous_class;
+    WrenchClass* klass = wrenchGetClass(context, module, className, &previous_class);
+
+    wrench_assert(klass != NULL, "%s %s %i %s", moduleName, className, (int)is_static, signature);
+
+    WrenchMethod* previous_method;
+    WrenchMethod* method = wrenchGetMethod(context, klass, is_static, signature, &previous_method);
+
+    wrench_assert(method != NULL, "%s %s %i %s", moduleName, className, (int)is_static, signature);
+
+    WrenForeignMethodFn function = method->method;
+    wrench_assert(function != NULL, "%s %s %i %s", moduleName, className, (int)is_static, signature);
+
+    if (1) // Unlink to reduce search space for the next bind operation.
+    {
+        // TODO: Flags to control this behavior (SetUnlinkMethodOnBind).
+        wrenchUnlinkMethod(context, klass, method, previous_method);
+
+        if (klass->method_head == NULL)
+        {
+            wrenchUnlinkClass(context, module, klass, previous_class);
+
+            // Don't unlink modules (so wrenGetModuleSource may work).
+            if (0 && module->class_head == NULL)
+            {
+                wrenchUnlinkModule(context, module, previous_module);
+            }
+        }
+    }
+
+    return function;
+}
+
+WRENCH_IMPL(WrenForeignClassMethods, DefaultBindForeignClass, (WrenVM* vm, const char* moduleName, const char* className))
+{
+    WrenForeignClassMethods methods = {};
+
+    if (wrench_strcmp(moduleName, "meta") == 0 || wrench_strcmp(moduleName, "random") == 0)
+    {
+        return methods;
+    }
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrench_assert(context != NULL, "");
+
+    WrenchModule* module = wrenchGetModule(context, moduleName, NULL);
+    wrench_assert(module != NULL, "%s %s", moduleName, className);
+
+    WrenchClass* klass = wrenchGetClass(context, module, className, NULL);
+    wrench_assert(klass != NULL, "%s %s", moduleName, className);
+
+    methods.allocate = klass->ctor;
+    methods.finalize = klass->dtor;
+
+    return methods;
+}
+
+WRENCH_IMPL(void, DefaultWrite, (WrenVM* vm, const char* text))
+{
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+
+    if (context != NULL && context->output.data != NULL)
+    {
+        wrenchOutputWrite(context, text, wrench_strlen(text));
+    }
+    else
+    {
+        wrench_fprintf(wrench_stdout, "%s", text);
+    }
+}
+
+WRENCH_IMPL(void, DefaultError, (WrenVM* vm, WrenErrorType type, const char* moduleName, int line, const char* message))
+{
+    // TODO: wrenSetErrorString?
+
+    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+    wrenFlushOutput(vm); // Anything printed before the error comes first (in the log, too).
+
+    if (context != NULL && context->log_add(context->id, (int)type, moduleName, line, message))
+    {
+        return;
+    }
+
+    switch (type)
+    {
+        case WREN_ERROR_COMPILE:
+        {
+            wrench_fprintf(wrench_stderr, "COMPILE ERROR [%s line %d]: %s\n", moduleName, line, message);
+        }
+        break;
+
+        case WREN_ERROR_RUNTIME:
+        {
+            wrench_fprintf(wrench_stderr, "RUNTIME ERROR: %s\n", message);
+        }
+        break;
+
+        case WREN_ERROR_STACK_TRACE:
+        {
+            wrench_fprintf(wrench_stderr, "[%s line %d] in %s\n", moduleName, line, message);
+        }
+        break;
+    }
+}
+
+#if defined(WRENCH_MAIN)
+
+#ifndef WRENCH_MAIN_INIT
+#define WRENCH_MAIN_INIT() (void)0
+#endif
+
+#ifndef WRENCH_MAIN_QUIT
+#define WRENCH_MAIN_QUIT() (void)0
+#endif
+
+/* Foreign libraries linked into the executable, as an X-macro list of module names, e.g.
+ * `#define WRENCH_STATIC_MODULES(X) X(file) X(image)`. Each is registered with
+ * `wrenRegisterStaticModule` before the first VM is created, so importing it never dlopens.
+ */
+#ifdef WRENCH_STATIC_MODULES
+    #define _WRENCH_DECLARE_STATIC_MODULE(name)                 \
+                                                                \
+        WRENCH_EXPORT bool name ## WrenInit(WrenVM* vm);        \
+        WRENCH_EXPORT void name ## WrenQuit(void);              \
+
+    WRENCH_STATIC_MODULES(_WRENCH_DECLARE_STATIC_MODULE)
+
+    #define _WRENCH_REGISTER_STATIC_MODULE(name) wrenRegisterStaticModule(#name, name ## WrenInit, name ## WrenQuit);
+
+    static void wrenchMainRegisterStaticModules(void)
+    {
+        WRENCH_STATIC_MODULES(_WRENCH_REGISTER_STATIC_MODULE)
+    }
+#else
+    static void wrenchMainRegisterStaticModules(void)
+    {
+        //
+    }
+#endif /* WRENCH_STATIC_MODULES */
+
+/* Whether the module defines a top-level `main` that's a Fn. Other values named `main` (a
+ * class, or an object that happens to have `call()`) are left alone. Every module sees the
+ * core classes, so this asks `main is Fn` without running any code in the module.
+ */
+static bool wrenchMainIsFn(WrenVM* vm, const char* module_name)
+{
+    if (!wrenHasVariable(vm, module_name, "main") || !wrenHasVariable(vm, module_name, "Fn"))
+    {
+        return false;
+    }
+
+    WrenHandle* is = wrenGetCachedCallHandle(vm, "is(_)");
+
+    if (is == NULL)
+    {
+        return false;
+    }
+
+    wrenEnsureSlots(vm, 2);
+    wrenGetVariable(vm, module_name, "main", 0);
+    wrenGetVariable(vm, module_name, "Fn", 1);
+
+    return wrenCall(vm, is) == WREN_RESULT_SUCCESS && wrenGetSlotType(vm, 0) == WREN_TYPE_BOOL && wrenGetSlotBool(vm, 0);
+}
+
+/* Run `target` (a .wren file, or a module to import) as module `module_name`, and any
+ * asynchronous work it started (e.g. AsyncFile) to completion. Returns false if it failed
+ * (`status` is then EXIT_FAILURE), and otherwise sets `status` to the process exit code.
+ */
+static bool wrenchMainRun(WrenVM* vm, const char* target, const char* module_name, int* status)
+{
+    *status = EXIT_FAILURE;
+
+    WrenInterpretResult result;
+
+    if (wrench_strstr(target, ".wren") != NULL)
+    {
+        size_t num_chars;
+        const char* code = wrenLoadSourceFile(vm, target, &num_chars);
+
+        if (code != NULL)
+        {
+            result = wrenInterpret(vm, module_name, code);
+
+            // The main script isn't a registered module, so nothing can ask for it again. This only
+            // reclaims its region if it imported nothing (imports are allocated above it).
+            if (wrenGetSourcePolicy(vm) != WREN_SOURCE_KEEP)
+            {
+                wrenchSourceCodeFree((WrenchContext*)wrenGetUserData(vm), code, num_chars);
+            }
+        }
+        else
+        {
+            wrench_fprintf(wrench_stderr, "RUNTIME ERROR: Could not load source file '%s'.\n", target);
+            result = WREN_RESULT_RUNTIME_ERROR;
+        }
+    }
+    else
+    {
+        char code[1024]; // Import for native code modules or scripts.
+        wrench_snprintf(code, sizeof(code), "import \"%s\"", target);
+
+        result = wrenInterpret(vm, module_name, (const char*)code);
+    }
+
+    wrenFlushOutput(vm);
+
+    switch (result)
+    {
+        case WREN_RESULT_COMPILE_ERROR:
+        case WREN_RESULT_RUNTIME_ERROR:
+        {
+            //wrench_fprintf(wrench_stderr, "%s\n", wrenGetErrorString(vm));
+            return false;
+        }
+        break;
+
+        default: break;
+    }
+
+    /* A top-level `main` Fn is called once the module has run. If it returns a Num, that's the
+     * exit status, which must be a whole number from 0 to 255.
+     */
+    int main_status = EXIT_SUCCESS;
+
+    if (wrenchMainIsFn(vm, module_name))
+    {
+        const WrenInterpretResult call_result = wrenCallCached(vm, module_name, "main", "call()");
+        wrenFlushOutput(vm);
+
+        if (call_result != WREN_RESULT_SUCCESS)
+        {
+            return false;
+        }
+
+        if (wrenGetSlotType(vm, 0) == WREN_TYPE_NUM)
+        {
+            const double value = wrenGetSlotDouble(vm, 0);
+
+            if (!(value >= 0.0 && value <= 255.0) || value != wrench_trunc(value))
+            {
+                wrench_fprintf(wrench_stderr, "RUNTIME ERROR: main() returned %.17g, which isn't an exit status (0 to 255).\n", value);
+                return false;
+            }
+
+            main_status = (int)value;
+        }
+    }
+
+    if (!wrenRunEventLoop(vm))
+    {
+        wrenFlushOutput(vm);
+        return false;
+    }
+
+    *status = main_status;
+    return true;
 }
 
-WRENCH_IMPL(void, SetSlotFloat, (WrenVM* vm, int slot, float value))
+#if !_WIN32
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+/* Fork server (`run_wren --serve socket [module...]`). The parent creates a VM, imports the
+ * given modules (loading their libraries and compiling their code) and listens on a Unix
+ * socket. `run_wren --client socket script [args...]` sends its working directory, arguments,
+ * and stdin/stdout/stderr; the parent forks, and the child runs the script in its copy-on-write
+ * copy of the warm VM. The parent reaps the child and sends its exit status back to the client.
+ *
+ * Request: a u32 length (sent along with the three descriptors), then the working directory
+ * and argv as NUL-terminated strings. Reply: an i32 exit status (128 + signal if it crashed).
+ */
+#ifndef WRENCH_MAIN_REQUEST_MAX
+#define WRENCH_MAIN_REQUEST_MAX (1024 * 64)
+#endif
+
+static int wrench_main_child_pipe[2] = { -1, -1 };
+
+static void wrenchMainOnChild(int signal_number)
 {
-    wrenSetSlotDouble(vm, slot, (double)value);
+    const int saved = errno;
+    const char c = 0;
+
+    if (write(wrench_main_child_pipe[1], &c, 1) < 0) {} // Wake the accept loop.
+    errno = saved;
 }
 
-WRENCH_IMPL(int, GetSlotInt, (WrenVM* vm, int slot))
+static bool wrenchMainSendAll(int fd, const void* data, size_t size)
 {
-    const WrenType type = wrenGetSlotType(vm, slot);
+    for (const char* p = (const char*)data; size > 0; )
+    {
+        const ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
 
-    switch (type)
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return false; }
+
+        p += n;
+        size -= (size_t)n;
+    }
+
+    return true;
+}
+
+static bool wrenchMainRecvAll(int fd, void* data, size_t size)
+{
+    for (char* p = (char*)data; size > 0; )
     {
-        case WREN_TYPE_NUM:
+        const ssize_t n = recv(fd, p, size, 0);
+
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return false; }
+
+        p += n;
+        size -= (size_t)n;
+    }
+
+    return true;
+}
+
+static bool wrenchMainAddress(const char* path, struct sockaddr_un* address)
+{
+    wrench_memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+
+    if (wrench_strlen(path) >= sizeof(address->sun_path))
+    {
+        wrench_fprintf(wrench_stderr, "Socket path too long: '%s'.\n", path);
+        return false;
+    }
+
+    wrench_memcpy(address->sun_path, path, wrench_strlen(path) + 1);
+    return true;
+}
+
+/* Receive a request: the client's descriptors, and its cwd + argv (in `buffer`).
+ */
+static int wrenchMainReceive(int connection, int fds[3], char* buffer, char*** argv_out)
+{
+    unsigned int size = 0;
+
+    char control[CMSG_SPACE(sizeof(int) * 3)];
+    wrench_memset(control, 0, sizeof(control));
+
+    struct iovec iov = { &size, sizeof(size) };
+    struct msghdr message;
+
+    wrench_memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (recvmsg(connection, &message, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(size))
+    {
+        return -1;
+    }
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+
+    if (header == NULL || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(int) * 3))
+    {
+        return -1;
+    }
+
+    wrench_memcpy(fds, CMSG_DATA(header), sizeof(int) * 3);
+
+    if (size < 2 || size > WRENCH_MAIN_REQUEST_MAX || !wrenchMainRecvAll(connection, buffer, size) || buffer[size - 1] != '\0')
+    {
+        for (int i = 0; i < 3; i++) { close(fds[i]); }
+        return -1;
+    }
+
+    int argc = -1; // Not counting the working directory.
+
+    for (unsigned int i = 0; i < size; i++)
+    {
+        if (buffer[i] == '\0') { argc++; }
+    }
+
+    char** argv = (char**)wrench_calloc((size_t)argc + 1, sizeof(char*));
+    char* s = buffer + wrench_strlen(buffer) + 1;
+
+    if (argv == NULL || argc < 2)
+    {
+        wrench_free(argv);
+        for (int i = 0; i < 3; i++) { close(fds[i]); }
+
+        return -1;
+    }
+
+    for (int i = 0; i < argc; i++, s += wrench_strlen(s) + 1)
+    {
+        argv[i] = s;
+    }
+
+    *argv_out = argv;
+    return argc;
+}
+
+static int wrenchMainServe(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        wrench_fprintf(wrench_stderr, "Usage: %s --serve socket_path [preloaded_module ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_un address;
+
+    if (!wrenchMainAddress(argv[2], &address))
+    {
+        return EXIT_FAILURE;
+    }
+
+    WrenVM* vm = wrenNewExtendedVM(argc, argv, true);
+
+    if (vm == NULL)
+    {
+        wrench_fprintf(wrench_stderr, "Failed to create a Wren VM!\n");
+        return EXIT_FAILURE;
+    }
+
+    WRENCH_MAIN_INIT();
+
+    for (int i = 3; i < argc; i++)
+    {
+        char code[1024]; // Modules are imported outside "main", which each child runs.
+        wrench_snprintf(code, sizeof(code), "import \"%s\"", argv[i]);
+
+        if (wrenInterpret(vm, "wrench_preload", (const char*)code) != WREN_RESULT_SUCCESS)
         {
-            const double value = wrenGetSlotDouble(vm, slot);
+            wrench_fprintf(wrench_stderr, "Failed to preload module '%s'.\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
 
-            /* TODO: Check for NaN.
-             * TODO: Check for Inf.
-             */
-            wrench_assert(WRENCH_NUM_IS_INT(value), "%f is not a whole number", value);
-            wrench_assert(WRENCH_NUM_IS_SAFE_INT(value), "%f is out of range", value);
+    // Children set up their own output (threads don't survive a fork).
+    wrenSetOutputBuffering(vm, 0, false);
+    fflush(NULL);
 
-            return WRENCH_NUM_TO_INT(value);
+    const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(argv[2]); // A stale socket from a previous server.
+
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 128) != 0 ||
+        pipe(wrench_main_child_pipe) != 0)
+    {
+        wrench_fprintf(wrench_stderr, "Failed to listen on '%s': %s\n", argv[2], strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(wrench_main_child_pipe[i], F_SETFL, fcntl(wrench_main_child_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(wrench_main_child_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    struct sigaction action;
+    wrench_memset(&action, 0, sizeof(action));
+
+    action.sa_handler = wrenchMainOnChild;
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &action, NULL);
+
+    /* Running children and the connections their statuses go back to.
+     */
+    pid_t* pids = NULL;
+    int* connections = NULL;
+    int num_children = 0, max_children = 0;
+
+    char* request = (char*)wrench_malloc(WRENCH_MAIN_REQUEST_MAX);
+
+    for (;;)
+    {
+        struct pollfd fds[2] = { { listener, POLLIN, 0 }, { wrench_main_child_pipe[0], POLLIN, 0 } };
+
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR) { continue; }
+            break;
         }
-        break;
 
-        case WREN_TYPE_BOOL:
+        if (fds[1].revents != 0)
         {
-            return (int)wrenGetSlotBool(vm, slot);
+            char drain[64];
+            while (read(wrench_main_child_pipe[0], drain, sizeof(drain)) > 0) {}
+
+            int status;
+            pid_t pid;
+
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+            {
+                for (int i = 0; i < num_children; i++)
+                {
+                    if (pids[i] == pid)
+                    {
+                        const int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+                        wrenchMainSendAll(connections[i], &code, sizeof(code));
+                        close(connections[i]);
+
+                        pids[i] = pids[--num_children];
+                        connections[i] = connections[num_children];
+
+                        break;
+                    }
+                }
+            }
         }
-        break;
 
-        default:
+        if ((fds[0].revents & POLLIN) == 0)
         {
-            wrench_assert(0, "%i", type);
+            continue;
         }
-        break;
+
+        const int connection = accept(listener, NULL, NULL);
+
+        if (connection < 0)
+        {
+            continue;
+        }
+
+        fcntl(connection, F_SETFD, FD_CLOEXEC);
+
+        struct timeval timeout = { 5, 0 }; // Don't let a stuck client hold up the server.
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        int stdio[3];
+        char** child_argv = NULL;
+        const int child_argc = wrenchMainReceive(connection, stdio, request, &child_argv);
+
+        if (child_argc < 0)
+        {
+            close(connection);
+            continue;
+        }
+
+        if (num_children == max_children)
+        {
+            max_children = max_children ? max_children * 2 : 16;
+
+            pids = (pid_t*)wrench_realloc(pids, sizeof(pid_t) * max_children);
+            connections = (int*)wrench_realloc(connections, sizeof(int) * max_children);
+        }
+
+        const pid_t pid = fork();
+
+        if (pid == 0)
+        {
+            signal(SIGCHLD, SIG_DFL);
+
+            close(listener);
+            close(connection);
+
+            for (int i = 0; i < num_children; i++)
+            {
+                close(connections[i]);
+            }
+
+            for (int i = 0; i < 3; i++)
+            {
+                dup2(stdio[i], i);
+                close(stdio[i]);
+            }
+
+            if (chdir(request) != 0)
+            {
+                wrench_fprintf(wrench_stderr, "Failed to enter directory '%s': %s\n", request, strerror(errno));
+                _exit(EXIT_FAILURE);
+            }
+
+            wrenchPoolAfterFork();
+            wrenSetCommandLine(vm, child_argc, child_argv);
+
+            if (!wrenchStdoutIsTerminal())
+            {
+                wrenSetOutputBuffering(vm, WRENCH_OUTPUT_BUFFER_SIZE, WRENCH_OUTPUT_THREADED);
+            }
+
+            int code;
+            wrenchMainRun(vm, child_argv[1], "main", &code);
+
+            wrenFlushOutput(vm);
+            fflush(NULL);
+
+            _exit(code);
+        }
+
+        for (int i = 0; i < 3; i++)
+        {
+            close(stdio[i]);
+        }
+
+        wrench_free(child_argv);
+
+        if (pid < 0)
+        {
+            const int code = EXIT_FAILURE;
+
+            wrenchMainSendAll(connection, &code, sizeof(code));
+            close(connection);
+
+            continue;
+        }
+
+        pids[num_children] = pid;
+        connections[num_children++] = connection;
+    }
+
+    wrench_fprintf(wrench_stderr, "Fork server stopped: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+}
+
+static int wrenchMainClient(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        wrench_fprintf(wrench_stderr, "Usage: %s --client socket_path main_wren_filename [args ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_un address;
+
+    if (!wrenchMainAddress(argv[2], &address))
+    {
+        return EXIT_FAILURE;
+    }
+
+    /* The request: cwd, then argv without "--client socket_path".
+     */
+    char* request = (char*)wrench_malloc(WRENCH_MAIN_REQUEST_MAX);
+    size_t size = 0;
+
+    if (request == NULL || getcwd(request, WRENCH_MAIN_REQUEST_MAX) == NULL)
+    {
+        wrench_fprintf(wrench_stderr, "Failed to get the working directory: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    size = wrench_strlen(request) + 1;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (i == 1 || i == 2)
+        {
+            continue;
+        }
+
+        const size_t length = wrench_strlen(argv[i]) + 1;
+
+        if (size + length > WRENCH_MAIN_REQUEST_MAX)
+        {
+            wrench_fprintf(wrench_stderr, "Too many arguments for the fork server.\n");
+            return EXIT_FAILURE;
+        }
+
+        wrench_memcpy(request + size, argv[i], length);
+        size += length;
+    }
+
+    const int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (connection < 0 || connect(connection, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        wrench_fprintf(wrench_stderr, "Failed to connect to '%s': %s\n", argv[2], strerror(errno));
+        return EXIT_FAILURE;
     }
 
-    return 0;
-}
+    unsigned int length = (unsigned int)size;
+    const int stdio[3] = { 0, 1, 2 };
+
+    char control[CMSG_SPACE(sizeof(stdio))];
+    wrench_memset(control, 0, sizeof(control));
+
+    struct iovec iov = { &length, sizeof(length) };
+    struct msghdr message;
+
+    wrench_memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(stdio));
+
+    wrench_memcpy(CMSG_DATA(header), stdio, sizeof(stdio));
+
+    int code = EXIT_FAILURE;
 
-WRENCH_IMPL(void, SetSlotInt, (WrenVM* vm, int slot, int value))
-{
-    // This will always be within the range of a signed 32-bit int.
-    wrenSetSlotDouble(vm, slot, (double)value);
-}
+    if (sendmsg(connection, &message, MSG_NOSIGNAL) != (ssize_t)sizeof(length) || !wrenchMainSendAll(connection, request, size) ||
+        !wrenchMainRecvAll(connection, &code, sizeof(code)))
+    {
+        wrench_fprintf(wrench_stderr, "Lost the connection to the fork server.\n");
+        code = EXIT_FAILURE;
+    }
 
-WRENCH_IMPL(uint8_t, GetSlotByte, (WrenVM* vm, int slot))
-{
-    const int value = wrenGetSlotInt(vm, slot);
+    close(connection);
+    wrench_free(request);
 
-    wrench_assert(value >= 0 && value <= UINT8_MAX, "%i", value);
-    return (uint8_t)value;
+    return code;
 }
 
-WRENCH_IMPL(void, SetSlotByte, (WrenVM* vm, int slot, uint8_t value))
-{
-    wrenSetSlotInt(vm, slot, (int)value);
-}
+#endif /* !_WIN32 */
 
-WRENCH_IMPL(void*, DefaultReallocate, (void* ptr, size_t newSize, void* userData))
+/* Batch mode (`run_wren --batch [-j threads] [--reuse] [--manifest file] [script ...]`): run
+ * many scripts in one process, in sequence or on several threads. Each script gets a fresh VM,
+ * or with `--reuse` each thread keeps one and runs every script as its own module (replacing
+ * the VM once its source buffer fills). Either way, loaded libraries stay loaded and sources
+ * are read from disk once. Reports each script's exit status and time on stderr, and fails if
+ * any script did. Output of concurrent scripts may interleave.
+ */
+typedef struct WrenchMainSource
 {
-    // TODO: Put a fixed-size small-block allocator in front of this.
-
-    if (newSize == 0)
-    {
-        wrench_free(ptr);
-        return NULL;
-    }
+    struct WrenchMainSource* next;
 
-    return wrench_realloc(ptr, newSize);
+    char* name;
+    void* data;
+    size_t size;
 }
+WrenchMainSource;
 
-WRENCH_IMPL(const char*, DefaultResolveModule, (WrenVM* vm, const char* importer, const char* name))
+static struct
 {
-    WRENCH_TEMP(); return name;
+    wrench_mutex lock;
+    WrenchMainSource* buckets[1024];
 }
+wrench_main_sources;
 
-WRENCH_IMPL(WrenLoadModuleResult, DefaultLoadModule, (WrenVM* vm, const char* name))
+static void* wrenchMainCachedRead(WrenVM* vm, const char* name, size_t* size)
 {
-    WrenLoadModuleResult result = {};
+    unsigned int hash = 2166136261u;
 
-    if (wrench_strcmp(name, "meta") == 0 || wrench_strcmp(name, "random") == 0)
+    for (const char* s = name; *s != '\0'; s++)
     {
-        return result;
+        hash = (hash ^ (unsigned char)*s) * 16777619u;
     }
 
-    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-    wrench_assert(context != NULL, "");
-
-    void* library = wrenchLoadLibrary(context, name);
+    WrenchMainSource** bucket = &wrench_main_sources.buckets[hash % WRENCH_ARRAY_COUNT(wrench_main_sources.buckets)];
 
-    if (library != NULL)
+    for (int pass = 0; pass < 2; pass++)
     {
-        char init_name[1024];
-        wrench_snprintf(init_name, sizeof(init_name), "%sWrenInit", name);
+        wrench_mutex_lock(&wrench_main_sources.lock);
 
-        wrenLibraryInitFn init = ( // TODO: Should lib initialization be able to fail?
-        wrenLibraryInitFn)wrenchLibraryFunc(context, library, (const char*)init_name);
-
-        if (init != NULL)
+        for (WrenchMainSource* node = *bucket; node != NULL; node = node->next)
         {
-            if (!init(vm))
+            if (wrench_strcmp(node->name, name) == 0)
             {
-                wrenchFreeLibrary(context, library);
-                return result;
+                wrench_mutex_unlock(&wrench_main_sources.lock);
+
+                *size = node->size;
+                return node->data;
             }
         }
-    }
 
-    WrenchModule* module = wrenchGetModule(context, name, NULL);
+        wrench_mutex_unlock(&wrench_main_sources.lock);
 
-    if (module != NULL)
-    {
-        module->library = library;
-        result.source = module->source;
+        if (pass > 0)
+        {
+            break;
+        }
 
-        if (result.source != NULL)
+        void* data = wrenDefaultFileRead(vm, name, size); // Outside the lock.
+        WrenchMainSource* node = (WrenchMainSource*)wrench_calloc(1, sizeof(WrenchMainSource));
+
+        if (data == NULL || node == NULL || (node->name = wrench_strdup(name)) == NULL)
         {
-            return result;
+            if (data != NULL) { wrenDefaultFileFree(vm, data, *size); }
+            wrench_free(node);
+
+            return NULL;
         }
-    }
 
-    size_t num_chars;
-    result.source = wrenchLoadSourceFile(context, name, &num_chars);
+        node->data = data;
+        node->size = *size;
 
-    if (result.source == NULL)
-    {
-        return result;
-    }
+        wrench_mutex_lock(&wrench_main_sources.lock);
+        bool raced = false;
 
-    if (module == NULL)
-    {
-        if (!wrenchRegisterModuleEx(context, name, result.source, num_chars, false))
+        for (WrenchMainSource* other = *bucket; other != NULL && !raced; other = other->next)
         {
-            // TODO: Should we do something if this fails? Set result.source = NULL?
-            return result;
+            raced = wrench_strcmp(other->name, name) == 0; // Another thread got there first.
         }
+
+        if (!raced)
+        {
+            node->next = *bucket;
+            *bucket = node;
+
+            wrench_mutex_unlock(&wrench_main_sources.lock);
+            return data;
+        }
+
+        wrench_mutex_unlock(&wrench_main_sources.lock);
+
+        wrenDefaultFileFree(vm, data, *size);
+        wrench_free(node->name);
+        wrench_free(node);
     }
 
-    return result;
+    return NULL;
 }
 
-WRENCH_IMPL(WrenForeignMethodFn, DefaultBindForeignMethod, (WrenVM* vm, const char* moduleName, const char* className, bool is_static, const char* signature))
+static void wrenchMainCachedFree(WrenVM* vm, void* data, size_t size)
 {
-    if (wrench_strcmp(moduleName, "meta") == 0 || wrench_strcmp(moduleName, "random") == 0)
+    // Owned by the cache.
+}
+
+typedef struct WrenchMainBatch
+{
+    char** scripts;
+    int num_scripts;
+
+    int* codes;
+    long long* times_ms;
+
+    long long next_script;
+    bool reuse;
+    char* argv0;
+
+    wrench_mutex lock; // Guards VM creation (not threadsafe), the report, and the counts below.
+    wrench_cond cond;
+
+    int num_running;
+    int num_failed;
+}
+WrenchMainBatch;
+
+static WrenVM* wrenchMainBatchVM(WrenchMainBatch* batch, WrenVM* vm, char** argv)
+{
+    if (vm != NULL)
     {
-        return NULL;
+        WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
+        const size_t used = (size_t)(context->source_code_alloc_mark - context->source_code_alloc_base);
+
+        if (used < (size_t)(context->source_code_alloc_end - context->source_code_alloc_base) / 4 * 3)
+        {
+            wrenSetCommandLine(vm, 2, argv);
+            return vm;
+        }
+
+        wrench_mutex_lock(&batch->lock);
+        wrenFreeExtendedVM(vm, true);
+        wrench_mutex_unlock(&batch->lock);
     }
 
-    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-    wrench_assert(context != NULL, "");
+    wrench_mutex_lock(&batch->lock);
+    vm = wrenNewExtendedVM(2, argv, true);
+    wrench_mutex_unlock(&batch->lock);
 
-    WrenchModule* previous_module;
-    WrenchModule* module = wrenchGetModule(context, moduleName, &previous_module);
+    if (vm != NULL)
+    {
+        wrenSetFileReadCallback(vm, wrenchMainCachedRead);
+        wrenSetFileFreeCallback(vm, wrenchMainCachedFree);
 
-    wrench_assert(module != NULL, "%s %s %i %s", moduleName, className, (int)is_static, signature);
+        WRENCH_MAIN_INIT();
+    }
 
-    WrenchClass* previous_class;
-    WrenchClass* klass = wrenchGetClass(context, module, className, &previous_class);
+    return vm;
+}
 
-    wrench_assert(klass != NULL, "%s %s %i %s", moduleName, className, (int)is_static, signature);
+static void wrenchMainBatchWorker(void* arg)
+{
+    WrenchMainBatch* batch = (WrenchMainBatch*)arg;
+    WrenVM* vm = NULL;
 
-    WrenchMethod* previous_method;
-    WrenchMethod* method = wrenchGetMethod(context, klass, is_static, signature, &previous_method);
+    for (;;)
+    {
+        const long long i = wrench_atomic_add(&batch->next_script, 1);
 
-    wrench_assert(method != NULL, "%s %s %i %s", moduleName, className, (int)is_static, signature);
+        if (i >= batch->num_scripts)
+        {
+            break;
+        }
 
-    WrenForeignMethodFn function = method->method;
-    wrench_assert(function != NULL, "%s %s %i %s", moduleName, className, (int)is_static, signature);
+        const char* script = batch->scripts[i];
+        char* argv[3] = { batch->argv0, (char*)script, NULL };
 
-    if (1) // Unlink to reduce search space for the next bind operation.
-    {
-        // TODO: Flags to control this behavior (SetUnlinkMethodOnBind).
-        wrenchUnlinkMethod(context, klass, method, previous_method);
+        const long long start = wrenchMilliseconds();
+        vm = wrenchMainBatchVM(batch, batch->reuse ? vm : NULL, argv);
 
-        if (klass->method_head == NULL)
+        int code = EXIT_FAILURE;
+
+        if (vm == NULL)
         {
-            wrenchUnlinkClass(context, module, klass, previous_class);
+            wrench_fprintf(wrench_stderr, "Failed to create a Wren VM!\n");
+        }
+        else
+        {
+            const bool ran = wrenchMainRun(vm, script, batch->reuse ? script : "main", &code);
+            wrenFlushOutput(vm);
 
-            // Don't unlink modules (so wrenGetModuleSource may work).
-            if (0 && module->class_head == NULL)
+            if (!batch->reuse)
             {
-                wrenchUnlinkModule(context, module, previous_module);
+                if (ran)
+                {
+                    WRENCH_MAIN_QUIT();
+                }
+
+                wrench_mutex_lock(&batch->lock);
+                wrenFreeExtendedVM(vm, true);
+                wrench_mutex_unlock(&batch->lock);
+
+                vm = NULL;
             }
         }
-    }
 
-    return function;
-}
+        batch->codes[i] = code;
+        batch->times_ms[i] = wrenchMilliseconds() - start;
 
-WRENCH_IMPL(WrenForeignClassMethods, DefaultBindForeignClass, (WrenVM* vm, const char* moduleName, const char* className))
-{
-    WrenForeignClassMethods methods = {};
+        wrench_mutex_lock(&batch->lock);
 
-    if (wrench_strcmp(moduleName, "meta") == 0 || wrench_strcmp(moduleName, "random") == 0)
-    {
-        return methods;
-    }
+        batch->num_failed += (code != EXIT_SUCCESS);
+        wrench_fprintf(wrench_stderr, "[%s] %6lld ms  %s\n", code == EXIT_SUCCESS ? " ok " : "FAIL", batch->times_ms[i], script);
 
-    WrenchContext* context = (WrenchContext*)wrenGetUserData(vm);
-    wrench_assert(context != NULL, "");
+        wrench_mutex_unlock(&batch->lock);
+    }
 
-    WrenchModule* module = wrenchGetModule(context, moduleName, NULL);
-    wrench_assert(module != NULL, "%s %s", moduleName, className);
+    wrench_mutex_lock(&batch->lock);
 
-    WrenchClass* klass = wrenchGetClass(context, module, className, NULL);
-    wrench_assert(klass != NULL, "%s %s", moduleName, className);
+    if (vm != NULL)
+    {
+        wrenFreeExtendedVM(vm, true);
+    }
 
-    methods.allocate = klass->ctor;
-    methods.finalize = klass->dtor;
+    batch->num_running--;
 
-    return methods;
+    wrench_cond_signal(&batch->cond);
+    wrench_mutex_unlock(&batch->lock);
 }
 
-WRENCH_IMPL(void, DefaultWrite, (WrenVM* vm, const char* text))
+static bool wrenchMainBatchAdd(WrenchMainBatch* batch, const char* script)
 {
-    wrench_fprintf(wrench_stdout, "%s", text);
+    char** scripts = (char**)wrench_realloc(batch->scripts, sizeof(char*) * (batch->num_scripts + 1));
+
+    if (scripts == NULL)
+    {
+        return false;
+    }
+
+    batch->scripts = scripts;
+    return (batch->scripts[batch->num_scripts++] = wrench_strdup(script)) != NULL;
 }
 
-WRENCH_IMPL(void, DefaultError, (WrenVM* vm, WrenErrorType type, const char* moduleName, int line, const char* message))
+static int wrenchMainBatch(int argc, char** argv)
 {
-    // TODO: wrenSetErrorString?
+    WrenchMainBatch batch;
+    wrench_memset(&batch, 0, sizeof(batch));
 
-    switch (type)
+    batch.argv0 = argv[0];
+    int num_threads = 1;
+
+    for (int i = 2; i < argc; i++)
     {
-        case WREN_ERROR_COMPILE:
+        if (wrench_strcmp(argv[i], "-j") == 0 && i + 1 < argc)
         {
-            wrench_fprintf(wrench_stderr, "COMPILE ERROR [%s line %d]: %s\n", moduleName, line, message);
+            num_threads = atoi(argv[++i]);
+            num_threads = (num_threads > 0) ? num_threads : wrenchCountProcessors();
         }
-        break;
-
-        case WREN_ERROR_RUNTIME:
+        else if (wrench_strcmp(argv[i], "--reuse") == 0)
         {
-            wrench_fprintf(wrench_stderr, "RUNTIME ERROR: %s\n", message);
+            batch.reuse = true;
         }
-        break;
+        else if (wrench_strcmp(argv[i], "--manifest") == 0 && i + 1 < argc)
+        {
+            FILE* manifest = wrench_fopen(argv[++i], "r");
+            char line[1024 * 4];
 
-        case WREN_ERROR_STACK_TRACE:
+            if (manifest == NULL)
+            {
+                wrench_fprintf(wrench_stderr, "Could not open manifest '%s'.\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+
+            while (fgets(line, sizeof(line), manifest) != NULL)
+            {
+                size_t length = wrench_strlen(line);
+
+                while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' '))
+                {
+                    line[--length] = '\0';
+                }
+
+                if (length > 0 && line[0] != '#' && !wrenchMainBatchAdd(&batch, line))
+                {
+                    wrench_fclose(manifest);
+                    return EXIT_FAILURE;
+                }
+            }
+
+            wrench_fclose(manifest);
+        }
+        else if (!wrenchMainBatchAdd(&batch, argv[i]))
         {
-            wrench_fprintf(wrench_stderr, "[%s line %d] in %s\n", moduleName, line, message);
+            return EXIT_FAILURE;
         }
-        break;
     }
-}
-
-#if defined(WRENCH_MAIN)
 
-int WRENCH_MAIN(int argc, char** argv)
-{
-    if (argc < 2)
+    if (batch.num_scripts == 0)
     {
-        wrench_fprintf(wrench_stderr, "Usage: %s main_wren_filename\n", argv[0]);
-        return EXIT_SUCCESS;
+        wrench_fprintf(wrench_stderr, "Usage: %s --batch [-j threads] [--reuse] [--manifest file] [script ...]\n", argv[0]);
+        return EXIT_FAILURE;
     }
 
-    WrenVM* vm = wrenNewExtendedVM(argc, argv, true);
+    batch.codes = (int*)wrench_calloc(batch.num_scripts, sizeof(int));
+    batch.times_ms = (long long*)wrench_calloc(batch.num_scripts, sizeof(long long));
 
-    if (vm == NULL)
+    if (batch.codes == NULL || batch.times_ms == NULL)
     {
-        wrench_fprintf(wrench_stderr, "Failed to create a Wren VM!\n");
         return EXIT_FAILURE;
     }
 
-    #ifndef WRENCH_MAIN_INIT
-    #define WRENCH_MAIN_INIT() (void)0
-    #endif
-    WRENCH_MAIN_INIT();
+    wrench_mutex_init(&batch.lock);
+    wrench_cond_init(&batch.cond);
+    wrench_mutex_init(&wrench_main_sources.lock);
 
-    WrenInterpretResult result;
+    wrenGetConfig(); // Initialized before there are threads.
+    wrench_library_keep_loaded = true;
 
-    if (wrench_strstr(argv[1], ".wren") != NULL)
-    {
-        const char* code = wrenLoadSourceFile(vm, argv[1], NULL);
+    const long long start = wrenchMilliseconds();
+    num_threads = (num_threads < batch.num_scripts) ? num_threads : batch.num_scripts;
 
-        if (code != NULL)
-        {
-            result = wrenInterpret(vm, "main", code);
-        }
-        else
+    batch.num_running = num_threads;
+
+    for (int i = 1; i < num_threads; i++)
+    {
+        if (!wrenchThreadStart(wrenchMainBatchWorker, &batch))
         {
-            wrench_fprintf(wrench_stderr, "RUNTIME ERROR: Could not load source file '%s'.\n", argv[1]);
-            result = WREN_RESULT_RUNTIME_ERROR;
+            wrench_mutex_lock(&batch.lock);
+            batch.num_running--;
+            wrench_mutex_unlock(&batch.lock);
         }
     }
-    else
+
+    wrenchMainBatchWorker(&batch); // This thread works too.
+
+    wrench_mutex_lock(&batch.lock);
+
+    while (batch.num_running > 0)
     {
-        char code[1024]; // Import for native code modules or scripts.
-        wrench_snprintf(code, sizeof(code), "import \"%s\"", argv[1]);
+        wrench_cond_wait(&batch.cond, &batch.lock);
+    }
+
+    wrench_mutex_unlock(&batch.lock);
+
+    wrench_fprintf(wrench_stderr, "%d passed, %d failed (%lld ms)\n", batch.num_scripts - batch.num_failed, batch.num_failed, wrenchMilliseconds() - start);
+    return batch.num_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int WRENCH_MAIN(int argc, char** argv)
+{
+    wrenchMainRegisterStaticModules();
+
+    if (argc < 2)
+    {
+        wrench_fprintf(wrench_stderr, "Usage: %s main_wren_filename\n", argv[0]);
+
+        wrench_fprintf(wrench_stderr, "       %s --batch [-j threads] [--reuse] [--manifest file] [script ...]\n", argv[0]);
 
-        result = wrenInterpret(vm, "main", (const char*)code);
+        #if !_WIN32
+            wrench_fprintf(wrench_stderr, "       %s --serve socket_path [preloaded_module ...]\n", argv[0]);
+            wrench_fprintf(wrench_stderr, "       %s --client socket_path main_wren_filename [args ...]\n", argv[0]);
+        #endif
+
+        return EXIT_SUCCESS;
     }
 
-    switch (result)
+    if (wrench_strcmp(argv[1], "--batch") == 0)
     {
-        case WREN_RESULT_COMPILE_ERROR:
-        case WREN_RESULT_RUNTIME_ERROR:
+        return wrenchMainBatch(argc, argv);
+    }
+
+    #if !_WIN32
+        if (wrench_strcmp(argv[1], "--serve") == 0)
         {
-            //wrench_fprintf(wrench_stderr, "%s\n", wrenGetErrorString(vm));
-            //wrenFreeExtendedVM(vm);
+            return wrenchMainServe(argc, argv);
+        }
 
-            return EXIT_FAILURE;
+        if (wrench_strcmp(argv[1], "--client") == 0)
+        {
+            return wrenchMainClient(argc, argv);
         }
-        break;
+    #endif
 
-        default: break;
+    WrenVM* vm = wrenNewExtendedVM(argc, argv, true);
+
+    if (vm == NULL)
+    {
+        wrench_fprintf(wrench_stderr, "Failed to create a Wren VM!\n");
+        return EXIT_FAILURE;
     }
 
-    // TODO: If the main module has a main() function, call it here.
+    WRENCH_MAIN_INIT();
+
+    int status;
+
+    if (!wrenchMainRun(vm, argv[1], "main", &status))
+    {
+        //wrenFreeExtendedVM(vm);
+        return EXIT_FAILURE;
+    }
 
-    #ifndef WRENCH_MAIN_QUIT
-    #define WRENCH_MAIN_QUIT() (void)0
-    #endif
     WRENCH_MAIN_QUIT();
 
     wrenFreeExtendedVM(vm, true);
-    return EXIT_SUCCESS;
+    return status;
 }
 
 #endif /* WRENCH_MAIN */
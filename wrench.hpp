@@ -0,0 +1,503 @@
+/* -----------------------------------------------------------------------------
+--- Copyright (c) 2012-2026 Adam Schackart / "AJ Hackman", all rights reserved.
+--- Distributed under the BSD license v2 (opensource.org/licenses/BSD-3-Clause)
+----------------------------------------------------------------------------- */
+#ifndef __WRENCH_HPP__
+#define __WRENCH_HPP__
+
+/* Wrench++: C++17 bindings generated from ordinary function signatures. Each bound function
+ * gets its own `WrenForeignMethodFn` thunk, instantiated at compile time, that reads its
+ * arguments from slots 1..N (the receiver from slot 0 for member functions) and writes its
+ * result to slot 0. There's no string comparison per call: a foreign class argument is checked
+ * by looking its object up among those this library made (a hash lookup under a lock), so
+ * foreign objects of other classes, e.g. a `File` or a `Buffer`, are never read.
+ *
+ *  WRENCH_EXPORT bool vec2WrenInit(WrenVM* vm)
+ *  {
+ *      if (!wrenBeginModule(vm, "vec2")) { return false; }
+ *
+ *      if (!wrench::ForeignClass<Vec2>::begin<double, double>(vm, "vec2", "Vec2")
+ *          .property<&Vec2::x>("x")
+ *          .property<&Vec2::y>("y")
+ *          .method<&Vec2::length>("length")
+ *          .method<&Vec2::dot>("dot")
+ *          .method<&vec2Lerp>("lerp") // A free function becomes a static method.
+ *          .end())
+ *      {
+ *          return false;
+ *      }
+ *
+ *      return wrenEndModule(vm);
+ *  }
+ *
+ * Arguments and results can be bool, arithmetic types, `const char*`, `std::string`,
+ * `std::string_view` (valid for the call only), `WrenHandle*` (the caller owns a returned
+ * handle), or bound classes - by value, which makes a new object, or by (const) reference to
+ * an existing one. Bound classes must be copyable to be returned by value. Primitive argument
+ * types are only checked in debug builds (`WRENCH_DEBUG`); foreign class arguments always are.
+ *
+ * Objects are only recognized by the library that bound their class. `examples/vec2.cpp` is a
+ * complete library built around the example above (`./build.sh` makes vec2.so).
+ */
+#include <wrench.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace wrench
+{
+    /* ===== [ foreign objects ] ============================================ */
+
+    template <typename T>
+    inline const char type_tag = 0;
+
+    template <typename T>
+    struct ForeignObject
+    {
+        const void* type; // NULL until constructed.
+        alignas(T) unsigned char value[sizeof(T)];
+
+        T* get() { return std::launder(reinterpret_cast<T*>(value)); }
+    };
+
+    /* Every constructed object this library made, with its type tag. Foreign data is only read
+     * once it's found here, as it may belong to any other foreign class (and be smaller than a
+     * pointer). Objects don't move, and the registry is shared by every VM using the library.
+     */
+    inline std::mutex registry_lock;
+    inline std::unordered_map<const void*, const void*> registry;
+
+    inline void registerObject(const void* data, const void* type)
+    {
+        std::lock_guard<std::mutex> lock(registry_lock);
+        registry[data] = type;
+    }
+
+    inline void unregisterObject(const void* data)
+    {
+        std::lock_guard<std::mutex> lock(registry_lock);
+        registry.erase(data);
+    }
+
+    inline const void* registeredType(const void* data)
+    {
+        std::lock_guard<std::mutex> lock(registry_lock);
+        const auto found = registry.find(data);
+
+        return (found != registry.end()) ? found->second : nullptr;
+    }
+
+    /* Where the class was bound, for making new objects of it (e.g. returning one by value).
+     */
+    template <typename T>
+    struct ClassInfo
+    {
+        static inline const char* module = nullptr;
+        static inline const char* name = nullptr;
+    };
+
+    inline bool abortFiber(WrenVM* vm, const char* expected, int slot)
+    {
+        char error[256];
+        std::snprintf(error, sizeof(error), "Expected %s for argument %d.", expected, slot);
+
+        wrenSetSlotString(vm, 0, error);
+        wrenAbortFiber(vm, 0);
+
+        return false;
+    }
+
+    /* ===== [ slots ] ====================================================== */
+
+    /* `check` validates an argument (aborting the fiber if it's wrong), `get` reads one, and
+     * `set` writes a result. The primary template handles bound classes.
+     */
+    template <typename T, typename Enable = void>
+    struct Slot
+    {
+        static bool check(WrenVM* vm, int slot)
+        {
+            if (wrenGetSlotType(vm, slot) == WREN_TYPE_FOREIGN && registeredType(wrenGetSlotForeign(vm, slot)) == &type_tag<T>)
+            {
+                return true;
+            }
+
+            return abortFiber(vm, (ClassInfo<T>::name != nullptr) ? ClassInfo<T>::name : "a foreign object", slot);
+        }
+
+        static T& get(WrenVM* vm, int slot)
+        {
+            return *static_cast<ForeignObject<T>*>(wrenGetSlotForeign(vm, slot))->get();
+        }
+
+        static void set(WrenVM* vm, int slot, T value)
+        {
+            static_assert(std::is_move_constructible_v<T>, "bound classes must be movable to be returned by value");
+
+            if (ClassInfo<T>::name == nullptr || !wrenGetVariableCached(vm, ClassInfo<T>::module, ClassInfo<T>::name, slot))
+            {
+                wrenSetSlotNull(vm, slot); // Never bound, or its module was never imported.
+                return;
+            }
+
+            auto* object = static_cast<ForeignObject<T>*>(wrenSetSlotNewForeign(vm, slot, slot, sizeof(ForeignObject<T>)));
+
+            new (object->value) T(std::move(value));
+            object->type = &type_tag<T>;
+
+            registerObject(object, &type_tag<T>);
+        }
+    };
+
+    template <>
+    struct Slot<bool>
+    {
+        static bool check(WrenVM* vm, int slot)
+        {
+            return !WRENCH_DEBUG || wrenGetSlotType(vm, slot) == WREN_TYPE_BOOL || abortFiber(vm, "a Bool", slot);
+        }
+
+        static bool get(WrenVM* vm, int slot) { return wrenGetSlotBool(vm, slot); }
+        static void set(WrenVM* vm, int slot, bool value) { wrenSetSlotBool(vm, slot, value); }
+    };
+
+    template <typename T>
+    struct Slot<T, std::enable_if_t<std::is_arithmetic_v<T> && !std::is_same_v<T, bool>>>
+    {
+        static bool check(WrenVM* vm, int slot)
+        {
+            return !WRENCH_DEBUG || wrenGetSlotType(vm, slot) == WREN_TYPE_NUM || abortFiber(vm, "a Num", slot);
+        }
+
+        static T get(WrenVM* vm, int slot) { return static_cast<T>(wrenGetSlotDouble(vm, slot)); }
+        static void set(WrenVM* vm, int slot, T value) { wrenSetSlotDouble(vm, slot, static_cast<double>(value)); }
+    };
+
+    template <>
+    struct Slot<const char*>
+    {
+        static bool check(WrenVM* vm, int slot)
+        {
+            return !WRENCH_DEBUG || wrenGetSlotType(vm, slot) == WREN_TYPE_STRING || abortFiber(vm, "a String", slot);
+        }
+
+        static const char* get(WrenVM* vm, int slot) { return wrenGetSlotString(vm, slot); }
+        static void set(WrenVM* vm, int slot, const char* value) { wrenSetSlotString(vm, slot, value); }
+    };
+
+    template <>
+    struct Slot<std::string_view>
+    {
+        static bool check(WrenVM* vm, int slot)
+        {
+            return Slot<const char*>::check(vm, slot);
+        }
+
+        static std::string_view get(WrenVM* vm, int slot)
+        {
+            int length;
+            const char* bytes = wrenGetSlotBytes(vm, slot, &length);
+
+            return std::string_view(bytes, static_cast<size_t>(length));
+        }
+
+        static void set(WrenVM* vm, int slot, std::string_view value)
+        {
+            wrenSetSlotBytes(vm, slot, value.data(), value.size());
+        }
+    };
+
+    template <>
+    struct Slot<std::string>
+    {
+        static bool check(WrenVM* vm, int slot) { return Slot<const char*>::check(vm, slot); }
+
+        static std::string get(WrenVM* vm, int slot) { return std::string(Slot<std::string_view>::get(vm, slot)); }
+        static void set(WrenVM* vm, int slot, const std::string& value) { Slot<std::string_view>::set(vm, slot, value); }
+    };
+
+    template <>
+    struct Slot<WrenHandle*>
+    {
+        static bool check(WrenVM*, int) { return true; }
+
+        static WrenHandle* get(WrenVM* vm, int slot) { return wrenGetSlotHandle(vm, slot); }
+        static void set(WrenVM* vm, int slot, WrenHandle* value) { wrenSetSlotHandle(vm, slot, value); }
+    };
+
+    template <typename T>
+    using SlotOf = Slot<std::remove_cv_t<std::remove_reference_t<T>>>;
+
+    /* ===== [ signatures ] ================================================= */
+
+    template <typename F>
+    struct Function;
+
+    template <typename R, typename... A>
+    struct Function<R (*)(A...)>
+    {
+        using Class = void;
+        using Result = R;
+
+        static constexpr size_t arity = sizeof...(A);
+
+        template <auto F, size_t... I>
+        static R call(WrenVM* vm, std::index_sequence<I...>)
+        {
+            (void)vm; // Unused without arguments.
+            return F(SlotOf<A>::get(vm, (int)I + 1)...);
+        }
+
+        template <size_t... I>
+        static bool check(WrenVM* vm, std::index_sequence<I...>)
+        {
+            (void)vm;
+            return (SlotOf<A>::check(vm, (int)I + 1) && ...);
+        }
+    };
+
+    template <typename R, typename... A>
+    struct Function<R (*)(A...) noexcept> : Function<R (*)(A...)> {};
+
+    template <typename C, typename R, typename... A>
+    struct Function<R (C::*)(A...)>
+    {
+        using Class = C;
+        using Result = R;
+
+        static constexpr size_t arity = sizeof...(A);
+
+        // Wren only dispatches to methods of the receiver's class, and foreign classes can't
+        // be subclassed, so the receiver needs no check.
+        template <auto F, size_t... I>
+        static R call(WrenVM* vm, std::index_sequence<I...>)
+        {
+            return (Slot<C>::get(vm, 0).*F)(SlotOf<A>::get(vm, (int)I + 1)...);
+        }
+
+        template <size_t... I>
+        static bool check(WrenVM* vm, std::index_sequence<I...>)
+        {
+            (void)vm;
+            return (SlotOf<A>::check(vm, (int)I + 1) && ...);
+        }
+    };
+
+    template <typename C, typename R, typename... A>
+    struct Function<R (C::*)(A...) const> : Function<R (C::*)(A...)> {};
+
+    template <typename C, typename R, typename... A>
+    struct Function<R (C::*)(A...) noexcept> : Function<R (C::*)(A...)> {};
+
+    template <typename C, typename R, typename... A>
+    struct Function<R (C::*)(A...) const noexcept> : Function<R (C::*)(A...)> {};
+
+    /* ===== [ thunks ] ===================================================== */
+
+    template <auto F>
+    void method(WrenVM* vm)
+    {
+        using Signature = Function<decltype(F)>;
+        using Indices = std::make_index_sequence<Signature::arity>;
+
+        if (!Signature::check(vm, Indices{}))
+        {
+            return;
+        }
+
+        if constexpr (std::is_void_v<typename Signature::Result>)
+        {
+            Signature::template call<F>(vm, Indices{});
+        }
+        else
+        {
+            SlotOf<typename Signature::Result>::set(vm, 0, Signature::template call<F>(vm, Indices{}));
+        }
+    }
+
+    template <auto M>
+    struct Member;
+
+    template <typename C, typename T, T C::*M>
+    struct Member<M>
+    {
+        static void get(WrenVM* vm)
+        {
+            SlotOf<T>::set(vm, 0, Slot<C>::get(vm, 0).*M);
+        }
+
+        static void set(WrenVM* vm)
+        {
+            if (SlotOf<T>::check(vm, 1))
+            {
+                Slot<C>::get(vm, 0).*M = SlotOf<T>::get(vm, 1);
+            }
+        }
+    };
+
+    template <typename T, typename... A, size_t... I>
+    void constructAt(WrenVM* vm, void* data, std::index_sequence<I...>)
+    {
+        (void)vm;
+        new (data) T(SlotOf<A>::get(vm, (int)I + 1)...);
+    }
+
+    template <typename T, typename... A>
+    void construct(WrenVM* vm)
+    {
+        auto* object = static_cast<ForeignObject<T>*>(wrenSetSlotNewForeign(vm, 0, 0, sizeof(ForeignObject<T>)));
+        object->type = nullptr;
+
+        if (!Function<void (*)(A...)>::check(vm, std::index_sequence_for<A...>{}))
+        {
+            return;
+        }
+
+        constructAt<T, A...>(vm, object->value, std::index_sequence_for<A...>{});
+
+        object->type = &type_tag<T>;
+        registerObject(object, &type_tag<T>);
+    }
+
+    template <typename T>
+    void finalize(void* data)
+    {
+        auto* object = static_cast<ForeignObject<T>*>(data);
+
+        if (object->type != nullptr)
+        {
+            unregisterObject(object);
+            object->get()->~T();
+        }
+    }
+
+    /* ===== [ binding ] ==================================================== */
+
+    /* Emits Wren declarations into the module being built (see `wrenBeginModule`) and registers
+     * the thunks. Errors are sticky: the first failure is returned by `end`.
+     */
+    template <typename T>
+    class ForeignClass
+    {
+    public:
+        template <typename... A>
+        static ForeignClass begin(WrenVM* vm, const char* module, const char* name)
+        {
+            static_assert(alignof(T) <= alignof(double), "foreign data is only aligned to 8 bytes");
+
+            ClassInfo<T>::module = module;
+            ClassInfo<T>::name = name;
+
+            ForeignClass self{vm, module, name};
+
+            self.ok = wrenCode(vm, (std::string("foreign class ") + name + " {\n").c_str()) &&
+                      wrenRegisterClass(vm, module, name, construct<T, A...>, finalize<T>) &&
+                      wrenCode(vm, ("construct new" + parameters(sizeof...(A), "a") + " {}\n").c_str());
+
+            return self;
+        }
+
+        /* Member functions become instance methods, free functions static ones.
+         */
+        template <auto F>
+        ForeignClass& method(const char* name)
+        {
+            using Signature = Function<decltype(F)>;
+            const bool is_static = std::is_void_v<typename Signature::Class>;
+
+            return declare(is_static, name + parameters(Signature::arity, "a"), name + parameters(Signature::arity, "_"), wrench::method<F>);
+        }
+
+        /* A member function with no arguments, or a data member.
+         */
+        template <auto F>
+        ForeignClass& getter(const char* name)
+        {
+            if constexpr (std::is_member_object_pointer_v<decltype(F)>)
+            {
+                return declare(false, name, name, Member<F>::get);
+            }
+            else
+            {
+                static_assert(Function<decltype(F)>::arity == 0, "getters take no arguments");
+                return declare(std::is_void_v<typename Function<decltype(F)>::Class>, name, name, wrench::method<F>);
+            }
+        }
+
+        /* A member function with one argument, or a data member.
+         */
+        template <auto F>
+        ForeignClass& setter(const char* name)
+        {
+            const std::string property = std::string(name) + "=";
+
+            if constexpr (std::is_member_object_pointer_v<decltype(F)>)
+            {
+                return declare(false, property + "(value)", property + "(_)", Member<F>::set);
+            }
+            else
+            {
+                static_assert(Function<decltype(F)>::arity == 1, "setters take one argument");
+                return declare(std::is_void_v<typename Function<decltype(F)>::Class>, property + "(value)", property + "(_)", wrench::method<F>);
+            }
+        }
+
+        template <auto M>
+        ForeignClass& property(const char* name)
+        {
+            return getter<M>(name).template setter<M>(name);
+        }
+
+        /* Plain Wren, e.g. convenience overloads.
+         */
+        ForeignClass& code(const char* text)
+        {
+            ok = ok && wrenCode(vm, (std::string(text) + "\n").c_str());
+            return *this;
+        }
+
+        bool end()
+        {
+            return ok && wrenCode(vm, "}\n");
+        }
+
+    private:
+        ForeignClass(WrenVM* vm, const char* module, const char* name) : vm(vm), module(module), name(name) {}
+
+        static std::string parameters(size_t count, const char* prefix)
+        {
+            std::string s = "(";
+
+            for (size_t i = 0; i < count; i++)
+            {
+                s += (i > 0) ? "," : "";
+                s += (prefix[0] == '_') ? std::string(prefix) : prefix + std::to_string(i);
+            }
+
+            return s + ")";
+        }
+
+        ForeignClass& declare(bool is_static, const std::string& declaration, const std::string& signature, WrenForeignMethodFn fn)
+        {
+            ok = ok && wrenCode(vm, ((is_static ? "foreign static " : "foreign ") + declaration + "\n").c_str()) &&
+                       wrenRegisterMethod(vm, module, name, is_static, signature.c_str(), fn);
+
+            return *this;
+        }
+
+        WrenVM* vm;
+        const char* module;
+        const char* name;
+
+        bool ok = false;
+    };
+}
+
+#endif /* __WRENCH_HPP__ */